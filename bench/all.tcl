@@ -0,0 +1,37 @@
+# Copyright Jerily LTD. All Rights Reserved.
+# SPDX-FileCopyrightText: 2024 Neofytos Dimitriou (neo@jerily.cy)
+# SPDX-License-Identifier: MIT.
+
+# Runs all benchmarks. Since the JSON scanner implementation is selected
+# when the package is loaded, each implementation is benchmarked in its own
+# process with the TJV_SIMD environment variable set.
+
+set dir [file dirname [file normalize [info script]]]
+
+if { [info exists ::env(TJV_BENCH_CHILD)] } {
+    source -encoding utf-8 [file join $dir common.tcl]
+    foreach file [lsort [glob -directory $dir *.bench]] {
+        puts "\n[file tail $file]:"
+        source -encoding utf-8 $file
+    }
+    exit 0
+}
+
+set output [open bench_output.txt w]
+
+foreach simd {default sse42 scalar} {
+    set header "==== TJV_SIMD: $simd ===="
+    puts $header
+    puts $output $header
+    set env(TJV_BENCH_CHILD) 1
+    if { $simd eq "default" } {
+        unset -nocomplain env(TJV_SIMD)
+    } else {
+        set env(TJV_SIMD) $simd
+    }
+    set result [exec [info nameofexecutable] [file join $dir all.tcl] {*}$argv 2>@1]
+    puts $result
+    puts $output $result
+}
+
+close $output
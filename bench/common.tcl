@@ -0,0 +1,50 @@
+# Copyright Jerily LTD. All Rights Reserved.
+# SPDX-FileCopyrightText: 2024 Neofytos Dimitriou (neo@jerily.cy)
+# SPDX-License-Identifier: MIT.
+
+package require tjv
+
+# The minimum time in milliseconds to run each benchmark
+set ::bench_min_time 1000
+
+# helper proc to print a result line
+proc bench_report { name value unit } {
+    set line [format "%-50s %10.3f %s" $name $value $unit]
+    puts $line
+    if { [info exists ::bench_output] } {
+        puts $::bench_output $line
+    }
+}
+
+# Runs the script until at least ::bench_min_time ms have passed and returns
+# average execution time in microseconds.
+proc bench_run { script } {
+    # warm up
+    uplevel 1 $script
+    set count 0
+    set start [clock microseconds]
+    set end [expr { $start + $::bench_min_time * 1000 }]
+    while { [set now [clock microseconds]] < $end } {
+        uplevel 1 $script
+        incr count
+    }
+    return [expr { double($now - $start) / $count }]
+}
+
+# Runs the script and reports its throughput in GB/s for the specified
+# amount of processed data in bytes.
+proc bench_throughput { name bytes script } {
+    set usec [uplevel 1 [list bench_run $script]]
+    bench_report $name [expr { $bytes / $usec / 1000.0 }] "GB/s"
+}
+
+# Runs the script and reports the average time of its execution.
+proc bench_time { name script } {
+    set usec [uplevel 1 [list bench_run $script]]
+    bench_report $name $usec "us/op"
+}
+
+# Returns the size of the string in bytes as passed to the validator.
+proc bench_bytes { str } {
+    return [string length [encoding convertto utf-8 $str]]
+}
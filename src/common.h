@@ -41,6 +41,32 @@ typedef int Tcl_Size;
 
 #define UNUSED(expr) do { (void)(expr); } while (0)
 
+// The number of trailing zero bits, x must not be 0
+#if defined(__GNUC__) || defined(__clang__)
+# define TJV_CTZ64(x) __builtin_ctzll(x)
+#else
+static inline int TJV_CTZ64(uint64_t x) {
+    int n = 0;
+    while (!(x & 1)) {
+        x >>= 1;
+        n++;
+    }
+    return n;
+}
+#endif
+
+// The number of set bits
+#if defined(__GNUC__) || defined(__clang__)
+# define TJV_POPCOUNT64(x) __builtin_popcountll(x)
+#else
+static inline int TJV_POPCOUNT64(uint64_t x) {
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (int)((x * 0x0101010101010101ULL) >> 56);
+}
+#endif
+
 #ifdef DEBUG
 # define DBG(x) x
 
@@ -83,6 +109,12 @@ typedef int Tcl_Size;
         Tcl_DictObjPutKeyList(NULL, *outcome_ptr, ve->outkey_objc, ve->outkey_objv, (v)); \
     }
 
+// The maximum nesting level of validated values. Values can be nested
+// deeper than the schema only if the schema is recursive (see -ref).
+// The frames live on a heap work stack, but the depth is still limited to
+// bound the memory and the time used by malicious input.
+#define TJV_VALIDATION_MAX_DEPTH 1000
+
 typedef struct tjv_ValidationStack tjv_ValidationStack;
 
 struct tjv_ValidationStack {
@@ -93,6 +125,16 @@ struct tjv_ValidationStack {
     Tcl_Obj *key;
     Tcl_Size index;
 
+    // The data with unknown keys stripped from it or from its children,
+    // NULL if the data is not changed
+    Tcl_Obj *cleaned;
+    // The cleaned value of the last validated child. The parent takes
+    // ownership of it and resets it to NULL.
+    Tcl_Obj *child_cleaned;
+
+    // The number of parents
+    Tcl_Size depth;
+
 };
 
 #ifdef __cplusplus
@@ -8,6 +8,7 @@
 
 static Tcl_VarTraceProc tjv_HandleVarTraceProc;
 static Tcl_CmdDeleteProc tjv_HandleDeleteProc;
+static void tjv_HandleFreeProc(char *blockPtr);
 
 static int tjv_ValidateCmd(ClientData clientData, Tcl_Interp *interp, int objc, Tcl_Obj *const objv[]) {
 
@@ -125,25 +126,282 @@ done:
 }
 
 
+// The number of records per worker thread that are validated at once by
+// validate-batch. Results of the records are merged before the next ones
+// are validated, so the memory is bounded for large batches.
+#define TJV_BATCH_RECORDS_PER_THREAD 32
+
+typedef struct {
+    // The string representation of the record, it is created by the
+    // current thread and workers only read it
+    const char *str;
+    Tcl_Size length;
+    // The record is not validated if the worker can't compile the schema
+    int is_done;
+    tjv_ReplicaText outcome;
+    tjv_ReplicaText error_message;
+    tjv_ReplicaText error_details;
+} tjv_BatchRecord;
+
+typedef struct {
+    tjv_Replica *replica;
+    tjv_BatchRecord *records;
+    // The index of the first record of the window in the batch
+    Tcl_Size first;
+} tjv_BatchWindow;
+
+// Validates the record with the schema of the current thread. The value is
+// created from the string representation of the record, as the record can
+// only be used by the thread of the interpreter.
+static void tjv_BatchValidate(void *clientData, Tcl_Size index) {
+
+    tjv_BatchWindow *window = (tjv_BatchWindow *)clientData;
+    tjv_BatchRecord *record = &window->records[index];
+
+    tjv_ValidationElement *root = tjv_ReplicaGet(window->replica);
+    if (root == NULL) {
+        DBG2(printf("record #%" TCL_SIZE_MODIFIER "d is left to the interpreter thread", window->first + index));
+        record->is_done = 0;
+        tjv_ReplicaTextSet(&record->outcome, NULL);
+        tjv_ReplicaTextSet(&record->error_message, NULL);
+        tjv_ReplicaTextSet(&record->error_details, NULL);
+        return;
+    }
+
+    // The same stack frame as the batch has for the record
+    tjv_ValidationStack stack;
+    stack.head = &stack;
+    stack.next = NULL;
+    stack.key = NULL;
+    stack.index = window->first + index;
+    stack.depth = -1;
+    stack.cleaned = NULL;
+    stack.child_cleaned = NULL;
+
+    Tcl_Obj *error_message = NULL;
+    Tcl_Obj *error_details = NULL;
+    Tcl_Obj *outcome = Tcl_NewDictObj();
+
+    Tcl_Obj *data = Tcl_NewStringObj(record->str, record->length);
+    Tcl_IncrRefCount(data);
+    tjv_ValidateTcl(data, &stack, root, &error_message, &error_details, &outcome);
+    Tcl_DecrRefCount(data);
+
+    // The cleaned value is only needed by the parent of the record
+    if (stack.child_cleaned != NULL) {
+        Tcl_BounceRefCount(stack.child_cleaned);
+    }
+
+    if (error_message != NULL) {
+        Tcl_BounceRefCount(outcome);
+        outcome = NULL;
+    }
+
+    record->is_done = 1;
+    tjv_ReplicaTextSet(&record->outcome, outcome);
+    tjv_ReplicaTextSet(&record->error_message, error_message);
+    tjv_ReplicaTextSet(&record->error_details, error_details);
+
+}
+
+// Validates each element of the list by the compiled schema. Records are
+// validated as elements of a list, so the paths in error messages start
+// with the record index. Without an outcome variable, validation stops at
+// the first invalid record. Otherwise, all records are validated, the list
+// of invalid record indexes is returned, and the outcome variable is set
+// to a dict with the outcomes of all records and the errors of invalid ones.
+//
+// If there are worker threads, records are validated in parallel by the
+// workers and the current thread, each with its own copy of the schema.
+// Their results are merged in the order of records, so they are the same
+// as without workers.
+static int tjv_HandleValidateBatch(Tcl_Interp *interp, tjv_ValidationHandler *h, Tcl_Obj *records, Tcl_Obj *outcome_var_name) {
+
+    DBG2(printf("enter"));
+
+    Tcl_Size objc;
+    Tcl_Obj **objv;
+    if (Tcl_ListObjGetElements(interp, records, &objc, &objv) != TCL_OK) {
+        DBG2(printf("return: TCL_ERROR (not a list)"));
+        return TCL_ERROR;
+    }
+
+    DBG2(printf("records: %" TCL_SIZE_MODIFIER "d", objc));
+
+    // The stack frame of the batch. Records are validated one level
+    // deeper, so their depth is the same as in a single validation.
+    tjv_ValidationStack stack;
+    stack.head = &stack;
+    stack.next = NULL;
+    stack.key = NULL;
+    stack.index = 0;
+    stack.depth = -1;
+    stack.cleaned = NULL;
+    stack.child_cleaned = NULL;
+
+    Tcl_Obj *outcomes = Tcl_NewListObj(objc, NULL);
+    Tcl_Obj *errors = NULL;
+    Tcl_Obj *failed = NULL;
+
+    if (outcome_var_name != NULL) {
+        errors = Tcl_NewDictObj();
+        failed = Tcl_NewListObj(0, NULL);
+    }
+
+    tjv_BatchWindow window;
+    window.replica = h->root->replica;
+    window.records = NULL;
+    window.first = 0;
+    Tcl_Size window_size = 0;
+    Tcl_Size window_end = 0;
+
+    int threads = (window.replica == NULL ? 0 : tjv_PoolThreads());
+    if (threads > 0 && objc > 1) {
+        window_size = (threads + 1) * TJV_BATCH_RECORDS_PER_THREAD;
+        if (window_size > objc) {
+            window_size = objc;
+        }
+        DBG2(printf("validate in parallel by %d threads, %" TCL_SIZE_MODIFIER "d records at once", threads, window_size));
+        window.records = ckalloc(sizeof(tjv_BatchRecord) * window_size);
+    }
+
+    for (; stack.index < objc; stack.index++) {
+
+        Tcl_Obj *error_message = NULL;
+        Tcl_Obj *error_details = NULL;
+        Tcl_Obj *outcome = NULL;
+
+        tjv_BatchRecord *record = NULL;
+        if (window.records != NULL) {
+            if (stack.index == window_end) {
+                window.first = window_end;
+                window_end += window_size;
+                if (window_end > objc) {
+                    window_end = objc;
+                }
+                // String representations are created by the current
+                // thread, workers only read them
+                for (Tcl_Size i = window.first; i < window_end; i++) {
+                    record = &window.records[i - window.first];
+                    record->str = Tcl_GetStringFromObj(objv[i], &record->length);
+                }
+                tjv_PoolRun(tjv_BatchValidate, &window, window_end - window.first);
+            }
+            record = &window.records[stack.index - window.first];
+            if (!record->is_done) {
+                record = NULL;
+            }
+        }
+
+        if (record == NULL) {
+            outcome = Tcl_NewDictObj();
+            tjv_ValidateTcl(objv[stack.index], &stack, h->root, &error_message, &error_details, &outcome);
+            // The cleaned value is only needed by the parent of the record
+            if (stack.child_cleaned != NULL) {
+                Tcl_BounceRefCount(stack.child_cleaned);
+                stack.child_cleaned = NULL;
+            }
+        } else {
+            outcome = tjv_ReplicaTextGet(&record->outcome);
+            error_message = tjv_ReplicaTextGet(&record->error_message);
+            error_details = tjv_ReplicaTextGet(&record->error_details);
+        }
+
+        if (error_message == NULL) {
+            Tcl_ListObjAppendElement(NULL, outcomes, outcome);
+            continue;
+        }
+
+        DBG2(printf("record #%" TCL_SIZE_MODIFIER "d is invalid", stack.index));
+
+        if (outcome != NULL) {
+            Tcl_BounceRefCount(outcome);
+        }
+
+        if (outcome_var_name == NULL) {
+            Tcl_BounceRefCount(outcomes);
+            Tcl_SetObjResult(interp, tjv_MessageCombine(error_message));
+            Tcl_BounceRefCount(error_details);
+            goto error;
+        }
+
+        Tcl_Obj *index = Tcl_NewWideIntObj(stack.index);
+        Tcl_ListObjAppendElement(NULL, failed, index);
+        Tcl_DictObjPut(NULL, errors, index, tjv_MessageCombineDetails(error_message, error_details));
+        Tcl_ListObjAppendElement(NULL, outcomes, Tcl_NewObj());
+
+    }
+
+    if (outcome_var_name == NULL) {
+        Tcl_SetObjResult(interp, outcomes);
+        goto done;
+    }
+
+    Tcl_Obj *result = Tcl_NewDictObj();
+    Tcl_DictObjPut(NULL, result, Tcl_NewStringObj("outcomes", -1), outcomes);
+    Tcl_DictObjPut(NULL, result, Tcl_NewStringObj("errors", -1), errors);
+    Tcl_ObjSetVar2(interp, outcome_var_name, NULL, result, 0);
+    Tcl_SetObjResult(interp, failed);
+
+done:
+
+    if (window.records != NULL) {
+        ckfree(window.records);
+    }
+
+    DBG2(printf("return: ok"));
+
+    return TCL_OK;
+
+error:
+
+    if (window.records != NULL) {
+        // Free the results of the records that are validated but not merged
+        for (Tcl_Size i = stack.index + 1; i < window_end; i++) {
+            tjv_BatchRecord *record = &window.records[i - window.first];
+            tjv_ReplicaTextFree(&record->outcome);
+            tjv_ReplicaTextFree(&record->error_message);
+            tjv_ReplicaTextFree(&record->error_details);
+        }
+        ckfree(window.records);
+    }
+
+    DBG2(printf("return: TCL_ERROR"));
+
+    return TCL_ERROR;
+
+}
+
 static int tjv_HandleCmd(ClientData clientData, Tcl_Interp *interp, int objc, Tcl_Obj *const objv[]) {
 
     DBG2(printf("enter: objc: %d", objc));
 
     static const char *const commands[] = {
-        "destroy", "validate",
+        "cancel", "destroy", "stream", "validate", "validate-async", "validate-batch", "validate-channel",
+        "validate-file", "validate-ndjson", "validate-step", "warnings",
         NULL
     };
 
     enum commands {
-        cmdDestroy, cmdValidate
+        cmdCancel, cmdDestroy, cmdStream, cmdValidate, cmdValidateAsync, cmdValidateBatch, cmdValidateChannel,
+        cmdValidateFile, cmdValidateNdjson, cmdValidateStep, cmdWarnings
     };
 
     if (objc < 2) {
 wrongArgsNum:
-        Tcl_WrongNumArgs(interp, 1, objv, "validate value ?outcome_variable?");
+        Tcl_WrongNumArgs(interp, 1, objv, "validate ?-format format? ?-output output? value ?outcome_variable?");
         // Unfortunately, we do not have access to INTERP_ALTERNATE_WRONG_ARGS
         // from the extension. Let's simulate it.
-        Tcl_AppendPrintfToObj(Tcl_GetObjResult(interp), " or \"%s destroy\"", Tcl_GetString(objv[0]));
+        Tcl_AppendPrintfToObj(Tcl_GetObjResult(interp), " or \"%s validate-batch values ?outcome_variable?\""
+            " or \"%s validate-async value callback\" or \"%s cancel id\""
+            " or \"%s validate-file ?-stats stats_variable? path ?outcome_variable?\""
+            " or \"%s validate-channel ?-stats stats_variable? channel ?outcome_variable?\""
+            " or \"%s validate-ndjson source ?-option value ...?\""
+            " or \"%s validate-step value\" or \"%s stream\" or \"%s destroy\" or \"%s warnings\"",
+            Tcl_GetString(objv[0]), Tcl_GetString(objv[0]), Tcl_GetString(objv[0]),
+            Tcl_GetString(objv[0]), Tcl_GetString(objv[0]), Tcl_GetString(objv[0]),
+            Tcl_GetString(objv[0]), Tcl_GetString(objv[0]), Tcl_GetString(objv[0]),
+            Tcl_GetString(objv[0]));
         DBG2(printf("return: TCL_ERROR (wrong # args)"));
         return TCL_ERROR;
     }
@@ -166,21 +424,179 @@ wrongArgsNum:
         goto done;
     }
 
-    // If we are here, then we are in the validate subcommand. First, check
-    // to see if we have enough arguments.
-    if (objc < 3 || objc > 4) {
+    if (command == cmdWarnings) {
+        if (objc != 2) {
+            goto wrongArgsNum;
+        }
+        DBG2(printf("warnings subcommand"));
+        Tcl_Obj *warnings = Tcl_NewListObj(0, NULL);
+        tjv_ValidationWarnings(h->root, NULL, warnings);
+        Tcl_SetObjResult(interp, warnings);
+        goto done;
+    }
+
+    if (command == cmdValidateAsync) {
+        if (objc != 4) {
+            goto wrongArgsNum;
+        }
+        DBG2(printf("validate-async subcommand"));
+        return tjv_AsyncValidate(interp, &h->async, h->root, objv[2], objv[3]);
+    }
+
+    if (command == cmdValidateStep) {
+        if (objc != 3) {
+            goto wrongArgsNum;
+        }
+        DBG2(printf("validate-step subcommand"));
+        return tjv_StepCreate(interp, (ClientData)h, h->root, objv[2]);
+    }
+
+    if (command == cmdStream) {
+        if (objc != 2) {
+            goto wrongArgsNum;
+        }
+        DBG2(printf("stream subcommand"));
+        return tjv_StreamCreate(interp, (ClientData)h, h->root);
+    }
+
+    if (command == cmdValidateFile || command == cmdValidateChannel) {
+        Tcl_Obj *stats_var_name = NULL;
+        int first = 2;
+        if (objc > 2 && strcmp(Tcl_GetString(objv[2]), "-stats") == 0) {
+            if (objc < 4) {
+                goto wrongArgsNum;
+            }
+            stats_var_name = objv[3];
+            first = 4;
+        }
+        if (objc - first < 1 || objc - first > 2) {
+            goto wrongArgsNum;
+        }
+        Tcl_Obj *outcome_var_name = (objc - first == 1 ? NULL : objv[first + 1]);
+        if (command == cmdValidateFile) {
+            DBG2(printf("validate-file subcommand"));
+            return tjv_SourceValidateFile(interp, h->root, objv[first], outcome_var_name, stats_var_name);
+        }
+        DBG2(printf("validate-channel subcommand"));
+        return tjv_SourceValidateChannel(interp, h->root, objv[first], outcome_var_name, stats_var_name);
+    }
+
+    if (command == cmdValidateNdjson) {
+        DBG2(printf("validate-ndjson subcommand"));
+        return tjv_NdjsonValidate(interp, (ClientData)h, h->root, objc, objv);
+    }
+
+    if (command == cmdCancel) {
+        if (objc != 3) {
+            goto wrongArgsNum;
+        }
+        DBG2(printf("cancel subcommand"));
+        int id;
+        if (Tcl_GetIntFromObj(interp, objv[2], &id) != TCL_OK) {
+            DBG2(printf("return: TCL_ERROR (wrong id)"));
+            return TCL_ERROR;
+        }
+        Tcl_SetObjResult(interp, Tcl_NewBooleanObj(tjv_AsyncCancel(&h->async, id)));
+        goto done;
+    }
+
+    // If we are here, then we are in the validate or validate-batch
+    // subcommand. First, check to see if we have enough arguments.
+    if (command == cmdValidateBatch) {
+        if (objc < 3 || objc > 4) {
+            goto wrongArgsNum;
+        }
+        DBG2(printf("validate-batch subcommand"));
+        return tjv_HandleValidateBatch(interp, h, objv[2], (objc == 3 ? NULL : objv[3]));
+    }
+
+    static const char *const formats[] = {
+        "tcl", "msgpack", "cbor", NULL
+    };
+
+    enum formats {
+        formatTcl, formatMsgpack, formatCbor
+    };
+
+    static const char *const outputs[] = {
+        "outcome", "json", NULL
+    };
+
+    enum outputs {
+        outputOutcome, outputJson
+    };
+
+    // The validate subcommand can have the -format and -output options
+    // before the value
+    int format = formatTcl;
+    int output = outputOutcome;
+    int first = 2;
+    while (objc - first > 2) {
+        const char *option = Tcl_GetString(objv[first]);
+        if (strcmp(option, "-format") == 0) {
+            if (Tcl_GetIndexFromObj(interp, objv[first + 1], formats, "format", 0, &format) != TCL_OK) {
+                DBG2(printf("return: error (wrong format: [%s])", Tcl_GetString(objv[first + 1])));
+                return TCL_ERROR;
+            }
+        } else if (strcmp(option, "-output") == 0) {
+            if (Tcl_GetIndexFromObj(interp, objv[first + 1], outputs, "output", 0, &output) != TCL_OK) {
+                DBG2(printf("return: error (wrong output: [%s])", Tcl_GetString(objv[first + 1])));
+                return TCL_ERROR;
+            }
+        } else {
+            goto wrongArgsNum;
+        }
+        first += 2;
+    }
+    if (objc - first < 1) {
         goto wrongArgsNum;
     }
 
-    Tcl_Obj *data = objv[2];
-    Tcl_Obj *outcome_var_name = (objc == 3 ? NULL : objv[3]);
+    Tcl_Obj *data = objv[first];
+    Tcl_Obj *outcome_var_name = (objc - first == 1 ? NULL : objv[first + 1]);
     DBG2(printf("outcome variable: [%s]", (outcome_var_name == NULL ? "<none>" : Tcl_GetString(outcome_var_name))));
 
     Tcl_Obj *error_message = NULL;
     Tcl_Obj *error_details = NULL;
-    Tcl_Obj *outcome = Tcl_NewDictObj();
+    Tcl_Obj *outcome;
+
+    // For -output json, the validators append the JSON text to the result
+    // instead of collecting the outcome. The stack of the thread can be used
+    // by a validation that is already running, so its output is restored.
+    tjv_WorkStack *ws = tjv_WorkStackGet();
+    Tcl_Obj *ws_output = ws->output;
+    Tcl_Obj **outcome_ptr;
+    if (output == outputJson) {
+        DBG2(printf("output json"));
+        outcome = Tcl_NewObj();
+        outcome_ptr = NULL;
+        ws->output = outcome;
+    } else {
+        outcome = Tcl_NewDictObj();
+        outcome_ptr = &outcome;
+    }
+
+    if (format == formatMsgpack || format == formatCbor) {
+
+        const char *format_name = formats[format];
+        DBG2(printf("validate %s", format_name));
+
+        // The decoded strings point into the bytes of the value, which
+        // is not released until the command returns
+        Tcl_Size length;
+        const unsigned char *bytes = Tcl_GetByteArrayFromObj(data, &length);
 
-    tjv_ValidateTcl(data, NULL, h->root, &error_message, &error_details, &outcome);
+        tjv_JsonDocument doc;
+        int parse_result = (format == formatMsgpack ? tjv_MsgpackParse(&doc, bytes, length) :
+            tjv_CborParse(&doc, bytes, length));
+        tjv_ValidateJsonRootDocument(NULL, &doc, parse_result, format_name, h->root,
+            &error_message, &error_details, outcome_ptr);
+
+    } else {
+        tjv_ValidateTcl(data, NULL, h->root, &error_message, &error_details, outcome_ptr);
+    }
+
+    ws->output = ws_output;
 
     // Return ok if we don't have errors
     if (error_message == NULL) {
@@ -236,10 +652,15 @@ static int tjv_CompileCmd(ClientData clientData, Tcl_Interp *interp, int objc, T
         return TCL_ERROR;
     }
 
+    // Worker threads compile the same arguments to get their own copies
+    root->replica = tjv_ReplicaNew(objc, objv, root);
+
     tjv_ValidationHandler *h = ckalloc(sizeof(tjv_ValidationHandler));
 
     h->interp = interp;
     h->root = root;
+    h->async.first = NULL;
+    h->async.last_id = 0;
 
     char buf[32];
     snprintf(buf, sizeof(buf), "%p", (void *)h);
@@ -267,6 +688,100 @@ static int tjv_CompileCmd(ClientData clientData, Tcl_Interp *interp, int objc, T
 
 }
 
+static int tjv_ConfigureCmd(ClientData clientData, Tcl_Interp *interp, int objc, Tcl_Obj *const objv[]) {
+
+    DBG2(printf("enter: objc: %d", objc));
+
+    UNUSED(clientData);
+
+    static const char *const options[] = {
+        "-queue-size", "-threads",
+        NULL
+    };
+
+    enum options {
+        optQueueSize, optThreads
+    };
+
+    if (objc > 2 && objc % 2 == 0) {
+        Tcl_WrongNumArgs(interp, 1, objv, "?-option? ?value? ?-option value ...?");
+        DBG2(printf("return: TCL_ERROR (wrong # args)"));
+        return TCL_ERROR;
+    }
+
+    int option;
+
+    // Return all options and their values
+    if (objc == 1) {
+        Tcl_Obj *result = Tcl_NewListObj(0, NULL);
+        for (option = 0; options[option] != NULL; option++) {
+            Tcl_ListObjAppendElement(NULL, result, Tcl_NewStringObj(options[option], -1));
+            Tcl_ListObjAppendElement(NULL, result, Tcl_NewIntObj(
+                (option == optThreads ? tjv_PoolThreads() : tjv_AsyncGetQueueSize())));
+        }
+        Tcl_SetObjResult(interp, result);
+        goto done;
+    }
+
+    // Return the value of the option
+    if (objc == 2) {
+        if (Tcl_GetIndexFromObj(interp, objv[1], options, "option", 0, &option) != TCL_OK) {
+            DBG2(printf("return: TCL_ERROR (wrong option: [%s])", Tcl_GetString(objv[1])));
+            return TCL_ERROR;
+        }
+        Tcl_SetObjResult(interp, Tcl_NewIntObj(
+            (option == optThreads ? tjv_PoolThreads() : tjv_AsyncGetQueueSize())));
+        goto done;
+    }
+
+    for (int i = 1; i < objc; i += 2) {
+
+        if (Tcl_GetIndexFromObj(interp, objv[i], options, "option", 0, &option) != TCL_OK) {
+            DBG2(printf("return: TCL_ERROR (wrong option: [%s])", Tcl_GetString(objv[i])));
+            return TCL_ERROR;
+        }
+
+        int value;
+        if (Tcl_GetIntFromObj(interp, objv[i + 1], &value) != TCL_OK) {
+            DBG2(printf("return: TCL_ERROR (wrong value: [%s])", Tcl_GetString(objv[i + 1])));
+            return TCL_ERROR;
+        }
+
+        switch ((enum options) option) {
+        case optThreads:
+            if (value < 0 || value > TJV_POOL_MAX_THREADS) {
+                Tcl_SetObjResult(interp, Tcl_ObjPrintf("the number of threads should be from 0 to %d, but got %d",
+                    TJV_POOL_MAX_THREADS, value));
+                DBG2(printf("return: TCL_ERROR (wrong number of threads: %d)", value));
+                return TCL_ERROR;
+            }
+            if (tjv_PoolConfigure(interp, value) != TCL_OK) {
+                DBG2(printf("return: TCL_ERROR"));
+                return TCL_ERROR;
+            }
+            break;
+        case optQueueSize:
+            if (value < 1) {
+                Tcl_SetObjResult(interp, Tcl_ObjPrintf("the queue size should be a positive number, but got %d", value));
+                DBG2(printf("return: TCL_ERROR (wrong queue size: %d)", value));
+                return TCL_ERROR;
+            }
+            tjv_AsyncSetQueueSize(value);
+            break;
+        }
+
+    }
+
+    Tcl_ResetResult(interp);
+
+done:
+
+    DBG2(printf("return: ok"));
+
+    return TCL_OK;
+
+}
+
 #if TCL_MAJOR_VERSION > 8
 #define MIN_VERSION "9.0"
 #else
@@ -282,10 +797,14 @@ int Tjv_Init(Tcl_Interp *interp) {
 
     tjv_ValidationCompileInit();
     tjv_MessageInit();
+    tjv_ValidateTclInit();
+    tjv_JsonInit();
+    tjv_PoolInit();
 
     Tcl_CreateNamespace(interp, "::tjv", NULL, NULL);
     Tcl_CreateObjCommand(interp, "::tjv::compile", tjv_CompileCmd, NULL, NULL);
     Tcl_CreateObjCommand(interp, "::tjv::validate", tjv_ValidateCmd, NULL, NULL);
+    Tcl_CreateObjCommand(interp, "::tjv::configure", tjv_ConfigureCmd, NULL, NULL);
 
 
     Tcl_RegisterConfig(interp, "tjv", tjv_pkgconfig, "iso8859-1");
@@ -340,10 +859,27 @@ static void tjv_HandleDeleteProc(ClientData clientData) {
         DBG2(printf("trace var is not found"));
     }
 
-    tjv_ValidationElementFree(h->root);
+    // Callbacks of pending validations are not called, as they would need
+    // the schema
+    tjv_AsyncCancelAll(&h->async);
 
-    ckfree(h);
+    // The schema is freed when validations in steps don't use it anymore.
+    // The argument of Tcl_FreeProc is char* in Tcl 8.6 and void* in Tcl 9.0.
+    Tcl_EventuallyFree(clientData, (Tcl_FreeProc *)tjv_HandleFreeProc);
 
     DBG2(printf("return: ok"));
 
 }
+
+static void tjv_HandleFreeProc(char *blockPtr) {
+
+    tjv_ValidationHandler *h = (tjv_ValidationHandler *)blockPtr;
+
+    DBG2(printf("free handler: %p", (void *)h));
+
+    tjv_ReplicaRelease(h->root->replica);
+    tjv_ValidationElementFree(h->root);
+
+    ckfree(h);
+
+}
@@ -10,6 +10,18 @@
 #include "tjvCompile.h"
 #include "tjvMessage.h"
 #include "tjvValidateTcl.h"
+#include "tjvValidateJson.h"
+#include "tjvJson.h"
+#include "tjvPool.h"
+#include "tjvReplica.h"
+#include "tjvAsync.h"
+#include "tjvStep.h"
+#include "tjvStream.h"
+#include "tjvSource.h"
+#include "tjvNdjson.h"
+#include "tjvMsgpack.h"
+#include "tjvCbor.h"
+#include "tjvForm.h"
 
 typedef struct {
     Tcl_Interp *interp;
@@ -17,6 +29,7 @@ typedef struct {
     Tcl_Obj *cmd_name;
     Tcl_Obj *trace_var;
     tjv_ValidationElement *root;
+    tjv_AsyncList async;
 } tjv_ValidationHandler;
 
 static Tcl_Config const tjv_pkgconfig[] = {
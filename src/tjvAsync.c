@@ -0,0 +1,296 @@
+/**
+ * Copyright Jerily LTD. All Rights Reserved.
+ * SPDX-FileCopyrightText: 2024 Neofytos Dimitriou (neo@jerily.cy)
+ * SPDX-License-Identifier: MIT.
+ */
+
+#include "tjvAsync.h"
+#include "tjvValidateTcl.h"
+#include "tjvMessage.h"
+#include "tjvPool.h"
+#include "tjvReplica.h"
+
+// Schemas, values and outcomes are Tcl objects, so they can only be used by
+// the thread of the interpreter. If there are worker threads, a worker
+// validates the string representation of the data with its own copy of
+// the schema and passes the outcome back as a string. The request returns
+// to the interpreter thread as an event, which converts the outcome to
+// an object and calls the callback. Without worker threads, the request
+// is validated when its event is processed.
+
+struct tjv_AsyncRequest {
+    // The list of pending requests, NULL if the request is cancelled
+    tjv_AsyncList *list;
+    tjv_AsyncRequest *prev;
+    tjv_AsyncRequest *next;
+    int id;
+    Tcl_Interp *interp;
+    Tcl_ThreadId owner;
+    tjv_ValidationElement *root;
+    Tcl_Obj *data;
+    Tcl_Obj *callback;
+    tjv_PoolTask task;
+    // The source of the schema copy of the worker, it is retained by the
+    // request as the schema can be destroyed before the worker is done
+    tjv_Replica *replica;
+    // The string representation of the data that the worker validates
+    const char *str;
+    Tcl_Size length;
+    // The result of the worker thread
+    int is_validated;
+    int is_valid;
+    // The outcome, or the error details if the data is not valid
+    tjv_ReplicaText outcome;
+};
+
+typedef struct {
+    Tcl_Event header;
+    tjv_AsyncRequest *request;
+} tjv_AsyncEvent;
+
+static Tcl_Mutex tjv_async_mx;
+// The number of requests in the process that are not completed yet,
+// including cancelled ones which are still being parsed
+static int tjv_async_pending = 0;
+static int tjv_async_queue_size = TJV_ASYNC_DEFAULT_QUEUE_SIZE;
+
+int tjv_AsyncGetQueueSize(void) {
+    Tcl_MutexLock(&tjv_async_mx);
+    int size = tjv_async_queue_size;
+    Tcl_MutexUnlock(&tjv_async_mx);
+    return size;
+}
+
+void tjv_AsyncSetQueueSize(int size) {
+    Tcl_MutexLock(&tjv_async_mx);
+    tjv_async_queue_size = size;
+    Tcl_MutexUnlock(&tjv_async_mx);
+}
+
+static void tjv_AsyncUnlink(tjv_AsyncRequest *request) {
+    if (request->prev == NULL) {
+        request->list->first = request->next;
+    } else {
+        request->prev->next = request->next;
+    }
+    if (request->next != NULL) {
+        request->next->prev = request->prev;
+    }
+    request->list = NULL;
+}
+
+// Calls the callback with the result of the worker, or validates the data
+// first if it is not validated by a worker
+static void tjv_AsyncComplete(tjv_AsyncRequest *request) {
+
+    DBG2(printf("enter: request #%d", request->id));
+
+    int is_valid;
+    Tcl_Obj *outcome;
+
+    if (request->is_validated) {
+        DBG2(printf("validated by a worker"));
+        is_valid = request->is_valid;
+        outcome = tjv_ReplicaTextGet(&request->outcome);
+    } else {
+        Tcl_Obj *error_message = NULL;
+        Tcl_Obj *error_details = NULL;
+        outcome = Tcl_NewDictObj();
+        tjv_ValidateTcl(request->data, NULL, request->root, &error_message, &error_details, &outcome);
+        is_valid = (error_message == NULL);
+        if (!is_valid) {
+            Tcl_BounceRefCount(outcome);
+            outcome = tjv_MessageCombineDetails(error_message, error_details);
+        }
+    }
+
+    Tcl_Obj *cmd = Tcl_DuplicateObj(request->callback);
+    Tcl_IncrRefCount(cmd);
+    Tcl_ListObjAppendElement(NULL, cmd, Tcl_NewBooleanObj(is_valid));
+    Tcl_ListObjAppendElement(NULL, cmd, outcome);
+
+    Tcl_Interp *interp = request->interp;
+    Tcl_Preserve(interp);
+    int rc = Tcl_EvalObjEx(interp, cmd, TCL_EVAL_GLOBAL);
+    if (rc != TCL_OK) {
+        DBG2(printf("callback error: %s", Tcl_GetStringResult(interp)));
+        Tcl_BackgroundException(interp, rc);
+    }
+    Tcl_Release(interp);
+
+    Tcl_DecrRefCount(cmd);
+
+    DBG2(printf("return: ok"));
+
+}
+
+static int tjv_AsyncEventProc(Tcl_Event *evPtr, int flags) {
+
+    if (!(flags & TCL_FILE_EVENTS)) {
+        return 0;
+    }
+
+    tjv_AsyncRequest *request = ((tjv_AsyncEvent *)evPtr)->request;
+
+    DBG2(printf("enter: request #%d", request->id));
+
+    // The request is removed from the list before the callback, so it
+    // can't be cancelled and the schema can be destroyed by the callback
+    if (request->list != NULL) {
+        tjv_AsyncUnlink(request);
+        tjv_AsyncComplete(request);
+    } else {
+        DBG2(printf("the request is cancelled"));
+    }
+
+    tjv_ReplicaTextFree(&request->outcome);
+    if (request->replica != NULL) {
+        tjv_ReplicaFree(request->replica);
+    }
+    Tcl_DecrRefCount(request->data);
+    Tcl_DecrRefCount(request->callback);
+    ckfree(request);
+
+    Tcl_MutexLock(&tjv_async_mx);
+    tjv_async_pending--;
+    Tcl_MutexUnlock(&tjv_async_mx);
+
+    DBG2(printf("return: ok"));
+
+    return 1;
+
+}
+
+// Returns the request to the interpreter thread. Can be called from any thread.
+static void tjv_AsyncQueueEvent(tjv_AsyncRequest *request) {
+    tjv_AsyncEvent *event = ckalloc(sizeof(tjv_AsyncEvent));
+    event->header.proc = tjv_AsyncEventProc;
+    event->request = request;
+    Tcl_ThreadQueueEvent(request->owner, (Tcl_Event *)event, TCL_QUEUE_TAIL);
+    Tcl_ThreadAlert(request->owner);
+}
+
+// Validates the data in a worker thread. The data is left to the interpreter
+// thread if the worker can't get the schema: it is destroyed and the request
+// is cancelled then, or its copy can't be compiled.
+static void tjv_AsyncValidateWorker(void *clientData) {
+
+    tjv_AsyncRequest *request = (tjv_AsyncRequest *)clientData;
+
+    DBG2(printf("validate request #%d", request->id));
+
+    tjv_ValidationElement *root = tjv_ReplicaGet(request->replica);
+    if (root != NULL) {
+
+        Tcl_Obj *error_message = NULL;
+        Tcl_Obj *error_details = NULL;
+        Tcl_Obj *outcome = Tcl_NewDictObj();
+
+        Tcl_Obj *data = Tcl_NewStringObj(request->str, request->length);
+        Tcl_IncrRefCount(data);
+        tjv_ValidateTcl(data, NULL, root, &error_message, &error_details, &outcome);
+        Tcl_DecrRefCount(data);
+
+        request->is_valid = (error_message == NULL);
+        if (!request->is_valid) {
+            Tcl_BounceRefCount(outcome);
+            outcome = tjv_MessageCombineDetails(error_message, error_details);
+        }
+
+        tjv_ReplicaTextSet(&request->outcome, outcome);
+        request->is_validated = 1;
+
+    }
+
+    tjv_AsyncQueueEvent(request);
+
+}
+
+int tjv_AsyncValidate(Tcl_Interp *interp, tjv_AsyncList *list, tjv_ValidationElement *root, Tcl_Obj *data, Tcl_Obj *callback) {
+
+    DBG2(printf("enter"));
+
+    // The data and the outcome are appended to the callback
+    Tcl_Size callback_length;
+    if (Tcl_ListObjLength(interp, callback, &callback_length) != TCL_OK) {
+        DBG2(printf("return: TCL_ERROR (callback is not a list)"));
+        return TCL_ERROR;
+    }
+
+    Tcl_MutexLock(&tjv_async_mx);
+    if (tjv_async_pending >= tjv_async_queue_size) {
+        int size = tjv_async_queue_size;
+        Tcl_MutexUnlock(&tjv_async_mx);
+        Tcl_SetObjResult(interp, Tcl_ObjPrintf("too many pending asynchronous validations, the limit is %d", size));
+        DBG2(printf("return: TCL_ERROR (queue is full)"));
+        return TCL_ERROR;
+    }
+    tjv_async_pending++;
+    Tcl_MutexUnlock(&tjv_async_mx);
+
+    tjv_AsyncRequest *request = ckalloc(sizeof(tjv_AsyncRequest));
+    request->id = ++list->last_id;
+    request->interp = interp;
+    request->owner = Tcl_GetCurrentThread();
+    request->root = root;
+    request->data = data;
+    Tcl_IncrRefCount(request->data);
+    request->callback = callback;
+    Tcl_IncrRefCount(request->callback);
+    request->replica = NULL;
+    request->is_validated = 0;
+    tjv_ReplicaTextSet(&request->outcome, NULL);
+
+    request->list = list;
+    request->prev = NULL;
+    request->next = list->first;
+    if (list->first != NULL) {
+        list->first->prev = request;
+    }
+    list->first = request;
+
+    DBG2(printf("request #%d", request->id));
+
+    Tcl_SetObjResult(interp, Tcl_NewIntObj(request->id));
+
+    if (root->replica != NULL) {
+        // The string representation is created by the current thread, and
+        // the worker only reads it. It doesn't change while the data is
+        // referenced by the request.
+        request->str = Tcl_GetStringFromObj(data, &request->length);
+        request->replica = root->replica;
+        tjv_ReplicaRetain(request->replica);
+        request->task.proc = tjv_AsyncValidateWorker;
+        request->task.clientData = request;
+        if (tjv_PoolSubmit(&request->task)) {
+            DBG2(printf("return: ok (validated by a worker)"));
+            return TCL_OK;
+        }
+        tjv_ReplicaFree(request->replica);
+        request->replica = NULL;
+    }
+
+    tjv_AsyncQueueEvent(request);
+
+    DBG2(printf("return: ok"));
+    return TCL_OK;
+
+}
+
+int tjv_AsyncCancel(tjv_AsyncList *list, int id) {
+    for (tjv_AsyncRequest *request = list->first; request != NULL; request = request->next) {
+        if (request->id == id) {
+            DBG2(printf("cancel request #%d", id));
+            tjv_AsyncUnlink(request);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void tjv_AsyncCancelAll(tjv_AsyncList *list) {
+    while (list->first != NULL) {
+        DBG2(printf("cancel request #%d", list->first->id));
+        tjv_AsyncUnlink(list->first);
+    }
+}
@@ -0,0 +1,45 @@
+/**
+ * Copyright Jerily LTD. All Rights Reserved.
+ * SPDX-FileCopyrightText: 2024 Neofytos Dimitriou (neo@jerily.cy)
+ * SPDX-License-Identifier: MIT.
+ */
+#ifndef TJV_ASYNC_H
+#define TJV_ASYNC_H
+
+#include "common.h"
+#include "tjvCompile.h"
+
+// The default maximum number of pending asynchronous validations
+#define TJV_ASYNC_DEFAULT_QUEUE_SIZE 100
+
+typedef struct tjv_AsyncRequest tjv_AsyncRequest;
+
+// Pending asynchronous validations of a compiled schema. The list is used
+// only by the thread of the interpreter that owns the schema.
+typedef struct {
+    tjv_AsyncRequest *first;
+    int last_id;
+} tjv_AsyncList;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Starts asynchronous validation of the data. The callback is called from
+// the event loop with the validation status and the outcome. Sets the
+// interpreter result to the id of the request.
+int tjv_AsyncValidate(Tcl_Interp *interp, tjv_AsyncList *list, tjv_ValidationElement *root, Tcl_Obj *data, Tcl_Obj *callback);
+// Cancels the request so that its callback is not called. Returns 0 if
+// there is no pending request with the specified id.
+int tjv_AsyncCancel(tjv_AsyncList *list, int id);
+void tjv_AsyncCancelAll(tjv_AsyncList *list);
+
+// The maximum number of pending requests in the process
+int tjv_AsyncGetQueueSize(void);
+void tjv_AsyncSetQueueSize(int size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TJV_ASYNC_H
@@ -0,0 +1,559 @@
+/**
+ * Copyright Jerily LTD. All Rights Reserved.
+ * SPDX-FileCopyrightText: 2024 Neofytos Dimitriou (neo@jerily.cy)
+ * SPDX-License-Identifier: MIT.
+ */
+
+// The NFA construction and its simulation follow the approach described by
+// Russ Cox in "Regular Expression Matching Can Be Simple And Fast"
+// (https://swtch.com/~rsc/regexp/regexp1.html) and
+// "Regular Expression Matching in the Wild"
+// (https://swtch.com/~rsc/regexp/regexp3.html). DFA states are sets of NFA
+// states and are created on first use. If the number of DFA states reaches
+// TJV_DFA_MAX_STATES, all of them are discarded and built again as needed,
+// so the memory usage is bounded and the time remains linear.
+
+#include "tjvAutomaton.h"
+
+#define TJV_DFA_MAX_STATES 1024
+
+// All NFA states reachable in this DFA state lead to the match state
+// without consuming input.
+#define TJV_DFA_MATCH        1
+// The match state is reachable if this is the end of input
+#define TJV_DFA_MATCH_AT_END 2
+// The state is at the beginning of input. The start state is
+// not shared with other states that have the same NFA states, because
+// the end of input assertions are checked differently for it.
+#define TJV_DFA_BEGIN        4
+
+struct tjv_DfaState {
+    int flags;
+    int count;
+    uint64_t hash;
+    // Transitions by input byte, NULL if not computed yet. Pointers instead
+    // of indexes save a memory load per byte in the matching loop.
+    tjv_DfaState *next[256];
+    // NFA states that consume input or wait for the end of input
+    int states[];
+};
+
+static int tjv_NfaAdd(tjv_Automaton *a, tjv_NfaStateType type, unsigned char lo, unsigned char hi, int out, int out1) {
+
+    if (a->nfa_count == a->nfa_capacity) {
+        a->nfa_capacity = (a->nfa_capacity == 0 ? 32 : a->nfa_capacity * 2);
+        a->nfa = ckrealloc(a->nfa, sizeof(tjv_NfaState) * a->nfa_capacity);
+    }
+
+    tjv_NfaState *s = &a->nfa[a->nfa_count];
+    s->type = type;
+    s->lo = lo;
+    s->hi = hi;
+    s->out = out;
+    s->out1 = out1;
+
+    return a->nfa_count++;
+
+}
+
+// Dangling outputs are referenced as (state index * 2 + 1) for out1 and
+// (state index * 2) for out. The list of dangling outputs is terminated
+// with -1.
+
+static inline int *tjv_NfaSlot(tjv_Automaton *a, int ref) {
+    return (ref & 1) ? &a->nfa[ref >> 1].out1 : &a->nfa[ref >> 1].out;
+}
+
+static void tjv_NfaPatch(tjv_Automaton *a, int dangling, int target) {
+    while (dangling != -1) {
+        int *slot = tjv_NfaSlot(a, dangling);
+        dangling = *slot;
+        *slot = target;
+    }
+}
+
+static int tjv_NfaAppend(tjv_Automaton *a, int dangling1, int dangling2) {
+    if (dangling1 == -1) {
+        return dangling2;
+    }
+    int ref = dangling1;
+    int *slot;
+    while (*(slot = tjv_NfaSlot(a, ref)) != -1) {
+        ref = *slot;
+    }
+    *slot = dangling2;
+    return dangling1;
+}
+
+tjv_NfaFragment tjv_NfaEmpty(tjv_Automaton *a) {
+    int s = tjv_NfaAdd(a, TJV_NFA_EMPTY, 0, 0, -1, -1);
+    return (tjv_NfaFragment){ s, s * 2 };
+}
+
+tjv_NfaFragment tjv_NfaByteRange(tjv_Automaton *a, unsigned char lo, unsigned char hi) {
+    int s = tjv_NfaAdd(a, TJV_NFA_RANGE, lo, hi, -1, -1);
+    return (tjv_NfaFragment){ s, s * 2 };
+}
+
+tjv_NfaFragment tjv_NfaAssert(tjv_Automaton *a, tjv_NfaStateType type) {
+    assert((type == TJV_NFA_BEGIN || type == TJV_NFA_END) && "unexpected assertion type");
+    int s = tjv_NfaAdd(a, type, 0, 0, -1, -1);
+    return (tjv_NfaFragment){ s, s * 2 };
+}
+
+tjv_NfaFragment tjv_NfaConcat(tjv_Automaton *a, tjv_NfaFragment f1, tjv_NfaFragment f2) {
+    tjv_NfaPatch(a, f1.dangling, f2.start);
+    return (tjv_NfaFragment){ f1.start, f2.dangling };
+}
+
+tjv_NfaFragment tjv_NfaAlt(tjv_Automaton *a, tjv_NfaFragment f1, tjv_NfaFragment f2) {
+    int s = tjv_NfaAdd(a, TJV_NFA_SPLIT, 0, 0, f1.start, f2.start);
+    return (tjv_NfaFragment){ s, tjv_NfaAppend(a, f1.dangling, f2.dangling) };
+}
+
+tjv_NfaFragment tjv_NfaStar(tjv_Automaton *a, tjv_NfaFragment f) {
+    int s = tjv_NfaAdd(a, TJV_NFA_SPLIT, 0, 0, f.start, -1);
+    tjv_NfaPatch(a, f.dangling, s);
+    return (tjv_NfaFragment){ s, s * 2 + 1 };
+}
+
+tjv_NfaFragment tjv_NfaPlus(tjv_Automaton *a, tjv_NfaFragment f) {
+    int s = tjv_NfaAdd(a, TJV_NFA_SPLIT, 0, 0, f.start, -1);
+    tjv_NfaPatch(a, f.dangling, s);
+    return (tjv_NfaFragment){ f.start, s * 2 + 1 };
+}
+
+tjv_NfaFragment tjv_NfaQuest(tjv_Automaton *a, tjv_NfaFragment f) {
+    int s = tjv_NfaAdd(a, TJV_NFA_SPLIT, 0, 0, f.start, -1);
+    return (tjv_NfaFragment){ s, tjv_NfaAppend(a, f.dangling, s * 2 + 1) };
+}
+
+tjv_NfaFragment tjv_NfaString(tjv_Automaton *a, const char *str, Tcl_Size length) {
+    if (length == 0) {
+        return tjv_NfaEmpty(a);
+    }
+    tjv_NfaFragment f = tjv_NfaByteRange(a, (unsigned char)str[0], (unsigned char)str[0]);
+    for (Tcl_Size i = 1; i < length; i++) {
+        f = tjv_NfaConcat(a, f, tjv_NfaByteRange(a, (unsigned char)str[i], (unsigned char)str[i]));
+    }
+    return f;
+}
+
+static int tjv_Utf8Encode(int ch, unsigned char *buf) {
+    if (ch < 0x80) {
+        buf[0] = (unsigned char)ch;
+        return 1;
+    }
+    if (ch < 0x800) {
+        buf[0] = (unsigned char)(0xC0 | (ch >> 6));
+        buf[1] = (unsigned char)(0x80 | (ch & 0x3F));
+        return 2;
+    }
+    if (ch < 0x10000) {
+        buf[0] = (unsigned char)(0xE0 | (ch >> 12));
+        buf[1] = (unsigned char)(0x80 | ((ch >> 6) & 0x3F));
+        buf[2] = (unsigned char)(0x80 | (ch & 0x3F));
+        return 3;
+    }
+    buf[0] = (unsigned char)(0xF0 | (ch >> 18));
+    buf[1] = (unsigned char)(0x80 | ((ch >> 12) & 0x3F));
+    buf[2] = (unsigned char)(0x80 | ((ch >> 6) & 0x3F));
+    buf[3] = (unsigned char)(0x80 | (ch & 0x3F));
+    return 4;
+}
+
+int tjv_Utf8Decode(const char *str, Tcl_Size length, int *ch_ptr) {
+
+    const unsigned char *s = (const unsigned char *)str;
+    int n;
+    int ch;
+
+    if (s[0] < 0x80) {
+        *ch_ptr = s[0];
+        return 1;
+    } else if (s[0] >= 0xC0 && s[0] < 0xE0) {
+        n = 2;
+        ch = s[0] & 0x1F;
+    } else if (s[0] >= 0xE0 && s[0] < 0xF0) {
+        n = 3;
+        ch = s[0] & 0x0F;
+    } else if (s[0] >= 0xF0 && s[0] < 0xF8) {
+        n = 4;
+        ch = s[0] & 0x07;
+    } else {
+        *ch_ptr = s[0];
+        return 1;
+    }
+
+    if (n > length) {
+        *ch_ptr = s[0];
+        return 1;
+    }
+
+    for (int i = 1; i < n; i++) {
+        if ((s[i] & 0xC0) != 0x80) {
+            *ch_ptr = s[0];
+            return 1;
+        }
+        ch = (ch << 6) | (s[i] & 0x3F);
+    }
+
+    *ch_ptr = ch;
+    return n;
+
+}
+
+// Converts a range of code points into alternatives of byte range sequences.
+// The range is split until the code points at both ends have encodings
+// of the same length that differ only in the last bytes.
+static tjv_NfaFragment tjv_NfaUtf8Range(tjv_Automaton *a, int lo, int hi) {
+
+    static const int max_for_length[] = { 0x7F, 0x7FF, 0xFFFF };
+
+    for (int i = 0; i < 3; i++) {
+        if (lo <= max_for_length[i] && hi > max_for_length[i]) {
+            return tjv_NfaAlt(a, tjv_NfaUtf8Range(a, lo, max_for_length[i]),
+                tjv_NfaUtf8Range(a, max_for_length[i] + 1, hi));
+        }
+    }
+
+    if (hi < 0x80) {
+        return tjv_NfaByteRange(a, (unsigned char)lo, (unsigned char)hi);
+    }
+
+    for (int i = 1; i < 4; i++) {
+        int m = (1 << (6 * i)) - 1;
+        if ((lo & ~m) != (hi & ~m)) {
+            if ((lo & m) != 0) {
+                return tjv_NfaAlt(a, tjv_NfaUtf8Range(a, lo, lo | m),
+                    tjv_NfaUtf8Range(a, (lo | m) + 1, hi));
+            }
+            if ((hi & m) != m) {
+                return tjv_NfaAlt(a, tjv_NfaUtf8Range(a, lo, (hi & ~m) - 1),
+                    tjv_NfaUtf8Range(a, hi & ~m, hi));
+            }
+        }
+    }
+
+    unsigned char lo_buf[4];
+    unsigned char hi_buf[4];
+    int n = tjv_Utf8Encode(lo, lo_buf);
+    tjv_Utf8Encode(hi, hi_buf);
+
+    tjv_NfaFragment f = tjv_NfaByteRange(a, lo_buf[0], hi_buf[0]);
+    for (int i = 1; i < n; i++) {
+        f = tjv_NfaConcat(a, f, tjv_NfaByteRange(a, lo_buf[i], hi_buf[i]));
+    }
+    return f;
+
+}
+
+tjv_NfaFragment tjv_NfaCharRange(tjv_Automaton *a, int lo, int hi) {
+
+    // Surrogates are not valid code points and they can't be encoded
+    if (lo < 0xD800 && hi > 0xDFFF) {
+        return tjv_NfaAlt(a, tjv_NfaCharRange(a, lo, 0xD7FF), tjv_NfaCharRange(a, 0xE000, hi));
+    }
+
+    tjv_NfaFragment f = tjv_NfaUtf8Range(a, lo, hi);
+
+    // Tcl encodes NUL as 0xC0 0x80 in its strings
+    if (lo == 0) {
+        f = tjv_NfaAlt(a, f, tjv_NfaString(a, "\xC0\x80", 2));
+    }
+
+    return f;
+
+}
+
+tjv_NfaFragment tjv_NfaCharClass(tjv_Automaton *a, const int *ranges, int count) {
+
+    if (count == 0) {
+        // A class without characters never matches. We use an empty byte
+        // range for that.
+        return tjv_NfaByteRange(a, 1, 0);
+    }
+
+    tjv_NfaFragment f = tjv_NfaCharRange(a, ranges[0], ranges[1]);
+    for (int i = 1; i < count; i++) {
+        f = tjv_NfaAlt(a, f, tjv_NfaCharRange(a, ranges[i * 2], ranges[i * 2 + 1]));
+    }
+    return f;
+
+}
+
+tjv_Automaton *tjv_AutomatonAlloc(int flags) {
+    tjv_Automaton *a = ckalloc(sizeof(tjv_Automaton));
+    memset(a, 0, sizeof(tjv_Automaton));
+    a->flags = flags;
+    a->nfa_start = -1;
+    a->dfa_start = NULL;
+    return a;
+}
+
+static void tjv_DfaFlush(tjv_Automaton *a) {
+    DBG2(printf("flush %d DFA states", a->dfa_count));
+    for (int i = 0; i < a->dfa_count; i++) {
+        ckfree(a->dfa[i]);
+    }
+    a->dfa_count = 0;
+    a->dfa_start = NULL;
+    a->dfa_generation++;
+    for (int i = 0; i <= a->dfa_hash_mask; i++) {
+        a->dfa_hash[i] = -1;
+    }
+}
+
+void tjv_AutomatonFree(tjv_Automaton *a) {
+    if (a->dfa != NULL) {
+        tjv_DfaFlush(a);
+        ckfree(a->dfa);
+        ckfree(a->dfa_hash);
+        ckfree(a->work_set);
+        ckfree(a->work_sparse);
+        ckfree(a->work_stack);
+    }
+    if (a->nfa != NULL) {
+        ckfree(a->nfa);
+    }
+    ckfree(a);
+}
+
+void tjv_AutomatonFinish(tjv_Automaton *a, tjv_NfaFragment f) {
+
+    int match = tjv_NfaAdd(a, TJV_NFA_MATCH, 0, 0, -1, -1);
+    tjv_NfaPatch(a, f.dangling, match);
+
+    if (a->flags & TJV_AUTOMATON_FULL_MATCH) {
+        a->nfa_start = f.start;
+    } else {
+        // For search, any number of bytes can be skipped before the match
+        tjv_NfaFragment skip = tjv_NfaStar(a, tjv_NfaByteRange(a, 0, 255));
+        a->nfa_start = tjv_NfaConcat(a, skip, f).start;
+    }
+
+    a->dfa_capacity = 16;
+    a->dfa = ckalloc(sizeof(tjv_DfaState *) * a->dfa_capacity);
+    a->dfa_hash_mask = TJV_DFA_MAX_STATES * 2 - 1;
+    a->dfa_hash = ckalloc(sizeof(int) * (a->dfa_hash_mask + 1));
+    for (int i = 0; i <= a->dfa_hash_mask; i++) {
+        a->dfa_hash[i] = -1;
+    }
+
+    a->work_set = ckalloc(sizeof(int) * a->nfa_count);
+    // The sparse array can contain any values less than the number of states.
+    // We initialize it only to keep these values in range.
+    a->work_sparse = ckalloc(sizeof(int) * a->nfa_count);
+    memset(a->work_sparse, 0, sizeof(int) * a->nfa_count);
+    // Each state is pushed to the stack at most once per its incoming
+    // transition, and there are at most 2 of them.
+    a->work_stack = ckalloc(sizeof(int) * (a->nfa_count * 2 + 1));
+
+    DBG2(printf("NFA states: %d", a->nfa_count));
+
+}
+
+// Adds the state and all states reachable from it by epsilon transitions
+// to the working set. Returns the updated count of states in the set.
+static int tjv_AutomatonAddState(tjv_Automaton *a, int state, int count, int is_begin, int is_end, int *flags_ptr) {
+
+    int *set = a->work_set;
+    int *sparse = a->work_sparse;
+    int *stack = a->work_stack;
+    int top = 0;
+
+    stack[top++] = state;
+
+    while (top > 0) {
+
+        int s = stack[--top];
+
+        // Check if the state is already in the set
+        if (sparse[s] < count && set[sparse[s]] == s) {
+            continue;
+        }
+        sparse[s] = count;
+        set[count++] = s;
+
+        const tjv_NfaState *ns = &a->nfa[s];
+        switch (ns->type) {
+        case TJV_NFA_RANGE:
+            break;
+        case TJV_NFA_EMPTY:
+            stack[top++] = ns->out;
+            break;
+        case TJV_NFA_SPLIT:
+            stack[top++] = ns->out1;
+            stack[top++] = ns->out;
+            break;
+        case TJV_NFA_BEGIN:
+            if (is_begin) {
+                stack[top++] = ns->out;
+            }
+            break;
+        case TJV_NFA_END:
+            if (is_end) {
+                stack[top++] = ns->out;
+            }
+            break;
+        case TJV_NFA_MATCH:
+            *flags_ptr |= TJV_DFA_MATCH;
+            break;
+        }
+
+    }
+
+    return count;
+
+}
+
+static int tjv_AutomatonCompareInt(const void *a, const void *b) {
+    int x = *(const int *)a;
+    int y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+// Converts the working set of count states to a DFA state and returns
+// its index. The set contains all states reachable by epsilon transitions,
+// only states that consume input or wait for the end of input are kept.
+static int tjv_DfaStateFromSet(tjv_Automaton *a, int count, int flags) {
+
+    int *set = a->work_set;
+    int n = 0;
+    for (int i = 0; i < count; i++) {
+        tjv_NfaStateType type = a->nfa[set[i]].type;
+        if (type == TJV_NFA_RANGE || type == TJV_NFA_END) {
+            set[n++] = set[i];
+        }
+    }
+
+    qsort(set, (size_t)n, sizeof(int), tjv_AutomatonCompareInt);
+
+    uint64_t hash = (uint64_t)(flags + 1) * 0x9E3779B97F4A7C15ULL;
+    for (int i = 0; i < n; i++) {
+        hash = (hash ^ (uint64_t)set[i]) * 0x100000001B3ULL;
+    }
+    hash ^= hash >> 32;
+
+    int pos = (int)(hash & (uint64_t)a->dfa_hash_mask);
+    while (a->dfa_hash[pos] != -1) {
+        tjv_DfaState *d = a->dfa[a->dfa_hash[pos]];
+        // The flag of match at the end is computed for new states below
+        if (d->hash == hash && d->count == n && (d->flags & ~TJV_DFA_MATCH_AT_END) == flags &&
+            memcmp(d->states, set, sizeof(int) * n) == 0)
+        {
+            return a->dfa_hash[pos];
+        }
+        pos = (pos + 1) & a->dfa_hash_mask;
+    }
+
+    if (a->dfa_count == TJV_DFA_MAX_STATES) {
+        tjv_DfaFlush(a);
+        pos = (int)(hash & (uint64_t)a->dfa_hash_mask);
+    }
+
+    // Check whether the match state is reachable at the end of input
+    if (!(flags & TJV_DFA_MATCH)) {
+        int end_flags = 0;
+        int end_count = n;
+        for (int i = 0; i < n; i++) {
+            a->work_sparse[set[i]] = i;
+        }
+        for (int i = 0; i < n; i++) {
+            if (a->nfa[set[i]].type == TJV_NFA_END) {
+                end_count = tjv_AutomatonAddState(a, a->nfa[set[i]].out, end_count,
+                    (flags & TJV_DFA_BEGIN), 1, &end_flags);
+            }
+        }
+        if (end_flags & TJV_DFA_MATCH) {
+            flags |= TJV_DFA_MATCH_AT_END;
+        }
+    } else {
+        flags |= TJV_DFA_MATCH_AT_END;
+    }
+
+    tjv_DfaState *d = ckalloc(sizeof(tjv_DfaState) + sizeof(int) * n);
+    d->flags = flags;
+    d->count = n;
+    d->hash = hash;
+    for (int i = 0; i < 256; i++) {
+        d->next[i] = NULL;
+    }
+    memcpy(d->states, set, sizeof(int) * n);
+
+    if (a->dfa_count == a->dfa_capacity) {
+        a->dfa_capacity *= 2;
+        a->dfa = ckrealloc(a->dfa, sizeof(tjv_DfaState *) * a->dfa_capacity);
+    }
+
+    a->dfa[a->dfa_count] = d;
+    a->dfa_hash[pos] = a->dfa_count;
+
+    return a->dfa_count++;
+
+}
+
+static tjv_DfaState *tjv_DfaStart(tjv_Automaton *a) {
+    int flags = TJV_DFA_BEGIN;
+    int count = tjv_AutomatonAddState(a, a->nfa_start, 0, 1, 0, &flags);
+    // tjv_DfaStateFromSet() can reallocate a->dfa, so take the index first
+    int index = tjv_DfaStateFromSet(a, count, flags);
+    a->dfa_start = a->dfa[index];
+    return a->dfa_start;
+}
+
+static tjv_DfaState *tjv_DfaNext(tjv_Automaton *a, tjv_DfaState *d, unsigned char c) {
+
+    int flags = 0;
+    int count = 0;
+
+    for (int i = 0; i < d->count; i++) {
+        const tjv_NfaState *ns = &a->nfa[d->states[i]];
+        if (ns->type == TJV_NFA_RANGE && ns->lo <= c && c <= ns->hi) {
+            count = tjv_AutomatonAddState(a, ns->out, count, 0, 0, &flags);
+        }
+    }
+
+    int generation = a->dfa_generation;
+    // tjv_DfaStateFromSet() can reallocate a->dfa, so take the index first
+    int index = tjv_DfaStateFromSet(a, count, flags);
+    tjv_DfaState *next = a->dfa[index];
+
+    // If the states were flushed, the current state doesn't exist anymore
+    if (generation == a->dfa_generation) {
+        d->next[c] = next;
+    }
+
+    return next;
+
+}
+
+int tjv_AutomatonMatch(tjv_Automaton *a, const char *str, Tcl_Size length) {
+
+    const unsigned char *s = (const unsigned char *)str;
+    int is_search = !(a->flags & TJV_AUTOMATON_FULL_MATCH);
+
+    tjv_DfaState *d = (a->dfa_start == NULL ? tjv_DfaStart(a) : a->dfa_start);
+
+    for (Tcl_Size i = 0; i < length; i++) {
+
+        if (d->flags & TJV_DFA_MATCH) {
+            if (is_search) {
+                return 1;
+            }
+        } else if (d->count == 0) {
+            // Dead state
+            return 0;
+        }
+
+        tjv_DfaState *next = d->next[s[i]];
+        if (next == NULL) {
+            next = tjv_DfaNext(a, d, s[i]);
+        }
+        d = next;
+
+    }
+
+    return (d->flags & TJV_DFA_MATCH_AT_END) ? 1 : 0;
+
+}
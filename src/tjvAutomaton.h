@@ -0,0 +1,112 @@
+/**
+ * Copyright Jerily LTD. All Rights Reserved.
+ * SPDX-FileCopyrightText: 2024 Neofytos Dimitriou (neo@jerily.cy)
+ * SPDX-License-Identifier: MIT.
+ */
+#ifndef TJV_AUTOMATON_H
+#define TJV_AUTOMATON_H
+
+#include "common.h"
+
+// A Thompson NFA over UTF-8 bytes that is executed as a lazily built DFA.
+// Matching takes time linear in the length of the input. Patterns (glob,
+// regexp) are compiled into the NFA by their own parsers using the fragment
+// functions below.
+
+typedef enum {
+    // Consumes one byte in the range lo..hi
+    TJV_NFA_RANGE,
+    // Epsilon transition to out
+    TJV_NFA_EMPTY,
+    // Epsilon transitions to out and out1
+    TJV_NFA_SPLIT,
+    // Epsilon transition that is allowed only at the beginning of input
+    TJV_NFA_BEGIN,
+    // Epsilon transition that is allowed only at the end of input
+    TJV_NFA_END,
+    TJV_NFA_MATCH
+} tjv_NfaStateType;
+
+typedef struct {
+    tjv_NfaStateType type;
+    unsigned char lo;
+    unsigned char hi;
+    int out;
+    int out1;
+} tjv_NfaState;
+
+// A partially built piece of NFA. The dangling outputs of its states are
+// chained through their out/out1 fields and patched when the fragment
+// is connected to the next one.
+typedef struct {
+    int start;
+    int dangling;
+} tjv_NfaFragment;
+
+// The input must match the whole automaton. Otherwise, the automaton
+// matches if it matches any part of the input (search).
+#define TJV_AUTOMATON_FULL_MATCH 1
+
+typedef struct tjv_DfaState tjv_DfaState;
+
+typedef struct {
+    int flags;
+    // NFA
+    tjv_NfaState *nfa;
+    int nfa_count;
+    int nfa_capacity;
+    int nfa_start;
+    // Lazily built DFA
+    tjv_DfaState **dfa;
+    int dfa_count;
+    int dfa_capacity;
+    tjv_DfaState *dfa_start;
+    // Incremented each time the DFA states are discarded
+    int dfa_generation;
+    // Hash table of DFA states by their sets of NFA states
+    int *dfa_hash;
+    int dfa_hash_mask;
+    // Scratch space for computing of transitions
+    int *work_set;
+    int *work_sparse;
+    int *work_stack;
+} tjv_Automaton;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+tjv_Automaton *tjv_AutomatonAlloc(int flags);
+void tjv_AutomatonFree(tjv_Automaton *a);
+
+// Completes the automaton. The dangling outputs of the fragment lead
+// to the match state.
+void tjv_AutomatonFinish(tjv_Automaton *a, tjv_NfaFragment f);
+
+int tjv_AutomatonMatch(tjv_Automaton *a, const char *str, Tcl_Size length);
+
+tjv_NfaFragment tjv_NfaEmpty(tjv_Automaton *a);
+tjv_NfaFragment tjv_NfaByteRange(tjv_Automaton *a, unsigned char lo, unsigned char hi);
+tjv_NfaFragment tjv_NfaAssert(tjv_Automaton *a, tjv_NfaStateType type);
+// Matches one character in the range of code points lo..hi
+tjv_NfaFragment tjv_NfaCharRange(tjv_Automaton *a, int lo, int hi);
+// Matches one character from the sorted list of non-overlapping ranges
+// of code points. The ranges array contains pairs of lo, hi values.
+tjv_NfaFragment tjv_NfaCharClass(tjv_Automaton *a, const int *ranges, int count);
+tjv_NfaFragment tjv_NfaString(tjv_Automaton *a, const char *str, Tcl_Size length);
+
+tjv_NfaFragment tjv_NfaConcat(tjv_Automaton *a, tjv_NfaFragment f1, tjv_NfaFragment f2);
+tjv_NfaFragment tjv_NfaAlt(tjv_Automaton *a, tjv_NfaFragment f1, tjv_NfaFragment f2);
+tjv_NfaFragment tjv_NfaStar(tjv_Automaton *a, tjv_NfaFragment f);
+tjv_NfaFragment tjv_NfaPlus(tjv_Automaton *a, tjv_NfaFragment f);
+tjv_NfaFragment tjv_NfaQuest(tjv_Automaton *a, tjv_NfaFragment f);
+
+// Decodes one UTF-8 character (also the 2-byte form of NUL) and returns
+// the number of consumed bytes. Invalid bytes are decoded as themselves.
+int tjv_Utf8Decode(const char *str, Tcl_Size length, int *ch_ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TJV_AUTOMATON_H
@@ -0,0 +1,697 @@
+/**
+ * Copyright Jerily LTD. All Rights Reserved.
+ * SPDX-FileCopyrightText: 2024 Neofytos Dimitriou (neo@jerily.cy)
+ * SPDX-License-Identifier: MIT.
+ */
+
+// CBOR decoder. Like the MessagePack decoder, it creates the same tree of
+// tjv_JsonValue as the JSON parser, and the major types map to JSON types:
+// unsigned and negative integers and floats to numbers, byte and text
+// strings to strings, arrays to arrays and maps to objects. Simple values
+// false, true, null and undefined map to booleans and null. Tags are
+// skipped and the tagged item is validated as is.
+//
+// The data is walked twice. The first pass checks it and counts the values
+// and the bytes of copied strings, the second one builds the tree in blocks
+// of exactly that size. Definite-length strings are not copied unless they
+// contain bytes that Tcl's UTF-8 represents differently: NUL is stored as
+// C0 80, and byte strings are represented as ISO-8859-1 characters like
+// a Tcl bytearray. Chunks of indefinite-length strings are joined, so these
+// strings are always copied.
+//
+// The decoder doesn't use recursion, nesting depth is limited only by
+// available memory.
+
+#include "tjvCbor.h"
+#include "tjvJsonNumber.h"
+#include <math.h>
+
+typedef enum {
+    TJV_CBOR_UINT,
+    TJV_CBOR_NEGINT,
+    TJV_CBOR_BYTES,
+    TJV_CBOR_TEXT,
+    TJV_CBOR_ARRAY,
+    TJV_CBOR_MAP,
+    TJV_CBOR_TAG,
+    TJV_CBOR_FALSE,
+    TJV_CBOR_TRUE,
+    TJV_CBOR_NULL,
+    TJV_CBOR_FLOAT,
+    TJV_CBOR_BREAK
+} tjv_CborType;
+
+typedef struct {
+    tjv_CborType type;
+    union {
+        // The value of UINT and NEGINT, the latter is -1 - u
+        Tcl_WideUInt u;
+        double d;
+    } number;
+    // Payload of a definite-length string, or the first chunk of
+    // an indefinite-length one
+    const unsigned char *data;
+    // Length of a string (the sum for all chunks), number of elements of
+    // a definite-length array or map
+    Tcl_WideUInt length;
+    int is_indefinite;
+} tjv_CborItem;
+
+typedef struct {
+    tjv_JsonValue *container;
+    tjv_JsonValue *last;
+    // Number of elements left in a definite-length container, map keys
+    // are counted as separate items
+    Tcl_WideUInt remaining;
+    int is_map;
+    int is_indefinite;
+    // The next item of the map is a key
+    int is_key;
+} tjv_CborFrame;
+
+#define TJV_CBOR_STATIC_FRAMES 32
+
+// Additional information of the initial byte that means indefinite length
+#define TJV_CBOR_INDEFINITE 31
+
+static inline Tcl_WideUInt tjv_CborReadUint(const unsigned char *p, int size) {
+    Tcl_WideUInt v = 0;
+    for (int i = 0; i < size; i++) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+// Reads the initial byte and the argument that follows it. Returns
+// the position after them, or NULL if the data is invalid.
+static const unsigned char *tjv_CborReadHead(const unsigned char *p, const unsigned char *end, int *major_ptr, int *info_ptr, Tcl_WideUInt *argument_ptr, const char **error_ptr) {
+
+    if (p >= end) {
+        *error_ptr = "unexpected end of data";
+        return NULL;
+    }
+
+    unsigned char c = *p++;
+    int info = c & 0x1f;
+
+    *major_ptr = c >> 5;
+    *info_ptr = info;
+
+    if (info < 24) {
+        *argument_ptr = (Tcl_WideUInt)info;
+        return p;
+    }
+
+    if (info == TJV_CBOR_INDEFINITE) {
+        *argument_ptr = 0;
+        return p;
+    }
+
+    if (info > 27) {
+        *error_ptr = "reserved additional information";
+        return NULL;
+    }
+
+    int size = 1 << (info - 24);
+    if (end - p < size) {
+        *error_ptr = "unexpected end of data";
+        return NULL;
+    }
+
+    *argument_ptr = tjv_CborReadUint(p, size);
+    return p + size;
+
+}
+
+static double tjv_CborHalfToDouble(unsigned int half) {
+
+    int exponent = (half >> 10) & 0x1f;
+    int mantissa = half & 0x3ff;
+    double value;
+
+    if (exponent == 0) {
+        value = ldexp(mantissa, -24);
+    } else if (exponent != 31) {
+        value = ldexp(mantissa + 1024, exponent - 25);
+    } else {
+        value = (mantissa == 0 ? INFINITY : NAN);
+    }
+
+    return (half & 0x8000 ? -value : value);
+
+}
+
+// Reads the item at p and returns the position after it, or NULL if
+// the data is invalid. Payload of strings is skipped, elements of arrays
+// and maps and the tagged item follow the head.
+static const unsigned char *tjv_CborReadItem(const unsigned char *p, const unsigned char *end, tjv_CborItem *item, const char **error_ptr) {
+
+    int major;
+    int info;
+    Tcl_WideUInt argument;
+
+    p = tjv_CborReadHead(p, end, &major, &info, &argument, error_ptr);
+    if (p == NULL) {
+        return NULL;
+    }
+
+    item->is_indefinite = (info == TJV_CBOR_INDEFINITE);
+
+    switch (major) {
+    case 0:
+    case 1:
+    case 6:
+        if (item->is_indefinite) {
+            goto invalidIndefinite;
+        }
+        item->type = (major == 0 ? TJV_CBOR_UINT : (major == 1 ? TJV_CBOR_NEGINT : TJV_CBOR_TAG));
+        item->number.u = argument;
+        return p;
+    case 2:
+    case 3:
+        item->type = (major == 2 ? TJV_CBOR_BYTES : TJV_CBOR_TEXT);
+        if (!item->is_indefinite) {
+            if (argument > (Tcl_WideUInt)(end - p)) {
+                goto unexpectedEnd;
+            }
+            item->data = p;
+            item->length = argument;
+            return p + argument;
+        }
+        // Chunks are definite-length strings of the same major type,
+        // terminated by break
+        item->data = p;
+        item->length = 0;
+        for (;;) {
+            if (p >= end) {
+                goto unexpectedEnd;
+            }
+            if (*p == 0xff) {
+                return p + 1;
+            }
+            int chunk_major;
+            int chunk_info;
+            p = tjv_CborReadHead(p, end, &chunk_major, &chunk_info, &argument, error_ptr);
+            if (p == NULL) {
+                return NULL;
+            }
+            if (chunk_major != major || chunk_info == TJV_CBOR_INDEFINITE) {
+                *error_ptr = "invalid chunk of indefinite-length string";
+                return NULL;
+            }
+            if (argument > (Tcl_WideUInt)(end - p)) {
+                goto unexpectedEnd;
+            }
+            item->length += argument;
+            p += argument;
+        }
+    case 4:
+    case 5:
+        item->type = (major == 4 ? TJV_CBOR_ARRAY : TJV_CBOR_MAP);
+        item->length = argument;
+        // Each element takes at least one byte. Checking this here prevents
+        // huge counts in short data.
+        if (argument > (Tcl_WideUInt)(end - p) / (major == 5 ? 2 : 1)) {
+            goto unexpectedEnd;
+        }
+        return p;
+    }
+
+    // Major type 7: floats and simple values
+    switch (info) {
+    case 20:
+        item->type = TJV_CBOR_FALSE;
+        return p;
+    case 21:
+        item->type = TJV_CBOR_TRUE;
+        return p;
+    case 22:
+    case 23:
+        // Undefined is treated as null
+        item->type = TJV_CBOR_NULL;
+        return p;
+    case 25:
+        item->type = TJV_CBOR_FLOAT;
+        item->number.d = tjv_CborHalfToDouble((unsigned int)argument);
+        return p;
+    case 26:
+        {
+            uint32_t bits = (uint32_t)argument;
+            float f;
+            memcpy(&f, &bits, sizeof(f));
+            item->type = TJV_CBOR_FLOAT;
+            item->number.d = f;
+        }
+        return p;
+    case 27:
+        item->type = TJV_CBOR_FLOAT;
+        memcpy(&item->number.d, &argument, sizeof(double));
+        return p;
+    case TJV_CBOR_INDEFINITE:
+        item->type = TJV_CBOR_BREAK;
+        return p;
+    }
+
+    *error_ptr = "unsupported simple value";
+    return NULL;
+
+invalidIndefinite:
+
+    *error_ptr = "invalid indefinite length";
+    return NULL;
+
+unexpectedEnd:
+
+    *error_ptr = "unexpected end of data";
+    return NULL;
+
+}
+
+// Returns the next chunk of the string. A definite-length string has
+// a single chunk. The position should be NULL before the first chunk.
+// Returns 0 if there are no more chunks. The data is already checked.
+static int tjv_CborNextChunk(const tjv_CborItem *item, const unsigned char **pos_ptr, const unsigned char **chunk_ptr, Tcl_WideUInt *length_ptr) {
+
+    const unsigned char *p = *pos_ptr;
+
+    if (!item->is_indefinite) {
+        if (p != NULL) {
+            return 0;
+        }
+        *chunk_ptr = item->data;
+        *length_ptr = item->length;
+        *pos_ptr = item->data + item->length;
+        return 1;
+    }
+
+    if (p == NULL) {
+        p = item->data;
+    }
+
+    if (*p == 0xff) {
+        return 0;
+    }
+
+    int info = *p++ & 0x1f;
+    Tcl_WideUInt length;
+    if (info < 24) {
+        length = (Tcl_WideUInt)info;
+    } else {
+        int size = 1 << (info - 24);
+        length = tjv_CborReadUint(p, size);
+        p += size;
+    }
+
+    *chunk_ptr = p;
+    *length_ptr = length;
+    *pos_ptr = p + length;
+    return 1;
+
+}
+
+static inline int tjv_CborNeedsConversion(unsigned char c, int is_binary) {
+    return (c == 0 || (is_binary && c >= 0x80));
+}
+
+// Returns the length of the string in Tcl's UTF-8, or -1 if it can be used
+// in place.
+static Tcl_Size tjv_CborConvertedLength(const tjv_CborItem *item) {
+
+    int is_binary = (item->type == TJV_CBOR_BYTES);
+    Tcl_Size extra = 0;
+    const unsigned char *pos = NULL;
+    const unsigned char *chunk;
+    Tcl_WideUInt length;
+
+    while (tjv_CborNextChunk(item, &pos, &chunk, &length)) {
+        for (Tcl_WideUInt i = 0; i < length; i++) {
+            if (tjv_CborNeedsConversion(chunk[i], is_binary)) {
+                extra++;
+            }
+        }
+    }
+
+    return (extra == 0 && !item->is_indefinite ? -1 : (Tcl_Size)item->length + extra);
+
+}
+
+// Copies the string to out in Tcl's UTF-8 and adds NUL. Returns the position
+// after NUL.
+static char *tjv_CborConvert(char *out, const tjv_CborItem *item) {
+
+    int is_binary = (item->type == TJV_CBOR_BYTES);
+    const unsigned char *pos = NULL;
+    const unsigned char *chunk;
+    Tcl_WideUInt length;
+
+    while (tjv_CborNextChunk(item, &pos, &chunk, &length)) {
+        for (Tcl_WideUInt i = 0; i < length; i++) {
+            unsigned char c = chunk[i];
+            if (tjv_CborNeedsConversion(c, is_binary)) {
+                *out++ = (char)(0xc0 | (c >> 6));
+                *out++ = (char)(0x80 | (c & 0x3f));
+            } else {
+                *out++ = (char)c;
+            }
+        }
+    }
+
+    *out++ = '\0';
+    return out;
+
+}
+
+// Checks that each chunk of the text string is valid UTF-8
+static int tjv_CborIsValidText(const tjv_CborItem *item) {
+
+    const unsigned char *pos = NULL;
+    const unsigned char *chunk;
+    Tcl_WideUInt length;
+
+    while (tjv_CborNextChunk(item, &pos, &chunk, &length)) {
+        if (!tjv_Utf8Validate(chunk, (Tcl_Size)length, 0)) {
+            return 0;
+        }
+    }
+
+    return 1;
+
+}
+
+// Writes the JSON text of the number to out and returns its length
+static Tcl_Size tjv_CborFormatNumber(char *out, const tjv_CborItem *item) {
+    switch (item->type) {
+    case TJV_CBOR_UINT:
+        return snprintf(out, TJV_JSON_NUMBER_TEXT_SIZE, "%" TCL_LL_MODIFIER "u", item->number.u);
+    case TJV_CBOR_NEGINT:
+        // -1 - u can be less than the minimum of 64-bit integers
+        if (item->number.u == ~(Tcl_WideUInt)0) {
+            strcpy(out, "-18446744073709551616");
+            return 21;
+        }
+        return snprintf(out, TJV_JSON_NUMBER_TEXT_SIZE, "-%" TCL_LL_MODIFIER "u", item->number.u + 1);
+    default:
+        return tjv_JsonFormatDouble(out, item->number.d);
+    }
+}
+
+// Walks the data. If doc->values is NULL, only checks the data and counts
+// the values and the size of copied strings. Otherwise, builds the tree in
+// the storage of the document.
+static int tjv_CborWalk(tjv_JsonDocument *doc, const unsigned char *bytes, Tcl_Size length, Tcl_Size *values_count_ptr, Tcl_Size *strings_size_ptr) {
+
+    int rc = TCL_OK;
+    int is_build = (doc->values != NULL);
+
+    tjv_CborFrame frames_static[TJV_CBOR_STATIC_FRAMES];
+    tjv_CborFrame *frames = frames_static;
+    Tcl_Size frames_capacity = TJV_CBOR_STATIC_FRAMES;
+    Tcl_Size depth = 0;
+
+    const unsigned char *p = bytes;
+    const unsigned char *end = bytes + length;
+    Tcl_Size values_count = 0;
+    Tcl_Size strings_size = 0;
+    char *out = doc->strings;
+    const char *key = NULL;
+    Tcl_Size key_length = 0;
+    int is_tagged = 0;
+
+    if (length == 0) {
+        doc->error = "no value";
+        goto error;
+    }
+
+    for (;;) {
+
+        tjv_CborItem item;
+        const unsigned char *start = p;
+        Tcl_Size converted_length;
+
+        p = tjv_CborReadItem(p, end, &item, &doc->error);
+        if (p == NULL) {
+            p = start;
+            goto error;
+        }
+
+        if (item.type == TJV_CBOR_TAG) {
+            is_tagged = 1;
+            continue;
+        }
+
+        tjv_CborFrame *frame = (depth > 0 ? &frames[depth - 1] : NULL);
+
+        if (item.type == TJV_CBOR_BREAK) {
+            if (is_tagged || frame == NULL || !frame->is_indefinite || (frame->is_map && !frame->is_key)) {
+                doc->error = "unexpected break";
+                p = start;
+                goto error;
+            }
+            depth--;
+            goto close;
+        }
+
+        is_tagged = 0;
+
+        if (!is_build && item.type == TJV_CBOR_TEXT && !tjv_CborIsValidText(&item)) {
+            doc->error = "invalid UTF-8 string";
+            p = start;
+            goto error;
+        }
+
+        if (frame != NULL && frame->is_map && frame->is_key) {
+
+            // Map keys are always copied, as the validator expects them
+            // to be NUL-terminated
+            frame->is_key = 0;
+            if (!frame->is_indefinite) {
+                frame->remaining--;
+            }
+
+            switch (item.type) {
+            case TJV_CBOR_TEXT:
+            case TJV_CBOR_BYTES:
+                if (!is_build) {
+                    converted_length = tjv_CborConvertedLength(&item);
+                    strings_size += (converted_length == -1 ? (Tcl_Size)item.length : converted_length) + 1;
+                    continue;
+                }
+                key = out;
+                out = tjv_CborConvert(out, &item);
+                key_length = out - key - 1;
+                break;
+            case TJV_CBOR_UINT:
+            case TJV_CBOR_NEGINT:
+                if (!is_build) {
+                    strings_size += TJV_JSON_NUMBER_TEXT_SIZE;
+                    continue;
+                }
+                key = out;
+                key_length = tjv_CborFormatNumber(out, &item);
+                out += key_length + 1;
+                break;
+            default:
+                doc->error = "map key should be a string or an integer";
+                p = start;
+                goto error;
+            }
+
+            continue;
+
+        }
+
+        if (item.type == TJV_CBOR_FLOAT && !isfinite(item.number.d)) {
+            doc->error = "non-finite numbers are not supported";
+            p = start;
+            goto error;
+        }
+
+        values_count++;
+
+        if (frame != NULL) {
+            if (frame->is_map) {
+                frame->is_key = 1;
+            }
+            if (!frame->is_indefinite) {
+                frame->remaining--;
+            }
+        }
+
+        tjv_JsonValue *value = NULL;
+
+        if (!is_build) {
+
+            switch (item.type) {
+            case TJV_CBOR_UINT:
+            case TJV_CBOR_NEGINT:
+            case TJV_CBOR_FLOAT:
+                strings_size += TJV_JSON_NUMBER_TEXT_SIZE;
+                break;
+            case TJV_CBOR_TEXT:
+            case TJV_CBOR_BYTES:
+                converted_length = tjv_CborConvertedLength(&item);
+                if (converted_length != -1) {
+                    strings_size += converted_length + 1;
+                }
+                break;
+            default:
+                break;
+            }
+
+        } else {
+
+            value = &doc->values[values_count - 1];
+            value->next = NULL;
+            value->child = NULL;
+            value->count = 0;
+            value->key = key;
+            value->key_length = key_length;
+            value->str = NULL;
+            value->length = 0;
+            key = NULL;
+            key_length = 0;
+
+            if (frame == NULL) {
+                doc->root = value;
+            } else {
+                if (frame->last == NULL) {
+                    frame->container->child = value;
+                } else {
+                    frame->last->next = value;
+                }
+                frame->last = value;
+                frame->container->count++;
+            }
+
+            switch (item.type) {
+            case TJV_CBOR_NULL:
+                value->type = TJV_JSON_NULL;
+                break;
+            case TJV_CBOR_FALSE:
+                value->type = TJV_JSON_FALSE;
+                break;
+            case TJV_CBOR_TRUE:
+                value->type = TJV_JSON_TRUE;
+                break;
+            case TJV_CBOR_UINT:
+            case TJV_CBOR_NEGINT:
+            case TJV_CBOR_FLOAT:
+                value->type = TJV_JSON_NUMBER;
+                value->str = out;
+                value->length = tjv_CborFormatNumber(out, &item);
+                out += value->length + 1;
+                break;
+            case TJV_CBOR_TEXT:
+            case TJV_CBOR_BYTES:
+                value->type = TJV_JSON_STRING;
+                if (tjv_CborConvertedLength(&item) == -1) {
+                    value->str = (const char *)item.data;
+                    value->length = (Tcl_Size)item.length;
+                } else {
+                    value->str = out;
+                    out = tjv_CborConvert(out, &item);
+                    value->length = out - value->str - 1;
+                }
+                break;
+            case TJV_CBOR_ARRAY:
+                value->type = TJV_JSON_ARRAY;
+                break;
+            case TJV_CBOR_MAP:
+                value->type = TJV_JSON_OBJECT;
+                break;
+            case TJV_CBOR_TAG:
+            case TJV_CBOR_BREAK:
+                // Handled above
+                break;
+            }
+
+        }
+
+        if ((item.type == TJV_CBOR_ARRAY || item.type == TJV_CBOR_MAP) && (item.is_indefinite || item.length > 0)) {
+
+            if (depth == frames_capacity) {
+                frames_capacity *= 2;
+                if (frames == frames_static) {
+                    frames = ckalloc(sizeof(tjv_CborFrame) * frames_capacity);
+                    memcpy(frames, frames_static, sizeof(frames_static));
+                } else {
+                    frames = ckrealloc(frames, sizeof(tjv_CborFrame) * frames_capacity);
+                }
+            }
+
+            frames[depth].container = value;
+            frames[depth].last = NULL;
+            frames[depth].is_map = (item.type == TJV_CBOR_MAP);
+            frames[depth].is_indefinite = item.is_indefinite;
+            frames[depth].is_key = frames[depth].is_map;
+            frames[depth].remaining = (frames[depth].is_map ? item.length * 2 : item.length);
+            depth++;
+            continue;
+
+        }
+
+close:
+
+        // Close the definite-length containers that are complete.
+        // Indefinite-length ones are closed by break.
+        while (depth > 0 && !frames[depth - 1].is_indefinite && frames[depth - 1].remaining == 0) {
+            depth--;
+        }
+
+        if (depth == 0) {
+            break;
+        }
+
+    }
+
+    if (p != end) {
+        doc->error = "unexpected data after the value";
+        goto error;
+    }
+
+    *values_count_ptr = values_count;
+    *strings_size_ptr = strings_size;
+    goto done;
+
+error:
+
+    doc->error_offset = p - bytes;
+    rc = TCL_ERROR;
+
+done:
+
+    if (frames != frames_static) {
+        ckfree(frames);
+    }
+
+    return rc;
+
+}
+
+int tjv_CborParse(tjv_JsonDocument *doc, const unsigned char *bytes, Tcl_Size length) {
+
+    Tcl_Size values_count;
+    Tcl_Size strings_size;
+
+    memset(doc, 0, sizeof(tjv_JsonDocument));
+
+    DBG2(printf("enter; length: %" TCL_SIZE_MODIFIER "d", length));
+
+    if (tjv_CborWalk(doc, bytes, length, &values_count, &strings_size) != TCL_OK) {
+        DBG2(printf("return: error at %" TCL_SIZE_MODIFIER "d (%s)", doc->error_offset, doc->error));
+        return TCL_ERROR;
+    }
+
+    DBG2(printf("values: %" TCL_SIZE_MODIFIER "d strings: %" TCL_SIZE_MODIFIER "d", values_count, strings_size));
+
+    doc->values = ckalloc(sizeof(tjv_JsonValue) * values_count);
+    // Strings can be empty, but ckalloc() needs a non-zero size
+    doc->strings = ckalloc(strings_size + 1);
+
+    // The data has been checked already, the second pass can't fail
+    tjv_CborWalk(doc, bytes, length, &values_count, &strings_size);
+
+    DBG2(printf("return: ok"));
+    return TCL_OK;
+
+}
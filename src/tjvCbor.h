@@ -0,0 +1,28 @@
+/**
+ * Copyright Jerily LTD. All Rights Reserved.
+ * SPDX-FileCopyrightText: 2024 Neofytos Dimitriou (neo@jerily.cy)
+ * SPDX-License-Identifier: MIT.
+ */
+#ifndef TJV_CBOR_H
+#define TJV_CBOR_H
+
+#include "common.h"
+#include "tjvJson.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Decodes a CBOR data item (RFC 8949) to the same document as tjv_JsonParse()
+// does for JSON text, so it is validated by the JSON frontend. Strings point
+// to the bytes, which should be valid as long as the document is used. Only
+// map keys, numbers, indefinite-length strings and strings that need
+// conversion to Tcl's UTF-8 are copied. On error, doc->error and
+// doc->error_offset describe it.
+int tjv_CborParse(tjv_JsonDocument *doc, const unsigned char *bytes, Tcl_Size length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TJV_CBOR_H
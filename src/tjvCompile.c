@@ -105,6 +105,10 @@ const char *tjv_GetValidationTypeString(tjv_ValidationElementTypeEx type_ex) {
         return "boolean";
     case TJV_VALIDATION_EX_DOUBLE:
         return "double";
+    case TJV_VALIDATION_EX_UNION:
+        return "union";
+    case TJV_VALIDATION_EX_FORM:
+        return "form";
     case TJV_VALIDATION_EX_EMAIL:
     case TJV_VALIDATION_EX_DURATION:
     case TJV_VALIDATION_EX_URI:
@@ -122,6 +126,64 @@ const char *tjv_GetValidationTypeString(tjv_ValidationElementTypeEx type_ex) {
     return NULL;
 }
 
+Tcl_Obj *tjv_GetUnionTypeString(tjv_ValidationElement *ve) {
+
+    const char **names = ckalloc(sizeof(const char *) * ve->opts.union_type.count);
+    Tcl_Size count = 0;
+
+    // Each type is listed once
+    for (Tcl_Size i = 0; i < ve->opts.union_type.count; i++) {
+        const char *name = tjv_GetValidationTypeString(ve->opts.union_type.elements[i]->type_ex);
+        Tcl_Size j = 0;
+        while (j < count && strcmp(names[j], name) != 0) {
+            j++;
+        }
+        if (j == count) {
+            names[count++] = name;
+        }
+    }
+
+    Tcl_Obj *rc = Tcl_NewStringObj(names[0], -1);
+    for (Tcl_Size i = 1; i < count; i++) {
+        Tcl_AppendStringsToObj(rc, (i == count - 1 ? " or " : ", "), names[i], (const char *)NULL);
+    }
+
+    ckfree(names);
+    return rc;
+
+}
+
+static tjv_ValidationElement *tjv_ValidationCompileElement(Tcl_Interp *interp, tjv_ValidationDefinitions *defs,
+    Tcl_Size objc, Tcl_Obj *const objv[], Tcl_Obj **rest_arg1, Tcl_Obj **rest_arg2);
+
+static void tjv_ValidationDefinitionsFree(tjv_ValidationDefinitions *defs) {
+
+    DBG2(printf("enter: defs: %p", (void *)defs));
+
+    Tcl_HashSearch search;
+    for (Tcl_HashEntry *entry = Tcl_FirstHashEntry(&defs->table, &search); entry != NULL;
+        entry = Tcl_NextHashEntry(&search))
+    {
+        tjv_ValidationDefinition *def = Tcl_GetHashValue(entry);
+        if (def->element != NULL) {
+            tjv_ValidationElementFree(def->element);
+        }
+        Tcl_DecrRefCount(def->name);
+        ckfree(def);
+    }
+
+    Tcl_DeleteHashTable(&defs->table);
+
+    if (defs->refs != NULL) {
+        ckfree(defs->refs);
+    }
+
+    ckfree(defs);
+
+    DBG2(printf("return: ok"));
+
+}
+
 static tjv_ValidationElement *tjv_ValidationElementAlloc(tjv_ValidationElementTypeEx type) {
 
     tjv_ValidationElement *rc = ckalloc(sizeof(tjv_ValidationElement));
@@ -148,6 +210,18 @@ void tjv_ValidationElementFree(tjv_ValidationElement *ve) {
     if (ve->outkey != NULL) {
         Tcl_DecrRefCount(ve->outkey);
     }
+    if (ve->default_value != NULL) {
+        Tcl_DecrRefCount(ve->default_value);
+    }
+    if (ve->definitions != NULL) {
+        tjv_ValidationDefinitionsFree(ve->definitions);
+    }
+
+    // The options of a reference belong to its definition
+    if (ve->definition != NULL) {
+        DBG2(printf("element is a reference"));
+        goto done;
+    }
 
     // A json can be defined as an array or an object. We need to change the ve
     // type to match the json type to properly release the children.
@@ -161,6 +235,10 @@ void tjv_ValidationElementFree(tjv_ValidationElement *ve) {
             DBG2(printf("set json type as an array"));
             ve->type = TJV_VALIDATION_ARRAY;
             break;
+        case TJV_FLAG_JSON_TYPE_UNION:
+            DBG2(printf("set json type as a union"));
+            ve->type = TJV_VALIDATION_UNION;
+            break;
         case TJV_FLAG_NONE:
         case TJV_FLAG_SKIP_KEY:
             break;
@@ -172,6 +250,15 @@ void tjv_ValidationElementFree(tjv_ValidationElement *ve) {
         if (ve->opts.str_type.pattern != NULL) {
             Tcl_DecrRefCount(ve->opts.str_type.pattern);
         }
+        if (ve->opts.str_type.set != NULL) {
+            tjv_StringSetFree(ve->opts.str_type.set);
+        }
+        if (ve->opts.str_type.automaton != NULL) {
+            tjv_AutomatonFree(ve->opts.str_type.automaton);
+        }
+        if (ve->opts.str_type.glob != NULL) {
+            tjv_GlobFree(ve->opts.str_type.glob);
+        }
         break;
     case TJV_VALIDATION_INTEGER:
         break;
@@ -187,6 +274,15 @@ void tjv_ValidationElementFree(tjv_ValidationElement *ve) {
         if (ve->opts.obj_type.keys_list != NULL) {
             Tcl_DecrRefCount(ve->opts.obj_type.keys_list);
         }
+        if (ve->opts.obj_type.key_index != NULL) {
+            tjv_StringSetFree(ve->opts.obj_type.key_index);
+        }
+        if (ve->opts.obj_type.required_bits != NULL) {
+            ckfree(ve->opts.obj_type.required_bits);
+        }
+        if (ve->opts.obj_type.json_key_index != NULL) {
+            tjv_StringSetFree(ve->opts.obj_type.json_key_index);
+        }
         break;
     case TJV_VALIDATION_ARRAY:
         if (ve->opts.array_type.element != NULL) {
@@ -197,15 +293,115 @@ void tjv_ValidationElementFree(tjv_ValidationElement *ve) {
         break;
     case TJV_VALIDATION_DOUBLE:
         break;
+    case TJV_VALIDATION_UNION:
+        if (ve->opts.union_type.elements != NULL) {
+            for (Tcl_Size i = 0; i < ve->opts.union_type.count; i++) {
+                if (ve->opts.union_type.elements[i] != NULL) {
+                    tjv_ValidationElementFree(ve->opts.union_type.elements[i]);
+                }
+            }
+            ckfree(ve->opts.union_type.elements);
+        }
+        if (ve->opts.union_type.discriminator != NULL) {
+            Tcl_DecrRefCount(ve->opts.union_type.discriminator);
+        }
+        if (ve->opts.union_type.tags_list != NULL) {
+            Tcl_DecrRefCount(ve->opts.union_type.tags_list);
+        }
+        if (ve->opts.union_type.tag_index != NULL) {
+            tjv_StringSetFree(ve->opts.union_type.tag_index);
+        }
+        break;
     }
 
+done:
+
     ckfree(ve);
 
     DBG2(printf("return: ok"));
 
 }
 
-static int tjv_ValidationCompileItems(Tcl_Interp *interp, Tcl_Obj *data, tjv_ValidationElement *ve) {
+void tjv_ValidationWarnings(tjv_ValidationElement *ve, Tcl_Obj *prefix, Tcl_Obj *list) {
+
+    // The warnings for definitions are reported only once, with their
+    // names, and not for each reference.
+    if (ve->definitions != NULL) {
+        Tcl_Obj *definitions_prefix = Tcl_NewStringObj("definitions", -1);
+        Tcl_IncrRefCount(definitions_prefix);
+        Tcl_HashSearch search;
+        for (Tcl_HashEntry *entry = Tcl_FirstHashEntry(&ve->definitions->table, &search); entry != NULL;
+            entry = Tcl_NextHashEntry(&search))
+        {
+            tjv_ValidationDefinition *def = Tcl_GetHashValue(entry);
+            tjv_ValidationWarnings(def->element, definitions_prefix, list);
+        }
+        Tcl_DecrRefCount(definitions_prefix);
+    }
+
+    if (ve->definition != NULL) {
+        return;
+    }
+
+    // Array elements have an empty stub as their key, and they are reported
+    // with the prefix of their array.
+    Tcl_Obj *path = prefix;
+    if (ve->key != NULL && Tcl_GetCharLength(ve->key) > 0) {
+        path = (prefix == NULL ? ve->key :
+            Tcl_ObjPrintf("%s->%s", Tcl_GetString(prefix), Tcl_GetString(ve->key)));
+    }
+    if (path != NULL) {
+        Tcl_IncrRefCount(path);
+    }
+
+    tjv_ValidationElementType type = ve->type;
+    if (type == TJV_VALIDATION_JSON) {
+        type = (ve->flag == TJV_FLAG_JSON_TYPE_OBJECT ? TJV_VALIDATION_OBJECT :
+            (ve->flag == TJV_FLAG_JSON_TYPE_ARRAY ? TJV_VALIDATION_ARRAY :
+            (ve->flag == TJV_FLAG_JSON_TYPE_UNION ? TJV_VALIDATION_UNION : TJV_VALIDATION_JSON)));
+    }
+
+    switch (type) {
+    case TJV_VALIDATION_STRING:
+        if (ve->opts.str_type.fallback_reason != NULL) {
+            Tcl_Obj *message = Tcl_ObjPrintf("regexp pattern \"%s\" is not supported"
+                " by the dfa engine (%s), the tcl engine is used",
+                Tcl_GetString(ve->opts.str_type.pattern), ve->opts.str_type.fallback_reason);
+            if (path != NULL) {
+                message = Tcl_ObjPrintf("%s->%s", Tcl_GetString(path), Tcl_GetString(message));
+            }
+            Tcl_ListObjAppendElement(NULL, list, message);
+        }
+        break;
+    case TJV_VALIDATION_OBJECT:
+        for (Tcl_Size i = 0; i < ve->opts.obj_type.keys_objc; i++) {
+            tjv_ValidationWarnings(ve->opts.obj_type.elements[i], path, list);
+        }
+        break;
+    case TJV_VALIDATION_ARRAY:
+        if (ve->opts.array_type.element != NULL) {
+            tjv_ValidationWarnings(ve->opts.array_type.element, path, list);
+        }
+        break;
+    case TJV_VALIDATION_UNION:
+        for (Tcl_Size i = 0; i < ve->opts.union_type.count; i++) {
+            tjv_ValidationWarnings(ve->opts.union_type.elements[i], path, list);
+        }
+        break;
+    case TJV_VALIDATION_JSON:
+    case TJV_VALIDATION_INTEGER:
+    case TJV_VALIDATION_BOOLEAN:
+    case TJV_VALIDATION_DOUBLE:
+        break;
+    }
+
+    if (path != NULL) {
+        Tcl_DecrRefCount(path);
+    }
+
+}
+
+static int tjv_ValidationCompileItems(Tcl_Interp *interp, tjv_ValidationDefinitions *defs, Tcl_Obj *data, tjv_ValidationElement *ve) {
 
     DBG2(printf("enter"));
 
@@ -227,7 +423,7 @@ static int tjv_ValidationCompileItems(Tcl_Interp *interp, Tcl_Obj *data, tjv_Val
     // for errors here.
     Tcl_ListObjGetElements(NULL, items_format, &items_objc, &items_objv);
 
-    tjv_ValidationElement *element = tjv_ValidationCompile(interp, items_objc, items_objv, NULL, NULL);
+    tjv_ValidationElement *element = tjv_ValidationCompileElement(interp, defs, items_objc, items_objv, NULL, NULL);
     Tcl_BounceRefCount(items_format);
 
     if (element == NULL) {
@@ -246,7 +442,7 @@ static int tjv_ValidationCompileItems(Tcl_Interp *interp, Tcl_Obj *data, tjv_Val
 
 }
 
-static int tjv_ValidationCompileProperties(Tcl_Interp *interp, Tcl_Obj *data, tjv_ValidationElement *ve) {
+static int tjv_ValidationCompileProperties(Tcl_Interp *interp, tjv_ValidationDefinitions *defs, Tcl_Obj *data, tjv_ValidationElement *ve) {
 
     DBG2(printf("enter"));
 
@@ -296,7 +492,7 @@ static int tjv_ValidationCompileProperties(Tcl_Interp *interp, Tcl_Obj *data, tj
         const char *key_name = Tcl_GetString(child_objv[0]);
 
         DBG2(printf("parse property: [%s]", key_name));
-        elements[i] = tjv_ValidationCompile(interp, child_objc, child_objv, NULL, NULL);
+        elements[i] = tjv_ValidationCompileElement(interp, defs, child_objc, child_objv, NULL, NULL);
         if (elements[i] == NULL) {
 
             DBG2(printf("return: error (failed to parse element #%" TCL_SIZE_MODIFIER "d [%s]: %s",
@@ -313,6 +509,470 @@ static int tjv_ValidationCompileProperties(Tcl_Interp *interp, Tcl_Obj *data, tj
         Tcl_ListObjGetElements(NULL, keys_list, &ve->opts.obj_type.keys_objc, &ve->opts.obj_type.keys_objv);
     }
 
+    // Build the index of keys and the bitmap of required keys. They are used
+    // to validate small dicts against large schemas in one pass over the dict.
+    // This is only possible if all keys are unique, because each dict key
+    // can correspond to only one element then. The index is also used to find
+    // unknown keys.
+
+    ve->opts.obj_type.key_index = tjv_StringSetCreate(ve->opts.obj_type.keys_objc,
+        ve->opts.obj_type.keys_objv, 0);
+
+    if (ve->opts.obj_type.key_index->count != ve->opts.obj_type.keys_objc) {
+        DBG2(printf("keys are not unique, the bitmap of required keys is not used"));
+    } else {
+        size_t bitmap_size = sizeof(uint64_t) * TJV_BITMAP_WORDS(ve->opts.obj_type.keys_objc);
+        ve->opts.obj_type.required_bits = ckalloc(bitmap_size);
+        memset(ve->opts.obj_type.required_bits, 0, bitmap_size);
+        for (Tcl_Size i = 0; i < ve->opts.obj_type.keys_objc; i++) {
+            if (elements[i]->is_required) {
+                ve->opts.obj_type.required_bits[i / 64] |= (uint64_t)1 << (i % 64);
+            }
+        }
+    }
+
+    for (Tcl_Size i = 0; i < ve->opts.obj_type.keys_objc; i++) {
+        if (elements[i]->default_value != NULL) {
+            ve->opts.obj_type.is_default_defined = 1;
+            break;
+        }
+    }
+
+    DBG2(printf("return: ok"));
+    return TCL_OK;
+
+}
+
+// Compiles the variants of a union. The variants with tags (-variants) are
+// specified in the same way as object properties, where the tag is used
+// instead of the key. The variants without tags (-anyOf and -oneOf) are
+// specified as a list of schemas.
+static int tjv_ValidationCompileUnion(Tcl_Interp *interp, tjv_ValidationDefinitions *defs, Tcl_Obj *opt_discriminator,
+    Tcl_Obj *opt_variants, Tcl_Obj *opt_any_of, Tcl_Obj *opt_one_of, tjv_ValidationElement *ve)
+{
+
+    DBG2(printf("enter"));
+
+    const struct {
+        const char *name;
+        Tcl_Obj *value;
+    } variant_options[] = {
+        { "-variants", opt_variants },
+        { "-anyOf",    opt_any_of   },
+        { "-oneOf",    opt_one_of   }
+    };
+
+    const char *option = NULL;
+    Tcl_Obj *data = NULL;
+    for (size_t i = 0; i < sizeof(variant_options) / sizeof(variant_options[0]); i++) {
+        if (variant_options[i].value == NULL) {
+            continue;
+        }
+        if (option != NULL) {
+            DBG2(printf("return: error (both %s and %s are defined)", option, variant_options[i].name));
+            Tcl_SetObjResult(interp, Tcl_ObjPrintf("both options %s and %s are specified,"
+                " only one of them can be specified", option, variant_options[i].name));
+            return TCL_ERROR;
+        }
+        option = variant_options[i].name;
+        data = variant_options[i].value;
+    }
+
+    if (opt_variants != NULL && opt_discriminator == NULL) {
+        DBG2(printf("return: error (-variants without -discriminator)"));
+        SetResult("option -variants is specified, but -discriminator is missing");
+        return TCL_ERROR;
+    }
+
+    if (opt_discriminator != NULL && opt_variants == NULL) {
+        DBG2(printf("return: error (-discriminator without -variants)"));
+        SetResult("option -discriminator is specified, but -variants is missing");
+        return TCL_ERROR;
+    }
+
+    if (option == NULL) {
+        DBG2(printf("return: error (no variants)"));
+        SetResult("one of options -variants, -anyOf or -oneOf is required for type \"union\"");
+        return TCL_ERROR;
+    }
+
+    Tcl_Size count;
+    if (Tcl_ListObjLength(interp, data, &count) != TCL_OK) {
+        DBG2(printf("return: error (%s is not a list)", option));
+        return TCL_ERROR;
+    }
+
+    DBG2(printf("%s: %" TCL_SIZE_MODIFIER "d variant(s)", option, count));
+
+    if (count == 0) {
+        DBG2(printf("return: error (no variants in %s)", option));
+        Tcl_SetObjResult(interp, Tcl_ObjPrintf("option %s should contain at least one variant", option));
+        return TCL_ERROR;
+    }
+
+    ve->opts.union_type.elements = ckalloc(sizeof(tjv_ValidationElement *) * count);
+    memset(ve->opts.union_type.elements, 0, sizeof(tjv_ValidationElement *) * count);
+    ve->opts.union_type.count = count;
+    ve->opts.union_type.is_one_of = (opt_one_of != NULL);
+
+    if (opt_discriminator != NULL) {
+        DBG2(printf("discriminator: [%s]", Tcl_GetString(opt_discriminator)));
+        ve->opts.union_type.discriminator = opt_discriminator;
+        Tcl_IncrRefCount(ve->opts.union_type.discriminator);
+        ve->opts.union_type.tags_list = Tcl_NewListObj(0, NULL);
+        Tcl_IncrRefCount(ve->opts.union_type.tags_list);
+    }
+
+    for (Tcl_Size i = 0; i < count; i++) {
+
+        Tcl_Obj *variant;
+        Tcl_ListObjIndex(NULL, data, i, &variant);
+
+        // The variants without tags get an empty stub as their key, the same
+        // as array elements
+        Tcl_Obj *format = variant;
+        if (opt_discriminator == NULL) {
+            Tcl_Obj *key_stub = Tcl_NewStringObj("", -1);
+            format = Tcl_DuplicateObj(variant);
+            if (Tcl_ListObjReplace(NULL, format, 0, 0, 1, &key_stub) != TCL_OK) {
+                Tcl_BounceRefCount(format);
+                Tcl_BounceRefCount(key_stub);
+                format = NULL;
+            }
+        }
+
+        Tcl_Size format_objc;
+        Tcl_Obj **format_objv;
+        if (format == NULL || Tcl_ListObjGetElements(NULL, format, &format_objc, &format_objv) != TCL_OK) {
+            Tcl_SetObjResult(interp, Tcl_ObjPrintf("variant #%" TCL_SIZE_MODIFIER "d"
+                " is malformed", i));
+            DBG2(printf("return: error (variant #%" TCL_SIZE_MODIFIER "d is not a list", i));
+            return TCL_ERROR;
+        }
+        if (format_objc < 1) {
+            Tcl_SetObjResult(interp, Tcl_ObjPrintf("variant #%" TCL_SIZE_MODIFIER "d"
+                " is an empty list", i));
+            DBG2(printf("return: error (variant #%" TCL_SIZE_MODIFIER "d is an empty list", i));
+            return TCL_ERROR;
+        }
+
+        tjv_ValidationElement *element = tjv_ValidationCompileElement(interp, defs, format_objc, format_objv, NULL, NULL);
+
+        if (element == NULL) {
+            DBG2(printf("return: error (failed to compile variant #%" TCL_SIZE_MODIFIER "d: %s",
+                i, Tcl_GetStringResult(interp)));
+            if (opt_discriminator == NULL) {
+                Tcl_SetObjResult(interp, Tcl_ObjPrintf("#%" TCL_SIZE_MODIFIER "d->%s", i,
+                    Tcl_GetStringResult(interp)));
+                Tcl_BounceRefCount(format);
+            } else {
+                Tcl_SetObjResult(interp, Tcl_ObjPrintf("%s->%s", Tcl_GetString(format_objv[0]),
+                    Tcl_GetStringResult(interp)));
+            }
+            return TCL_ERROR;
+        }
+
+        if (opt_discriminator == NULL) {
+            Tcl_BounceRefCount(format);
+        } else {
+            Tcl_ListObjAppendElement(NULL, ve->opts.union_type.tags_list, element->key);
+        }
+
+        ve->opts.union_type.elements[i] = element;
+
+    }
+
+    if (opt_discriminator == NULL) {
+        DBG2(printf("return: ok"));
+        return TCL_OK;
+    }
+
+    // Build the index of tags. Each tag should select only one variant.
+
+    Tcl_Size tags_objc;
+    Tcl_Obj **tags_objv;
+    Tcl_ListObjGetElements(NULL, ve->opts.union_type.tags_list, &tags_objc, &tags_objv);
+
+    ve->opts.union_type.tag_index = tjv_StringSetCreate(tags_objc, tags_objv, 0);
+
+    if (ve->opts.union_type.tag_index->count != tags_objc) {
+        for (Tcl_Size i = 0; i < tags_objc; i++) {
+            Tcl_Size length;
+            const char *str = Tcl_GetStringFromObj(tags_objv[i], &length);
+            if (tjv_StringSetFind(ve->opts.union_type.tag_index, str, length) != i) {
+                DBG2(printf("return: error (duplicate tag [%s])", str));
+                Tcl_SetObjResult(interp, Tcl_ObjPrintf("variant \"%s\" is specified"
+                    " more than once", str));
+                return TCL_ERROR;
+            }
+        }
+    }
+
+    DBG2(printf("return: ok"));
+    return TCL_OK;
+
+}
+
+static int tjv_ValidationCompileAdditional(Tcl_Interp *interp, Tcl_Obj *data, tjv_ValidationElement *ve) {
+
+    static const struct {
+        const char *additional_name;
+        tjv_ValidationAdditionalType additional;
+    } additional_name_map[] = {
+        { "allow", TJV_ADDITIONAL_ALLOW },
+        { "deny",  TJV_ADDITIONAL_DENY  },
+        { "strip", TJV_ADDITIONAL_STRIP },
+        { NULL }
+    };
+
+    DBG2(printf("enter"));
+
+    int idx;
+    if (Tcl_GetIndexFromObjStruct(interp, data, additional_name_map,
+        sizeof(additional_name_map[0]), "additional mode", 0, &idx) != TCL_OK)
+    {
+        DBG2(printf("return: error (wrong -additional: [%s])", Tcl_GetString(data)));
+        return TCL_ERROR;
+    }
+
+    ve->opts.obj_type.additional = additional_name_map[idx].additional;
+    DBG2(printf("additional mode: %s", additional_name_map[idx].additional_name));
+
+    // JSON object members are matched to keys ignoring the case of ASCII
+    // letters. So, a separate index is needed to find unknown members.
+    if (ve->opts.obj_type.additional != TJV_ADDITIONAL_ALLOW && ve->opts.obj_type.keys_objc > 0) {
+        ve->opts.obj_type.json_key_index = tjv_StringSetCreate(ve->opts.obj_type.keys_objc,
+            ve->opts.obj_type.keys_objv, TJV_STRING_SET_NOCASE_ASCII);
+    }
+
+    DBG2(printf("return: ok"));
+    return TCL_OK;
+
+}
+
+// Parses the limits specified by a pair of options such as -minItems and
+// -maxItems. The minimum is 0 if it is not specified.
+static int tjv_ValidationCompileLimits(Tcl_Interp *interp, const char *min_option, Tcl_Obj *min_obj,
+    const char *max_option, Tcl_Obj *max_obj, Tcl_Size *min_ptr, Tcl_Size *max_ptr, int *is_max_defined_ptr)
+{
+
+    const char *option[2] = { min_option, max_option };
+    Tcl_Obj *obj[2] = { min_obj, max_obj };
+    Tcl_Size *value_ptr[2] = { min_ptr, max_ptr };
+
+    for (int i = 0; i < 2; i++) {
+        if (obj[i] == NULL) {
+            continue;
+        }
+        if (Tcl_GetSizeIntFromObj(interp, obj[i], value_ptr[i]) != TCL_OK) {
+            DBG2(printf("return: ERROR (wrong %s value: [%s])", option[i], Tcl_GetString(obj[i])));
+            return TCL_ERROR;
+        }
+        if (*value_ptr[i] < 0) {
+            DBG2(printf("return: ERROR (negative %s value: [%s])", option[i], Tcl_GetString(obj[i])));
+            Tcl_SetObjResult(interp, Tcl_ObjPrintf("option %s must be a non-negative integer,"
+                " but got \"%s\"", option[i], Tcl_GetString(obj[i])));
+            return TCL_ERROR;
+        }
+        DBG2(printf("%s: %" TCL_SIZE_MODIFIER "d", option[i], *value_ptr[i]));
+    }
+
+    if (max_obj != NULL) {
+        *is_max_defined_ptr = 1;
+        if (*min_ptr > *max_ptr) {
+            DBG2(printf("return: ERROR (%s is greater than %s)", min_option, max_option));
+            Tcl_SetObjResult(interp, Tcl_ObjPrintf("option %s is greater than option %s",
+                min_option, max_option));
+            return TCL_ERROR;
+        }
+    }
+
+    return TCL_OK;
+
+}
+
+// Compiles the definitions specified as a dict of names and schemas. All names
+// are registered before the schemas are compiled, so the schemas can refer
+// to any definition, including themselves.
+static int tjv_ValidationCompileDefinitions(Tcl_Interp *interp, Tcl_Obj *data, tjv_ValidationElement *ve) {
+
+    DBG2(printf("enter"));
+
+    Tcl_Size size;
+    if (Tcl_DictObjSize(interp, data, &size) != TCL_OK) {
+        DBG2(printf("return: error (definitions are not a dict)"));
+        return TCL_ERROR;
+    }
+
+    tjv_ValidationDefinitions *defs = ckalloc(sizeof(tjv_ValidationDefinitions));
+    memset(defs, 0, sizeof(tjv_ValidationDefinitions));
+    Tcl_InitObjHashTable(&defs->table);
+    ve->definitions = defs;
+
+    Tcl_DictSearch search;
+    Tcl_Obj *name, *schema;
+    int is_done;
+
+    Tcl_DictObjFirst(NULL, data, &search, &name, &schema, &is_done);
+    for (; !is_done; Tcl_DictObjNext(&search, &name, &schema, &is_done)) {
+        DBG2(printf("register definition: [%s]", Tcl_GetString(name)));
+        tjv_ValidationDefinition *def = ckalloc(sizeof(tjv_ValidationDefinition));
+        memset(def, 0, sizeof(tjv_ValidationDefinition));
+        def->name = name;
+        Tcl_IncrRefCount(def->name);
+        int is_new;
+        Tcl_HashEntry *entry = Tcl_CreateHashEntry(&defs->table, (char *)name, &is_new);
+        Tcl_SetHashValue(entry, def);
+    }
+    Tcl_DictObjDone(&search);
+
+    Tcl_HashSearch hash_search;
+    for (Tcl_HashEntry *entry = Tcl_FirstHashEntry(&defs->table, &hash_search); entry != NULL;
+        entry = Tcl_NextHashEntry(&hash_search))
+    {
+
+        tjv_ValidationDefinition *def = Tcl_GetHashValue(entry);
+        const char *def_name = Tcl_GetString(def->name);
+        DBG2(printf("compile definition: [%s]", def_name));
+
+        Tcl_DictObjGet(NULL, data, def->name, &schema);
+
+        // The definition name is used as the key of its element in the same
+        // way as for object properties
+        Tcl_Obj *format = Tcl_DuplicateObj(schema);
+        if (Tcl_ListObjReplace(interp, format, 0, 0, 1, &def->name) != TCL_OK) {
+            DBG2(printf("return: error (definition [%s] is not a list)", def_name));
+            Tcl_BounceRefCount(format);
+            Tcl_SetObjResult(interp, Tcl_ObjPrintf("definitions->%s->%s", def_name, Tcl_GetStringResult(interp)));
+            return TCL_ERROR;
+        }
+
+        Tcl_Size format_objc;
+        Tcl_Obj **format_objv;
+        Tcl_ListObjGetElements(NULL, format, &format_objc, &format_objv);
+
+        def->element = tjv_ValidationCompileElement(interp, defs, format_objc, format_objv, NULL, NULL);
+        Tcl_BounceRefCount(format);
+
+        if (def->element == NULL) {
+            DBG2(printf("return: error (failed to compile definition [%s])", def_name));
+            Tcl_SetObjResult(interp, Tcl_ObjPrintf("definitions->%s->%s", def_name, Tcl_GetStringResult(interp)));
+            return TCL_ERROR;
+        }
+
+    }
+
+    DBG2(printf("return: ok"));
+    return TCL_OK;
+
+}
+
+// Makes ve use the type and the options of the definition element src
+static inline void tjv_ValidationCopyDefinition(tjv_ValidationElement *ve, tjv_ValidationElement *src) {
+    // Array elements skip their key unless they are arrays themselves,
+    // the same as in tjv_ValidationCompileItems().
+    if (ve->flag != TJV_FLAG_SKIP_KEY || src->type == TJV_VALIDATION_ARRAY) {
+        ve->flag = src->flag;
+    }
+    ve->type = src->type;
+    ve->type_ex = src->type_ex;
+    ve->is_coerce = src->is_coerce;
+    ve->opts = src->opts;
+}
+
+// Resolves the definition if it is a reference to another definition.
+// References can form a chain, and all definitions in the chain get
+// the options of the last one. The chain is followed without recursion.
+static int tjv_ValidationResolveDefinition(Tcl_Interp *interp, tjv_ValidationDefinition *def) {
+
+    tjv_ValidationDefinition *last = def;
+    while (last->state == TJV_DEFINITION_UNRESOLVED && last->element->definition != NULL) {
+        last->state = TJV_DEFINITION_RESOLVING;
+        last = last->element->definition;
+    }
+
+    if (last->state == TJV_DEFINITION_RESOLVING) {
+        DBG2(printf("return: error (definition [%s] refers to itself)", Tcl_GetString(last->name)));
+        Tcl_SetObjResult(interp, Tcl_ObjPrintf("definition \"%s\" refers to itself",
+            Tcl_GetString(last->name)));
+        return TCL_ERROR;
+    }
+
+    last->state = TJV_DEFINITION_RESOLVED;
+
+    while (def->state == TJV_DEFINITION_RESOLVING) {
+        DBG2(printf("definition [%s] is resolved as [%s]", Tcl_GetString(def->name), Tcl_GetString(last->name)));
+        tjv_ValidationCopyDefinition(def->element, last->element);
+        def->state = TJV_DEFINITION_RESOLVED;
+        def = def->element->definition;
+    }
+
+    return TCL_OK;
+
+}
+
+// Checks that a union doesn't refer to itself through its variants, without
+// a nested value in between. Validation of such a union would never end.
+static int tjv_ValidationCheckUnion(Tcl_Interp *interp, tjv_ValidationElement *ve) {
+
+    if (!(ve->type == TJV_VALIDATION_UNION ||
+        (ve->type == TJV_VALIDATION_JSON && ve->flag == TJV_FLAG_JSON_TYPE_UNION)))
+    {
+        return TCL_OK;
+    }
+
+    tjv_ValidationDefinition *def = ve->definition;
+    if (def != NULL) {
+        if (def->union_state == TJV_DEFINITION_VISITED) {
+            return TCL_OK;
+        }
+        if (def->union_state == TJV_DEFINITION_VISITING) {
+            DBG2(printf("return: error (definition [%s] is a union that refers to itself)", Tcl_GetString(def->name)));
+            Tcl_SetObjResult(interp, Tcl_ObjPrintf("definition \"%s\" refers to itself"
+                " through the variants of a union", Tcl_GetString(def->name)));
+            return TCL_ERROR;
+        }
+        def->union_state = TJV_DEFINITION_VISITING;
+    }
+
+    for (Tcl_Size i = 0; i < ve->opts.union_type.count; i++) {
+        if (tjv_ValidationCheckUnion(interp, ve->opts.union_type.elements[i]) != TCL_OK) {
+            return TCL_ERROR;
+        }
+    }
+
+    if (def != NULL) {
+        def->union_state = TJV_DEFINITION_VISITED;
+    }
+
+    return TCL_OK;
+
+}
+
+static int tjv_ValidationResolveReferences(Tcl_Interp *interp, tjv_ValidationDefinitions *defs) {
+
+    DBG2(printf("enter: %" TCL_SIZE_MODIFIER "d reference(s)", defs->refs_count));
+
+    for (Tcl_Size i = 0; i < defs->refs_count; i++) {
+        tjv_ValidationElement *ref = defs->refs[i];
+        if (tjv_ValidationResolveDefinition(interp, ref->definition) != TCL_OK) {
+            return TCL_ERROR;
+        }
+        tjv_ValidationCopyDefinition(ref, ref->definition->element);
+    }
+
+    // Only references can make a union refer to itself, and all references
+    // are reachable from the definitions
+    Tcl_HashSearch search;
+    for (Tcl_HashEntry *entry = Tcl_FirstHashEntry(&defs->table, &search); entry != NULL;
+        entry = Tcl_NextHashEntry(&search))
+    {
+        tjv_ValidationDefinition *def = Tcl_GetHashValue(entry);
+        if (tjv_ValidationCheckUnion(interp, def->element) != TCL_OK) {
+            return TCL_ERROR;
+        }
+    }
+
     DBG2(printf("return: ok"));
     return TCL_OK;
 
@@ -328,7 +988,9 @@ static int copy_arg(void *clientData, Tcl_Obj *objPtr, void *dstPtr) {
     return 1;
 }
 
-tjv_ValidationElement *tjv_ValidationCompile(Tcl_Interp *interp, Tcl_Size objc, Tcl_Obj *const objv[], Tcl_Obj **rest_arg1, Tcl_Obj **rest_arg2) {
+static tjv_ValidationElement *tjv_ValidationCompileElement(Tcl_Interp *interp, tjv_ValidationDefinitions *defs,
+    Tcl_Size objc, Tcl_Obj *const objv[], Tcl_Obj **rest_arg1, Tcl_Obj **rest_arg2)
+{
 
     DBG2(printf("enter: objc: %d", objc));
 
@@ -339,14 +1001,32 @@ tjv_ValidationElement *tjv_ValidationCompile(Tcl_Interp *interp, Tcl_Size objc,
     Tcl_Obj *opt_type = NULL;
     int opt_is_required = 0;
     int opt_is_nullable = 0;
+    int opt_is_coerce = 0;
+    int opt_is_preserve = 0;
     Tcl_Obj *opt_command = NULL;
     Tcl_Obj *opt_match = NULL;
     Tcl_Obj *opt_pattern = NULL;
+    Tcl_Obj *opt_regexp_engine = NULL;
     Tcl_Obj *opt_minimum = NULL;
     Tcl_Obj *opt_maximum = NULL;
     Tcl_Obj *opt_properties = NULL;
+    Tcl_Obj *opt_additional = NULL;
     Tcl_Obj *opt_items = NULL;
+    Tcl_Obj *opt_min_items = NULL;
+    Tcl_Obj *opt_max_items = NULL;
+    int opt_is_unique_items = 0;
+    Tcl_Obj *opt_min_properties = NULL;
+    Tcl_Obj *opt_max_properties = NULL;
+    Tcl_Obj *opt_min_length = NULL;
+    Tcl_Obj *opt_max_length = NULL;
     Tcl_Obj *opt_outkey = NULL;
+    Tcl_Obj *opt_default = NULL;
+    Tcl_Obj *opt_ref = NULL;
+    Tcl_Obj *opt_definitions = NULL;
+    Tcl_Obj *opt_discriminator = NULL;
+    Tcl_Obj *opt_variants = NULL;
+    Tcl_Obj *opt_any_of = NULL;
+    Tcl_Obj *opt_one_of = NULL;
 
 #pragma GCC diagnostic push
 // ignore warning for copy_arg:
@@ -356,18 +1036,38 @@ tjv_ValidationElement *tjv_ValidationCompile(Tcl_Interp *interp, Tcl_Size objc,
         { TCL_ARGV_FUNC,     "-type",       copy_arg,   &opt_type,        NULL, NULL },
         { TCL_ARGV_CONSTANT, "-required",   INT2PTR(1), &opt_is_required, NULL, NULL },
         { TCL_ARGV_CONSTANT, "-nullable",   INT2PTR(1), &opt_is_nullable, NULL, NULL },
+        // TJV_VALIDATION_INTEGER / TJV_VALIDATION_DOUBLE / TJV_VALIDATION_BOOLEAN
+        { TCL_ARGV_CONSTANT, "-coerce",     INT2PTR(1), &opt_is_coerce,   NULL, NULL },
         // { TCL_ARGV_FUNC,     "-command",    copy_arg,   &opt_command,     NULL, NULL },
         { TCL_ARGV_FUNC,     "-outkey",     copy_arg,   &opt_outkey,      NULL, NULL },
+        { TCL_ARGV_FUNC,     "-default",    copy_arg,   &opt_default,     NULL, NULL },
+        { TCL_ARGV_FUNC,     "-ref",        copy_arg,   &opt_ref,         NULL, NULL },
+        { TCL_ARGV_FUNC,     "-definitions", copy_arg,  &opt_definitions, NULL, NULL },
+        { TCL_ARGV_CONSTANT, "-preserve",   INT2PTR(1), &opt_is_preserve, NULL, NULL },
         // TJV_VALIDATION_STRING
         { TCL_ARGV_FUNC,     "-match",      copy_arg,   &opt_match,       NULL, NULL },
         { TCL_ARGV_FUNC,     "-pattern",    copy_arg,   &opt_pattern,     NULL, NULL },
+        { TCL_ARGV_FUNC,     "-regexp-engine", copy_arg, &opt_regexp_engine, NULL, NULL },
+        { TCL_ARGV_FUNC,     "-minLength",  copy_arg,   &opt_min_length,  NULL, NULL },
+        { TCL_ARGV_FUNC,     "-maxLength",  copy_arg,   &opt_max_length,  NULL, NULL },
         // TJV_VALIDATION_INTEGER / TJV_VALIDATION_DOUBLE
         { TCL_ARGV_FUNC,     "-minimum",    copy_arg,   &opt_minimum,     NULL, NULL },
         { TCL_ARGV_FUNC,     "-maximum",    copy_arg,   &opt_maximum,     NULL, NULL },
         // TJV_VALIDATION_OBJECT
         { TCL_ARGV_FUNC,     "-properties", copy_arg,   &opt_properties,  NULL, NULL },
+        { TCL_ARGV_FUNC,     "-additional", copy_arg,   &opt_additional,  NULL, NULL },
+        { TCL_ARGV_FUNC,     "-minProperties", copy_arg, &opt_min_properties, NULL, NULL },
+        { TCL_ARGV_FUNC,     "-maxProperties", copy_arg, &opt_max_properties, NULL, NULL },
         // TJV_VALIDATION_ARRAY
         { TCL_ARGV_FUNC,     "-items",      copy_arg,   &opt_items,       NULL, NULL },
+        { TCL_ARGV_FUNC,     "-minItems",   copy_arg,   &opt_min_items,   NULL, NULL },
+        { TCL_ARGV_FUNC,     "-maxItems",   copy_arg,   &opt_max_items,   NULL, NULL },
+        { TCL_ARGV_CONSTANT, "-uniqueItems", INT2PTR(1), &opt_is_unique_items, NULL, NULL },
+        // TJV_VALIDATION_UNION
+        { TCL_ARGV_FUNC,     "-discriminator", copy_arg, &opt_discriminator, NULL, NULL },
+        { TCL_ARGV_FUNC,     "-variants",   copy_arg,   &opt_variants,    NULL, NULL },
+        { TCL_ARGV_FUNC,     "-anyOf",      copy_arg,   &opt_any_of,      NULL, NULL },
+        { TCL_ARGV_FUNC,     "-oneOf",      copy_arg,   &opt_one_of,      NULL, NULL },
         TCL_ARGV_TABLE_END
     };
 #pragma GCC diagnostic pop
@@ -378,8 +1078,10 @@ tjv_ValidationElement *tjv_ValidationCompile(Tcl_Interp *interp, Tcl_Size objc,
     } type_name_map[] = {
         { "json",                      TJV_VALIDATION_EX_JSON                      },
         { "object",                    TJV_VALIDATION_EX_OBJECT                    },
+        { "form",                      TJV_VALIDATION_EX_FORM                      },
         { "array",                     TJV_VALIDATION_EX_ARRAY                     },
         { "list",                      TJV_VALIDATION_EX_ARRAY                     },
+        { "union",                     TJV_VALIDATION_EX_UNION                     },
         { "integer",                   TJV_VALIDATION_EX_INTEGER                   },
         { "float",                     TJV_VALIDATION_EX_DOUBLE                    },
         { "double",                    TJV_VALIDATION_EX_DOUBLE                    },
@@ -404,12 +1106,22 @@ tjv_ValidationElement *tjv_ValidationCompile(Tcl_Interp *interp, Tcl_Size objc,
         const char *match_name;
         tjv_ValidationStringMatchingType match;
     } match_name_map[] = {
-        { "glob",   TJV_STRING_MATCHING_GLOB  },
-        { "regexp", TJV_STRING_MATCHING_REGEXP },
-        { "list",   TJV_STRING_MATCHING_LIST },
+        { "glob",     TJV_STRING_MATCHING_GLOB     },
+        { "globlist", TJV_STRING_MATCHING_GLOBLIST },
+        { "regexp",   TJV_STRING_MATCHING_REGEXP   },
+        { "list",     TJV_STRING_MATCHING_LIST     },
+        { "ilist",    TJV_STRING_MATCHING_ILIST    },
         { NULL }
     };
 
+    static const char *const regexp_engines[] = {
+        "tcl", "dfa", NULL
+    };
+
+    enum regexp_engines {
+        engineTcl, engineDfa
+    };
+
     DBG2(printf("parse arguments"));
 
     Tcl_Size temp_objc = objc;
@@ -447,20 +1159,38 @@ tjv_ValidationElement *tjv_ValidationCompile(Tcl_Interp *interp, Tcl_Size objc,
 
     // Validate parameters
 
-    if (opt_type == NULL || opt_type == INT2PTR(1)) {
-        DBG2(printf("return: ERROR (no -type)"));
-        SetResult("required option -type is not specified or its value is missing");
-        goto error;
-    }
+    tjv_ValidationElementTypeEx element_type;
 
-    if (Tcl_GetIndexFromObjStruct(interp, opt_type, type_name_map,
-            sizeof(type_name_map[0]), "type", 0, &idx) != TCL_OK)
-    {
-        DBG2(printf("return: ERROR (wrong -type: [%s])", Tcl_GetString(opt_type)));
-        goto error;
-    }
+    if (opt_ref != NULL && opt_ref != INT2PTR(1)) {
+
+        if (opt_type != NULL) {
+            DBG2(printf("return: ERROR (both -type and -ref)"));
+            SetResult("both options -type and -ref are specified, only one of them can be specified");
+            goto error;
+        }
 
-    tjv_ValidationElementTypeEx element_type = type_name_map[idx].type;
+        // The type is not known until the reference is resolved. Use json
+        // without options as a placeholder.
+        element_type = TJV_VALIDATION_EX_JSON;
+
+    } else {
+
+        if (opt_type == NULL || opt_type == INT2PTR(1)) {
+            DBG2(printf("return: ERROR (no -type)"));
+            SetResult("required option -type is not specified or its value is missing");
+            goto error;
+        }
+
+        if (Tcl_GetIndexFromObjStruct(interp, opt_type, type_name_map,
+                sizeof(type_name_map[0]), "type", 0, &idx) != TCL_OK)
+        {
+            DBG2(printf("return: ERROR (wrong -type: [%s])", Tcl_GetString(opt_type)));
+            goto error;
+        }
+
+        element_type = type_name_map[idx].type;
+
+    }
 
     // Check if we have options with missing values
 
@@ -479,8 +1209,38 @@ tjv_ValidationElement *tjv_ValidationCompile(Tcl_Interp *interp, Tcl_Size objc,
         bad_option = "-match";
     } else if (opt_items == INT2PTR(1)) {
         bad_option = "-items";
+    } else if (opt_default == INT2PTR(1)) {
+        bad_option = "-default";
     } else if (opt_outkey == INT2PTR(1)) {
         bad_option = "-outkey";
+    } else if (opt_regexp_engine == INT2PTR(1)) {
+        bad_option = "-regexp-engine";
+    } else if (opt_additional == INT2PTR(1)) {
+        bad_option = "-additional";
+    } else if (opt_min_items == INT2PTR(1)) {
+        bad_option = "-minItems";
+    } else if (opt_max_items == INT2PTR(1)) {
+        bad_option = "-maxItems";
+    } else if (opt_min_properties == INT2PTR(1)) {
+        bad_option = "-minProperties";
+    } else if (opt_max_properties == INT2PTR(1)) {
+        bad_option = "-maxProperties";
+    } else if (opt_min_length == INT2PTR(1)) {
+        bad_option = "-minLength";
+    } else if (opt_max_length == INT2PTR(1)) {
+        bad_option = "-maxLength";
+    } else if (opt_ref == INT2PTR(1)) {
+        bad_option = "-ref";
+    } else if (opt_definitions == INT2PTR(1)) {
+        bad_option = "-definitions";
+    } else if (opt_discriminator == INT2PTR(1)) {
+        bad_option = "-discriminator";
+    } else if (opt_variants == INT2PTR(1)) {
+        bad_option = "-variants";
+    } else if (opt_any_of == INT2PTR(1)) {
+        bad_option = "-anyOf";
+    } else if (opt_one_of == INT2PTR(1)) {
+        bad_option = "-oneOf";
     }
 
     if (bad_option != NULL) {
@@ -490,21 +1250,112 @@ tjv_ValidationElement *tjv_ValidationCompile(Tcl_Interp *interp, Tcl_Size objc,
         goto error;
     }
 
+    if (opt_definitions != NULL && rest_arg1 == NULL) {
+        DBG2(printf("return: ERROR (-definitions in non-root element)"));
+        SetResult("option -definitions is only allowed for the root element");
+        goto error;
+    }
+
+    if (opt_is_preserve && rest_arg1 == NULL) {
+        DBG2(printf("return: ERROR (-preserve in non-root element)"));
+        SetResult("option -preserve is only allowed for the root element");
+        goto error;
+    }
+
     // Check if the user has specified options that are not supported for
-    // the corresponding type.
+    // the corresponding type. A reference supports only the options that
+    // don't depend on the type.
+
+    if (opt_ref != NULL) {
+        if (opt_match != NULL) {
+            bad_option = "-match";
+        } else if (opt_pattern != NULL) {
+            bad_option = "-pattern";
+        } else if (opt_regexp_engine != NULL) {
+            bad_option = "-regexp-engine";
+        } else if (opt_properties != NULL) {
+            bad_option = "-properties";
+        } else if (opt_additional != NULL) {
+            bad_option = "-additional";
+        } else if (opt_minimum != NULL) {
+            bad_option = "-minimum";
+        } else if (opt_maximum != NULL) {
+            bad_option = "-maximum";
+        } else if (opt_items != NULL) {
+            bad_option = "-items";
+        } else if (opt_min_items != NULL) {
+            bad_option = "-minItems";
+        } else if (opt_max_items != NULL) {
+            bad_option = "-maxItems";
+        } else if (opt_is_unique_items) {
+            bad_option = "-uniqueItems";
+        } else if (opt_min_properties != NULL) {
+            bad_option = "-minProperties";
+        } else if (opt_max_properties != NULL) {
+            bad_option = "-maxProperties";
+        } else if (opt_min_length != NULL) {
+            bad_option = "-minLength";
+        } else if (opt_max_length != NULL) {
+            bad_option = "-maxLength";
+        } else if (opt_discriminator != NULL) {
+            bad_option = "-discriminator";
+        } else if (opt_variants != NULL) {
+            bad_option = "-variants";
+        } else if (opt_any_of != NULL) {
+            bad_option = "-anyOf";
+        } else if (opt_one_of != NULL) {
+            bad_option = "-oneOf";
+        } else if (opt_is_coerce) {
+            bad_option = "-coerce";
+        }
+        if (bad_option != NULL) {
+            DBG2(printf("return: ERROR (wrong option %s for reference)", bad_option));
+            Tcl_SetObjResult(interp, Tcl_ObjPrintf("\"%s\" option is not supported for a reference,"
+                " it should be specified in the definition", bad_option));
+            goto error;
+        }
+    }
 
     if (opt_match != NULL && element_type != TJV_VALIDATION_EX_STRING) {
         bad_option = "-match";
     } else if (opt_pattern != NULL && element_type != TJV_VALIDATION_EX_STRING) {
         bad_option = "-pattern";
-    } else if (opt_properties != NULL && !(element_type == TJV_VALIDATION_EX_OBJECT || element_type == TJV_VALIDATION_EX_JSON)) {
+    } else if (opt_regexp_engine != NULL && element_type != TJV_VALIDATION_EX_STRING) {
+        bad_option = "-regexp-engine";
+    } else if (opt_properties != NULL && !(element_type == TJV_VALIDATION_EX_OBJECT || element_type == TJV_VALIDATION_EX_FORM || element_type == TJV_VALIDATION_EX_JSON)) {
         bad_option = "-properties";
+    } else if (opt_additional != NULL && !(element_type == TJV_VALIDATION_EX_OBJECT || element_type == TJV_VALIDATION_EX_FORM || element_type == TJV_VALIDATION_EX_JSON)) {
+        bad_option = "-additional";
     } else if (opt_minimum != NULL && !(element_type == TJV_VALIDATION_EX_INTEGER || element_type == TJV_VALIDATION_EX_DOUBLE)) {
         bad_option = "-minimum";
     } else if (opt_maximum != NULL && !(element_type == TJV_VALIDATION_EX_INTEGER || element_type == TJV_VALIDATION_EX_DOUBLE)) {
         bad_option = "-maximum";
     } else if (opt_items != NULL && !(element_type == TJV_VALIDATION_EX_ARRAY || element_type == TJV_VALIDATION_EX_JSON)) {
         bad_option = "-items";
+    } else if (opt_min_items != NULL && !(element_type == TJV_VALIDATION_EX_ARRAY || element_type == TJV_VALIDATION_EX_JSON)) {
+        bad_option = "-minItems";
+    } else if (opt_max_items != NULL && !(element_type == TJV_VALIDATION_EX_ARRAY || element_type == TJV_VALIDATION_EX_JSON)) {
+        bad_option = "-maxItems";
+    } else if (opt_is_unique_items && !(element_type == TJV_VALIDATION_EX_ARRAY || element_type == TJV_VALIDATION_EX_JSON)) {
+        bad_option = "-uniqueItems";
+    } else if (opt_min_properties != NULL && !(element_type == TJV_VALIDATION_EX_OBJECT || element_type == TJV_VALIDATION_EX_FORM || element_type == TJV_VALIDATION_EX_JSON)) {
+        bad_option = "-minProperties";
+    } else if (opt_max_properties != NULL && !(element_type == TJV_VALIDATION_EX_OBJECT || element_type == TJV_VALIDATION_EX_FORM || element_type == TJV_VALIDATION_EX_JSON)) {
+        bad_option = "-maxProperties";
+    } else if (opt_min_length != NULL && TJV_VALIDATION_TYPE_FROM_EX(element_type) != TJV_VALIDATION_STRING) {
+        bad_option = "-minLength";
+    } else if (opt_max_length != NULL && TJV_VALIDATION_TYPE_FROM_EX(element_type) != TJV_VALIDATION_STRING) {
+        bad_option = "-maxLength";
+    } else if (opt_discriminator != NULL && !(element_type == TJV_VALIDATION_EX_UNION || element_type == TJV_VALIDATION_EX_JSON)) {
+        bad_option = "-discriminator";
+    } else if (opt_variants != NULL && !(element_type == TJV_VALIDATION_EX_UNION || element_type == TJV_VALIDATION_EX_JSON)) {
+        bad_option = "-variants";
+    } else if (opt_any_of != NULL && !(element_type == TJV_VALIDATION_EX_UNION || element_type == TJV_VALIDATION_EX_JSON)) {
+        bad_option = "-anyOf";
+    } else if (opt_one_of != NULL && !(element_type == TJV_VALIDATION_EX_UNION || element_type == TJV_VALIDATION_EX_JSON)) {
+        bad_option = "-oneOf";
+    } else if (opt_is_coerce && !(element_type == TJV_VALIDATION_EX_INTEGER || element_type == TJV_VALIDATION_EX_DOUBLE || element_type == TJV_VALIDATION_EX_BOOLEAN)) {
+        bad_option = "-coerce";
     }
 
     if (bad_option != NULL) {
@@ -521,6 +1372,8 @@ tjv_ValidationElement *tjv_ValidationCompile(Tcl_Interp *interp, Tcl_Size objc,
             bad_option = "-match";
         } else if (opt_pattern != NULL) {
             bad_option = "-pattern";
+        } else if (opt_regexp_engine != NULL) {
+            bad_option = "-regexp-engine";
         } else if (opt_minimum != NULL) {
             bad_option = "-minimum";
         } else if (opt_maximum != NULL) {
@@ -544,12 +1397,20 @@ tjv_ValidationElement *tjv_ValidationCompile(Tcl_Interp *interp, Tcl_Size objc,
 
     rc->is_required = opt_is_required;
     rc->is_nullable = opt_is_nullable;
+    rc->is_coerce = opt_is_coerce;
+    rc->is_preserve = opt_is_preserve;
 
     if (opt_command != NULL) {
         rc->command = opt_command;
         Tcl_IncrRefCount(rc->command);
     }
 
+    if (opt_default != NULL) {
+        DBG2(printf("default: [%s]", Tcl_GetString(opt_default)));
+        rc->default_value = opt_default;
+        Tcl_IncrRefCount(rc->default_value);
+    }
+
     if (opt_outkey != NULL) {
 
         DBG2(printf("outkey: [%s]", Tcl_GetString(opt_outkey)));
@@ -578,7 +1439,40 @@ tjv_ValidationElement *tjv_ValidationCompile(Tcl_Interp *interp, Tcl_Size objc,
         DBG2(printf("key: <root>"));
     }
 
+    // Definitions are compiled before everything else, because the root
+    // element and its children can refer to them.
+    if (opt_definitions != NULL) {
+        if (tjv_ValidationCompileDefinitions(interp, opt_definitions, rc) != TCL_OK) {
+            DBG2(printf("return: ERROR (failed to compile definitions)"));
+            goto error;
+        }
+        defs = rc->definitions;
+    }
+
+    if (opt_ref != NULL) {
+
+        DBG2(printf("reference: [%s]", Tcl_GetString(opt_ref)));
+
+        Tcl_HashEntry *entry = (defs == NULL ? NULL : Tcl_FindHashEntry(&defs->table, (char *)opt_ref));
+        if (entry == NULL) {
+            DBG2(printf("return: ERROR (unknown definition)"));
+            Tcl_SetObjResult(interp, Tcl_ObjPrintf("definition \"%s\" is not found",
+                Tcl_GetString(opt_ref)));
+            goto error;
+        }
+
+        rc->definition = Tcl_GetHashValue(entry);
+
+        if (defs->refs_count == defs->refs_capacity) {
+            defs->refs_capacity = (defs->refs_capacity == 0 ? 16 : defs->refs_capacity * 2);
+            defs->refs = ckrealloc(defs->refs, sizeof(tjv_ValidationElement *) * defs->refs_capacity);
+        }
+        defs->refs[defs->refs_count++] = rc;
+
+    }
+
     ThreadSpecificData *tsdPtr;
+    const char *array_option, *object_option, *union_option;
 
     switch (element_type) {
     case TJV_VALIDATION_EX_HOSTNAME:
@@ -630,6 +1524,22 @@ tjv_ValidationElement *tjv_ValidationCompile(Tcl_Interp *interp, Tcl_Size objc,
             rc->opts.str_type.match = TJV_STRING_MATCHING_REGEXP;
         }
 
+        int regexp_engine = engineTcl;
+        if (opt_regexp_engine != NULL) {
+            if (rc->opts.str_type.match != TJV_STRING_MATCHING_REGEXP) {
+                DBG2(printf("return: ERROR (-regexp-engine for non-regexp matching)"));
+                SetResult("option -regexp-engine is specified, but matching type is not regexp");
+                goto error;
+            }
+            if (Tcl_GetIndexFromObj(interp, opt_regexp_engine, regexp_engines, "regexp engine", 0,
+                &regexp_engine) != TCL_OK)
+            {
+                DBG2(printf("return: ERROR (wrong -regexp-engine: [%s])", Tcl_GetString(opt_regexp_engine)));
+                goto error;
+            }
+            DBG2(printf("regexp engine: %s", regexp_engines[regexp_engine]));
+        }
+
         if (opt_pattern != NULL) {
 
             DBG2(printf("pattern: [%s]", Tcl_GetString(opt_pattern)));
@@ -640,11 +1550,14 @@ tjv_ValidationElement *tjv_ValidationCompile(Tcl_Interp *interp, Tcl_Size objc,
             // as long as the internal representation of bound Tcl object
             // is not changed.
             //
-            // For the list type, we split the list and it should not be modified
+            // For the list types, we split the list and it should not be modified
             // so as not to invalidate the split form. Thus, we make a copy of
-            // the pattern also.
+            // the pattern also. The allowed values are then stored in a hash set
+            // (case-folded for ilist), and the list of globs is compiled into
+            // a single automaton.
             //
-            // For glob type, we can safely use the original pattern.
+            // For glob type, we can safely use the original pattern. It is
+            // compiled and the compiled form doesn't depend on the pattern object.
 
             if (rc->opts.str_type.match == TJV_STRING_MATCHING_REGEXP) {
 
@@ -657,7 +1570,21 @@ tjv_ValidationElement *tjv_ValidationCompile(Tcl_Interp *interp, Tcl_Size objc,
                     goto error;
                 }
 
-            } else if (rc->opts.str_type.match == TJV_STRING_MATCHING_LIST) {
+                // The pattern is already validated by Tcl. Now try to compile it
+                // for the dfa engine. If it is not possible, we keep using
+                // the Tcl engine and remember the reason to report it
+                // as a warning.
+                if (regexp_engine == engineDfa) {
+                    rc->opts.str_type.automaton = tjv_RegexpCompile(rc->opts.str_type.pattern,
+                        &rc->opts.str_type.fallback_reason);
+                    DBG2(printf("dfa engine: %s", (rc->opts.str_type.automaton == NULL ?
+                        rc->opts.str_type.fallback_reason : "ok")));
+                }
+
+            } else if (rc->opts.str_type.match == TJV_STRING_MATCHING_LIST ||
+                rc->opts.str_type.match == TJV_STRING_MATCHING_ILIST ||
+                rc->opts.str_type.match == TJV_STRING_MATCHING_GLOBLIST)
+            {
 
                 rc->opts.str_type.pattern = Tcl_DuplicateObj(opt_pattern);
                 Tcl_IncrRefCount(rc->opts.str_type.pattern);
@@ -666,10 +1593,19 @@ tjv_ValidationElement *tjv_ValidationCompile(Tcl_Interp *interp, Tcl_Size objc,
                         Tcl_GetString(rc->opts.str_type.pattern)));
                     goto error;
                 }
+                if (rc->opts.str_type.match == TJV_STRING_MATCHING_GLOBLIST) {
+                    rc->opts.str_type.glob = tjv_GlobCompile(rc->opts.str_type.pattern_objc,
+                        rc->opts.str_type.pattern_objv);
+                } else {
+                    rc->opts.str_type.set = tjv_StringSetCreate(rc->opts.str_type.pattern_objc,
+                        rc->opts.str_type.pattern_objv,
+                        (rc->opts.str_type.match == TJV_STRING_MATCHING_ILIST ? TJV_STRING_SET_NOCASE : 0));
+                }
 
             } else {
                 rc->opts.str_type.pattern = opt_pattern;
                 Tcl_IncrRefCount(rc->opts.str_type.pattern);
+                rc->opts.str_type.glob = tjv_GlobCompile(1, &rc->opts.str_type.pattern);
             }
 
         } else {
@@ -701,30 +1637,79 @@ tjv_ValidationElement *tjv_ValidationCompile(Tcl_Interp *interp, Tcl_Size objc,
         break;
     case TJV_VALIDATION_EX_JSON:
 
-        if (opt_items != NULL) {
+        // A json can be either an array or an object. Find the first option
+        // for each of them to make sure that only one of them is specified.
+        array_option = (opt_items != NULL ? "-items" : opt_min_items != NULL ? "-minItems" :
+            opt_max_items != NULL ? "-maxItems" : opt_is_unique_items ? "-uniqueItems" : NULL);
+        object_option = (opt_properties != NULL ? "-properties" : opt_additional != NULL ? "-additional" :
+            opt_min_properties != NULL ? "-minProperties" : opt_max_properties != NULL ? "-maxProperties" : NULL);
+
+        union_option = (opt_variants != NULL ? "-variants" : opt_any_of != NULL ? "-anyOf" :
+            opt_one_of != NULL ? "-oneOf" : opt_discriminator != NULL ? "-discriminator" : NULL);
+
+        if ((array_option != NULL ? 1 : 0) + (object_option != NULL ? 1 : 0) + (union_option != NULL ? 1 : 0) > 1) {
+            const char *first_option = (array_option != NULL ? array_option : object_option);
+            const char *second_option = (union_option != NULL ? union_option : object_option);
+            DBG2(printf("return: error (both %s and %s are defined)", first_option, second_option));
+            Tcl_SetObjResult(interp, Tcl_ObjPrintf("both options %s and %s are specified,"
+                " for json format only one of them can be specified", first_option, second_option));
+            goto error;
+        }
 
-            if (opt_properties != NULL) {
-                DBG2(printf("return: error (both -items and -properties are defined)"));
-                SetResult("both options -items and -properties are specified,"
-                    " for json format only one of them can be specified");
+        if (union_option != NULL) {
+
+            rc->flag = TJV_FLAG_JSON_TYPE_UNION;
+
+            if (tjv_ValidationCompileUnion(interp, defs, opt_discriminator, opt_variants, opt_any_of,
+                opt_one_of, rc) != TCL_OK)
+            {
+                DBG2(printf("return: error (failed to parse variants)"));
                 goto error;
             }
 
+        } else if (array_option != NULL) {
+
             rc->flag = TJV_FLAG_JSON_TYPE_ARRAY;
 
-            DBG2(printf("add items format"));
-            if (tjv_ValidationCompileItems(interp, opt_items, rc) != TCL_OK) {
-                DBG2(printf("return: error (failed to parse items format)"));
+            if (opt_items != NULL) {
+                DBG2(printf("add items format"));
+                if (tjv_ValidationCompileItems(interp, defs, opt_items, rc) != TCL_OK) {
+                    DBG2(printf("return: error (failed to parse items format)"));
+                    goto error;
+                }
+            }
+
+            if (tjv_ValidationCompileLimits(interp, "-minItems", opt_min_items, "-maxItems", opt_max_items,
+                &rc->opts.array_type.min_items, &rc->opts.array_type.max_items,
+                &rc->opts.array_type.is_max_items_defined) != TCL_OK)
+            {
                 goto error;
             }
+            rc->opts.array_type.is_unique_items = opt_is_unique_items;
 
-        } else if (opt_properties != NULL) {
+        } else if (object_option != NULL) {
 
             rc->flag = TJV_FLAG_JSON_TYPE_OBJECT;
 
-            DBG2(printf("add properties"));
-            if (tjv_ValidationCompileProperties(interp, opt_properties, rc) != TCL_OK) {
-                DBG2(printf("return: error (failed to parse properties)"));
+            if (opt_properties != NULL) {
+                DBG2(printf("add properties"));
+                if (tjv_ValidationCompileProperties(interp, defs, opt_properties, rc) != TCL_OK) {
+                    DBG2(printf("return: error (failed to parse properties)"));
+                    goto error;
+                }
+            }
+
+            if (opt_additional != NULL) {
+                if (tjv_ValidationCompileAdditional(interp, opt_additional, rc) != TCL_OK) {
+                    DBG2(printf("return: error (failed to parse additional mode)"));
+                    goto error;
+                }
+            }
+
+            if (tjv_ValidationCompileLimits(interp, "-minProperties", opt_min_properties, "-maxProperties", opt_max_properties,
+                &rc->opts.obj_type.min_properties, &rc->opts.obj_type.max_properties,
+                &rc->opts.obj_type.is_max_properties_defined) != TCL_OK)
+            {
                 goto error;
             }
 
@@ -738,7 +1723,7 @@ tjv_ValidationElement *tjv_ValidationCompile(Tcl_Interp *interp, Tcl_Size objc,
         if (opt_items != NULL) {
 
             DBG2(printf("add items format"));
-            if (tjv_ValidationCompileItems(interp, opt_items, rc) != TCL_OK) {
+            if (tjv_ValidationCompileItems(interp, defs, opt_items, rc) != TCL_OK) {
                 DBG2(printf("return: error (failed to parse items format)"));
                 goto error;
             }
@@ -747,13 +1732,22 @@ tjv_ValidationElement *tjv_ValidationCompile(Tcl_Interp *interp, Tcl_Size objc,
             DBG2(printf("items format is not specified"));
         }
 
+        if (tjv_ValidationCompileLimits(interp, "-minItems", opt_min_items, "-maxItems", opt_max_items,
+            &rc->opts.array_type.min_items, &rc->opts.array_type.max_items,
+            &rc->opts.array_type.is_max_items_defined) != TCL_OK)
+        {
+            goto error;
+        }
+        rc->opts.array_type.is_unique_items = opt_is_unique_items;
+
         break;
     case TJV_VALIDATION_EX_OBJECT:
+    case TJV_VALIDATION_EX_FORM:
 
         if (opt_properties != NULL) {
 
             DBG2(printf("add properties"));
-            if (tjv_ValidationCompileProperties(interp, opt_properties, rc) != TCL_OK) {
+            if (tjv_ValidationCompileProperties(interp, defs, opt_properties, rc) != TCL_OK) {
                 DBG2(printf("return: error (failed to parse properties)"));
                 goto error;
             }
@@ -762,8 +1756,32 @@ tjv_ValidationElement *tjv_ValidationCompile(Tcl_Interp *interp, Tcl_Size objc,
             DBG2(printf("no properties are defined"));
         }
 
+        if (opt_additional != NULL) {
+            if (tjv_ValidationCompileAdditional(interp, opt_additional, rc) != TCL_OK) {
+                DBG2(printf("return: error (failed to parse additional mode)"));
+                goto error;
+            }
+        }
+
+        if (tjv_ValidationCompileLimits(interp, "-minProperties", opt_min_properties, "-maxProperties", opt_max_properties,
+            &rc->opts.obj_type.min_properties, &rc->opts.obj_type.max_properties,
+            &rc->opts.obj_type.is_max_properties_defined) != TCL_OK)
+        {
+            goto error;
+        }
+
         break;
     case TJV_VALIDATION_EX_BOOLEAN:
+        break;
+    case TJV_VALIDATION_EX_UNION:
+
+        if (tjv_ValidationCompileUnion(interp, defs, opt_discriminator, opt_variants, opt_any_of,
+            opt_one_of, rc) != TCL_OK)
+        {
+            DBG2(printf("return: error (failed to parse variants)"));
+            goto error;
+        }
+
         break;
     case TJV_VALIDATION_EX_DOUBLE:
         if (opt_minimum != NULL) {
@@ -789,6 +1807,23 @@ tjv_ValidationElement *tjv_ValidationCompile(Tcl_Interp *interp, Tcl_Size objc,
         break;
     }
 
+    // String length limits are the same for all string types
+    if (rc->type == TJV_VALIDATION_STRING) {
+        if (tjv_ValidationCompileLimits(interp, "-minLength", opt_min_length, "-maxLength", opt_max_length,
+            &rc->opts.str_type.min_length, &rc->opts.str_type.max_length,
+            &rc->opts.str_type.is_max_length_defined) != TCL_OK)
+        {
+            goto error;
+        }
+    }
+
+    // All elements are compiled now and the references can be resolved
+    if (rc->definitions != NULL) {
+        if (tjv_ValidationResolveReferences(interp, rc->definitions) != TCL_OK) {
+            goto error;
+        }
+    }
+
     DBG2(printf("return: ok (%p)", (void *)rc));
     goto done;
 
@@ -806,6 +1841,10 @@ done:
 
 }
 
+tjv_ValidationElement *tjv_ValidationCompile(Tcl_Interp *interp, Tcl_Size objc, Tcl_Obj *const objv[], Tcl_Obj **rest_arg1, Tcl_Obj **rest_arg2) {
+    return tjv_ValidationCompileElement(interp, NULL, objc, objv, rest_arg1, rest_arg2);
+}
+
 static void tjv_ValidationCompileThreadExitProc(ClientData clientData) {
 
     UNUSED(clientData);
@@ -7,6 +7,9 @@
 #define TJV_COMPILE_H
 
 #include "common.h"
+#include "tjvStringSet.h"
+#include "tjvGlob.h"
+#include "tjvRegexp.h"
 
 typedef enum {
     TJV_VALIDATION_OBJECT,
@@ -15,7 +18,8 @@ typedef enum {
     TJV_VALIDATION_INTEGER,
     TJV_VALIDATION_JSON,
     TJV_VALIDATION_BOOLEAN,
-    TJV_VALIDATION_DOUBLE
+    TJV_VALIDATION_DOUBLE,
+    TJV_VALIDATION_UNION
 } tjv_ValidationElementType;
 
 typedef enum {
@@ -26,6 +30,7 @@ typedef enum {
     TJV_VALIDATION_EX_JSON,
     TJV_VALIDATION_EX_BOOLEAN,
     TJV_VALIDATION_EX_DOUBLE,
+    TJV_VALIDATION_EX_UNION,
     TJV_VALIDATION_EX_EMAIL,
     TJV_VALIDATION_EX_DURATION,
     TJV_VALIDATION_EX_URI,
@@ -37,7 +42,8 @@ typedef enum {
     TJV_VALIDATION_EX_UUID,
     TJV_VALIDATION_EX_JSON_POINTER,
     TJV_VALIDATION_EX_JSON_POINTER_URI_FRAGMENT,
-    TJV_VALIDATION_EX_RELATIVE_JSON_POINTER
+    TJV_VALIDATION_EX_RELATIVE_JSON_POINTER,
+    TJV_VALIDATION_EX_FORM
 } tjv_ValidationElementTypeEx;
 
 #define TJV_VALIDATION_TYPE_FROM_EX(x) ( \
@@ -48,6 +54,7 @@ typedef enum {
     (x) == TJV_VALIDATION_EX_JSON                      ? TJV_VALIDATION_JSON    : \
     (x) == TJV_VALIDATION_EX_BOOLEAN                   ? TJV_VALIDATION_BOOLEAN : \
     (x) == TJV_VALIDATION_EX_DOUBLE                    ? TJV_VALIDATION_DOUBLE  : \
+    (x) == TJV_VALIDATION_EX_UNION                     ? TJV_VALIDATION_UNION   : \
     (x) == TJV_VALIDATION_EX_EMAIL                     ? TJV_VALIDATION_STRING  : \
     (x) == TJV_VALIDATION_EX_DURATION                  ? TJV_VALIDATION_STRING  : \
     (x) == TJV_VALIDATION_EX_URI                       ? TJV_VALIDATION_STRING  : \
@@ -60,6 +67,7 @@ typedef enum {
     (x) == TJV_VALIDATION_EX_JSON_POINTER              ? TJV_VALIDATION_STRING  : \
     (x) == TJV_VALIDATION_EX_JSON_POINTER_URI_FRAGMENT ? TJV_VALIDATION_STRING  : \
     (x) == TJV_VALIDATION_EX_RELATIVE_JSON_POINTER     ? TJV_VALIDATION_STRING  : \
+    (x) == TJV_VALIDATION_EX_FORM                      ? TJV_VALIDATION_OBJECT  : \
     -1 )
 
 #define TJV_VALIDATION_EX_TYPE_STR(x) ( \
@@ -70,6 +78,7 @@ typedef enum {
     (x) == TJV_VALIDATION_EX_JSON                      ? "TJV_VALIDATION_EX_JSON"                      : \
     (x) == TJV_VALIDATION_EX_BOOLEAN                   ? "TJV_VALIDATION_EX_BOOLEAN"                   : \
     (x) == TJV_VALIDATION_EX_DOUBLE                    ? "TJV_VALIDATION_EX_DOUBLE"                    : \
+    (x) == TJV_VALIDATION_EX_UNION                     ? "TJV_VALIDATION_EX_UNION"                     : \
     (x) == TJV_VALIDATION_EX_EMAIL                     ? "TJV_VALIDATION_EX_EMAIL"                     : \
     (x) == TJV_VALIDATION_EX_DURATION                  ? "TJV_VALIDATION_EX_DURATION"                  : \
     (x) == TJV_VALIDATION_EX_URI                       ? "TJV_VALIDATION_EX_URI"                       : \
@@ -82,22 +91,64 @@ typedef enum {
     (x) == TJV_VALIDATION_EX_JSON_POINTER              ? "TJV_VALIDATION_EX_JSON_POINTER"              : \
     (x) == TJV_VALIDATION_EX_JSON_POINTER_URI_FRAGMENT ? "TJV_VALIDATION_EX_JSON_POINTER_URI_FRAGMENT" : \
     (x) == TJV_VALIDATION_EX_RELATIVE_JSON_POINTER     ? "TJV_VALIDATION_EX_RELATIVE_JSON_POINTER"     : \
+    (x) == TJV_VALIDATION_EX_FORM                      ? "TJV_VALIDATION_EX_FORM"                      : \
     "ERROR - UNKNOWN VALIDATION TYPE" )
 
+// The number of 64-bit words in a bitmap for the specified number of keys
+#define TJV_BITMAP_WORDS(x) (((x) + 63) / 64)
+
 typedef enum {
     TJV_STRING_MATCHING_GLOB,
+    TJV_STRING_MATCHING_GLOBLIST,
     TJV_STRING_MATCHING_REGEXP,
-    TJV_STRING_MATCHING_LIST
+    TJV_STRING_MATCHING_LIST,
+    TJV_STRING_MATCHING_ILIST
 } tjv_ValidationStringMatchingType;
 
+typedef enum {
+    TJV_ADDITIONAL_ALLOW,
+    TJV_ADDITIONAL_DENY,
+    TJV_ADDITIONAL_STRIP
+} tjv_ValidationAdditionalType;
+
 typedef enum {
     TJV_FLAG_NONE,
     TJV_FLAG_JSON_TYPE_OBJECT,
     TJV_FLAG_JSON_TYPE_ARRAY,
+    TJV_FLAG_JSON_TYPE_UNION,
     TJV_FLAG_SKIP_KEY
 } tjv_ValidationFlagType;
 
 typedef struct tjv_ValidationElement tjv_ValidationElement;
+typedef struct tjv_Replica tjv_Replica;
+
+// A named schema that is declared by -definitions and referenced by -ref
+typedef struct {
+    Tcl_Obj *name;
+    tjv_ValidationElement *element;
+    // state of resolving references to this definition
+    enum {
+        TJV_DEFINITION_UNRESOLVED,
+        TJV_DEFINITION_RESOLVING,
+        TJV_DEFINITION_RESOLVED
+    } state;
+    // state of the search for unions that refer to themselves
+    enum {
+        TJV_DEFINITION_UNVISITED,
+        TJV_DEFINITION_VISITING,
+        TJV_DEFINITION_VISITED
+    } union_state;
+} tjv_ValidationDefinition;
+
+typedef struct {
+    // definitions by their names
+    Tcl_HashTable table;
+    // all reference elements that should be resolved when the root element
+    // is compiled
+    tjv_ValidationElement **refs;
+    Tcl_Size refs_count;
+    Tcl_Size refs_capacity;
+} tjv_ValidationDefinitions;
 
 struct tjv_ValidationElement {
     // Common options
@@ -106,12 +157,30 @@ struct tjv_ValidationElement {
     tjv_ValidationFlagType flag;
     int is_required;
     int is_nullable;
+    // store integer, double and boolean values in the outcome as new
+    // objects of these types, without converting the validated value
+    int is_coerce;
+    // validate Tcl values without changing their internal representations,
+    // it is specified only for the root element
+    int is_preserve;
     Tcl_Obj *command;
     Tcl_Obj *key;
     Tcl_Obj *outkey;
+    // the value of a missing key in the JSON output, it is validated
+    // in the same way as the value of the key
+    Tcl_Obj *default_value;
     // cache for faster access
     Tcl_Size outkey_objc;
     Tcl_Obj **outkey_objv;
+    // If it is not NULL, the element is a reference. Its type and
+    // type-specific options are borrowed from the definition and are not
+    // released with the element.
+    tjv_ValidationDefinition *definition;
+    // definitions that are declared in the root element
+    tjv_ValidationDefinitions *definitions;
+    // the source of copies of the schema for worker threads, it is specified
+    // only for the root element of tjv::compile, which owns it
+    tjv_Replica *replica;
 
     // Type-specific options
     union {
@@ -123,6 +192,18 @@ struct tjv_ValidationElement {
             // cache for faster access
             Tcl_Size pattern_objc;
             Tcl_Obj **pattern_objv;
+            // allowed values for TJV_STRING_MATCHING_LIST and TJV_STRING_MATCHING_ILIST
+            tjv_StringSet *set;
+            // compiled pattern for TJV_STRING_MATCHING_GLOB and TJV_STRING_MATCHING_GLOBLIST
+            tjv_Glob *glob;
+            // compiled regexp for the dfa engine, NULL if the Tcl engine is used
+            tjv_Automaton *automaton;
+            // the reason why the dfa engine was requested but not used
+            const char *fallback_reason;
+            // limits for the number of characters
+            Tcl_Size min_length;
+            Tcl_Size max_length;
+            int is_max_length_defined;
         } str_type;
         // options for TJV_VALIDATION_INTEGER
         struct {
@@ -138,6 +219,22 @@ struct tjv_ValidationElement {
             // cache for faster access
             Tcl_Size keys_objc;
             Tcl_Obj **keys_objv;
+            // index of keys in keys_objv, NULL if there are no keys
+            tjv_StringSet *key_index;
+            // bitmap of required keys by their index in keys_objv, NULL if
+            // keys are not unique
+            uint64_t *required_bits;
+            // how to handle keys that are not in keys_list
+            tjv_ValidationAdditionalType additional;
+            // index of keys folded in the same way as JSON object members
+            // are matched, only for TJV_ADDITIONAL_DENY and TJV_ADDITIONAL_STRIP
+            tjv_StringSet *json_key_index;
+            // some of the keys have default values
+            int is_default_defined;
+            // limits for the number of keys
+            Tcl_Size min_properties;
+            Tcl_Size max_properties;
+            int is_max_properties_defined;
         } obj_type;
         // options for TJV_VALIDATION_DOUBLE
         struct {
@@ -149,7 +246,25 @@ struct tjv_ValidationElement {
         // options for TJV_VALIDATION_ARRAY and TJV_VALIDATION_JSON
         struct {
             tjv_ValidationElement *element;
+            // limits for the number of elements
+            Tcl_Size min_items;
+            Tcl_Size max_items;
+            int is_max_items_defined;
+            int is_unique_items;
         } array_type;
+        // options for TJV_VALIDATION_UNION and TJV_VALIDATION_JSON
+        struct {
+            tjv_ValidationElement **elements;
+            Tcl_Size count;
+            // the key of the tag that selects the variant, NULL for
+            // the variants without tags (-anyOf and -oneOf)
+            Tcl_Obj *discriminator;
+            // tags of the variants and their index
+            Tcl_Obj *tags_list;
+            tjv_StringSet *tag_index;
+            // exactly one variant should match (-oneOf)
+            int is_one_of;
+        } union_type;
     } opts;
 
 };
@@ -161,8 +276,13 @@ extern "C" {
 void tjv_ValidationCompileInit(void);
 void tjv_ValidationElementFree(tjv_ValidationElement *ve);
 tjv_ValidationElement *tjv_ValidationCompile(Tcl_Interp *interp, Tcl_Size objc, Tcl_Obj *const objv[], Tcl_Obj **rest_arg1, Tcl_Obj **rest_arg2);
+// Appends to the list the warnings about the compiled element and its children
+void tjv_ValidationWarnings(tjv_ValidationElement *ve, Tcl_Obj *prefix, Tcl_Obj *list);
 
 const char *tjv_GetValidationTypeString(tjv_ValidationElementTypeEx type_ex);
+// Returns a new object with the list of types of the union variants, such as
+// "integer or string", for error messages
+Tcl_Obj *tjv_GetUnionTypeString(tjv_ValidationElement *ve);
 
 #ifdef __cplusplus
 }
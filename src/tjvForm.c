@@ -0,0 +1,205 @@
+/**
+ * Copyright Jerily LTD. All Rights Reserved.
+ * SPDX-FileCopyrightText: 2024 Neofytos Dimitriou (neo@jerily.cy)
+ * SPDX-License-Identifier: MIT.
+ */
+
+#include "tjvForm.h"
+#include "tjvJsonScan.h"
+
+static inline int tjv_FormHexValue(unsigned char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// Decodes '+' and %XX sequences in place and returns the decoded length.
+// A '%' that is not followed by two hex digits is kept as is. NUL is
+// decoded to C0 80 as Tcl stores it, this still fits as %00 is 3 bytes.
+static Tcl_Size tjv_FormDecode(unsigned char *str, Tcl_Size length) {
+
+    unsigned char *out = str;
+    const unsigned char *end = str + length;
+
+    for (const unsigned char *p = str; p < end; p++) {
+        if (*p == '+') {
+            *out++ = ' ';
+            continue;
+        }
+        if (*p == '%' && end - p > 2) {
+            int hi = tjv_FormHexValue(p[1]);
+            int lo = tjv_FormHexValue(p[2]);
+            if (hi != -1 && lo != -1) {
+                unsigned char c = (unsigned char)((hi << 4) | lo);
+                if (c == '\0') {
+                    *out++ = 0xc0;
+                    *out++ = 0x80;
+                } else {
+                    *out++ = c;
+                }
+                p += 2;
+                continue;
+            }
+        }
+        *out++ = *p;
+    }
+
+    return out - str;
+
+}
+
+// Returns the value converted to the type of the schema element, or
+// the value itself if it is not of that type. Such values are left for
+// the validation to report them.
+static Tcl_Obj *tjv_FormCoerce(Tcl_Obj *value, const tjv_ValidationElement *ve) {
+
+    switch (ve->type) {
+    case TJV_VALIDATION_INTEGER: ; // empty statement
+        Tcl_WideInt wide_val;
+        if (Tcl_GetWideIntFromObj(NULL, value, &wide_val) == TCL_OK) {
+            Tcl_BounceRefCount(value);
+            return Tcl_NewWideIntObj(wide_val);
+        }
+        break;
+    case TJV_VALIDATION_DOUBLE: ; // empty statement
+        double double_val;
+        if (Tcl_GetDoubleFromObj(NULL, value, &double_val) == TCL_OK) {
+            Tcl_BounceRefCount(value);
+            return Tcl_NewDoubleObj(double_val);
+        }
+        break;
+    case TJV_VALIDATION_BOOLEAN: ; // empty statement
+        int bool_val;
+        if (Tcl_GetBooleanFromObj(NULL, value, &bool_val) == TCL_OK) {
+            Tcl_BounceRefCount(value);
+            return Tcl_NewBooleanObj(bool_val);
+        }
+        break;
+    case TJV_VALIDATION_OBJECT:
+    case TJV_VALIDATION_ARRAY:
+    case TJV_VALIDATION_STRING:
+    case TJV_VALIDATION_JSON:
+    case TJV_VALIDATION_UNION:
+        break;
+    }
+
+    return value;
+
+}
+
+Tcl_Obj *tjv_FormParse(Tcl_Obj *data, const tjv_ValidationElement *ve) {
+
+    Tcl_Size length;
+    const char *str = Tcl_GetStringFromObj(data, &length);
+
+    DBG2(printf("enter: length: %" TCL_SIZE_MODIFIER "d", length));
+
+    Tcl_Obj *result = Tcl_NewDictObj();
+
+    if (length == 0) {
+        DBG2(printf("return: empty"));
+        return result;
+    }
+
+    // The string representation can't be changed, so the data is decoded
+    // in place in one private copy
+    unsigned char *buf = ckalloc(length);
+    memcpy(buf, str, length);
+
+    unsigned char *p = buf;
+    unsigned char *end = buf + length;
+
+    for (;;) {
+
+        unsigned char *pair_end = memchr(p, '&', end - p);
+        if (pair_end == NULL) {
+            pair_end = end;
+        }
+
+        // Skip empty pairs as in "a=1&&b=2"
+        if (pair_end == p) {
+            goto next;
+        }
+
+        unsigned char *key = p;
+        unsigned char *value = memchr(p, '=', pair_end - p);
+        Tcl_Size key_length, value_length;
+        if (value == NULL) {
+            key_length = tjv_FormDecode(key, pair_end - key);
+            value_length = 0;
+        } else {
+            key_length = tjv_FormDecode(key, value - key);
+            value++;
+            value_length = tjv_FormDecode(value, pair_end - value);
+        }
+
+        if (!tjv_Utf8Validate(key, key_length, TJV_JSON_SCAN_MODIFIED_UTF8) ||
+            !tjv_Utf8Validate(value, value_length, TJV_JSON_SCAN_MODIFIED_UTF8))
+        {
+            DBG2(printf("return: error (not valid UTF-8)"));
+            Tcl_BounceRefCount(result);
+            result = NULL;
+            goto done;
+        }
+
+        const tjv_ValidationElement *element = NULL;
+        if (ve->opts.obj_type.key_index != NULL) {
+            Tcl_Size index = tjv_StringSetFind(ve->opts.obj_type.key_index, (const char *)key, key_length);
+            if (index != -1) {
+                element = ve->opts.obj_type.elements[index];
+            }
+        }
+
+        Tcl_Obj *key_obj = Tcl_NewStringObj((const char *)key, key_length);
+        Tcl_Obj *value_obj = Tcl_NewStringObj((const char *)value, value_length);
+
+        if (element != NULL && element->type == TJV_VALIDATION_ARRAY) {
+
+            if (element->opts.array_type.element != NULL) {
+                value_obj = tjv_FormCoerce(value_obj, element->opts.array_type.element);
+            }
+
+            Tcl_Obj *list = NULL;
+            Tcl_DictObjGet(NULL, result, key_obj, &list);
+            if (list == NULL) {
+                list = Tcl_NewListObj(1, &value_obj);
+            } else {
+                // The list is owned by the dict only, it is put back to
+                // invalidate the string representation of the dict
+                Tcl_ListObjAppendElement(NULL, list, value_obj);
+            }
+            Tcl_DictObjPut(NULL, result, key_obj, list);
+
+        } else {
+
+            if (element != NULL) {
+                value_obj = tjv_FormCoerce(value_obj, element);
+            }
+            Tcl_DictObjPut(NULL, result, key_obj, value_obj);
+
+        }
+
+        // The dict keeps the first key object for repeated keys
+        Tcl_BounceRefCount(key_obj);
+
+    next:
+
+        if (pair_end == end) {
+            break;
+        }
+        p = pair_end + 1;
+
+    }
+
+    DBG2(printf("return: ok"));
+
+done:
+    ckfree(buf);
+    return result;
+
+}
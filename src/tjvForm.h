@@ -0,0 +1,27 @@
+/**
+ * Copyright Jerily LTD. All Rights Reserved.
+ * SPDX-FileCopyrightText: 2024 Neofytos Dimitriou (neo@jerily.cy)
+ * SPDX-License-Identifier: MIT.
+ */
+#ifndef TJV_FORM_H
+#define TJV_FORM_H
+
+#include "common.h"
+#include "tjvCompile.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Parses application/x-www-form-urlencoded data to a new dict for the form
+// schema element. Repeated keys of array properties are collected to lists,
+// for other keys the last value wins. Values of integer, double and boolean
+// properties are converted to the objects of these types. Returns NULL if
+// the decoded data is not valid UTF-8.
+Tcl_Obj *tjv_FormParse(Tcl_Obj *data, const tjv_ValidationElement *ve);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TJV_FORM_H
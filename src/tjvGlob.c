@@ -0,0 +1,331 @@
+/**
+ * Copyright Jerily LTD. All Rights Reserved.
+ * SPDX-FileCopyrightText: 2024 Neofytos Dimitriou (neo@jerily.cy)
+ * SPDX-License-Identifier: MIT.
+ */
+
+#include "tjvGlob.h"
+
+typedef enum {
+    TJV_GLOB_ELEMENT_LITERAL,
+    TJV_GLOB_ELEMENT_ANY,
+    TJV_GLOB_ELEMENT_CLASS,
+    TJV_GLOB_ELEMENT_STAR
+} tjv_GlobElementType;
+
+typedef struct {
+    tjv_GlobElementType type;
+    // For TJV_GLOB_ELEMENT_LITERAL, the bytes of the character
+    const char *str;
+    int length;
+    // For TJV_GLOB_ELEMENT_CLASS, pairs of code points lo, hi
+    int *ranges;
+    int range_count;
+} tjv_GlobElement;
+
+typedef struct {
+    tjv_GlobElement *elements;
+    int count;
+    int *ranges;
+} tjv_GlobParsed;
+
+static int tjv_GlobCompareRange(const void *a, const void *b) {
+    int x = *(const int *)a;
+    int y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+// Sorts the ranges of the class and merges those that overlap or adjoin.
+static void tjv_GlobNormalizeClass(tjv_GlobElement *el) {
+
+    if (el->range_count < 2) {
+        return;
+    }
+
+    qsort(el->ranges, (size_t)el->range_count, sizeof(int) * 2, tjv_GlobCompareRange);
+
+    int n = 0;
+    for (int i = 1; i < el->range_count; i++) {
+        if (el->ranges[i * 2] <= el->ranges[n * 2 + 1] + 1) {
+            if (el->ranges[i * 2 + 1] > el->ranges[n * 2 + 1]) {
+                el->ranges[n * 2 + 1] = el->ranges[i * 2 + 1];
+            }
+        } else {
+            n++;
+            el->ranges[n * 2] = el->ranges[i * 2];
+            el->ranges[n * 2 + 1] = el->ranges[i * 2 + 1];
+        }
+    }
+    el->range_count = n + 1;
+
+}
+
+// Splits the pattern into elements. The syntax and its corner cases follow
+// Tcl_StringCaseMatch():
+//   - a backslash at the end of the pattern never matches;
+//   - a character class doesn't support escapes, and it extends to the end
+//     of the pattern if there is no closing bracket;
+//   - a range without the end character at the end of the pattern is
+//     ignored;
+//   - a range can be specified in any order, [z-a] is the same as [a-z].
+static void tjv_GlobParse(const char *p, Tcl_Size length, tjv_GlobParsed *parsed) {
+
+    parsed->elements = ckalloc(sizeof(tjv_GlobElement) * (length + 1));
+    parsed->ranges = ckalloc(sizeof(int) * 2 * (length + 1));
+    parsed->count = 0;
+
+    int *ranges = parsed->ranges;
+    Tcl_Size i = 0;
+
+    while (i < length) {
+
+        tjv_GlobElement *el = &parsed->elements[parsed->count];
+        int ch;
+
+        switch (p[i]) {
+        case '*':
+            i++;
+            if (parsed->count > 0 && el[-1].type == TJV_GLOB_ELEMENT_STAR) {
+                continue;
+            }
+            el->type = TJV_GLOB_ELEMENT_STAR;
+            break;
+        case '?':
+            i++;
+            el->type = TJV_GLOB_ELEMENT_ANY;
+            break;
+        case '[':
+            i++;
+            el->type = TJV_GLOB_ELEMENT_CLASS;
+            el->ranges = ranges;
+            el->range_count = 0;
+            while (i < length && p[i] != ']') {
+                int lo;
+                int hi;
+                i += tjv_Utf8Decode(p + i, length - i, &lo);
+                if (i < length && p[i] == '-') {
+                    i++;
+                    if (i == length) {
+                        break;
+                    }
+                    i += tjv_Utf8Decode(p + i, length - i, &hi);
+                } else {
+                    hi = lo;
+                }
+                el->ranges[el->range_count * 2] = (lo < hi ? lo : hi);
+                el->ranges[el->range_count * 2 + 1] = (lo < hi ? hi : lo);
+                el->range_count++;
+            }
+            // Skip the closing bracket
+            if (i < length) {
+                i++;
+            }
+            ranges += el->range_count * 2;
+            tjv_GlobNormalizeClass(el);
+            break;
+        case '\\':
+            i++;
+            if (i == length) {
+                // Nothing can match the trailing backslash
+                el->type = TJV_GLOB_ELEMENT_CLASS;
+                el->ranges = NULL;
+                el->range_count = 0;
+                break;
+            }
+            // fallthrough
+        default:
+            el->type = TJV_GLOB_ELEMENT_LITERAL;
+            el->str = p + i;
+            el->length = tjv_Utf8Decode(p + i, length - i, &ch);
+            i += el->length;
+            break;
+        }
+
+        parsed->count++;
+
+    }
+
+}
+
+static void tjv_GlobParsedFree(tjv_GlobParsed *parsed) {
+    ckfree(parsed->elements);
+    ckfree(parsed->ranges);
+}
+
+static tjv_NfaFragment tjv_GlobToNfa(tjv_Automaton *a, const tjv_GlobElement *elements, int count) {
+
+    tjv_NfaFragment f = tjv_NfaEmpty(a);
+
+    for (int i = 0; i < count; i++) {
+        const tjv_GlobElement *el = &elements[i];
+        tjv_NfaFragment next;
+        switch (el->type) {
+        case TJV_GLOB_ELEMENT_LITERAL:
+            next = tjv_NfaString(a, el->str, el->length);
+            break;
+        case TJV_GLOB_ELEMENT_ANY:
+            next = tjv_NfaCharRange(a, 0, 0x10FFFF);
+            break;
+        case TJV_GLOB_ELEMENT_CLASS:
+            next = tjv_NfaCharClass(a, el->ranges, el->range_count);
+            break;
+        case TJV_GLOB_ELEMENT_STAR:
+            // The input is valid UTF-8, so we can skip any bytes here. The next
+            // element can only match at the beginning of a character.
+            next = tjv_NfaStar(a, tjv_NfaByteRange(a, 0, 255));
+            break;
+        }
+        f = tjv_NfaConcat(a, f, next);
+    }
+
+    return f;
+
+}
+
+static char *tjv_GlobLiteral(const tjv_GlobElement *elements, int count, Tcl_Size *length_ptr) {
+
+    Tcl_Size length = 0;
+    for (int i = 0; i < count; i++) {
+        length += elements[i].length;
+    }
+
+    char *str = ckalloc(length + 1);
+    length = 0;
+    for (int i = 0; i < count; i++) {
+        memcpy(str + length, elements[i].str, (size_t)elements[i].length);
+        length += elements[i].length;
+    }
+    str[length] = '\0';
+
+    *length_ptr = length;
+    return str;
+
+}
+
+tjv_Glob *tjv_GlobCompile(Tcl_Size objc, Tcl_Obj *const objv[]) {
+
+    DBG2(printf("enter: objc: %" TCL_SIZE_MODIFIER "d", objc));
+
+    tjv_Glob *glob = ckalloc(sizeof(tjv_Glob));
+    memset(glob, 0, sizeof(tjv_Glob));
+
+    tjv_GlobParsed parsed;
+
+    if (objc == 1) {
+
+        Tcl_Size length;
+        const char *pattern = Tcl_GetStringFromObj(objv[0], &length);
+        tjv_GlobParse(pattern, length, &parsed);
+
+        int prefix_count = 0;
+        while (prefix_count < parsed.count && parsed.elements[prefix_count].type == TJV_GLOB_ELEMENT_LITERAL) {
+            prefix_count++;
+        }
+
+        glob->prefix = tjv_GlobLiteral(parsed.elements, prefix_count, &glob->prefix_length);
+
+        if (prefix_count == parsed.count) {
+            DBG2(printf("return: ok (exact)"));
+            glob->kind = TJV_GLOB_EXACT;
+            goto done;
+        }
+
+        int suffix_count = 0;
+        while (parsed.elements[parsed.count - suffix_count - 1].type == TJV_GLOB_ELEMENT_LITERAL) {
+            suffix_count++;
+        }
+
+        glob->suffix = tjv_GlobLiteral(parsed.elements + parsed.count - suffix_count, suffix_count, &glob->suffix_length);
+
+        const tjv_GlobElement *middle = parsed.elements + prefix_count;
+        int middle_count = parsed.count - prefix_count - suffix_count;
+
+        // Consecutive stars are merged by the parser
+        if (middle_count == 1 && middle[0].type == TJV_GLOB_ELEMENT_STAR) {
+            DBG2(printf("return: ok (prefix and suffix)"));
+            glob->kind = TJV_GLOB_PREFIX_SUFFIX;
+            goto done;
+        }
+
+        glob->kind = TJV_GLOB_AUTOMATON;
+        glob->automaton = tjv_AutomatonAlloc(TJV_AUTOMATON_FULL_MATCH);
+        tjv_AutomatonFinish(glob->automaton, tjv_GlobToNfa(glob->automaton, middle, middle_count));
+
+        DBG2(printf("return: ok (automaton)"));
+        goto done;
+
+    }
+
+    glob->kind = TJV_GLOB_AUTOMATON;
+    glob->automaton = tjv_AutomatonAlloc(TJV_AUTOMATON_FULL_MATCH);
+
+    tjv_NfaFragment f;
+    if (objc == 0) {
+        // Nothing matches an empty list of patterns
+        f = tjv_NfaCharClass(glob->automaton, NULL, 0);
+    } else {
+        for (Tcl_Size i = 0; i < objc; i++) {
+            Tcl_Size length;
+            const char *pattern = Tcl_GetStringFromObj(objv[i], &length);
+            tjv_GlobParse(pattern, length, &parsed);
+            tjv_NfaFragment next = tjv_GlobToNfa(glob->automaton, parsed.elements, parsed.count);
+            f = (i == 0 ? next : tjv_NfaAlt(glob->automaton, f, next));
+            tjv_GlobParsedFree(&parsed);
+        }
+    }
+
+    tjv_AutomatonFinish(glob->automaton, f);
+
+    DBG2(printf("return: ok (automaton for %" TCL_SIZE_MODIFIER "d patterns)", objc));
+    return glob;
+
+done:
+
+    tjv_GlobParsedFree(&parsed);
+    return glob;
+
+}
+
+void tjv_GlobFree(tjv_Glob *glob) {
+    if (glob->prefix != NULL) {
+        ckfree(glob->prefix);
+    }
+    if (glob->suffix != NULL) {
+        ckfree(glob->suffix);
+    }
+    if (glob->automaton != NULL) {
+        tjv_AutomatonFree(glob->automaton);
+    }
+    ckfree(glob);
+}
+
+int tjv_GlobMatch(tjv_Glob *glob, const char *str, Tcl_Size length) {
+
+    switch (glob->kind) {
+    case TJV_GLOB_EXACT:
+        return (length == glob->prefix_length && memcmp(str, glob->prefix, (size_t)length) == 0);
+    case TJV_GLOB_PREFIX_SUFFIX:
+    case TJV_GLOB_AUTOMATON:
+        break;
+    }
+
+    if (length < glob->prefix_length + glob->suffix_length) {
+        return 0;
+    }
+
+    if (glob->prefix_length > 0 && memcmp(str, glob->prefix, (size_t)glob->prefix_length) != 0) {
+        return 0;
+    }
+
+    if (glob->suffix_length > 0 && memcmp(str + length - glob->suffix_length, glob->suffix, (size_t)glob->suffix_length) != 0) {
+        return 0;
+    }
+
+    if (glob->kind == TJV_GLOB_PREFIX_SUFFIX) {
+        return 1;
+    }
+
+    return tjv_AutomatonMatch(glob->automaton, str + glob->prefix_length,
+        length - glob->prefix_length - glob->suffix_length);
+
+}
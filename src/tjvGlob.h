@@ -0,0 +1,48 @@
+/**
+ * Copyright Jerily LTD. All Rights Reserved.
+ * SPDX-FileCopyrightText: 2024 Neofytos Dimitriou (neo@jerily.cy)
+ * SPDX-License-Identifier: MIT.
+ */
+#ifndef TJV_GLOB_H
+#define TJV_GLOB_H
+
+#include "common.h"
+#include "tjvAutomaton.h"
+
+typedef enum {
+    // The pattern has no special characters and it is matched as a string
+    TJV_GLOB_EXACT,
+    // The pattern is a literal prefix and a literal suffix with only
+    // stars between them
+    TJV_GLOB_PREFIX_SUFFIX,
+    // The part between the prefix and the suffix is matched by the automaton
+    TJV_GLOB_AUTOMATON
+} tjv_GlobKind;
+
+// Glob patterns with the same syntax as Tcl_StringMatch() compiled into
+// a matcher that runs in linear time. A single pattern is matched by
+// checking its literal prefix and suffix first. Multiple patterns are
+// combined into one automaton.
+typedef struct {
+    tjv_GlobKind kind;
+    char *prefix;
+    Tcl_Size prefix_length;
+    char *suffix;
+    Tcl_Size suffix_length;
+    tjv_Automaton *automaton;
+} tjv_Glob;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+tjv_Glob *tjv_GlobCompile(Tcl_Size objc, Tcl_Obj *const objv[]);
+void tjv_GlobFree(tjv_Glob *glob);
+
+int tjv_GlobMatch(tjv_Glob *glob, const char *str, Tcl_Size length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TJV_GLOB_H
@@ -0,0 +1,966 @@
+/**
+ * Copyright Jerily LTD. All Rights Reserved.
+ * SPDX-FileCopyrightText: 2024 Neofytos Dimitriou (neo@jerily.cy)
+ * SPDX-License-Identifier: MIT.
+ */
+
+// This is the second stage of JSON parsing. It walks the structural index
+// built by tjv_JsonScan() and creates a tree of tjv_JsonValue. All values
+// are allocated in a single block, because the number of values can't exceed
+// the number of structural characters. All unescaped strings are stored in
+// another single block, because they can't be longer than the source text.
+//
+// The parser doesn't use recursion, nesting depth is limited only by
+// available memory.
+
+#include "tjvJson.h"
+#include "tjvJsonNumber.h"
+#include <math.h>
+
+typedef struct {
+    tjv_JsonValue *container;
+    tjv_JsonValue *last;
+} tjv_JsonParseFrame;
+
+#define TJV_JSON_STATIC_FRAMES 32
+
+static inline int tjv_JsonIsDigit(char c) {
+    return (c >= '0' && c <= '9');
+}
+
+// Returns true if the character can follow a scalar value
+static inline int tjv_JsonIsDelimiter(char c) {
+    switch (c) {
+    case ' ':
+    case '\t':
+    case '\n':
+    case '\r':
+    case ',':
+    case ':':
+    case '[':
+    case ']':
+    case '{':
+    case '}':
+        return 1;
+    }
+    return 0;
+}
+
+static inline int tjv_JsonParseHex4(const char *p, unsigned int *code_ptr) {
+
+    unsigned int code = 0;
+
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        code <<= 4;
+        if (c >= '0' && c <= '9') {
+            code |= c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            code |= c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            code |= c - 'A' + 10;
+        } else {
+            return 0;
+        }
+    }
+
+    *code_ptr = code;
+    return 1;
+
+}
+
+static inline char *tjv_JsonPutUtf8(char *out, unsigned int code) {
+
+    if (code == 0) {
+        // Tcl represents NUL as C0 80 in its internal strings. This also
+        // keeps our strings NUL-terminated.
+        *out++ = (char)0xC0;
+        *out++ = (char)0x80;
+    } else if (code < 0x80) {
+        *out++ = (char)code;
+    } else if (code < 0x800) {
+        *out++ = (char)(0xC0 | (code >> 6));
+        *out++ = (char)(0x80 | (code & 0x3F));
+    } else if (code < 0x10000) {
+        *out++ = (char)(0xE0 | (code >> 12));
+        *out++ = (char)(0x80 | ((code >> 6) & 0x3F));
+        *out++ = (char)(0x80 | (code & 0x3F));
+    } else {
+        *out++ = (char)(0xF0 | (code >> 18));
+        *out++ = (char)(0x80 | ((code >> 12) & 0x3F));
+        *out++ = (char)(0x80 | ((code >> 6) & 0x3F));
+        *out++ = (char)(0x80 | (code & 0x3F));
+    }
+
+    return out;
+
+}
+
+// Unescapes the string that starts after the opening quote at p. Returns
+// a pointer to the character after the closing quote or NULL in case of
+// an error.
+static const char *tjv_JsonParseString(const char *p, const char *end, char **out_ptr, const char **error_ptr) {
+
+    char *out = *out_ptr;
+
+    for (;;) {
+
+        const char *quote = memchr(p, '"', end - p);
+        if (quote == NULL) {
+            *error_ptr = "unterminated string";
+            return NULL;
+        }
+
+        const char *backslash = memchr(p, '\\', quote - p);
+        if (backslash == NULL) {
+            memcpy(out, p, quote - p);
+            out += quote - p;
+            p = quote + 1;
+            break;
+        }
+
+        memcpy(out, p, backslash - p);
+        out += backslash - p;
+        p = backslash + 1;
+
+        if (p >= end) {
+            *error_ptr = "unterminated string";
+            return NULL;
+        }
+
+        unsigned int code;
+
+        switch (*p++) {
+        case '"':  *out++ = '"';  break;
+        case '\\': *out++ = '\\'; break;
+        case '/':  *out++ = '/';  break;
+        case 'b':  *out++ = '\b'; break;
+        case 'f':  *out++ = '\f'; break;
+        case 'n':  *out++ = '\n'; break;
+        case 'r':  *out++ = '\r'; break;
+        case 't':  *out++ = '\t'; break;
+        case 'u':
+            if (end - p < 4 || !tjv_JsonParseHex4(p, &code)) {
+                *error_ptr = "invalid unicode escape";
+                return NULL;
+            }
+            p += 4;
+            if (code >= 0xDC00 && code <= 0xDFFF) {
+                *error_ptr = "invalid unicode surrogate";
+                return NULL;
+            }
+            if (code >= 0xD800 && code <= 0xDBFF) {
+                unsigned int low;
+                if (end - p < 6 || p[0] != '\\' || p[1] != 'u' || !tjv_JsonParseHex4(p + 2, &low)
+                    || low < 0xDC00 || low > 0xDFFF)
+                {
+                    *error_ptr = "invalid unicode surrogate";
+                    return NULL;
+                }
+                p += 6;
+                code = 0x10000 + (((code & 0x3FF) << 10) | (low & 0x3FF));
+            }
+            out = tjv_JsonPutUtf8(out, code);
+            break;
+        default:
+            *error_ptr = "invalid escape sequence";
+            return NULL;
+        }
+
+    }
+
+    *out++ = '\0';
+    *out_ptr = out;
+
+    return p;
+
+}
+
+// Checks the number grammar and returns a pointer to the character after
+// the number or NULL if the number is malformed.
+static const char *tjv_JsonParseNumber(const char *p, const char *end) {
+
+    if (*p == '-') {
+        p++;
+    }
+
+    if (p >= end) {
+        return NULL;
+    }
+
+    if (*p == '0') {
+        p++;
+    } else if (*p >= '1' && *p <= '9') {
+        while (++p < end && tjv_JsonIsDigit(*p));
+    } else {
+        return NULL;
+    }
+
+    if (p < end && *p == '.') {
+        if (++p >= end || !tjv_JsonIsDigit(*p)) {
+            return NULL;
+        }
+        while (++p < end && tjv_JsonIsDigit(*p));
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        if (++p < end && (*p == '+' || *p == '-')) {
+            p++;
+        }
+        if (p >= end || !tjv_JsonIsDigit(*p)) {
+            return NULL;
+        }
+        while (++p < end && tjv_JsonIsDigit(*p));
+    }
+
+    return p;
+
+}
+
+static inline const char *tjv_JsonParseLiteral(const char *p, const char *end, const char *literal, Tcl_Size literal_length) {
+
+    if (end - p < literal_length || memcmp(p, literal, literal_length) != 0) {
+        return NULL;
+    }
+
+    return p + literal_length;
+
+}
+
+// Makes sure that the buffer has room for the specified number of items
+static void *tjv_JsonBuffersReserve(void *buffer, Tcl_Size *capacity_ptr, Tcl_Size need, size_t item_size) {
+
+    if (*capacity_ptr >= need) {
+        return buffer;
+    }
+
+    // The contents is not needed, so the buffer is not reallocated
+    if (buffer != NULL) {
+        ckfree(buffer);
+    }
+
+    Tcl_Size capacity = *capacity_ptr * 2;
+    if (capacity < need) {
+        capacity = need;
+    }
+
+    *capacity_ptr = capacity;
+    return ckalloc(item_size * capacity);
+
+}
+
+int tjv_JsonParse(tjv_JsonDocument *doc, const char *json, Tcl_Size length, int flags) {
+    return tjv_JsonParseBuffered(doc, NULL, json, length, flags);
+}
+
+int tjv_JsonParseBuffered(tjv_JsonDocument *doc, tjv_JsonBuffers *buffers, const char *json, Tcl_Size length, int flags) {
+
+    DBG2(printf("enter: length: %" TCL_SIZE_MODIFIER "d buffers: %p", length, (void *)buffers));
+
+    memset(doc, 0, sizeof(tjv_JsonDocument));
+
+    if (buffers != NULL) {
+        doc->buffers = buffers;
+        doc->index = buffers->index;
+    }
+
+    switch (tjv_JsonScan(json, length, flags, &doc->index)) {
+    case TJV_JSON_SCAN_OK:
+        break;
+    case TJV_JSON_SCAN_UNCLOSED_STRING:
+        doc->error = "unterminated string";
+        goto error;
+    case TJV_JSON_SCAN_CONTROL_CHARACTER:
+        doc->error = "unescaped control character in string";
+        goto error;
+    case TJV_JSON_SCAN_INVALID_UTF8:
+        doc->error = "invalid UTF-8";
+        goto error;
+    case TJV_JSON_SCAN_TOO_LARGE:
+        doc->error = "document is too large";
+        goto error;
+    }
+
+    const uint32_t *indexes = doc->index.indexes;
+    Tcl_Size count = doc->index.count;
+
+    if (count == 0) {
+        doc->error = "no value";
+        goto error;
+    }
+
+    const char *end = json + length;
+    if (buffers == NULL) {
+        doc->values = ckalloc(sizeof(tjv_JsonValue) * count);
+        doc->strings = ckalloc(length + 1);
+    } else {
+        buffers->values = tjv_JsonBuffersReserve(buffers->values, &buffers->values_capacity,
+            count, sizeof(tjv_JsonValue));
+        buffers->strings = tjv_JsonBuffersReserve(buffers->strings, &buffers->strings_capacity,
+            length + 1, sizeof(char));
+        doc->values = buffers->values;
+        doc->strings = buffers->strings;
+    }
+
+    tjv_JsonParseFrame frames_static[TJV_JSON_STATIC_FRAMES];
+    tjv_JsonParseFrame *frames = frames_static;
+    Tcl_Size frames_capacity = TJV_JSON_STATIC_FRAMES;
+    Tcl_Size depth = 0;
+
+    Tcl_Size i = 0;
+    Tcl_Size values_count = 0;
+    char *out = doc->strings;
+    const char *key = NULL;
+    Tcl_Size key_length = 0;
+    const char *p;
+    tjv_JsonValue *value;
+
+parseValue:
+
+    if (i >= count) {
+        goto unexpectedEnd;
+    }
+
+    p = json + indexes[i++];
+
+    value = &doc->values[values_count++];
+    value->next = NULL;
+    value->child = NULL;
+    value->count = 0;
+    value->key = key;
+    value->key_length = key_length;
+    value->str = NULL;
+    value->length = 0;
+    key = NULL;
+
+    if (depth > 0) {
+        tjv_JsonParseFrame *frame = &frames[depth - 1];
+        if (frame->last == NULL) {
+            frame->container->child = value;
+        } else {
+            frame->last->next = value;
+        }
+        frame->last = value;
+        frame->container->count++;
+    } else {
+        doc->root = value;
+    }
+
+    const char *value_end;
+
+    switch (*p) {
+    case '{':
+    case '[':
+
+        value->type = (*p == '{' ? TJV_JSON_OBJECT : TJV_JSON_ARRAY);
+
+        if (depth == frames_capacity) {
+            frames_capacity *= 2;
+            if (frames == frames_static) {
+                frames = ckalloc(sizeof(tjv_JsonParseFrame) * frames_capacity);
+                memcpy(frames, frames_static, sizeof(frames_static));
+            } else {
+                frames = ckrealloc(frames, sizeof(tjv_JsonParseFrame) * frames_capacity);
+            }
+        }
+
+        frames[depth].container = value;
+        frames[depth].last = NULL;
+        depth++;
+
+        if (i >= count) {
+            goto unexpectedEnd;
+        }
+
+        // Check for empty container
+        if (json[indexes[i]] == (value->type == TJV_JSON_OBJECT ? '}' : ']')) {
+            i++;
+            depth--;
+            goto valueEnd;
+        }
+
+        if (value->type == TJV_JSON_OBJECT) {
+            goto parseKey;
+        }
+
+        goto parseValue;
+
+    case '"':
+        value->type = TJV_JSON_STRING;
+        value->str = out;
+        if (tjv_JsonParseString(p + 1, end, &out, &doc->error) == NULL) {
+            goto errorAtPosition;
+        }
+        value->length = out - value->str - 1;
+        goto valueEnd;
+
+    case 't':
+        value->type = TJV_JSON_TRUE;
+        value_end = tjv_JsonParseLiteral(p, end, "true", 4);
+        break;
+    case 'f':
+        value->type = TJV_JSON_FALSE;
+        value_end = tjv_JsonParseLiteral(p, end, "false", 5);
+        break;
+    case 'n':
+        value->type = TJV_JSON_NULL;
+        value_end = tjv_JsonParseLiteral(p, end, "null", 4);
+        break;
+    case '-':
+    case '0':
+    case '1':
+    case '2':
+    case '3':
+    case '4':
+    case '5':
+    case '6':
+    case '7':
+    case '8':
+    case '9':
+        value->type = TJV_JSON_NUMBER;
+        value_end = tjv_JsonParseNumber(p, end);
+        if (value_end != NULL) {
+            value->str = p;
+            value->length = value_end - p;
+        }
+        break;
+    default:
+        doc->error = "unexpected character";
+        goto errorAtPosition;
+    }
+
+    // Make sure that the scalar value is not followed by garbage
+    if (value_end == NULL || (value_end < end && !tjv_JsonIsDelimiter(*value_end))) {
+        doc->error = (value->type == TJV_JSON_NUMBER ? "invalid number" : "invalid literal");
+        goto errorAtPosition;
+    }
+
+valueEnd:
+
+    if (depth == 0) {
+        if (i != count) {
+            p = json + indexes[i];
+            doc->error = "unexpected data after value";
+            goto errorAtPosition;
+        }
+        goto done;
+    }
+
+    if (i >= count) {
+        goto unexpectedEnd;
+    }
+
+    p = json + indexes[i++];
+
+    if (frames[depth - 1].container->type == TJV_JSON_OBJECT) {
+        if (*p == ',') {
+            goto parseKey;
+        }
+        if (*p == '}') {
+            depth--;
+            goto valueEnd;
+        }
+        doc->error = "expected ',' or '}'";
+    } else {
+        if (*p == ',') {
+            goto parseValue;
+        }
+        if (*p == ']') {
+            depth--;
+            goto valueEnd;
+        }
+        doc->error = "expected ',' or ']'";
+    }
+
+    goto errorAtPosition;
+
+parseKey:
+
+    if (i >= count) {
+        goto unexpectedEnd;
+    }
+
+    p = json + indexes[i++];
+    if (*p != '"') {
+        doc->error = "expected string key";
+        goto errorAtPosition;
+    }
+
+    key = out;
+    if (tjv_JsonParseString(p + 1, end, &out, &doc->error) == NULL) {
+        goto errorAtPosition;
+    }
+    key_length = out - key - 1;
+
+    if (i >= count) {
+        goto unexpectedEnd;
+    }
+
+    p = json + indexes[i++];
+    if (*p != ':') {
+        doc->error = "expected ':'";
+        goto errorAtPosition;
+    }
+
+    goto parseValue;
+
+unexpectedEnd:
+
+    doc->error = "unexpected end of data";
+    p = end;
+
+errorAtPosition:
+
+    doc->error_offset = p - json;
+    if (frames != frames_static) {
+        ckfree(frames);
+    }
+
+error:
+
+    DBG2(printf("return: error (%s at %" TCL_SIZE_MODIFIER "d)", doc->error, doc->error_offset));
+    tjv_JsonFree(doc);
+    return TCL_ERROR;
+
+done:
+
+    if (frames != frames_static) {
+        ckfree(frames);
+    }
+
+    DBG2(printf("return: ok (%" TCL_SIZE_MODIFIER "d values)", values_count));
+    return TCL_OK;
+
+}
+
+int tjv_JsonParseScalar(tjv_JsonValue *value, const char *json, Tcl_Size length, char *out, const char **error_ptr) {
+
+    const char *p = json;
+    const char *end = json + length;
+    const char *value_end;
+
+    memset(value, 0, sizeof(tjv_JsonValue));
+
+    if (length == 0) {
+        *error_ptr = "no value";
+        return TCL_ERROR;
+    }
+
+    switch (*p) {
+    case '"':
+        value->type = TJV_JSON_STRING;
+        value->str = out;
+        value_end = tjv_JsonParseString(p + 1, end, &out, error_ptr);
+        if (value_end == NULL) {
+            return TCL_ERROR;
+        }
+        value->length = out - value->str - 1;
+        break;
+    case 't':
+        value->type = TJV_JSON_TRUE;
+        value_end = tjv_JsonParseLiteral(p, end, "true", 4);
+        break;
+    case 'f':
+        value->type = TJV_JSON_FALSE;
+        value_end = tjv_JsonParseLiteral(p, end, "false", 5);
+        break;
+    case 'n':
+        value->type = TJV_JSON_NULL;
+        value_end = tjv_JsonParseLiteral(p, end, "null", 4);
+        break;
+    default:
+        value->type = TJV_JSON_NUMBER;
+        value_end = tjv_JsonParseNumber(p, end);
+        value->str = p;
+        value->length = length;
+        break;
+    }
+
+    if (value_end != end) {
+        *error_ptr = (value->type == TJV_JSON_NUMBER ? "invalid number" :
+            (value->type == TJV_JSON_STRING ? "unexpected data after value" : "invalid literal"));
+        return TCL_ERROR;
+    }
+
+    return TCL_OK;
+
+}
+
+void tjv_JsonFree(tjv_JsonDocument *doc) {
+
+    if (doc->buffers != NULL) {
+        // Give the storage back to the buffers. The index could be
+        // reallocated by the scanner, so it is copied back as well.
+        doc->buffers->index = doc->index;
+        doc->buffers = NULL;
+        doc->values = NULL;
+        doc->strings = NULL;
+        memset(&doc->index, 0, sizeof(tjv_JsonScanIndex));
+        doc->root = NULL;
+        return;
+    }
+
+    if (doc->values != NULL) {
+        ckfree(doc->values);
+        doc->values = NULL;
+    }
+
+    if (doc->strings != NULL) {
+        ckfree(doc->strings);
+        doc->strings = NULL;
+    }
+
+    tjv_JsonScanIndexFree(&doc->index);
+    doc->root = NULL;
+
+}
+
+void tjv_JsonBuffersFree(tjv_JsonBuffers *buffers) {
+
+    if (buffers->values != NULL) {
+        ckfree(buffers->values);
+        buffers->values = NULL;
+    }
+    buffers->values_capacity = 0;
+
+    if (buffers->strings != NULL) {
+        ckfree(buffers->strings);
+        buffers->strings = NULL;
+    }
+    buffers->strings_capacity = 0;
+
+    tjv_JsonScanIndexFree(&buffers->index);
+
+}
+
+// Object members are matched case-insensitively to keep compatibility
+// with cJSON_GetObjectItem() used by previous versions.
+const tjv_JsonValue *tjv_JsonGetObjectItem(const tjv_JsonValue *object, const char *key) {
+
+    const tjv_JsonValue *item;
+    tjv_JsonArrayForEach(item, object) {
+
+        const unsigned char *a = (const unsigned char *)item->key;
+        const unsigned char *b = (const unsigned char *)key;
+
+        for (;; a++, b++) {
+            unsigned char ca = (*a >= 'A' && *a <= 'Z' ? *a + ('a' - 'A') : *a);
+            unsigned char cb = (*b >= 'A' && *b <= 'Z' ? *b + ('a' - 'A') : *b);
+            if (ca != cb) {
+                break;
+            }
+            if (ca == '\0') {
+                return item;
+            }
+        }
+
+    }
+
+    return NULL;
+
+}
+
+void tjv_JsonAppendString(Tcl_Obj *obj, const char *str, Tcl_Size length) {
+
+    static const char hex[] = "0123456789abcdef";
+
+    Tcl_AppendToObj(obj, "\"", 1);
+
+    const char *start = str;
+    const char *end = str + length;
+    for (const char *p = str; p < end; p++) {
+
+        unsigned char c = (unsigned char)*p;
+        char buf[6];
+        Tcl_Size buf_length = 2;
+
+        if (c == '"' || c == '\\') {
+            buf[0] = '\\';
+            buf[1] = (char)c;
+        } else if (c >= 0x20 && !(c == 0xC0 && p + 1 < end && (unsigned char)p[1] == 0x80)) {
+            continue;
+        } else if (c == '\n') {
+            memcpy(buf, "\\n", 2);
+        } else if (c == '\r') {
+            memcpy(buf, "\\r", 2);
+        } else if (c == '\t') {
+            memcpy(buf, "\\t", 2);
+        } else {
+            // Control characters and NUL in modified UTF-8 (C0 80)
+            unsigned char code = (c == 0xC0 ? 0 : c);
+            memcpy(buf, "\\u00", 4);
+            buf[4] = hex[code >> 4];
+            buf[5] = hex[code & 0xF];
+            buf_length = 6;
+        }
+
+        Tcl_AppendToObj(obj, start, p - start);
+        Tcl_AppendToObj(obj, buf, buf_length);
+        if (c == 0xC0) {
+            p++;
+        }
+        start = p + 1;
+
+    }
+
+    Tcl_AppendToObj(obj, start, end - start);
+    Tcl_AppendToObj(obj, "\"", 1);
+
+}
+
+void tjv_JsonAppendWideInt(Tcl_Obj *obj, Tcl_WideInt val) {
+    char buf[32];
+    int length = snprintf(buf, sizeof(buf), "%" TCL_LL_MODIFIER "d", val);
+    Tcl_AppendToObj(obj, buf, length);
+}
+
+void tjv_JsonAppendDouble(Tcl_Obj *obj, double val) {
+    if (!isfinite(val)) {
+        Tcl_AppendToObj(obj, "null", 4);
+        return;
+    }
+    char buf[TJV_JSON_NUMBER_TEXT_SIZE];
+    Tcl_Size length = tjv_JsonFormatDouble(buf, val);
+    Tcl_AppendToObj(obj, buf, length);
+}
+
+void tjv_JsonAppendSeparator(Tcl_Obj *obj) {
+    Tcl_Size length;
+    const char *str = Tcl_GetStringFromObj(obj, &length);
+    if (length > 0 && str[length - 1] != '[' && str[length - 1] != '{') {
+        Tcl_AppendToObj(obj, ",", 1);
+    }
+}
+
+void tjv_JsonAppendKey(Tcl_Obj *obj, Tcl_Obj *key) {
+    tjv_JsonAppendSeparator(obj);
+    Tcl_Size length;
+    const char *str = Tcl_GetStringFromObj(key, &length);
+    tjv_JsonAppendString(obj, str, length);
+    Tcl_AppendToObj(obj, ":", 1);
+}
+
+// The value is written without recursion, the stack holds the arrays and
+// objects that are not closed yet.
+void tjv_JsonAppendValue(Tcl_Obj *obj, const tjv_JsonValue *value) {
+
+    const tjv_JsonValue *stack_static[TJV_JSON_STATIC_FRAMES];
+    const tjv_JsonValue **stack = stack_static;
+    Tcl_Size stack_capacity = TJV_JSON_STATIC_FRAMES;
+    Tcl_Size depth = 0;
+
+    const tjv_JsonValue *v = value;
+    for (;;) {
+
+        if (depth > 0 && tjv_JsonIsObject(stack[depth - 1])) {
+            tjv_JsonAppendString(obj, v->key, v->key_length);
+            Tcl_AppendToObj(obj, ":", 1);
+        }
+
+        switch (v->type) {
+        case TJV_JSON_NULL:
+            Tcl_AppendToObj(obj, "null", 4);
+            break;
+        case TJV_JSON_FALSE:
+            Tcl_AppendToObj(obj, "false", 5);
+            break;
+        case TJV_JSON_TRUE:
+            Tcl_AppendToObj(obj, "true", 4);
+            break;
+        case TJV_JSON_NUMBER:
+            Tcl_AppendToObj(obj, v->str, v->length);
+            break;
+        case TJV_JSON_STRING:
+            tjv_JsonAppendString(obj, v->str, v->length);
+            break;
+        case TJV_JSON_ARRAY:
+        case TJV_JSON_OBJECT:
+            Tcl_AppendToObj(obj, (tjv_JsonIsArray(v) ? "[" : "{"), 1);
+            if (v->child != NULL) {
+                if (depth == stack_capacity) {
+                    stack_capacity *= 2;
+                    if (stack == stack_static) {
+                        stack = ckalloc(sizeof(tjv_JsonValue *) * stack_capacity);
+                        memcpy(stack, stack_static, sizeof(stack_static));
+                    } else {
+                        stack = ckrealloc(stack, sizeof(tjv_JsonValue *) * stack_capacity);
+                    }
+                }
+                stack[depth++] = v;
+                v = v->child;
+                continue;
+            }
+            Tcl_AppendToObj(obj, (tjv_JsonIsArray(v) ? "]" : "}"), 1);
+            break;
+        }
+
+        // Close the containers where v is the last element
+        while (depth > 0 && v->next == NULL) {
+            v = stack[--depth];
+            Tcl_AppendToObj(obj, (tjv_JsonIsArray(v) ? "]" : "}"), 1);
+        }
+
+        if (depth == 0) {
+            break;
+        }
+
+        Tcl_AppendToObj(obj, ",", 1);
+        v = v->next;
+
+    }
+
+    if (stack != stack_static) {
+        ckfree(stack);
+    }
+
+}
+
+typedef struct {
+    const tjv_JsonValue *container;
+    // The canonical forms of the elements that are already processed
+    Tcl_Obj *parts;
+} tjv_JsonCanonicalFrame;
+
+static void tjv_JsonAppendCanonicalString(Tcl_Obj *obj, const char *str, Tcl_Size length) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "s%" TCL_SIZE_MODIFIER "d:", length);
+    Tcl_AppendToObj(obj, buf, -1);
+    Tcl_AppendToObj(obj, str, length);
+}
+
+static int tjv_JsonCanonicalCompare(const void *a, const void *b) {
+    Tcl_Size a_length, b_length;
+    const char *a_str = Tcl_GetStringFromObj(*(Tcl_Obj * const *)a, &a_length);
+    const char *b_str = Tcl_GetStringFromObj(*(Tcl_Obj * const *)b, &b_length);
+    int rc = memcmp(a_str, b_str, (a_length < b_length ? a_length : b_length));
+    if (rc != 0) {
+        return rc;
+    }
+    return (a_length < b_length ? -1 : (a_length > b_length ? 1 : 0));
+}
+
+// Joins the parts of the container. Object members are sorted, so objects
+// with the same members in a different order have the same canonical form.
+static Tcl_Obj *tjv_JsonCanonicalClose(const tjv_JsonCanonicalFrame *frame) {
+
+    Tcl_Size objc;
+    Tcl_Obj **objv;
+    Tcl_ListObjGetElements(NULL, frame->parts, &objc, &objv);
+
+    if (tjv_JsonIsObject(frame->container)) {
+        qsort(objv, objc, sizeof(Tcl_Obj *), tjv_JsonCanonicalCompare);
+    }
+
+    Tcl_Obj *result = Tcl_NewStringObj((tjv_JsonIsArray(frame->container) ? "[" : "{"), 1);
+    for (Tcl_Size i = 0; i < objc; i++) {
+        if (i > 0) {
+            Tcl_AppendToObj(result, ",", 1);
+        }
+        Tcl_AppendObjToObj(result, objv[i]);
+    }
+    Tcl_AppendToObj(result, (tjv_JsonIsArray(frame->container) ? "]" : "}"), 1);
+
+    Tcl_BounceRefCount(frame->parts);
+    return result;
+
+}
+
+// The value is processed without recursion, the stack holds the arrays and
+// objects that are not closed yet.
+Tcl_Obj *tjv_JsonCanonical(const tjv_JsonValue *value) {
+
+    tjv_JsonCanonicalFrame stack_static[TJV_JSON_STATIC_FRAMES];
+    tjv_JsonCanonicalFrame *stack = stack_static;
+    Tcl_Size stack_capacity = TJV_JSON_STATIC_FRAMES;
+    Tcl_Size depth = 0;
+
+    Tcl_Obj *part = NULL;
+    const tjv_JsonValue *v = value;
+    for (;;) {
+
+        switch (v->type) {
+        case TJV_JSON_NULL:
+            part = Tcl_NewStringObj("n", 1);
+            break;
+        case TJV_JSON_FALSE:
+            part = Tcl_NewStringObj("f", 1);
+            break;
+        case TJV_JSON_TRUE:
+            part = Tcl_NewStringObj("t", 1);
+            break;
+        case TJV_JSON_NUMBER:
+            part = Tcl_NewObj();
+            tjv_JsonAppendCanonicalNumber(part, v);
+            break;
+        case TJV_JSON_STRING:
+            part = Tcl_NewObj();
+            tjv_JsonAppendCanonicalString(part, v->str, v->length);
+            break;
+        case TJV_JSON_ARRAY:
+        case TJV_JSON_OBJECT:
+            if (v->child == NULL) {
+                part = Tcl_NewStringObj((tjv_JsonIsArray(v) ? "[]" : "{}"), 2);
+                break;
+            }
+            if (depth == stack_capacity) {
+                stack_capacity *= 2;
+                if (stack == stack_static) {
+                    stack = ckalloc(sizeof(tjv_JsonCanonicalFrame) * stack_capacity);
+                    memcpy(stack, stack_static, sizeof(stack_static));
+                } else {
+                    stack = ckrealloc(stack, sizeof(tjv_JsonCanonicalFrame) * stack_capacity);
+                }
+            }
+            stack[depth].container = v;
+            stack[depth].parts = Tcl_NewListObj(0, NULL);
+            depth++;
+            v = v->child;
+            continue;
+        }
+
+        // Add the part to its container and close the containers where
+        // v is the last element
+        for (;;) {
+
+            if (depth == 0) {
+                goto done;
+            }
+
+            tjv_JsonCanonicalFrame *frame = &stack[depth - 1];
+            if (tjv_JsonIsObject(frame->container)) {
+                Tcl_Obj *member = Tcl_NewObj();
+                tjv_JsonAppendCanonicalString(member, v->key, v->key_length);
+                Tcl_AppendToObj(member, ":", 1);
+                Tcl_AppendObjToObj(member, part);
+                Tcl_BounceRefCount(part);
+                part = member;
+            }
+            Tcl_ListObjAppendElement(NULL, frame->parts, part);
+
+            if (v->next != NULL) {
+                break;
+            }
+
+            part = tjv_JsonCanonicalClose(frame);
+            v = frame->container;
+            depth--;
+
+        }
+
+        v = v->next;
+
+    }
+
+done:
+
+    if (stack != stack_static) {
+        ckfree(stack);
+    }
+
+    return part;
+
+}
+
+void tjv_JsonInit(void) {
+    tjv_JsonScanInit();
+}
@@ -0,0 +1,120 @@
+/**
+ * Copyright Jerily LTD. All Rights Reserved.
+ * SPDX-FileCopyrightText: 2024 Neofytos Dimitriou (neo@jerily.cy)
+ * SPDX-License-Identifier: MIT.
+ */
+#ifndef TJV_JSON_H
+#define TJV_JSON_H
+
+#include "common.h"
+#include "tjvJsonScan.h"
+
+typedef enum {
+    TJV_JSON_NULL,
+    TJV_JSON_FALSE,
+    TJV_JSON_TRUE,
+    TJV_JSON_NUMBER,
+    TJV_JSON_STRING,
+    TJV_JSON_ARRAY,
+    TJV_JSON_OBJECT
+} tjv_JsonType;
+
+typedef struct tjv_JsonValue tjv_JsonValue;
+
+struct tjv_JsonValue {
+    tjv_JsonType type;
+    // Next element of the parent array or object
+    tjv_JsonValue *next;
+    // First element of array or object
+    tjv_JsonValue *child;
+    // Number of elements in array or object
+    Tcl_Size count;
+    // Member name if the value belongs to an object (unescaped, NUL-terminated)
+    const char *key;
+    Tcl_Size key_length;
+    // Unescaped string for TJV_JSON_STRING or the source text of
+    // TJV_JSON_NUMBER. Strings parsed from JSON text are NUL-terminated,
+    // but strings decoded from MessagePack may point into its data, so
+    // the length should always be used.
+    const char *str;
+    Tcl_Size length;
+};
+
+// Storage that is reused by parses of many small documents, e.g. records of
+// NDJSON text, so that it is not allocated for each of them. It grows to
+// the size of the largest document and is freed by tjv_JsonBuffersFree().
+typedef struct {
+    tjv_JsonValue *values;
+    Tcl_Size values_capacity;
+    char *strings;
+    Tcl_Size strings_capacity;
+    tjv_JsonScanIndex index;
+} tjv_JsonBuffers;
+
+typedef struct {
+    tjv_JsonValue *root;
+    // Description of parse error and its position in the source text
+    const char *error;
+    Tcl_Size error_offset;
+    // Storage for values, unescaped strings and structural index
+    tjv_JsonValue *values;
+    char *strings;
+    tjv_JsonScanIndex index;
+    // The buffers that own the storage, or NULL if it is owned by the document
+    tjv_JsonBuffers *buffers;
+} tjv_JsonDocument;
+
+#define tjv_JsonIsNull(x)   ((x)->type == TJV_JSON_NULL)
+#define tjv_JsonIsBool(x)   ((x)->type == TJV_JSON_FALSE || (x)->type == TJV_JSON_TRUE)
+#define tjv_JsonIsTrue(x)   ((x)->type == TJV_JSON_TRUE)
+#define tjv_JsonIsNumber(x) ((x)->type == TJV_JSON_NUMBER)
+#define tjv_JsonIsString(x) ((x)->type == TJV_JSON_STRING)
+#define tjv_JsonIsArray(x)  ((x)->type == TJV_JSON_ARRAY)
+#define tjv_JsonIsObject(x) ((x)->type == TJV_JSON_OBJECT)
+
+#define tjv_JsonArrayForEach(el, arr) for ((el) = (arr)->child; (el) != NULL; (el) = (el)->next)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void tjv_JsonInit(void);
+
+int tjv_JsonParse(tjv_JsonDocument *doc, const char *json, Tcl_Size length, int flags);
+void tjv_JsonFree(tjv_JsonDocument *doc);
+// The same as tjv_JsonParse(), but the storage of the document is taken from
+// the buffers. It is given back to them by tjv_JsonFree(), and the buffers
+// can't be used by another document until then.
+int tjv_JsonParseBuffered(tjv_JsonDocument *doc, tjv_JsonBuffers *buffers, const char *json, Tcl_Size length, int flags);
+void tjv_JsonBuffersFree(tjv_JsonBuffers *buffers);
+// Parses the text of a single scalar value without the structural index,
+// e.g. a token of a JSON stream. A string is unescaped to out, which should
+// have room for length + 1 bytes. The text should not contain unescaped
+// control characters, as they are not checked.
+int tjv_JsonParseScalar(tjv_JsonValue *value, const char *json, Tcl_Size length, char *out, const char **error_ptr);
+
+const tjv_JsonValue *tjv_JsonGetObjectItem(const tjv_JsonValue *object, const char *key);
+
+// Append the value or the string to obj as compact JSON text
+void tjv_JsonAppendValue(Tcl_Obj *obj, const tjv_JsonValue *value);
+void tjv_JsonAppendString(Tcl_Obj *obj, const char *str, Tcl_Size length);
+// Append the number in the shortest form that is parsed to the same value.
+// Infinity and NaN can't be represented in JSON and are appended as null.
+void tjv_JsonAppendWideInt(Tcl_Obj *obj, Tcl_WideInt val);
+void tjv_JsonAppendDouble(Tcl_Obj *obj, double val);
+// Appends a comma if obj ends with a value, i.e. the next value is not
+// the first one in its array or object
+void tjv_JsonAppendSeparator(Tcl_Obj *obj);
+// Appends the key of the next object member with the separator before it
+void tjv_JsonAppendKey(Tcl_Obj *obj, Tcl_Obj *key);
+
+// Returns a new object with the canonical form of the value. Values that
+// are equal as JSON (e.g. numbers 1 and 1.0, objects with the same members
+// in a different order) have the same canonical form.
+Tcl_Obj *tjv_JsonCanonical(const tjv_JsonValue *value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TJV_JSON_H
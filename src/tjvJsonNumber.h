@@ -0,0 +1,65 @@
+/**
+ * Copyright Jerily LTD. All Rights Reserved.
+ * SPDX-FileCopyrightText: 2024 Neofytos Dimitriou (neo@jerily.cy)
+ * SPDX-License-Identifier: MIT.
+ */
+#ifndef TJV_JSONNUMBER_H
+#define TJV_JSONNUMBER_H
+
+#include "tjvJson.h"
+#include <tclTomMath.h>
+
+typedef enum {
+    // The number is not an integer
+    TJV_JSON_INTEGER_NONE,
+    // The integer fits into Tcl_WideInt
+    TJV_JSON_INTEGER_WIDE,
+    // The integer is outside the Tcl_WideInt range
+    TJV_JSON_INTEGER_BIG,
+    // The integer has more than TJV_JSON_INTEGER_MAX_DIGITS digits
+    TJV_JSON_INTEGER_TOO_LONG
+} tjv_JsonIntegerType;
+
+// The maximum number of digits in an integer. It limits the size of
+// the bignum that is built for numbers like 1e1000000000.
+#define TJV_JSON_INTEGER_MAX_DIGITS 1024
+
+// Room for the text of any number that is converted from binary formats,
+// e.g. "-18446744073709551616" or "-2.2250738585072014e-308". It is larger
+// than TCL_DOUBLE_SPACE + 2, see tjv_JsonFormatDouble().
+#define TJV_JSON_NUMBER_TEXT_SIZE 32
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+double tjv_JsonGetNumberValue(const tjv_JsonValue *value);
+
+// For TJV_JSON_INTEGER_BIG, *wide_ptr is set to the sign of the value (-1 or 1)
+// and the bignum is initialized only if big_ptr is not NULL.
+tjv_JsonIntegerType tjv_JsonGetIntegerValue(const tjv_JsonValue *value, Tcl_WideInt *wide_ptr, mp_int *big_ptr);
+
+// Checks the number against the bounds, min_ptr and max_ptr can be NULL.
+// Returns -1 if the number is less than the minimum, 1 if it is greater
+// than the maximum and 0 otherwise. The result is the same as for
+// the converted value, but the conversion is skipped when the result is clear
+// from the digits and the exponent. If the number was converted,
+// *is_converted_ptr is set to 1 and its value is stored in *value_ptr.
+int tjv_JsonCheckNumberRange(const tjv_JsonValue *value, const double *min_ptr, const double *max_ptr, double *value_ptr, int *is_converted_ptr);
+
+// Appends the canonical form of the number to obj. Numbers that are equal
+// in value (e.g. 1, 1.0 and 10e-1) have the same canonical form.
+void tjv_JsonAppendCanonicalNumber(Tcl_Obj *obj, const tjv_JsonValue *value);
+
+// Writes the shortest text that reads back as the same double to out, which
+// should have room for TJV_JSON_NUMBER_TEXT_SIZE bytes. The text always has
+// a fraction or an exponent and doesn't depend on the locale. As with other
+// conversions of doubles in Tcl, a non-zero tcl_precision limits the number
+// of digits. The value should be finite. Returns the length.
+Tcl_Size tjv_JsonFormatDouble(char *out, double value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TJV_JSONNUMBER_H
@@ -0,0 +1,914 @@
+/**
+ * Copyright Jerily LTD. All Rights Reserved.
+ * SPDX-FileCopyrightText: 2024 Neofytos Dimitriou (neo@jerily.cy)
+ * SPDX-License-Identifier: MIT.
+ */
+
+// This is the first stage of JSON parsing. It is modeled after stage 1 of
+// simdjson (https://arxiv.org/abs/1902.08318): the input is processed in
+// 64-byte blocks, each block is turned into a set of 64-bit masks (quotes,
+// backslashes, operators, whitespace, control characters) and then plain
+// bit arithmetic finds escaped characters, string boundaries and the starts
+// of all values. At the same time, the input is validated as UTF-8 using
+// the lookup algorithm by John Keiser and Daniel Lemire.
+//
+// There are vectorized kernels for AVX2, SSE4.2 and NEON and a portable
+// scalar kernel. The kernel is selected at runtime based on the features of
+// the current CPU. A less capable kernel can be forced by the TJV_SIMD
+// environment variable ("scalar" or "sse42"), which is mainly useful for
+// benchmarking.
+
+#include "tjvJsonScan.h"
+
+#if (defined(__x86_64__) || defined(_M_X64)) && (defined(__GNUC__) || defined(__clang__))
+# define TJV_SCAN_X86 1
+# include <immintrin.h>
+# define TJV_TARGET_SSE42 __attribute__((target("sse4.2")))
+# define TJV_TARGET_AVX2  __attribute__((target("avx2")))
+#elif defined(__aarch64__) || defined(_M_ARM64)
+# define TJV_SCAN_NEON 1
+# include <arm_neon.h>
+#endif
+
+typedef struct {
+    // 1 if the last byte of the previous block is an odd-length backslash sequence
+    uint64_t prev_odd_backslash;
+    // all ones if the previous block ended inside a string
+    uint64_t prev_in_string;
+    // 1 if the last byte of the previous block is a part of non-quote scalar
+    uint64_t prev_scalar;
+    // unescaped control characters found inside strings
+    uint64_t ctrl_error;
+} tjv_JsonScanState;
+
+typedef tjv_JsonScanResult (tjv_JsonScanKernel)(const char *buf, Tcl_Size length, tjv_JsonScanIndex *idx, int *utf8_error_ptr);
+
+static tjv_JsonScanKernel *tjv_json_scan_kernel = NULL;
+static const char *tjv_json_scan_kernel_name = NULL;
+
+typedef Tcl_Size (tjv_Utf8LengthKernel)(const char *buf, Tcl_Size length);
+
+static tjv_Utf8LengthKernel *tjv_utf8_length_kernel = NULL;
+
+static int tjv_json_scan_initialized = 0;
+static Tcl_Mutex tjv_json_scan_initialize_mx;
+
+// Byte classes for the scalar kernel
+#define TJV_SCAN_CLASS_QUOTE     0x01
+#define TJV_SCAN_CLASS_BACKSLASH 0x02
+#define TJV_SCAN_CLASS_OP        0x04
+#define TJV_SCAN_CLASS_WS        0x08
+#define TJV_SCAN_CLASS_CTRL      0x10
+
+static unsigned char tjv_json_scan_class[256];
+
+static inline uint64_t tjv_JsonScanPrefixXor(uint64_t x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+// Returns the mask of characters that are escaped by a backslash
+static inline uint64_t tjv_JsonScanEscaped(tjv_JsonScanState *st, uint64_t backslash) {
+
+    const uint64_t even_bits = 0x5555555555555555ULL;
+    const uint64_t odd_bits = ~even_bits;
+
+    uint64_t start_edges = backslash & ~(backslash << 1);
+    // If the previous block ended with an odd-length backslash sequence, then
+    // the parity of the sequence starts is flipped.
+    uint64_t even_start_mask = even_bits ^ st->prev_odd_backslash;
+    uint64_t even_starts = start_edges & even_start_mask;
+    uint64_t odd_starts = start_edges & ~even_start_mask;
+    uint64_t even_carries = backslash + even_starts;
+    uint64_t odd_carries = backslash + odd_starts;
+    uint64_t ends_odd_backslash = (odd_carries < backslash ? 1 : 0);
+    odd_carries |= st->prev_odd_backslash;
+    st->prev_odd_backslash = ends_odd_backslash;
+    uint64_t even_carry_ends = even_carries & ~backslash;
+    uint64_t odd_carry_ends = odd_carries & ~backslash;
+    uint64_t even_start_odd_end = even_carry_ends & odd_bits;
+    uint64_t odd_start_even_end = odd_carry_ends & even_bits;
+
+    return even_start_odd_end | odd_start_even_end;
+
+}
+
+// Converts the classification masks of a block into the structural mask and
+// updates the carried state.
+static inline uint64_t tjv_JsonScanStructurals(tjv_JsonScanState *st, uint64_t quote,
+    uint64_t backslash, uint64_t op, uint64_t ws, uint64_t ctrl)
+{
+
+    quote &= ~tjv_JsonScanEscaped(st, backslash);
+
+    // in_string includes opening quotes and excludes closing quotes
+    uint64_t in_string = tjv_JsonScanPrefixXor(quote) ^ st->prev_in_string;
+    st->prev_in_string = (uint64_t)((int64_t)in_string >> 63);
+    // string_tail excludes opening quotes and includes closing quotes
+    uint64_t string_tail = in_string ^ quote;
+
+    st->ctrl_error |= ctrl & string_tail;
+
+    // Scalars are everything that is not an operator or whitespace. The first
+    // byte of each scalar is a value start, except for those that follow
+    // another non-quote scalar byte.
+    uint64_t scalar = ~(op | ws);
+    uint64_t nonquote_scalar = scalar & ~quote;
+    uint64_t follows_scalar = (nonquote_scalar << 1) | st->prev_scalar;
+    st->prev_scalar = nonquote_scalar >> 63;
+    uint64_t scalar_start = scalar & ~follows_scalar;
+
+    return (op | scalar_start) & ~string_tail;
+
+}
+
+static inline int tjv_JsonScanReserve(tjv_JsonScanIndex *idx, Tcl_Size need) {
+
+    if (idx->count + need <= idx->capacity) {
+        return 1;
+    }
+
+    Tcl_Size capacity = (idx->capacity < 64 ? 64 : idx->capacity);
+    while (capacity < idx->count + need) {
+        capacity *= 2;
+    }
+
+    uint32_t *indexes = attemptckrealloc(idx->indexes, sizeof(uint32_t) * capacity);
+    if (indexes == NULL) {
+        return 0;
+    }
+
+    idx->indexes = indexes;
+    idx->capacity = capacity;
+    return 1;
+
+}
+
+static inline void tjv_JsonScanFlatten(tjv_JsonScanIndex *idx, uint32_t base, uint64_t bits) {
+
+    uint32_t *out = idx->indexes + idx->count;
+    while (bits != 0) {
+        *out++ = base + (uint32_t)TJV_CTZ64(bits);
+        bits &= bits - 1;
+    }
+    idx->count = out - idx->indexes;
+
+}
+
+static inline tjv_JsonScanResult tjv_JsonScanFinish(tjv_JsonScanState *st) {
+
+    if (st->prev_in_string) {
+        return TJV_JSON_SCAN_UNCLOSED_STRING;
+    }
+    if (st->ctrl_error) {
+        return TJV_JSON_SCAN_CONTROL_CHARACTER;
+    }
+    return TJV_JSON_SCAN_OK;
+
+}
+
+// Loads a block of 64 bytes. The last block is padded with spaces so that
+// it does not change the classification of the real input.
+static inline const uint8_t *tjv_JsonScanLoadBlock(const char *buf, Tcl_Size length, Tcl_Size pos, uint8_t *tail) {
+
+    if (length - pos >= 64) {
+        return (const uint8_t *)buf + pos;
+    }
+
+    memset(tail, ' ', 64);
+    memcpy(tail, buf + pos, length - pos);
+    return tail;
+
+}
+
+int tjv_Utf8Validate(const unsigned char *buf, Tcl_Size length, int flags) {
+
+    int modified = (flags & TJV_JSON_SCAN_MODIFIED_UTF8);
+    const unsigned char *end = buf + length;
+
+    while (buf < end) {
+
+        // Fast path for ASCII
+        if (end - buf >= 8) {
+            uint64_t v;
+            memcpy(&v, buf, sizeof(v));
+            if ((v & 0x8080808080808080ULL) == 0) {
+                buf += 8;
+                continue;
+            }
+        }
+
+        unsigned char c = *buf;
+
+        if (c < 0x80) {
+            buf++;
+            continue;
+        }
+
+        Tcl_Size size;
+        unsigned char lo = 0x80, hi = 0xBF;
+
+        if (c >= 0xC2 && c <= 0xDF) {
+            size = 2;
+        } else if (c == 0xC0 && modified) {
+            // NUL in modified UTF-8
+            size = 2;
+            hi = 0x80;
+        } else if (c == 0xE0) {
+            size = 3;
+            lo = 0xA0;
+        } else if (c == 0xED) {
+            size = 3;
+            // Surrogates are allowed in modified UTF-8
+            if (!modified) {
+                hi = 0x9F;
+            }
+        } else if (c >= 0xE1 && c <= 0xEF) {
+            size = 3;
+        } else if (c == 0xF0) {
+            size = 4;
+            lo = 0x90;
+        } else if (c >= 0xF1 && c <= 0xF3) {
+            size = 4;
+        } else if (c == 0xF4) {
+            size = 4;
+            hi = 0x8F;
+        } else {
+            return 0;
+        }
+
+        if (end - buf < size || buf[1] < lo || buf[1] > hi) {
+            return 0;
+        }
+
+        for (Tcl_Size i = 2; i < size; i++) {
+            if ((buf[i] & 0xC0) != 0x80) {
+                return 0;
+            }
+        }
+
+        buf += size;
+
+    }
+
+    return 1;
+
+}
+
+// Counts the characters as the bytes that are not continuation bytes
+// (10xxxxxx). The input is not validated.
+static Tcl_Size tjv_Utf8LengthScalar(const char *buf, Tcl_Size length) {
+
+    Tcl_Size count = 0;
+    Tcl_Size pos = 0;
+
+    // A byte is a continuation byte if its bit 7 is set and bit 6 is not.
+    // Shifting by one moves bit 6 of each byte to bit 7 of the same byte.
+    for (; pos + 8 <= length; pos += 8) {
+        uint64_t v;
+        memcpy(&v, buf + pos, sizeof(v));
+        uint64_t cont = v & ~(v << 1) & 0x8080808080808080ULL;
+        count += 8 - TJV_POPCOUNT64(cont);
+    }
+
+    for (; pos < length; pos++) {
+        if (((unsigned char)buf[pos] & 0xC0) != 0x80) {
+            count++;
+        }
+    }
+
+    return count;
+
+}
+
+static tjv_JsonScanResult tjv_JsonScanScalar(const char *buf, Tcl_Size length, tjv_JsonScanIndex *idx, int *utf8_error_ptr) {
+
+    tjv_JsonScanState st = { 0, 0, 0, 0 };
+    uint8_t tail[64];
+
+    *utf8_error_ptr = !tjv_Utf8Validate((const unsigned char *)buf, length, 0);
+
+    for (Tcl_Size pos = 0; pos < length; pos += 64) {
+
+        const uint8_t *block = tjv_JsonScanLoadBlock(buf, length, pos, tail);
+
+        uint64_t quote = 0, backslash = 0, op = 0, ws = 0, ctrl = 0;
+        for (int i = 0; i < 64; i++) {
+            unsigned char c = tjv_json_scan_class[block[i]];
+            uint64_t bit = (uint64_t)1 << i;
+            if (c & TJV_SCAN_CLASS_QUOTE) quote |= bit;
+            if (c & TJV_SCAN_CLASS_BACKSLASH) backslash |= bit;
+            if (c & TJV_SCAN_CLASS_OP) op |= bit;
+            if (c & TJV_SCAN_CLASS_WS) ws |= bit;
+            if (c & TJV_SCAN_CLASS_CTRL) ctrl |= bit;
+        }
+
+        if (!tjv_JsonScanReserve(idx, 64)) {
+            return TJV_JSON_SCAN_TOO_LARGE;
+        }
+        tjv_JsonScanFlatten(idx, (uint32_t)pos, tjv_JsonScanStructurals(&st, quote, backslash, op, ws, ctrl));
+
+    }
+
+    return tjv_JsonScanFinish(&st);
+
+}
+
+#ifdef TJV_SCAN_X86
+
+// UTF-8 validation by John Keiser and Daniel Lemire, see:
+//     https://arxiv.org/abs/2010.03090
+//
+// The tables below classify each pair of adjacent bytes (by the high nibble
+// and low nibble of the first byte and the high nibble of the second byte).
+// Each bit is a kind of error, an error is present if the bit is set in all
+// three lookups.
+
+#define TJV_UTF8_TOO_SHORT      (1 << 0)
+#define TJV_UTF8_TOO_LONG       (1 << 1)
+#define TJV_UTF8_OVERLONG_3     (1 << 2)
+#define TJV_UTF8_TOO_LARGE      (1 << 3)
+#define TJV_UTF8_SURROGATE      (1 << 4)
+#define TJV_UTF8_OVERLONG_2     (1 << 5)
+#define TJV_UTF8_TOO_LARGE_1000 (1 << 6)
+#define TJV_UTF8_OVERLONG_4     (1 << 6)
+#define TJV_UTF8_TWO_CONTS      ((char)(1 << 7))
+#define TJV_UTF8_CARRY          (TJV_UTF8_TOO_SHORT | TJV_UTF8_TOO_LONG | TJV_UTF8_TWO_CONTS)
+
+#define TJV_UTF8_TABLE_BYTE_1_HIGH \
+    TJV_UTF8_TOO_LONG, TJV_UTF8_TOO_LONG, TJV_UTF8_TOO_LONG, TJV_UTF8_TOO_LONG, \
+    TJV_UTF8_TOO_LONG, TJV_UTF8_TOO_LONG, TJV_UTF8_TOO_LONG, TJV_UTF8_TOO_LONG, \
+    TJV_UTF8_TWO_CONTS, TJV_UTF8_TWO_CONTS, TJV_UTF8_TWO_CONTS, TJV_UTF8_TWO_CONTS, \
+    TJV_UTF8_TOO_SHORT | TJV_UTF8_OVERLONG_2, \
+    TJV_UTF8_TOO_SHORT, \
+    TJV_UTF8_TOO_SHORT | TJV_UTF8_OVERLONG_3 | TJV_UTF8_SURROGATE, \
+    TJV_UTF8_TOO_SHORT | TJV_UTF8_TOO_LARGE | TJV_UTF8_TOO_LARGE_1000 | TJV_UTF8_OVERLONG_4
+
+#define TJV_UTF8_TABLE_BYTE_1_LOW \
+    TJV_UTF8_CARRY | TJV_UTF8_OVERLONG_3 | TJV_UTF8_OVERLONG_2 | TJV_UTF8_OVERLONG_4, \
+    TJV_UTF8_CARRY | TJV_UTF8_OVERLONG_2, \
+    TJV_UTF8_CARRY, \
+    TJV_UTF8_CARRY, \
+    TJV_UTF8_CARRY | TJV_UTF8_TOO_LARGE, \
+    TJV_UTF8_CARRY | TJV_UTF8_TOO_LARGE | TJV_UTF8_TOO_LARGE_1000, \
+    TJV_UTF8_CARRY | TJV_UTF8_TOO_LARGE | TJV_UTF8_TOO_LARGE_1000, \
+    TJV_UTF8_CARRY | TJV_UTF8_TOO_LARGE | TJV_UTF8_TOO_LARGE_1000, \
+    TJV_UTF8_CARRY | TJV_UTF8_TOO_LARGE | TJV_UTF8_TOO_LARGE_1000, \
+    TJV_UTF8_CARRY | TJV_UTF8_TOO_LARGE | TJV_UTF8_TOO_LARGE_1000, \
+    TJV_UTF8_CARRY | TJV_UTF8_TOO_LARGE | TJV_UTF8_TOO_LARGE_1000, \
+    TJV_UTF8_CARRY | TJV_UTF8_TOO_LARGE | TJV_UTF8_TOO_LARGE_1000, \
+    TJV_UTF8_CARRY | TJV_UTF8_TOO_LARGE | TJV_UTF8_TOO_LARGE_1000, \
+    TJV_UTF8_CARRY | TJV_UTF8_TOO_LARGE | TJV_UTF8_TOO_LARGE_1000 | TJV_UTF8_SURROGATE, \
+    TJV_UTF8_CARRY | TJV_UTF8_TOO_LARGE | TJV_UTF8_TOO_LARGE_1000, \
+    TJV_UTF8_CARRY | TJV_UTF8_TOO_LARGE | TJV_UTF8_TOO_LARGE_1000
+
+#define TJV_UTF8_TABLE_BYTE_2_HIGH \
+    TJV_UTF8_TOO_SHORT, TJV_UTF8_TOO_SHORT, TJV_UTF8_TOO_SHORT, TJV_UTF8_TOO_SHORT, \
+    TJV_UTF8_TOO_SHORT, TJV_UTF8_TOO_SHORT, TJV_UTF8_TOO_SHORT, TJV_UTF8_TOO_SHORT, \
+    TJV_UTF8_TOO_LONG | TJV_UTF8_OVERLONG_2 | TJV_UTF8_TWO_CONTS | TJV_UTF8_OVERLONG_3 | TJV_UTF8_TOO_LARGE_1000 | TJV_UTF8_OVERLONG_4, \
+    TJV_UTF8_TOO_LONG | TJV_UTF8_OVERLONG_2 | TJV_UTF8_TWO_CONTS | TJV_UTF8_OVERLONG_3 | TJV_UTF8_TOO_LARGE, \
+    TJV_UTF8_TOO_LONG | TJV_UTF8_OVERLONG_2 | TJV_UTF8_TWO_CONTS | TJV_UTF8_SURROGATE | TJV_UTF8_TOO_LARGE, \
+    TJV_UTF8_TOO_LONG | TJV_UTF8_OVERLONG_2 | TJV_UTF8_TWO_CONTS | TJV_UTF8_SURROGATE | TJV_UTF8_TOO_LARGE, \
+    TJV_UTF8_TOO_SHORT, TJV_UTF8_TOO_SHORT, TJV_UTF8_TOO_SHORT, TJV_UTF8_TOO_SHORT
+
+// The maximum values of the last 3 bytes in a vector that do not start
+// an incomplete multibyte sequence.
+#define TJV_UTF8_INCOMPLETE_TAIL (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1)
+
+// Continuation bytes are 0x80..0xBF, that is less than -64 as signed bytes.
+// The comparison result (-1 for other bytes) is subtracted from byte
+// counters, which are summed up before they can overflow.
+TJV_TARGET_SSE42 static Tcl_Size tjv_Utf8LengthSse42(const char *buf, Tcl_Size length) {
+
+    const __m128i v_cont_max = _mm_set1_epi8(-65);
+    const __m128i v_zero = _mm_setzero_si128();
+
+    Tcl_Size count = 0;
+    Tcl_Size pos = 0;
+
+    while (pos + 16 <= length) {
+        __m128i acc = _mm_setzero_si128();
+        for (int i = 0; i < 255 && pos + 16 <= length; i++, pos += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(buf + pos));
+            acc = _mm_sub_epi8(acc, _mm_cmpgt_epi8(v, v_cont_max));
+        }
+        __m128i sum = _mm_sad_epu8(acc, v_zero);
+        count += _mm_cvtsi128_si32(sum) + _mm_extract_epi16(sum, 4);
+    }
+
+    return count + tjv_Utf8LengthScalar(buf + pos, length - pos);
+
+}
+
+TJV_TARGET_SSE42 static inline __m128i tjv_Utf8CheckSse42(__m128i input, __m128i prev_input) {
+
+    const __m128i table_1_high = _mm_setr_epi8(TJV_UTF8_TABLE_BYTE_1_HIGH);
+    const __m128i table_1_low = _mm_setr_epi8(TJV_UTF8_TABLE_BYTE_1_LOW);
+    const __m128i table_2_high = _mm_setr_epi8(TJV_UTF8_TABLE_BYTE_2_HIGH);
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+
+    __m128i prev1 = _mm_alignr_epi8(input, prev_input, 16 - 1);
+    __m128i prev2 = _mm_alignr_epi8(input, prev_input, 16 - 2);
+    __m128i prev3 = _mm_alignr_epi8(input, prev_input, 16 - 3);
+
+    __m128i byte_1_high = _mm_shuffle_epi8(table_1_high, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble));
+    __m128i byte_1_low = _mm_shuffle_epi8(table_1_low, _mm_and_si128(prev1, nibble));
+    __m128i byte_2_high = _mm_shuffle_epi8(table_2_high, _mm_and_si128(_mm_srli_epi16(input, 4), nibble));
+    __m128i special = _mm_and_si128(_mm_and_si128(byte_1_high, byte_1_low), byte_2_high);
+
+    __m128i is_third_byte = _mm_subs_epu8(prev2, _mm_set1_epi8((char)(0xE0 - 0x80)));
+    __m128i is_fourth_byte = _mm_subs_epu8(prev3, _mm_set1_epi8((char)(0xF0 - 0x80)));
+    __m128i must23_80 = _mm_and_si128(_mm_or_si128(is_third_byte, is_fourth_byte), _mm_set1_epi8((char)0x80));
+
+    return _mm_xor_si128(must23_80, special);
+
+}
+
+TJV_TARGET_SSE42 static tjv_JsonScanResult tjv_JsonScanSse42(const char *buf, Tcl_Size length, tjv_JsonScanIndex *idx, int *utf8_error_ptr) {
+
+    tjv_JsonScanState st = { 0, 0, 0, 0 };
+    uint8_t tail[64];
+
+    const __m128i v_quote = _mm_set1_epi8('"');
+    const __m128i v_backslash = _mm_set1_epi8('\\');
+    const __m128i v_lower = _mm_set1_epi8(0x20);
+    const __m128i v_brace_open = _mm_set1_epi8('{');
+    const __m128i v_brace_close = _mm_set1_epi8('}');
+    const __m128i v_colon = _mm_set1_epi8(':');
+    const __m128i v_comma = _mm_set1_epi8(',');
+    const __m128i v_space = _mm_set1_epi8(' ');
+    const __m128i v_tab = _mm_set1_epi8('\t');
+    const __m128i v_lf = _mm_set1_epi8('\n');
+    const __m128i v_cr = _mm_set1_epi8('\r');
+    const __m128i v_ctrl_max = _mm_set1_epi8(0x1F);
+    const __m128i v_incomplete = _mm_setr_epi8(
+        (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF,
+        (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF, TJV_UTF8_INCOMPLETE_TAIL);
+
+    __m128i prev_input = _mm_setzero_si128();
+    __m128i prev_incomplete = _mm_setzero_si128();
+    __m128i utf8_error = _mm_setzero_si128();
+
+    for (Tcl_Size pos = 0; pos < length; pos += 64) {
+
+        const uint8_t *block = tjv_JsonScanLoadBlock(buf, length, pos, tail);
+
+        uint64_t quote = 0, backslash = 0, op = 0, ws = 0, ctrl = 0, high = 0;
+        __m128i in[4];
+
+        for (int i = 0; i < 4; i++) {
+
+            __m128i v = _mm_loadu_si128((const __m128i *)(block + 16 * i));
+            __m128i lower = _mm_or_si128(v, v_lower);
+            in[i] = v;
+
+            // '[' and ']' turn into '{' and '}' when 0x20 bit is set
+            __m128i v_op = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(lower, v_brace_open), _mm_cmpeq_epi8(lower, v_brace_close)),
+                _mm_or_si128(_mm_cmpeq_epi8(v, v_colon), _mm_cmpeq_epi8(v, v_comma)));
+            __m128i v_ws = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(v, v_space), _mm_cmpeq_epi8(v, v_tab)),
+                _mm_or_si128(_mm_cmpeq_epi8(v, v_lf), _mm_cmpeq_epi8(v, v_cr)));
+            __m128i v_ctrl = _mm_cmpeq_epi8(_mm_min_epu8(v, v_ctrl_max), v);
+
+            int shift = 16 * i;
+            quote |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, v_quote)) << shift;
+            backslash |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, v_backslash)) << shift;
+            op |= (uint64_t)(uint16_t)_mm_movemask_epi8(v_op) << shift;
+            ws |= (uint64_t)(uint16_t)_mm_movemask_epi8(v_ws) << shift;
+            ctrl |= (uint64_t)(uint16_t)_mm_movemask_epi8(v_ctrl) << shift;
+            high |= (uint64_t)(uint16_t)_mm_movemask_epi8(v) << shift;
+
+        }
+
+        if (high == 0) {
+            // An ASCII block can only be an error if the previous block ended
+            // with an incomplete sequence.
+            utf8_error = _mm_or_si128(utf8_error, prev_incomplete);
+        } else {
+            for (int i = 0; i < 4; i++) {
+                utf8_error = _mm_or_si128(utf8_error, tjv_Utf8CheckSse42(in[i], prev_input));
+                prev_input = in[i];
+            }
+            prev_incomplete = _mm_subs_epu8(in[3], v_incomplete);
+        }
+        prev_input = in[3];
+
+        if (!tjv_JsonScanReserve(idx, 64)) {
+            return TJV_JSON_SCAN_TOO_LARGE;
+        }
+        tjv_JsonScanFlatten(idx, (uint32_t)pos, tjv_JsonScanStructurals(&st, quote, backslash, op, ws, ctrl));
+
+    }
+
+    utf8_error = _mm_or_si128(utf8_error, prev_incomplete);
+
+    *utf8_error_ptr = !_mm_testz_si128(utf8_error, utf8_error);
+
+    return tjv_JsonScanFinish(&st);
+
+}
+
+TJV_TARGET_AVX2 static Tcl_Size tjv_Utf8LengthAvx2(const char *buf, Tcl_Size length) {
+
+    const __m256i v_cont_max = _mm256_set1_epi8(-65);
+    const __m256i v_zero = _mm256_setzero_si256();
+
+    Tcl_Size count = 0;
+    Tcl_Size pos = 0;
+
+    while (pos + 32 <= length) {
+        __m256i acc = _mm256_setzero_si256();
+        for (int i = 0; i < 255 && pos + 32 <= length; i++, pos += 32) {
+            __m256i v = _mm256_loadu_si256((const __m256i *)(buf + pos));
+            acc = _mm256_sub_epi8(acc, _mm256_cmpgt_epi8(v, v_cont_max));
+        }
+        __m256i sum = _mm256_sad_epu8(acc, v_zero);
+        count += _mm256_extract_epi64(sum, 0) + _mm256_extract_epi64(sum, 1) +
+            _mm256_extract_epi64(sum, 2) + _mm256_extract_epi64(sum, 3);
+    }
+
+    return count + tjv_Utf8LengthScalar(buf + pos, length - pos);
+
+}
+
+TJV_TARGET_AVX2 static inline __m256i tjv_Utf8CheckAvx2(__m256i input, __m256i prev_input) {
+
+    const __m256i table_1_high = _mm256_setr_epi8(TJV_UTF8_TABLE_BYTE_1_HIGH, TJV_UTF8_TABLE_BYTE_1_HIGH);
+    const __m256i table_1_low = _mm256_setr_epi8(TJV_UTF8_TABLE_BYTE_1_LOW, TJV_UTF8_TABLE_BYTE_1_LOW);
+    const __m256i table_2_high = _mm256_setr_epi8(TJV_UTF8_TABLE_BYTE_2_HIGH, TJV_UTF8_TABLE_BYTE_2_HIGH);
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+
+    // The bytes that precede the input: the upper lane of the previous
+    // vector and the lower lane of the input.
+    __m256i shifted = _mm256_permute2x128_si256(prev_input, input, 0x21);
+    __m256i prev1 = _mm256_alignr_epi8(input, shifted, 16 - 1);
+    __m256i prev2 = _mm256_alignr_epi8(input, shifted, 16 - 2);
+    __m256i prev3 = _mm256_alignr_epi8(input, shifted, 16 - 3);
+
+    __m256i byte_1_high = _mm256_shuffle_epi8(table_1_high, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble));
+    __m256i byte_1_low = _mm256_shuffle_epi8(table_1_low, _mm256_and_si256(prev1, nibble));
+    __m256i byte_2_high = _mm256_shuffle_epi8(table_2_high, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble));
+    __m256i special = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+    __m256i is_third_byte = _mm256_subs_epu8(prev2, _mm256_set1_epi8((char)(0xE0 - 0x80)));
+    __m256i is_fourth_byte = _mm256_subs_epu8(prev3, _mm256_set1_epi8((char)(0xF0 - 0x80)));
+    __m256i must23_80 = _mm256_and_si256(_mm256_or_si256(is_third_byte, is_fourth_byte), _mm256_set1_epi8((char)0x80));
+
+    return _mm256_xor_si256(must23_80, special);
+
+}
+
+TJV_TARGET_AVX2 static tjv_JsonScanResult tjv_JsonScanAvx2(const char *buf, Tcl_Size length, tjv_JsonScanIndex *idx, int *utf8_error_ptr) {
+
+    tjv_JsonScanState st = { 0, 0, 0, 0 };
+    uint8_t tail[64];
+
+    const __m256i v_quote = _mm256_set1_epi8('"');
+    const __m256i v_backslash = _mm256_set1_epi8('\\');
+    const __m256i v_lower = _mm256_set1_epi8(0x20);
+    const __m256i v_brace_open = _mm256_set1_epi8('{');
+    const __m256i v_brace_close = _mm256_set1_epi8('}');
+    const __m256i v_colon = _mm256_set1_epi8(':');
+    const __m256i v_comma = _mm256_set1_epi8(',');
+    const __m256i v_space = _mm256_set1_epi8(' ');
+    const __m256i v_tab = _mm256_set1_epi8('\t');
+    const __m256i v_lf = _mm256_set1_epi8('\n');
+    const __m256i v_cr = _mm256_set1_epi8('\r');
+    const __m256i v_ctrl_max = _mm256_set1_epi8(0x1F);
+    const __m256i v_incomplete = _mm256_setr_epi8(
+        (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF,
+        (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF,
+        (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF,
+        (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF, TJV_UTF8_INCOMPLETE_TAIL);
+
+    __m256i prev_input = _mm256_setzero_si256();
+    __m256i prev_incomplete = _mm256_setzero_si256();
+    __m256i utf8_error = _mm256_setzero_si256();
+
+    for (Tcl_Size pos = 0; pos < length; pos += 64) {
+
+        const uint8_t *block = tjv_JsonScanLoadBlock(buf, length, pos, tail);
+
+        uint64_t quote = 0, backslash = 0, op = 0, ws = 0, ctrl = 0, high = 0;
+        __m256i in[2];
+
+        for (int i = 0; i < 2; i++) {
+
+            __m256i v = _mm256_loadu_si256((const __m256i *)(block + 32 * i));
+            __m256i lower = _mm256_or_si256(v, v_lower);
+            in[i] = v;
+
+            __m256i v_op = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(lower, v_brace_open), _mm256_cmpeq_epi8(lower, v_brace_close)),
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, v_colon), _mm256_cmpeq_epi8(v, v_comma)));
+            __m256i v_ws = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, v_space), _mm256_cmpeq_epi8(v, v_tab)),
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, v_lf), _mm256_cmpeq_epi8(v, v_cr)));
+            __m256i v_ctrl = _mm256_cmpeq_epi8(_mm256_min_epu8(v, v_ctrl_max), v);
+
+            int shift = 32 * i;
+            quote |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, v_quote)) << shift;
+            backslash |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, v_backslash)) << shift;
+            op |= (uint64_t)(uint32_t)_mm256_movemask_epi8(v_op) << shift;
+            ws |= (uint64_t)(uint32_t)_mm256_movemask_epi8(v_ws) << shift;
+            ctrl |= (uint64_t)(uint32_t)_mm256_movemask_epi8(v_ctrl) << shift;
+            high |= (uint64_t)(uint32_t)_mm256_movemask_epi8(v) << shift;
+
+        }
+
+        if (high == 0) {
+            utf8_error = _mm256_or_si256(utf8_error, prev_incomplete);
+        } else {
+            utf8_error = _mm256_or_si256(utf8_error, tjv_Utf8CheckAvx2(in[0], prev_input));
+            utf8_error = _mm256_or_si256(utf8_error, tjv_Utf8CheckAvx2(in[1], in[0]));
+            prev_incomplete = _mm256_subs_epu8(in[1], v_incomplete);
+        }
+        prev_input = in[1];
+
+        if (!tjv_JsonScanReserve(idx, 64)) {
+            return TJV_JSON_SCAN_TOO_LARGE;
+        }
+        tjv_JsonScanFlatten(idx, (uint32_t)pos, tjv_JsonScanStructurals(&st, quote, backslash, op, ws, ctrl));
+
+    }
+
+    utf8_error = _mm256_or_si256(utf8_error, prev_incomplete);
+
+    *utf8_error_ptr = !_mm256_testz_si256(utf8_error, utf8_error);
+
+    return tjv_JsonScanFinish(&st);
+
+}
+
+#endif /* TJV_SCAN_X86 */
+
+#ifdef TJV_SCAN_NEON
+
+static inline uint8x16_t tjv_Utf8CheckNeon(uint8x16_t input, uint8x16_t prev_input) {
+
+    static const int8_t table_1_high_data[16] = { TJV_UTF8_TABLE_BYTE_1_HIGH };
+    static const int8_t table_1_low_data[16] = { TJV_UTF8_TABLE_BYTE_1_LOW };
+    static const int8_t table_2_high_data[16] = { TJV_UTF8_TABLE_BYTE_2_HIGH };
+
+    const uint8x16_t table_1_high = vreinterpretq_u8_s8(vld1q_s8(table_1_high_data));
+    const uint8x16_t table_1_low = vreinterpretq_u8_s8(vld1q_s8(table_1_low_data));
+    const uint8x16_t table_2_high = vreinterpretq_u8_s8(vld1q_s8(table_2_high_data));
+    const uint8x16_t nibble = vdupq_n_u8(0x0F);
+
+    uint8x16_t prev1 = vextq_u8(prev_input, input, 16 - 1);
+    uint8x16_t prev2 = vextq_u8(prev_input, input, 16 - 2);
+    uint8x16_t prev3 = vextq_u8(prev_input, input, 16 - 3);
+
+    uint8x16_t byte_1_high = vqtbl1q_u8(table_1_high, vshrq_n_u8(prev1, 4));
+    uint8x16_t byte_1_low = vqtbl1q_u8(table_1_low, vandq_u8(prev1, nibble));
+    uint8x16_t byte_2_high = vqtbl1q_u8(table_2_high, vshrq_n_u8(input, 4));
+    uint8x16_t special = vandq_u8(vandq_u8(byte_1_high, byte_1_low), byte_2_high);
+
+    uint8x16_t is_third_byte = vqsubq_u8(prev2, vdupq_n_u8(0xE0 - 0x80));
+    uint8x16_t is_fourth_byte = vqsubq_u8(prev3, vdupq_n_u8(0xF0 - 0x80));
+    uint8x16_t must23_80 = vandq_u8(vorrq_u8(is_third_byte, is_fourth_byte), vdupq_n_u8(0x80));
+
+    return veorq_u8(must23_80, special);
+
+}
+
+// NEON has no movemask instruction. Each byte is reduced to a single bit
+// and 4 vectors are combined into a 64-bit mask by pairwise additions.
+static inline uint64_t tjv_JsonScanNeonMask(uint8x16_t v0, uint8x16_t v1, uint8x16_t v2, uint8x16_t v3) {
+
+    static const uint8_t bits_data[16] = {
+        0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80,
+        0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80
+    };
+    const uint8x16_t bits = vld1q_u8(bits_data);
+
+    uint8x16_t sum0 = vpaddq_u8(vandq_u8(v0, bits), vandq_u8(v1, bits));
+    uint8x16_t sum1 = vpaddq_u8(vandq_u8(v2, bits), vandq_u8(v3, bits));
+    sum0 = vpaddq_u8(sum0, sum1);
+    sum0 = vpaddq_u8(sum0, sum0);
+
+    return vgetq_lane_u64(vreinterpretq_u64_u8(sum0), 0);
+
+}
+
+static Tcl_Size tjv_Utf8LengthNeon(const char *buf, Tcl_Size length) {
+
+    const int8x16_t v_cont_max = vdupq_n_s8(-65);
+
+    Tcl_Size count = 0;
+    Tcl_Size pos = 0;
+
+    while (pos + 16 <= length) {
+        uint8x16_t acc = vdupq_n_u8(0);
+        for (int i = 0; i < 255 && pos + 16 <= length; i++, pos += 16) {
+            int8x16_t v = vld1q_s8((const int8_t *)(buf + pos));
+            acc = vsubq_u8(acc, vcgtq_s8(v, v_cont_max));
+        }
+        count += vaddlvq_u8(acc);
+    }
+
+    return count + tjv_Utf8LengthScalar(buf + pos, length - pos);
+
+}
+
+static tjv_JsonScanResult tjv_JsonScanNeon(const char *buf, Tcl_Size length, tjv_JsonScanIndex *idx, int *utf8_error_ptr) {
+
+    tjv_JsonScanState st = { 0, 0, 0, 0 };
+    uint8_t tail[64];
+
+    static const int8_t incomplete_data[16] = {
+        -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, TJV_UTF8_INCOMPLETE_TAIL
+    };
+    const uint8x16_t v_incomplete = vreinterpretq_u8_s8(vld1q_s8(incomplete_data));
+
+    uint8x16_t prev_input = vdupq_n_u8(0);
+    uint8x16_t prev_incomplete = vdupq_n_u8(0);
+    uint8x16_t utf8_error = vdupq_n_u8(0);
+
+    for (Tcl_Size pos = 0; pos < length; pos += 64) {
+
+        const uint8_t *block = tjv_JsonScanLoadBlock(buf, length, pos, tail);
+
+        uint8x16_t in[4], v_quote[4], v_backslash[4], v_op[4], v_ws[4], v_ctrl[4];
+        uint8x16_t v_high = vdupq_n_u8(0);
+
+        for (int i = 0; i < 4; i++) {
+            uint8x16_t v = vld1q_u8(block + 16 * i);
+            uint8x16_t lower = vorrq_u8(v, vdupq_n_u8(0x20));
+            in[i] = v;
+            v_quote[i] = vceqq_u8(v, vdupq_n_u8('"'));
+            v_backslash[i] = vceqq_u8(v, vdupq_n_u8('\\'));
+            v_op[i] = vorrq_u8(
+                vorrq_u8(vceqq_u8(lower, vdupq_n_u8('{')), vceqq_u8(lower, vdupq_n_u8('}'))),
+                vorrq_u8(vceqq_u8(v, vdupq_n_u8(':')), vceqq_u8(v, vdupq_n_u8(','))));
+            v_ws[i] = vorrq_u8(
+                vorrq_u8(vceqq_u8(v, vdupq_n_u8(' ')), vceqq_u8(v, vdupq_n_u8('\t'))),
+                vorrq_u8(vceqq_u8(v, vdupq_n_u8('\n')), vceqq_u8(v, vdupq_n_u8('\r'))));
+            v_ctrl[i] = vcleq_u8(v, vdupq_n_u8(0x1F));
+            v_high = vorrq_u8(v_high, v);
+        }
+
+        if (vmaxvq_u8(v_high) < 0x80) {
+            utf8_error = vorrq_u8(utf8_error, prev_incomplete);
+        } else {
+            for (int i = 0; i < 4; i++) {
+                utf8_error = vorrq_u8(utf8_error, tjv_Utf8CheckNeon(in[i], prev_input));
+                prev_input = in[i];
+            }
+            prev_incomplete = vqsubq_u8(in[3], v_incomplete);
+        }
+        prev_input = in[3];
+
+        uint64_t quote = tjv_JsonScanNeonMask(v_quote[0], v_quote[1], v_quote[2], v_quote[3]);
+        uint64_t backslash = tjv_JsonScanNeonMask(v_backslash[0], v_backslash[1], v_backslash[2], v_backslash[3]);
+        uint64_t op = tjv_JsonScanNeonMask(v_op[0], v_op[1], v_op[2], v_op[3]);
+        uint64_t ws = tjv_JsonScanNeonMask(v_ws[0], v_ws[1], v_ws[2], v_ws[3]);
+        uint64_t ctrl = tjv_JsonScanNeonMask(v_ctrl[0], v_ctrl[1], v_ctrl[2], v_ctrl[3]);
+
+        if (!tjv_JsonScanReserve(idx, 64)) {
+            return TJV_JSON_SCAN_TOO_LARGE;
+        }
+        tjv_JsonScanFlatten(idx, (uint32_t)pos, tjv_JsonScanStructurals(&st, quote, backslash, op, ws, ctrl));
+
+    }
+
+    utf8_error = vorrq_u8(utf8_error, prev_incomplete);
+
+    *utf8_error_ptr = (vmaxvq_u8(utf8_error) != 0);
+
+    return tjv_JsonScanFinish(&st);
+
+}
+
+#endif /* TJV_SCAN_NEON */
+
+tjv_JsonScanResult tjv_JsonScan(const char *buf, Tcl_Size length, int flags, tjv_JsonScanIndex *idx) {
+
+    DBG2(printf("enter: length: %" TCL_SIZE_MODIFIER "d kernel: %s", length, tjv_json_scan_kernel_name));
+
+    idx->count = 0;
+
+    if ((Tcl_WideUInt)length > TJV_JSON_SCAN_MAX_LENGTH) {
+        DBG2(printf("return: too large"));
+        return TJV_JSON_SCAN_TOO_LARGE;
+    }
+
+    int utf8_error;
+    tjv_JsonScanResult rc = tjv_json_scan_kernel(buf, length, idx, &utf8_error);
+
+    // Vectorized UTF-8 validation is strict. If the input is allowed to be
+    // in modified UTF-8, then double-check it using the relaxed validator.
+    // This only happens for rare inputs that contain NUL characters or
+    // surrogates, so it doesn't affect the fast path.
+    if (rc == TJV_JSON_SCAN_OK && utf8_error) {
+        if (!(flags & TJV_JSON_SCAN_MODIFIED_UTF8) || !tjv_Utf8Validate((const unsigned char *)buf, length, flags)) {
+            rc = TJV_JSON_SCAN_INVALID_UTF8;
+        } else {
+            DBG2(printf("input is valid modified UTF-8"));
+        }
+    }
+
+    DBG2(printf("return: %d (%" TCL_SIZE_MODIFIER "d structurals)", (int)rc, idx->count));
+    return rc;
+
+}
+
+Tcl_Size tjv_Utf8Length(const char *buf, Tcl_Size length) {
+    if (length < 32) {
+        return tjv_Utf8LengthScalar(buf, length);
+    }
+    return tjv_utf8_length_kernel(buf, length);
+}
+
+void tjv_JsonScanIndexFree(tjv_JsonScanIndex *idx) {
+    if (idx->indexes != NULL) {
+        ckfree(idx->indexes);
+        idx->indexes = NULL;
+    }
+    idx->count = 0;
+    idx->capacity = 0;
+}
+
+const char *tjv_JsonScanImplementation(void) {
+    return tjv_json_scan_kernel_name;
+}
+
+void tjv_JsonScanInit(void) {
+
+    Tcl_MutexLock(&tjv_json_scan_initialize_mx);
+
+    if (!tjv_json_scan_initialized) {
+
+        DBG2(printf("enter..."));
+
+        for (int i = 0; i < 0x20; i++) {
+            tjv_json_scan_class[i] = TJV_SCAN_CLASS_CTRL;
+        }
+        tjv_json_scan_class['"'] = TJV_SCAN_CLASS_QUOTE;
+        tjv_json_scan_class['\\'] = TJV_SCAN_CLASS_BACKSLASH;
+        tjv_json_scan_class['{'] = TJV_SCAN_CLASS_OP;
+        tjv_json_scan_class['}'] = TJV_SCAN_CLASS_OP;
+        tjv_json_scan_class['['] = TJV_SCAN_CLASS_OP;
+        tjv_json_scan_class[']'] = TJV_SCAN_CLASS_OP;
+        tjv_json_scan_class[':'] = TJV_SCAN_CLASS_OP;
+        tjv_json_scan_class[','] = TJV_SCAN_CLASS_OP;
+        tjv_json_scan_class[' '] = TJV_SCAN_CLASS_WS;
+        tjv_json_scan_class['\t'] |= TJV_SCAN_CLASS_WS;
+        tjv_json_scan_class['\n'] |= TJV_SCAN_CLASS_WS;
+        tjv_json_scan_class['\r'] |= TJV_SCAN_CLASS_WS;
+
+        tjv_json_scan_kernel = tjv_JsonScanScalar;
+        tjv_utf8_length_kernel = tjv_Utf8LengthScalar;
+        tjv_json_scan_kernel_name = "scalar";
+
+#if defined(TJV_SCAN_X86)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            tjv_json_scan_kernel = tjv_JsonScanAvx2;
+            tjv_utf8_length_kernel = tjv_Utf8LengthAvx2;
+            tjv_json_scan_kernel_name = "avx2";
+        } else if (__builtin_cpu_supports("sse4.2")) {
+            tjv_json_scan_kernel = tjv_JsonScanSse42;
+            tjv_utf8_length_kernel = tjv_Utf8LengthSse42;
+            tjv_json_scan_kernel_name = "sse42";
+        }
+#elif defined(TJV_SCAN_NEON)
+        tjv_json_scan_kernel = tjv_JsonScanNeon;
+        tjv_utf8_length_kernel = tjv_Utf8LengthNeon;
+        tjv_json_scan_kernel_name = "neon";
+#endif
+
+        // Allow to force a less capable kernel
+        const char *force = getenv("TJV_SIMD");
+        if (force != NULL) {
+            if (strcmp(force, "scalar") == 0) {
+                tjv_json_scan_kernel = tjv_JsonScanScalar;
+                tjv_utf8_length_kernel = tjv_Utf8LengthScalar;
+                tjv_json_scan_kernel_name = "scalar";
+#if defined(TJV_SCAN_X86)
+            } else if (strcmp(force, "sse42") == 0 && __builtin_cpu_supports("sse4.2")) {
+                tjv_json_scan_kernel = tjv_JsonScanSse42;
+                tjv_utf8_length_kernel = tjv_Utf8LengthSse42;
+                tjv_json_scan_kernel_name = "sse42";
+#endif
+            }
+        }
+
+        DBG2(printf("selected kernel: %s", tjv_json_scan_kernel_name));
+
+        tjv_json_scan_initialized = 1;
+
+        DBG2(printf("return: ok"));
+
+    }
+
+    Tcl_MutexUnlock(&tjv_json_scan_initialize_mx);
+
+}
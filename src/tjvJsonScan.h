@@ -0,0 +1,54 @@
+/**
+ * Copyright Jerily LTD. All Rights Reserved.
+ * SPDX-FileCopyrightText: 2024 Neofytos Dimitriou (neo@jerily.cy)
+ * SPDX-License-Identifier: MIT.
+ */
+#ifndef TJV_JSONSCAN_H
+#define TJV_JSONSCAN_H
+
+#include "common.h"
+
+typedef enum {
+    TJV_JSON_SCAN_OK,
+    TJV_JSON_SCAN_UNCLOSED_STRING,
+    TJV_JSON_SCAN_CONTROL_CHARACTER,
+    TJV_JSON_SCAN_INVALID_UTF8,
+    TJV_JSON_SCAN_TOO_LARGE
+} tjv_JsonScanResult;
+
+// Accept Tcl's internal "modified UTF-8" (NUL as C0 80 and surrogates encoded
+// as 3-byte sequences) in addition to strict UTF-8.
+#define TJV_JSON_SCAN_MODIFIED_UTF8 1
+
+// The maximum length of the text. Offsets in the index are 32-bit, and
+// the kernels read the last block of 64 bytes past the end of the text.
+#define TJV_JSON_SCAN_MAX_LENGTH ((Tcl_WideUInt)UINT32_MAX - 64)
+
+// The structural index built by the scanner. It contains the offsets of all
+// structural characters ({}[]:,), of opening quotes and of the first bytes
+// of scalar values (numbers, true, false, null).
+typedef struct {
+    uint32_t *indexes;
+    Tcl_Size count;
+    Tcl_Size capacity;
+} tjv_JsonScanIndex;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void tjv_JsonScanInit(void);
+const char *tjv_JsonScanImplementation(void);
+
+tjv_JsonScanResult tjv_JsonScan(const char *buf, Tcl_Size length, int flags, tjv_JsonScanIndex *idx);
+void tjv_JsonScanIndexFree(tjv_JsonScanIndex *idx);
+
+int tjv_Utf8Validate(const unsigned char *buf, Tcl_Size length, int flags);
+// Returns the number of characters in the UTF-8 (or modified UTF-8) string
+Tcl_Size tjv_Utf8Length(const char *buf, Tcl_Size length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TJV_JSONSCAN_H
@@ -17,13 +17,14 @@ enum {
     TJV_STATIC_STR_KEYWORD_REQUIRED,
     TJV_STATIC_STR_KEYWORD_TYPE,
     TJV_STATIC_STR_KEYWORD_VALUE,
+    TJV_STATIC_STR_KEYWORD_ADDITIONAL,
     _TJV_STATIC_STR_COUNT
 };
 
 static const char *static_strings[_TJV_STATIC_STR_COUNT] = {
     "error", "name", "message", "data", "keyword", "dataPath",
     "ValidationError",
-    "required", "type", "value"
+    "required", "type", "value", "additionalProperties"
 };
 
 typedef struct ThreadSpecificData {
@@ -83,6 +84,14 @@ void tjv_MessageGenerateRequired(tjv_ValidationStack *stack, Tcl_Obj *required_k
         error_message_ptr, error_details_ptr);
 }
 
+void tjv_MessageGenerateAdditional(tjv_ValidationStack *stack, const char *additional_key,
+    Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr)
+{
+    tjv_MessageGenerate(TJV_MSG_KEYWORD_ADDITIONAL, stack,
+        Tcl_ObjPrintf("should NOT have additional property '%s'", additional_key),
+        error_message_ptr, error_details_ptr);
+}
+
 void tjv_MessageGenerateValue(tjv_ValidationStack *stack, Tcl_Obj *message,
     Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr)
 {
@@ -91,6 +100,25 @@ void tjv_MessageGenerateValue(tjv_ValidationStack *stack, Tcl_Obj *message,
         error_message_ptr, error_details_ptr);
 }
 
+void tjv_MessageGenerateLimit(tjv_ValidationStack *stack, const char *format, Tcl_Size limit,
+    Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr)
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%" TCL_LL_MODIFIER "d", (Tcl_WideInt)limit);
+    tjv_MessageGenerate(TJV_MSG_KEYWORD_VALUE, stack,
+        Tcl_ObjPrintf(format, buf),
+        error_message_ptr, error_details_ptr);
+}
+
+void tjv_MessageGenerateMember(tjv_MessageErrorKeywordType keyword_type, tjv_ValidationStack *stack, Tcl_Obj *key,
+    Tcl_Obj *message, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr)
+{
+    tjv_ValidationStack stack_member = { stack->head, NULL, key, -1, NULL, NULL, stack->depth + 1 };
+    stack->next = &stack_member;
+    tjv_MessageGenerate(keyword_type, &stack_member, message, error_message_ptr, error_details_ptr);
+    stack->next = NULL;
+}
+
 void tjv_MessageGenerate(tjv_MessageErrorKeywordType keyword_type, tjv_ValidationStack *stack, Tcl_Obj *message,
     Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr)
 {
@@ -124,10 +152,12 @@ void tjv_MessageGenerate(tjv_MessageErrorKeywordType keyword_type, tjv_Validatio
 
         if (stack_current->key == INT2PTR(1)) {
             DBG2(printf("key is skipped"));
-            continue;
-        }
-
-        if (stack_current->key != NULL) {
+            // An array element that is a union can still be validated
+            // as an array in the same frame, keep its index then.
+            if (stack_current->index == -1) {
+                continue;
+            }
+        } else if (stack_current->key != NULL) {
             Tcl_AppendToObj(path, ".", 1);
             Tcl_AppendObjToObj(path, stack_current->key);
             DBG2(printf("add to path: '.%s'", Tcl_GetString(stack_current->key)));
@@ -136,7 +166,7 @@ void tjv_MessageGenerate(tjv_MessageErrorKeywordType keyword_type, tjv_Validatio
         }
 
         if (stack_current->index != -1) {
-            if (stack_current->key == NULL) {
+            if (stack_current->key == NULL || stack_current->key == INT2PTR(1)) {
                 Tcl_AppendToObj(path, ".", 1);
             }
             snprintf(buf, sizeof(buf), "[%" TCL_SIZE_MODIFIER "d]", stack_current->index);
@@ -173,6 +203,11 @@ void tjv_MessageGenerate(tjv_MessageErrorKeywordType keyword_type, tjv_Validatio
     case TJV_MSG_KEYWORD_VALUE:
         keyword = tsdPtr->static_strings[TJV_STATIC_STR_KEYWORD_VALUE];
         break;
+    case TJV_MSG_KEYWORD_ADDITIONAL:
+        keyword = tsdPtr->static_strings[TJV_STATIC_STR_KEYWORD_ADDITIONAL];
+        break;
+    default:
+        Tcl_Panic("unknown keyword type %d", (int)keyword_type);
     }
     Tcl_DictObjPut(NULL, details, tsdPtr->static_strings[TJV_STATIC_STR_KEYWORD], keyword);
     Tcl_DictObjPut(NULL, details, tsdPtr->static_strings[TJV_STATIC_STR_DATAPATH], path);
@@ -11,7 +11,8 @@
 typedef enum {
     TJV_MSG_KEYWORD_TYPE,
     TJV_MSG_KEYWORD_REQUIRED,
-    TJV_MSG_KEYWORD_VALUE
+    TJV_MSG_KEYWORD_VALUE,
+    TJV_MSG_KEYWORD_ADDITIONAL
 } tjv_MessageErrorKeywordType;
 
 #ifdef __cplusplus
@@ -29,12 +30,25 @@ void tjv_MessageGenerate(tjv_MessageErrorKeywordType keyword_type, tjv_Validatio
 void tjv_MessageGenerateRequired(tjv_ValidationStack *stack, Tcl_Obj *required_key,
     Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr);
 
+void tjv_MessageGenerateAdditional(tjv_ValidationStack *stack, const char *additional_key,
+    Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr);
+
 void tjv_MessageGenerateType(tjv_ValidationStack *stack, const char *required_type,
     Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr);
 
 void tjv_MessageGenerateValue(tjv_ValidationStack *stack, Tcl_Obj *message,
     Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr);
 
+// Generates a message for the member with the specified key of the object
+// that is being validated, when the member has no validation element of its
+// own (such as the tag of a union)
+void tjv_MessageGenerateMember(tjv_MessageErrorKeywordType keyword_type, tjv_ValidationStack *stack, Tcl_Obj *key,
+    Tcl_Obj *message, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr);
+
+// The format should contain one %s which is replaced by the limit
+void tjv_MessageGenerateLimit(tjv_ValidationStack *stack, const char *format, Tcl_Size limit,
+    Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr);
+
 #ifdef __cplusplus
 }
 #endif
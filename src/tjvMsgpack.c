@@ -0,0 +1,566 @@
+/**
+ * Copyright Jerily LTD. All Rights Reserved.
+ * SPDX-FileCopyrightText: 2024 Neofytos Dimitriou (neo@jerily.cy)
+ * SPDX-License-Identifier: MIT.
+ */
+
+// MessagePack decoder. It creates the same tree of tjv_JsonValue as the JSON
+// parser, so a compiled schema of the json type validates MessagePack data
+// without any changes in the validator.
+//
+// The data is walked twice. The first pass checks it and counts the values
+// and the bytes of copied strings, the second one builds the tree in blocks
+// of exactly that size. Strings are not copied unless they contain bytes
+// that Tcl's UTF-8 represents differently: NUL is stored as C0 80, and
+// binary data is represented as ISO-8859-1 characters like a Tcl bytearray.
+// Numbers are converted to their JSON text, because the number checks of
+// the validator work on the source text.
+//
+// The decoder doesn't use recursion, nesting depth is limited only by
+// available memory.
+
+#include "tjvMsgpack.h"
+#include "tjvJsonNumber.h"
+#include <math.h>
+
+typedef enum {
+    TJV_MSGPACK_NIL,
+    TJV_MSGPACK_FALSE,
+    TJV_MSGPACK_TRUE,
+    TJV_MSGPACK_UINT,
+    TJV_MSGPACK_INT,
+    TJV_MSGPACK_FLOAT,
+    TJV_MSGPACK_STR,
+    TJV_MSGPACK_BIN,
+    TJV_MSGPACK_ARRAY,
+    TJV_MSGPACK_MAP
+} tjv_MsgpackType;
+
+typedef struct {
+    tjv_MsgpackType type;
+    union {
+        Tcl_WideUInt u;
+        Tcl_WideInt i;
+        double d;
+    } number;
+    // Payload of str and bin
+    const unsigned char *data;
+    // Length of str and bin, number of elements of array and map
+    Tcl_WideUInt length;
+} tjv_MsgpackItem;
+
+typedef struct {
+    tjv_JsonValue *container;
+    tjv_JsonValue *last;
+    // Number of items left, map keys are counted as separate items
+    Tcl_WideUInt remaining;
+    int is_map;
+} tjv_MsgpackFrame;
+
+#define TJV_MSGPACK_STATIC_FRAMES 32
+
+static inline Tcl_WideUInt tjv_MsgpackReadUint(const unsigned char *p, int size) {
+    Tcl_WideUInt v = 0;
+    for (int i = 0; i < size; i++) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+// Reads the header of the item at p and returns the position after the
+// item, or NULL if the data is invalid. Payload of str and bin is skipped,
+// elements of array and map follow the header.
+static const unsigned char *tjv_MsgpackReadItem(const unsigned char *p, const unsigned char *end, tjv_MsgpackItem *item, const char **error_ptr) {
+
+    // Size of the length or the value that follows the type byte
+    int size;
+    unsigned char c = *p++;
+
+    // Fields that are not used by the item type stay zero
+    memset(item, 0, sizeof(tjv_MsgpackItem));
+
+    if (c <= 0x7f) {
+        item->type = TJV_MSGPACK_UINT;
+        item->number.u = c;
+        return p;
+    }
+
+    if (c >= 0xe0) {
+        item->type = TJV_MSGPACK_INT;
+        item->number.i = (Tcl_WideInt)c - 0x100;
+        return p;
+    }
+
+    if (c <= 0x8f) {
+        item->type = TJV_MSGPACK_MAP;
+        item->length = c & 0x0f;
+        goto container;
+    }
+
+    if (c <= 0x9f) {
+        item->type = TJV_MSGPACK_ARRAY;
+        item->length = c & 0x0f;
+        goto container;
+    }
+
+    if (c <= 0xbf) {
+        item->type = TJV_MSGPACK_STR;
+        item->length = c & 0x1f;
+        goto payload;
+    }
+
+    switch (c) {
+    case 0xc0:
+        item->type = TJV_MSGPACK_NIL;
+        return p;
+    case 0xc2:
+        item->type = TJV_MSGPACK_FALSE;
+        return p;
+    case 0xc3:
+        item->type = TJV_MSGPACK_TRUE;
+        return p;
+    case 0xc4:
+    case 0xc5:
+    case 0xc6:
+        item->type = TJV_MSGPACK_BIN;
+        size = 1 << (c - 0xc4);
+        goto length;
+    case 0xd9:
+    case 0xda:
+    case 0xdb:
+        item->type = TJV_MSGPACK_STR;
+        size = 1 << (c - 0xd9);
+        goto length;
+    case 0xdc:
+    case 0xdd:
+        item->type = TJV_MSGPACK_ARRAY;
+        size = (c == 0xdc ? 2 : 4);
+        goto count;
+    case 0xde:
+    case 0xdf:
+        item->type = TJV_MSGPACK_MAP;
+        size = (c == 0xde ? 2 : 4);
+        goto count;
+    case 0xcc:
+    case 0xcd:
+    case 0xce:
+    case 0xcf:
+        size = 1 << (c - 0xcc);
+        if (end - p < size) {
+            goto unexpectedEnd;
+        }
+        item->type = TJV_MSGPACK_UINT;
+        item->number.u = tjv_MsgpackReadUint(p, size);
+        return p + size;
+    case 0xd0:
+    case 0xd1:
+    case 0xd2:
+    case 0xd3:
+        size = 1 << (c - 0xd0);
+        if (end - p < size) {
+            goto unexpectedEnd;
+        }
+        item->type = TJV_MSGPACK_INT;
+        item->number.u = tjv_MsgpackReadUint(p, size);
+        if (size < 8 && (item->number.u >> (size * 8 - 1))) {
+            // Sign extension
+            item->number.u |= ~(Tcl_WideUInt)0 << (size * 8);
+        }
+        return p + size;
+    case 0xca:
+        if (end - p < 4) {
+            goto unexpectedEnd;
+        } else {
+            uint32_t bits = (uint32_t)tjv_MsgpackReadUint(p, 4);
+            float f;
+            memcpy(&f, &bits, sizeof(f));
+            item->type = TJV_MSGPACK_FLOAT;
+            item->number.d = f;
+        }
+        return p + 4;
+    case 0xcb:
+        if (end - p < 8) {
+            goto unexpectedEnd;
+        } else {
+            Tcl_WideUInt bits = tjv_MsgpackReadUint(p, 8);
+            memcpy(&item->number.d, &bits, sizeof(double));
+            item->type = TJV_MSGPACK_FLOAT;
+        }
+        return p + 8;
+    case 0xc7:
+    case 0xc8:
+    case 0xc9:
+    case 0xd4:
+    case 0xd5:
+    case 0xd6:
+    case 0xd7:
+    case 0xd8:
+        *error_ptr = "extension types are not supported";
+        return NULL;
+    default:
+        // 0xc1 is never used
+        *error_ptr = "invalid type byte";
+        return NULL;
+    }
+
+length:
+
+    if (end - p < size) {
+        goto unexpectedEnd;
+    }
+    item->length = tjv_MsgpackReadUint(p, size);
+    p += size;
+
+payload:
+
+    if (item->length > (Tcl_WideUInt)(end - p)) {
+        goto unexpectedEnd;
+    }
+    item->data = p;
+    return p + item->length;
+
+count:
+
+    if (end - p < size) {
+        goto unexpectedEnd;
+    }
+    item->length = tjv_MsgpackReadUint(p, size);
+    p += size;
+
+container:
+
+    // Each element takes at least one byte. Checking this here prevents
+    // huge counts in short data.
+    if (item->length > (Tcl_WideUInt)(end - p) / (item->type == TJV_MSGPACK_MAP ? 2 : 1)) {
+        goto unexpectedEnd;
+    }
+    return p;
+
+unexpectedEnd:
+
+    *error_ptr = "unexpected end of data";
+    return NULL;
+
+}
+
+static inline int tjv_MsgpackNeedsConversion(unsigned char c, int is_binary) {
+    return (c == 0 || (is_binary && c >= 0x80));
+}
+
+// Returns the length of the payload in Tcl's UTF-8, or -1 if it is
+// the same as the length of the payload.
+static Tcl_Size tjv_MsgpackConvertedLength(const tjv_MsgpackItem *item) {
+    int is_binary = (item->type == TJV_MSGPACK_BIN);
+    Tcl_Size extra = 0;
+    for (Tcl_WideUInt i = 0; i < item->length; i++) {
+        if (tjv_MsgpackNeedsConversion(item->data[i], is_binary)) {
+            extra++;
+        }
+    }
+    return (extra == 0 ? -1 : (Tcl_Size)item->length + extra);
+}
+
+// Copies the payload to out in Tcl's UTF-8 and adds NUL. Returns
+// the position after NUL.
+static char *tjv_MsgpackConvert(char *out, const tjv_MsgpackItem *item) {
+    int is_binary = (item->type == TJV_MSGPACK_BIN);
+    for (Tcl_WideUInt i = 0; i < item->length; i++) {
+        unsigned char c = item->data[i];
+        if (tjv_MsgpackNeedsConversion(c, is_binary)) {
+            *out++ = (char)(0xc0 | (c >> 6));
+            *out++ = (char)(0x80 | (c & 0x3f));
+        } else {
+            *out++ = (char)c;
+        }
+    }
+    *out++ = '\0';
+    return out;
+}
+
+// Writes the JSON text of the number to out and returns its length
+static Tcl_Size tjv_MsgpackFormatNumber(char *out, const tjv_MsgpackItem *item) {
+    int length;
+    switch (item->type) {
+    case TJV_MSGPACK_UINT:
+        length = snprintf(out, TJV_JSON_NUMBER_TEXT_SIZE, "%" TCL_LL_MODIFIER "u", item->number.u);
+        break;
+    case TJV_MSGPACK_INT:
+        length = snprintf(out, TJV_JSON_NUMBER_TEXT_SIZE, "%" TCL_LL_MODIFIER "d", item->number.i);
+        break;
+    default:
+        length = tjv_JsonFormatDouble(out, item->number.d);
+        break;
+    }
+    return length;
+}
+
+// Walks the data. If doc->values is NULL, only checks the data and counts
+// the values and the size of copied strings. Otherwise, builds the tree in
+// the storage of the document.
+static int tjv_MsgpackWalk(tjv_JsonDocument *doc, const unsigned char *bytes, Tcl_Size length, Tcl_Size *values_count_ptr, Tcl_Size *strings_size_ptr) {
+
+    int rc = TCL_OK;
+    int is_build = (doc->values != NULL);
+
+    tjv_MsgpackFrame frames_static[TJV_MSGPACK_STATIC_FRAMES];
+    tjv_MsgpackFrame *frames = frames_static;
+    Tcl_Size frames_capacity = TJV_MSGPACK_STATIC_FRAMES;
+    Tcl_Size depth = 0;
+
+    const unsigned char *p = bytes;
+    const unsigned char *end = bytes + length;
+    Tcl_Size values_count = 0;
+    Tcl_Size strings_size = 0;
+    char *out = doc->strings;
+    const char *key = NULL;
+    Tcl_Size key_length = 0;
+
+    if (length == 0) {
+        doc->error = "no value";
+        goto error;
+    }
+
+    for (;;) {
+
+        tjv_MsgpackItem item;
+        const unsigned char *start = p;
+        Tcl_Size converted_length;
+
+        if (p >= end) {
+            doc->error = "unexpected end of data";
+            goto error;
+        }
+
+        p = tjv_MsgpackReadItem(p, end, &item, &doc->error);
+        if (p == NULL) {
+            p = start;
+            goto error;
+        }
+
+        if (!is_build && item.type == TJV_MSGPACK_STR && !tjv_Utf8Validate(item.data, (Tcl_Size)item.length, 0)) {
+            doc->error = "invalid UTF-8 string";
+            p = start;
+            goto error;
+        }
+
+        tjv_MsgpackFrame *frame = (depth > 0 ? &frames[depth - 1] : NULL);
+
+        if (frame != NULL && frame->is_map && frame->remaining % 2 == 0) {
+
+            // Map keys are always copied, as the validator expects them
+            // to be NUL-terminated
+            frame->remaining--;
+
+            switch (item.type) {
+            case TJV_MSGPACK_STR:
+            case TJV_MSGPACK_BIN:
+                if (!is_build) {
+                    converted_length = tjv_MsgpackConvertedLength(&item);
+                    strings_size += (converted_length == -1 ? (Tcl_Size)item.length : converted_length) + 1;
+                    continue;
+                }
+                key = out;
+                out = tjv_MsgpackConvert(out, &item);
+                key_length = out - key - 1;
+                break;
+            case TJV_MSGPACK_UINT:
+            case TJV_MSGPACK_INT:
+                if (!is_build) {
+                    strings_size += TJV_JSON_NUMBER_TEXT_SIZE;
+                    continue;
+                }
+                key = out;
+                key_length = tjv_MsgpackFormatNumber(out, &item);
+                out += key_length + 1;
+                break;
+            default:
+                doc->error = "map key should be a string or an integer";
+                p = start;
+                goto error;
+            }
+
+            continue;
+
+        }
+
+        if (item.type == TJV_MSGPACK_FLOAT && !isfinite(item.number.d)) {
+            doc->error = "non-finite numbers are not supported";
+            p = start;
+            goto error;
+        }
+
+        values_count++;
+
+        if (frame != NULL) {
+            frame->remaining--;
+        }
+
+        tjv_JsonValue *value = NULL;
+
+        if (!is_build) {
+
+            switch (item.type) {
+            case TJV_MSGPACK_UINT:
+            case TJV_MSGPACK_INT:
+            case TJV_MSGPACK_FLOAT:
+                strings_size += TJV_JSON_NUMBER_TEXT_SIZE;
+                break;
+            case TJV_MSGPACK_STR:
+            case TJV_MSGPACK_BIN:
+                converted_length = tjv_MsgpackConvertedLength(&item);
+                if (converted_length != -1) {
+                    strings_size += converted_length + 1;
+                }
+                break;
+            default:
+                break;
+            }
+
+        } else {
+
+            value = &doc->values[values_count - 1];
+            value->next = NULL;
+            value->child = NULL;
+            value->count = 0;
+            value->key = key;
+            value->key_length = key_length;
+            value->str = NULL;
+            value->length = 0;
+            key = NULL;
+            key_length = 0;
+
+            if (frame == NULL) {
+                doc->root = value;
+            } else {
+                if (frame->last == NULL) {
+                    frame->container->child = value;
+                } else {
+                    frame->last->next = value;
+                }
+                frame->last = value;
+                frame->container->count++;
+            }
+
+            switch (item.type) {
+            case TJV_MSGPACK_NIL:
+                value->type = TJV_JSON_NULL;
+                break;
+            case TJV_MSGPACK_FALSE:
+                value->type = TJV_JSON_FALSE;
+                break;
+            case TJV_MSGPACK_TRUE:
+                value->type = TJV_JSON_TRUE;
+                break;
+            case TJV_MSGPACK_UINT:
+            case TJV_MSGPACK_INT:
+            case TJV_MSGPACK_FLOAT:
+                value->type = TJV_JSON_NUMBER;
+                value->str = out;
+                value->length = tjv_MsgpackFormatNumber(out, &item);
+                out += value->length + 1;
+                break;
+            case TJV_MSGPACK_STR:
+            case TJV_MSGPACK_BIN:
+                value->type = TJV_JSON_STRING;
+                if (tjv_MsgpackConvertedLength(&item) == -1) {
+                    value->str = (const char *)item.data;
+                    value->length = (Tcl_Size)item.length;
+                } else {
+                    value->str = out;
+                    out = tjv_MsgpackConvert(out, &item);
+                    value->length = out - value->str - 1;
+                }
+                break;
+            case TJV_MSGPACK_ARRAY:
+                value->type = TJV_JSON_ARRAY;
+                break;
+            case TJV_MSGPACK_MAP:
+                value->type = TJV_JSON_OBJECT;
+                break;
+            }
+
+        }
+
+        if ((item.type == TJV_MSGPACK_ARRAY || item.type == TJV_MSGPACK_MAP) && item.length > 0) {
+
+            if (depth == frames_capacity) {
+                frames_capacity *= 2;
+                if (frames == frames_static) {
+                    frames = ckalloc(sizeof(tjv_MsgpackFrame) * frames_capacity);
+                    memcpy(frames, frames_static, sizeof(frames_static));
+                } else {
+                    frames = ckrealloc(frames, sizeof(tjv_MsgpackFrame) * frames_capacity);
+                }
+            }
+
+            frames[depth].container = value;
+            frames[depth].last = NULL;
+            frames[depth].is_map = (item.type == TJV_MSGPACK_MAP);
+            frames[depth].remaining = (frames[depth].is_map ? item.length * 2 : item.length);
+            depth++;
+            continue;
+
+        }
+
+        // Close the containers that are complete
+        while (depth > 0 && frames[depth - 1].remaining == 0) {
+            depth--;
+        }
+
+        if (depth == 0) {
+            break;
+        }
+
+    }
+
+    if (p != end) {
+        doc->error = "unexpected data after the value";
+        goto error;
+    }
+
+    *values_count_ptr = values_count;
+    *strings_size_ptr = strings_size;
+    goto done;
+
+error:
+
+    doc->error_offset = p - bytes;
+    rc = TCL_ERROR;
+
+done:
+
+    if (frames != frames_static) {
+        ckfree(frames);
+    }
+
+    return rc;
+
+}
+
+int tjv_MsgpackParse(tjv_JsonDocument *doc, const unsigned char *bytes, Tcl_Size length) {
+
+    Tcl_Size values_count;
+    Tcl_Size strings_size;
+
+    memset(doc, 0, sizeof(tjv_JsonDocument));
+
+    DBG2(printf("enter; length: %" TCL_SIZE_MODIFIER "d", length));
+
+    if (tjv_MsgpackWalk(doc, bytes, length, &values_count, &strings_size) != TCL_OK) {
+        DBG2(printf("return: error at %" TCL_SIZE_MODIFIER "d (%s)", doc->error_offset, doc->error));
+        return TCL_ERROR;
+    }
+
+    DBG2(printf("values: %" TCL_SIZE_MODIFIER "d strings: %" TCL_SIZE_MODIFIER "d", values_count, strings_size));
+
+    doc->values = ckalloc(sizeof(tjv_JsonValue) * values_count);
+    // Strings can be empty, but ckalloc() needs a non-zero size
+    doc->strings = ckalloc(strings_size + 1);
+
+    // The data has been checked already, the second pass can't fail
+    tjv_MsgpackWalk(doc, bytes, length, &values_count, &strings_size);
+
+    DBG2(printf("return: ok"));
+    return TCL_OK;
+
+}
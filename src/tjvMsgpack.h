@@ -0,0 +1,27 @@
+/**
+ * Copyright Jerily LTD. All Rights Reserved.
+ * SPDX-FileCopyrightText: 2024 Neofytos Dimitriou (neo@jerily.cy)
+ * SPDX-License-Identifier: MIT.
+ */
+#ifndef TJV_MSGPACK_H
+#define TJV_MSGPACK_H
+
+#include "common.h"
+#include "tjvJson.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Decodes a MessagePack value to the same document as tjv_JsonParse() does
+// for JSON text, so it is validated by the JSON frontend. Strings point to
+// the bytes, which should be valid as long as the document is used. Only
+// map keys, numbers and strings that need conversion to Tcl's UTF-8 are
+// copied. On error, doc->error and doc->error_offset describe it.
+int tjv_MsgpackParse(tjv_JsonDocument *doc, const unsigned char *bytes, Tcl_Size length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TJV_MSGPACK_H
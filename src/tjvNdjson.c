@@ -0,0 +1,571 @@
+/**
+ * Copyright Jerily LTD. All Rights Reserved.
+ * SPDX-FileCopyrightText: 2024 Neofytos Dimitriou (neo@jerily.cy)
+ * SPDX-License-Identifier: MIT.
+ */
+
+#include "tjvNdjson.h"
+#include "tjvValidateJson.h"
+#include "tjvMessage.h"
+#include "tjvSource.h"
+#include "tjvPool.h"
+#include "tjvJsonScan.h"
+
+#include <limits.h>
+
+// Line boundaries are found by memchr(), which is vectorized by the C
+// library. Records are collected to a window. The records of the window
+// are parsed at once, in parallel if there are worker threads, and then
+// they are validated by the current thread in the order of lines, as the
+// validation creates Tcl objects. Each slot of the window has its own
+// parse buffers, which are reused by the records of the next windows, so
+// the storage of documents is allocated only when a larger record comes.
+
+typedef struct {
+    const char *json;
+    Tcl_Size length;
+    Tcl_WideInt line;
+    // Flags for tjv_JsonParse()
+    int flags;
+    int parse_result;
+    tjv_JsonDocument doc;
+    tjv_JsonBuffers buffers;
+} tjv_NdjsonRecord;
+
+typedef struct {
+    Tcl_Interp *interp;
+    tjv_ValidationElement *root;
+    int flags;
+    Tcl_Obj *onerror;
+    Tcl_Obj *onchunk;
+    Tcl_Size chunk_size;
+    // The number of the last line that is found
+    Tcl_WideInt line;
+    Tcl_WideInt records;
+    Tcl_WideInt invalid;
+    // The results that are returned, NULL if they are passed to callbacks
+    Tcl_Obj *failed;
+    Tcl_Obj *errors;
+    Tcl_Obj *outcomes;
+    // The outcomes that are not passed to the -onchunk callback yet
+    Tcl_Obj *chunk;
+    Tcl_Size chunk_count;
+    tjv_NdjsonRecord *window;
+    Tcl_Size window_size;
+    Tcl_Size window_count;
+    // Set when a callback returns break
+    int stop;
+} tjv_NdjsonState;
+
+static void tjv_NdjsonParse(void *clientData, Tcl_Size index) {
+    tjv_NdjsonRecord *record = &((tjv_NdjsonRecord *)clientData)[index];
+    record->parse_result = tjv_JsonParseBuffered(&record->doc, &record->buffers, record->json,
+        record->length, record->flags);
+}
+
+// Calls the callback with the arguments appended. The break code of the
+// callback stops the validation, the other codes except errors are ignored.
+static int tjv_NdjsonCallback(tjv_NdjsonState *st, Tcl_Obj *callback, const char *option, Tcl_Obj *arg1, Tcl_Obj *arg2) {
+
+    Tcl_Interp *interp = st->interp;
+
+    // The callback is already checked to be a list
+    Tcl_Obj *cmd = Tcl_DuplicateObj(callback);
+    Tcl_IncrRefCount(cmd);
+    Tcl_ListObjAppendElement(NULL, cmd, arg1);
+    if (arg2 != NULL) {
+        Tcl_ListObjAppendElement(NULL, cmd, arg2);
+    }
+
+    int rc = Tcl_EvalObjEx(interp, cmd, 0);
+    Tcl_DecrRefCount(cmd);
+
+    switch (rc) {
+    case TCL_ERROR:
+        Tcl_AppendObjToErrorInfo(interp, Tcl_ObjPrintf("\n    (\"%s\" callback)", option));
+        DBG2(printf("return: TCL_ERROR (%s callback failed)", option));
+        return TCL_ERROR;
+    case TCL_BREAK:
+        DBG2(printf("stop by %s callback", option));
+        st->stop = 1;
+        break;
+    }
+
+    return TCL_OK;
+
+}
+
+static int tjv_NdjsonFlushChunk(tjv_NdjsonState *st) {
+
+    if (st->chunk_count == 0) {
+        return TCL_OK;
+    }
+
+    DBG2(printf("pass %" TCL_SIZE_MODIFIER "d outcomes", st->chunk_count));
+
+    Tcl_Obj *chunk = st->chunk;
+    st->chunk = Tcl_NewDictObj();
+    Tcl_IncrRefCount(st->chunk);
+    st->chunk_count = 0;
+
+    int rc = tjv_NdjsonCallback(st, st->onchunk, "-onchunk", chunk, NULL);
+    Tcl_DecrRefCount(chunk);
+
+    return rc;
+
+}
+
+// Validates the parsed record and collects its result or passes it
+// to a callback. The document of the record is freed.
+static int tjv_NdjsonValidateRecord(tjv_NdjsonState *st, tjv_NdjsonRecord *record) {
+
+    DBG2(printf("enter: line: %" TCL_LL_MODIFIER "d", record->line));
+
+    tjv_ValidationElement *root = st->root;
+
+    Tcl_Obj *error_message = NULL;
+    Tcl_Obj *error_details = NULL;
+    Tcl_Obj *outcome = Tcl_NewDictObj();
+
+    tjv_ValidateJsonRootText(record->json, record->length, &record->doc, record->parse_result, root,
+        &error_message, &error_details, &outcome);
+
+    st->records++;
+
+    Tcl_Obj *line = Tcl_NewWideIntObj(record->line);
+
+    if (error_message == NULL) {
+        if (st->outcomes != NULL) {
+            Tcl_DictObjPut(NULL, st->outcomes, line, outcome);
+        }
+        if (st->chunk != NULL) {
+            Tcl_DictObjPut(NULL, st->chunk, line, outcome);
+            if (++st->chunk_count == st->chunk_size) {
+                return tjv_NdjsonFlushChunk(st);
+            }
+        }
+        DBG2(printf("return: ok (valid)"));
+        return TCL_OK;
+    }
+
+    DBG2(printf("record is invalid"));
+
+    Tcl_BounceRefCount(outcome);
+    st->invalid++;
+
+    Tcl_Obj *details = tjv_MessageCombineDetails(error_message, error_details);
+
+    if (st->onerror != NULL) {
+        return tjv_NdjsonCallback(st, st->onerror, "-onerror", line, details);
+    }
+
+    Tcl_ListObjAppendElement(NULL, st->failed, line);
+    Tcl_DictObjPut(NULL, st->errors, line, details);
+
+    DBG2(printf("return: ok (invalid)"));
+    return TCL_OK;
+
+}
+
+// Parses and validates the records of the window
+static int tjv_NdjsonValidateWindow(tjv_NdjsonState *st) {
+
+    Tcl_Size count = st->window_count;
+    if (count == 0) {
+        return TCL_OK;
+    }
+
+    DBG2(printf("enter: records: %" TCL_SIZE_MODIFIER "d", count));
+
+    st->window_count = 0;
+    tjv_PoolRun(tjv_NdjsonParse, st->window, count);
+
+    int rc = TCL_OK;
+    Tcl_Size i;
+    for (i = 0; i < count && rc == TCL_OK && !st->stop; i++) {
+        rc = tjv_NdjsonValidateRecord(st, &st->window[i]);
+    }
+
+    // The lines after the record that stopped the validation are not
+    // counted, even if they are already found
+    if (st->stop) {
+        st->line = st->window[i - 1].line;
+    }
+
+    // Free the records that are parsed but not validated
+    for (; i < count; i++) {
+        tjv_JsonFree(&st->window[i].doc);
+    }
+
+    DBG2(printf("return: %s", (rc == TCL_OK ? "ok" : "TCL_ERROR")));
+    return rc;
+
+}
+
+// Processes the lines of the text that end with a newline, and also the last
+// line without a newline if this is the end of the input. The text before
+// scan_from is known to have no newlines. Sets consumed_ptr to the size of
+// the processed text.
+static int tjv_NdjsonLines(tjv_NdjsonState *st, const char *text, Tcl_Size length, Tcl_Size scan_from, int eof, Tcl_Size *consumed_ptr) {
+
+    DBG2(printf("enter: length: %" TCL_SIZE_MODIFIER "d eof: %d", length, eof));
+
+    const char *start = text;
+    const char *search = text + scan_from;
+    const char *end = text + length;
+
+    int rc = TCL_OK;
+
+    for (;;) {
+
+        const char *line_end = memchr(search, '\n', end - search);
+        if (line_end == NULL) {
+            if (!eof || start == end) {
+                break;
+            }
+            line_end = end;
+        }
+
+        st->line++;
+
+        // Blank lines are skipped
+        const char *p = start;
+        while (p < line_end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+            p++;
+        }
+
+        // Larger records can't be parsed, see tjv_JsonScan()
+        if ((Tcl_WideUInt)(line_end - start) > TJV_JSON_SCAN_MAX_LENGTH) {
+            Tcl_SetObjResult(st->interp, Tcl_ObjPrintf("the line %" TCL_LL_MODIFIER "d is too large to validate",
+                st->line));
+            rc = TCL_ERROR;
+            goto done;
+        }
+
+        if (p < line_end) {
+            tjv_NdjsonRecord *record = &st->window[st->window_count++];
+            record->json = start;
+            record->length = line_end - start;
+            record->line = st->line;
+            record->flags = st->flags;
+            if (st->window_count == st->window_size) {
+                rc = tjv_NdjsonValidateWindow(st);
+                if (rc != TCL_OK || st->stop) {
+                    goto done;
+                }
+            }
+        }
+
+        if (line_end == end) {
+            start = end;
+            break;
+        }
+
+        start = search = line_end + 1;
+
+    }
+
+    // The records point to the text, so they are validated before
+    // the text is changed
+    rc = tjv_NdjsonValidateWindow(st);
+
+done:
+
+    // The records that are not validated after an error or a break
+    // are dropped
+    st->window_count = 0;
+    *consumed_ptr = start - text;
+
+    DBG2(printf("return: %s (consumed %" TCL_SIZE_MODIFIER "d)", (rc == TCL_OK ? "ok" : "TCL_ERROR"), *consumed_ptr));
+    return rc;
+
+}
+
+// Reads the channel by blocks to the end and processes the lines in them.
+// Only the incomplete last line is kept between blocks.
+static int tjv_NdjsonRead(tjv_NdjsonState *st, Tcl_Channel chan) {
+
+    DBG2(printf("enter: channel: %s", Tcl_GetChannelName(chan)));
+
+    Tcl_Interp *interp = st->interp;
+    int rc = TCL_OK;
+
+    Tcl_DString ds;
+    Tcl_DStringInit(&ds);
+
+    while (rc == TCL_OK && !st->stop) {
+
+        // The text in the buffer has no newlines, as the lines are
+        // already processed
+        Tcl_Size length = Tcl_DStringLength(&ds);
+        if (length > TCL_SIZE_MAX - TJV_SOURCE_BUFFER_SIZE || (Tcl_WideUInt)length > TJV_JSON_SCAN_MAX_LENGTH) {
+            Tcl_SetObjResult(interp, Tcl_ObjPrintf("the line %" TCL_LL_MODIFIER "d is too large to validate",
+                st->line + 1));
+            rc = TCL_ERROR;
+            break;
+        }
+
+        Tcl_DStringSetLength(&ds, length + TJV_SOURCE_BUFFER_SIZE);
+        Tcl_Size count = Tcl_Read(chan, Tcl_DStringValue(&ds) + length, TJV_SOURCE_BUFFER_SIZE);
+
+        if (count < 0) {
+            Tcl_SetObjResult(interp, Tcl_ObjPrintf("error reading \"%s\": %s",
+                Tcl_GetChannelName(chan), Tcl_PosixError(interp)));
+            rc = TCL_ERROR;
+            break;
+        }
+
+        Tcl_DStringSetLength(&ds, length + count);
+
+        int eof = Tcl_Eof(chan);
+
+        // Without data, a channel in non-blocking mode would be read again
+        // and again
+        if (count == 0 && !eof && Tcl_InputBlocked(chan)) {
+            Tcl_SetObjResult(interp, Tcl_ObjPrintf("channel \"%s\" is in non-blocking mode and has no data",
+                Tcl_GetChannelName(chan)));
+            rc = TCL_ERROR;
+            break;
+        }
+
+        Tcl_Size consumed;
+        rc = tjv_NdjsonLines(st, Tcl_DStringValue(&ds), length + count, length, eof, &consumed);
+        if (eof) {
+            break;
+        }
+
+        // Keep the incomplete line
+        Tcl_Size remaining = length + count - consumed;
+        if (consumed > 0) {
+            memmove(Tcl_DStringValue(&ds), Tcl_DStringValue(&ds) + consumed, remaining);
+        }
+        Tcl_DStringSetLength(&ds, remaining);
+
+    }
+
+    Tcl_DStringFree(&ds);
+
+    DBG2(printf("return: %s", (rc == TCL_OK ? "ok" : "TCL_ERROR")));
+    return rc;
+
+}
+
+int tjv_NdjsonValidate(Tcl_Interp *interp, ClientData owner, tjv_ValidationElement *root, int objc, Tcl_Obj *const objv[]) {
+
+    DBG2(printf("enter: objc: %d", objc));
+
+    static const char *const options[] = {
+        "-chunk-size", "-from", "-onchunk", "-onerror",
+        NULL
+    };
+
+    enum options {
+        optChunkSize, optFrom, optOnChunk, optOnError
+    };
+
+    static const char *const sources[] = {
+        "channel", "file", "text",
+        NULL
+    };
+
+    enum sources {
+        srcChannel, srcFile, srcText
+    };
+
+    if (objc < 3 || objc % 2 == 0) {
+        Tcl_WrongNumArgs(interp, 2, objv, "source ?-from text|file|channel? ?-onerror callback?"
+            " ?-onchunk callback? ?-chunk-size count?");
+        DBG2(printf("return: TCL_ERROR (wrong # args)"));
+        return TCL_ERROR;
+    }
+
+    if (root->type != TJV_VALIDATION_JSON) {
+        SetResult("validation of NDJSON requires a schema of the json type");
+        DBG2(printf("return: TCL_ERROR (not json)"));
+        return TCL_ERROR;
+    }
+
+    tjv_NdjsonState st;
+    memset(&st, 0, sizeof(tjv_NdjsonState));
+    st.interp = interp;
+    st.root = root;
+    st.chunk_size = TJV_NDJSON_DEFAULT_CHUNK_SIZE;
+
+    int source = srcText;
+
+    for (int i = 3; i < objc; i += 2) {
+
+        int option;
+        if (Tcl_GetIndexFromObj(interp, objv[i], options, "option", 0, &option) != TCL_OK) {
+            DBG2(printf("return: TCL_ERROR (wrong option: [%s])", Tcl_GetString(objv[i])));
+            return TCL_ERROR;
+        }
+
+        Tcl_Obj *value = objv[i + 1];
+        Tcl_Size length;
+
+        switch ((enum options) option) {
+        case optFrom:
+            if (Tcl_GetIndexFromObj(interp, value, sources, "source", 0, &source) != TCL_OK) {
+                DBG2(printf("return: TCL_ERROR (wrong source: [%s])", Tcl_GetString(value)));
+                return TCL_ERROR;
+            }
+            break;
+        case optChunkSize:
+            if (Tcl_GetSizeIntFromObj(interp, value, &st.chunk_size) != TCL_OK) {
+                DBG2(printf("return: TCL_ERROR (wrong chunk size: [%s])", Tcl_GetString(value)));
+                return TCL_ERROR;
+            }
+            if (st.chunk_size < 1) {
+                SetResult("the chunk size must be a positive integer");
+                DBG2(printf("return: TCL_ERROR (wrong chunk size)"));
+                return TCL_ERROR;
+            }
+            break;
+        case optOnChunk:
+        case optOnError:
+            if (Tcl_ListObjLength(interp, value, &length) != TCL_OK) {
+                DBG2(printf("return: TCL_ERROR (callback is not a list)"));
+                return TCL_ERROR;
+            }
+            // An empty callback is the same as no callback
+            if (option == optOnChunk) {
+                st.onchunk = (length == 0 ? NULL : value);
+            } else {
+                st.onerror = (length == 0 ? NULL : value);
+            }
+            break;
+        }
+
+    }
+
+    Tcl_Channel chan = NULL;
+    tjv_SourceMapping mapping;
+    mapping.bytes = NULL;
+
+    int mode;
+
+    switch ((enum sources) source) {
+    case srcChannel:
+        chan = Tcl_GetChannel(interp, Tcl_GetString(objv[2]), &mode);
+        if (chan == NULL) {
+            DBG2(printf("return: TCL_ERROR (no channel)"));
+            return TCL_ERROR;
+        }
+        if (!(mode & TCL_READABLE)) {
+            Tcl_SetObjResult(interp, Tcl_ObjPrintf("channel \"%s\" wasn't opened for reading",
+                Tcl_GetString(objv[2])));
+            DBG2(printf("return: TCL_ERROR (not readable)"));
+            return TCL_ERROR;
+        }
+        // The channel is not closed if the callbacks close it
+        Tcl_RegisterChannel(NULL, chan);
+        break;
+    case srcFile:
+        if (tjv_SourceMapFile(interp, objv[2], &mapping) != TCL_OK) {
+            DBG2(printf("return: TCL_ERROR (map failed)"));
+            return TCL_ERROR;
+        }
+        if (mapping.bytes == NULL) {
+            chan = tjv_SourceOpenFile(interp, objv[2]);
+            if (chan == NULL) {
+                DBG2(printf("return: TCL_ERROR (open failed)"));
+                return TCL_ERROR;
+            }
+        }
+        break;
+    case srcText:
+        break;
+    }
+
+    if (st.onchunk == NULL) {
+        st.outcomes = Tcl_NewDictObj();
+        Tcl_IncrRefCount(st.outcomes);
+    } else {
+        st.chunk = Tcl_NewDictObj();
+        Tcl_IncrRefCount(st.chunk);
+    }
+
+    if (st.onerror == NULL) {
+        st.failed = Tcl_NewListObj(0, NULL);
+        Tcl_IncrRefCount(st.failed);
+        st.errors = Tcl_NewDictObj();
+        Tcl_IncrRefCount(st.errors);
+    }
+
+    int threads = tjv_PoolThreads();
+    st.window_size = (threads > 0 ? (threads + 1) * TJV_NDJSON_RECORDS_PER_THREAD : 1);
+    st.window = ckalloc(sizeof(tjv_NdjsonRecord) * st.window_size);
+    memset(st.window, 0, sizeof(tjv_NdjsonRecord) * st.window_size);
+
+    DBG2(printf("window: %" TCL_SIZE_MODIFIER "d records", st.window_size));
+
+    // The callbacks can destroy the schema
+    Tcl_Preserve(owner);
+
+    int rc;
+    Tcl_Size consumed;
+
+    if (chan != NULL) {
+        rc = tjv_NdjsonRead(&st, chan);
+    } else if (mapping.bytes != NULL) {
+        rc = tjv_NdjsonLines(&st, mapping.bytes, mapping.length, 0, 1, &consumed);
+    } else {
+        Tcl_Size length;
+        const char *text = Tcl_GetStringFromObj(objv[2], &length);
+        st.flags = TJV_JSON_SCAN_MODIFIED_UTF8;
+        rc = tjv_NdjsonLines(&st, text, length, 0, 1, &consumed);
+    }
+
+    if (rc == TCL_OK && !st.stop && st.chunk != NULL) {
+        rc = tjv_NdjsonFlushChunk(&st);
+    }
+
+    if (rc == TCL_OK) {
+        Tcl_Obj *result = Tcl_NewDictObj();
+        Tcl_DictObjPut(NULL, result, Tcl_NewStringObj("lines", -1), Tcl_NewWideIntObj(st.line));
+        Tcl_DictObjPut(NULL, result, Tcl_NewStringObj("records", -1), Tcl_NewWideIntObj(st.records));
+        Tcl_DictObjPut(NULL, result, Tcl_NewStringObj("valid", -1), Tcl_NewWideIntObj(st.records - st.invalid));
+        Tcl_DictObjPut(NULL, result, Tcl_NewStringObj("invalid", -1), Tcl_NewWideIntObj(st.invalid));
+        if (st.failed != NULL) {
+            Tcl_DictObjPut(NULL, result, Tcl_NewStringObj("failed", -1), st.failed);
+            Tcl_DictObjPut(NULL, result, Tcl_NewStringObj("errors", -1), st.errors);
+        }
+        if (st.outcomes != NULL) {
+            Tcl_DictObjPut(NULL, result, Tcl_NewStringObj("outcomes", -1), st.outcomes);
+        }
+        Tcl_SetObjResult(interp, result);
+    }
+
+    Tcl_Release(owner);
+
+    for (Tcl_Size i = 0; i < st.window_size; i++) {
+        tjv_JsonBuffersFree(&st.window[i].buffers);
+    }
+    ckfree(st.window);
+
+    if (st.outcomes != NULL) {
+        Tcl_DecrRefCount(st.outcomes);
+    }
+    if (st.chunk != NULL) {
+        Tcl_DecrRefCount(st.chunk);
+    }
+    if (st.failed != NULL) {
+        Tcl_DecrRefCount(st.failed);
+        Tcl_DecrRefCount(st.errors);
+    }
+
+    if (source == srcChannel) {
+        Tcl_UnregisterChannel(NULL, chan);
+    } else if (source == srcFile) {
+        if (chan != NULL) {
+            Tcl_Close(NULL, chan);
+        } else {
+            tjv_SourceUnmapFile(&mapping);
+        }
+    }
+
+    DBG2(printf("return: %s", (rc == TCL_OK ? "ok" : "TCL_ERROR")));
+    return rc;
+
+}
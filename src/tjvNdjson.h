@@ -0,0 +1,32 @@
+/**
+ * Copyright Jerily LTD. All Rights Reserved.
+ * SPDX-FileCopyrightText: 2024 Neofytos Dimitriou (neo@jerily.cy)
+ * SPDX-License-Identifier: MIT.
+ */
+#ifndef TJV_NDJSON_H
+#define TJV_NDJSON_H
+
+#include "common.h"
+#include "tjvCompile.h"
+
+// The number of records per worker thread that are parsed at once
+#define TJV_NDJSON_RECORDS_PER_THREAD 32
+
+// The default number of outcomes that are passed to the -onchunk callback
+#define TJV_NDJSON_DEFAULT_CHUNK_SIZE 1000
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Validates each line of the newline-delimited JSON text as a separate
+// document. The arguments are those of the handle subcommand, the source
+// is objv[2] and the options follow it. The owner is preserved while
+// callbacks run, so the schema is not freed if they destroy it.
+int tjv_NdjsonValidate(Tcl_Interp *interp, ClientData owner, tjv_ValidationElement *root, int objc, Tcl_Obj *const objv[]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TJV_NDJSON_H
@@ -0,0 +1,299 @@
+/**
+ * Copyright Jerily LTD. All Rights Reserved.
+ * SPDX-FileCopyrightText: 2024 Neofytos Dimitriou (neo@jerily.cy)
+ * SPDX-License-Identifier: MIT.
+ */
+
+#include "tjvPool.h"
+
+// The number of chunks per thread that a job is split into. Threads take
+// chunks one by one, so the work is balanced if items take different time.
+#define TJV_POOL_CHUNKS_PER_THREAD 4
+
+typedef struct {
+    tjv_PoolProc *proc;
+    void *clientData;
+    Tcl_Size count;
+    Tcl_Size chunk;
+    // The index of the first item that is not taken by any thread
+    Tcl_Size next;
+    // The number of threads that are processing the job
+    int active;
+} tjv_PoolJob;
+
+// All fields are protected by tjv_pool_mx
+static struct {
+    // The number of running worker threads
+    int threads;
+    // Worker threads with ids that are not less than this number exit
+    int threads_wanted;
+    // The job that is being processed or NULL
+    tjv_PoolJob *job;
+    // Incremented for each job, so workers don't take the same job twice
+    unsigned int job_id;
+    // The queue of tasks
+    tjv_PoolTask *tasks_first;
+    tjv_PoolTask *tasks_last;
+    // The process is exiting
+    int is_finalizing;
+} tjv_pool;
+
+static Tcl_Mutex tjv_pool_mx;
+// Workers wait on this condition for a new job, a task or a signal to exit
+static Tcl_Condition tjv_pool_work_cond;
+// Notified when a worker finishes a job or exits
+static Tcl_Condition tjv_pool_done_cond;
+
+static int tjv_pool_initialized = 0;
+static Tcl_Mutex tjv_pool_initialize_mx;
+
+// Processes items of the job until there are no untaken items left. Must be
+// called with tjv_pool_mx locked, the mutex is released while items are
+// processed.
+static void tjv_PoolJobRun(tjv_PoolJob *job) {
+    while (job->next < job->count) {
+        Tcl_Size from = job->next;
+        Tcl_Size to = from + job->chunk;
+        if (to > job->count) {
+            to = job->count;
+        }
+        job->next = to;
+        Tcl_MutexUnlock(&tjv_pool_mx);
+        for (Tcl_Size i = from; i < to; i++) {
+            job->proc(job->clientData, i);
+        }
+        Tcl_MutexLock(&tjv_pool_mx);
+    }
+}
+
+// Takes the first task from the queue. Must be called with tjv_pool_mx
+// locked and with a non-empty queue.
+static tjv_PoolTask *tjv_PoolTaskTake(void) {
+    tjv_PoolTask *task = tjv_pool.tasks_first;
+    tjv_pool.tasks_first = task->next;
+    if (tjv_pool.tasks_first == NULL) {
+        tjv_pool.tasks_last = NULL;
+    }
+    return task;
+}
+
+static Tcl_ThreadCreateType tjv_PoolWorker(ClientData clientData) {
+
+    int id = PTR2INT(clientData);
+    unsigned int job_id = 0;
+
+    DBG2(printf("worker #%d: start", id));
+
+    Tcl_MutexLock(&tjv_pool_mx);
+
+    for (;;) {
+
+        while (id < tjv_pool.threads_wanted && (tjv_pool.job == NULL || tjv_pool.job_id == job_id) &&
+            tjv_pool.tasks_first == NULL)
+        {
+            Tcl_ConditionWait(&tjv_pool_work_cond, &tjv_pool_mx, NULL);
+        }
+
+        if (id >= tjv_pool.threads_wanted) {
+            break;
+        }
+
+        // Jobs have a priority over tasks, as there is a thread that
+        // waits for the job
+        if (tjv_pool.job == NULL || tjv_pool.job_id == job_id) {
+            tjv_PoolTask *task = tjv_PoolTaskTake();
+            Tcl_MutexUnlock(&tjv_pool_mx);
+            task->proc(task->clientData);
+            Tcl_MutexLock(&tjv_pool_mx);
+            continue;
+        }
+
+        tjv_PoolJob *job = tjv_pool.job;
+        job_id = tjv_pool.job_id;
+        job->active++;
+        tjv_PoolJobRun(job);
+        if (--job->active == 0) {
+            Tcl_ConditionNotify(&tjv_pool_done_cond);
+        }
+
+    }
+
+    DBG2(printf("worker #%d: exit", id));
+
+    int is_finalizing = tjv_pool.is_finalizing;
+    tjv_pool.threads--;
+    Tcl_ConditionNotify(&tjv_pool_done_cond);
+    Tcl_MutexUnlock(&tjv_pool_mx);
+
+    // When the process exits, Tcl is being finalized by the thread that
+    // waits for us. Thread data is not released then, as it would need
+    // locks that are held by that thread.
+    if (!is_finalizing) {
+        Tcl_ExitThread(0);
+    }
+
+    TCL_THREAD_CREATE_RETURN;
+
+}
+
+// Waits until the number of workers is not more than wanted. Must be called
+// with tjv_pool_mx locked.
+static void tjv_PoolWaitThreads(void) {
+    while (tjv_pool.threads > tjv_pool.threads_wanted) {
+        Tcl_ConditionWait(&tjv_pool_done_cond, &tjv_pool_mx, NULL);
+    }
+}
+
+int tjv_PoolConfigure(Tcl_Interp *interp, int threads) {
+
+    DBG2(printf("enter: threads: %d", threads));
+
+    Tcl_MutexLock(&tjv_pool_mx);
+
+    tjv_pool.threads_wanted = threads;
+    Tcl_ConditionNotify(&tjv_pool_work_cond);
+    tjv_PoolWaitThreads();
+
+    // There are no workers left to process the queued tasks
+    if (threads == 0) {
+        while (tjv_pool.tasks_first != NULL) {
+            tjv_PoolTask *task = tjv_PoolTaskTake();
+            Tcl_MutexUnlock(&tjv_pool_mx);
+            DBG2(printf("process a queued task"));
+            task->proc(task->clientData);
+            Tcl_MutexLock(&tjv_pool_mx);
+        }
+    }
+
+    while (tjv_pool.threads < threads) {
+        Tcl_ThreadId thread_id;
+        if (Tcl_CreateThread(&thread_id, tjv_PoolWorker, INT2PTR(tjv_pool.threads),
+            TCL_THREAD_STACK_DEFAULT, TCL_THREAD_NOFLAGS) != TCL_OK)
+        {
+            // Keep the workers that are already started
+            tjv_pool.threads_wanted = tjv_pool.threads;
+            Tcl_MutexUnlock(&tjv_pool_mx);
+            SetResult("unable to create a worker thread");
+            DBG2(printf("return: TCL_ERROR"));
+            return TCL_ERROR;
+        }
+        tjv_pool.threads++;
+    }
+
+    Tcl_MutexUnlock(&tjv_pool_mx);
+
+    DBG2(printf("return: ok"));
+    return TCL_OK;
+
+}
+
+int tjv_PoolThreads(void) {
+    Tcl_MutexLock(&tjv_pool_mx);
+    int threads = tjv_pool.threads;
+    Tcl_MutexUnlock(&tjv_pool_mx);
+    return threads;
+}
+
+void tjv_PoolRun(tjv_PoolProc *proc, void *clientData, Tcl_Size count) {
+
+    DBG2(printf("enter: count: %" TCL_SIZE_MODIFIER "d", count));
+
+    Tcl_MutexLock(&tjv_pool_mx);
+
+    if (tjv_pool.threads == 0 || tjv_pool.job != NULL || count < 2) {
+        Tcl_MutexUnlock(&tjv_pool_mx);
+        DBG2(printf("run in the current thread"));
+        for (Tcl_Size i = 0; i < count; i++) {
+            proc(clientData, i);
+        }
+        DBG2(printf("return: ok"));
+        return;
+    }
+
+    tjv_PoolJob job;
+    job.proc = proc;
+    job.clientData = clientData;
+    job.count = count;
+    job.chunk = count / ((tjv_pool.threads + 1) * TJV_POOL_CHUNKS_PER_THREAD);
+    if (job.chunk == 0) {
+        job.chunk = 1;
+    }
+    job.next = 0;
+    // The current thread is one of the threads that process the job
+    job.active = 1;
+
+    tjv_pool.job = &job;
+    tjv_pool.job_id++;
+    Tcl_ConditionNotify(&tjv_pool_work_cond);
+
+    tjv_PoolJobRun(&job);
+    job.active--;
+
+    while (job.active > 0) {
+        Tcl_ConditionWait(&tjv_pool_done_cond, &tjv_pool_mx, NULL);
+    }
+
+    tjv_pool.job = NULL;
+
+    Tcl_MutexUnlock(&tjv_pool_mx);
+
+    DBG2(printf("return: ok"));
+
+}
+
+int tjv_PoolSubmit(tjv_PoolTask *task) {
+
+    Tcl_MutexLock(&tjv_pool_mx);
+
+    if (tjv_pool.threads_wanted == 0) {
+        Tcl_MutexUnlock(&tjv_pool_mx);
+        DBG2(printf("return: no workers"));
+        return 0;
+    }
+
+    task->next = NULL;
+    if (tjv_pool.tasks_last == NULL) {
+        tjv_pool.tasks_first = task;
+    } else {
+        tjv_pool.tasks_last->next = task;
+    }
+    tjv_pool.tasks_last = task;
+    Tcl_ConditionNotify(&tjv_pool_work_cond);
+
+    Tcl_MutexUnlock(&tjv_pool_mx);
+
+    DBG2(printf("return: queued"));
+    return 1;
+
+}
+
+static void tjv_PoolExitProc(ClientData clientData) {
+
+    UNUSED(clientData);
+
+    DBG2(printf("enter..."));
+
+    Tcl_MutexLock(&tjv_pool_mx);
+    tjv_pool.is_finalizing = 1;
+    tjv_pool.threads_wanted = 0;
+    Tcl_ConditionNotify(&tjv_pool_work_cond);
+    tjv_PoolWaitThreads();
+    Tcl_MutexUnlock(&tjv_pool_mx);
+
+    DBG2(printf("return: ok"));
+
+}
+
+void tjv_PoolInit(void) {
+
+    Tcl_MutexLock(&tjv_pool_initialize_mx);
+
+    if (!tjv_pool_initialized) {
+        DBG2(printf("enter..."));
+        Tcl_CreateExitHandler(tjv_PoolExitProc, NULL);
+        tjv_pool_initialized = 1;
+        DBG2(printf("return: ok"));
+    }
+
+    Tcl_MutexUnlock(&tjv_pool_initialize_mx);
+}
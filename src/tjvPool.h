@@ -0,0 +1,53 @@
+/**
+ * Copyright Jerily LTD. All Rights Reserved.
+ * SPDX-FileCopyrightText: 2024 Neofytos Dimitriou (neo@jerily.cy)
+ * SPDX-License-Identifier: MIT.
+ */
+#ifndef TJV_POOL_H
+#define TJV_POOL_H
+
+#include "common.h"
+
+// The maximum number of worker threads
+#define TJV_POOL_MAX_THREADS 256
+
+// A procedure that processes the item with the specified index. It is called
+// from worker threads, so it should not use Tcl objects or interpreters.
+typedef void (tjv_PoolProc)(void *clientData, Tcl_Size index);
+
+// A task that is processed by one of worker threads. The structure is
+// owned by the caller, and it should be valid until the task is processed.
+typedef struct tjv_PoolTask tjv_PoolTask;
+
+struct tjv_PoolTask {
+    tjv_PoolTask *next;
+    void (*proc)(void *clientData);
+    void *clientData;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void tjv_PoolInit(void);
+
+// Starts or stops worker threads so that there are the specified number
+// of them. The pool is shared by all interpreters in the process.
+int tjv_PoolConfigure(Tcl_Interp *interp, int threads);
+int tjv_PoolThreads(void);
+
+// Calls proc for indexes from 0 to count-1 on worker threads and on the
+// current thread, and returns when all of them are processed. If there
+// are no workers or they are busy with another job, all items are
+// processed by the current thread.
+void tjv_PoolRun(tjv_PoolProc *proc, void *clientData, Tcl_Size count);
+
+// Adds the task to the queue of worker threads and returns without waiting
+// for it. Returns 0 if there are no workers and the task is not queued.
+int tjv_PoolSubmit(tjv_PoolTask *task);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TJV_POOL_H
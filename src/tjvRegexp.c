@@ -0,0 +1,670 @@
+/**
+ * Copyright Jerily LTD. All Rights Reserved.
+ * SPDX-FileCopyrightText: 2024 Neofytos Dimitriou (neo@jerily.cy)
+ * SPDX-License-Identifier: MIT.
+ */
+
+// A parser for the subset of Tcl advanced regular expressions (see re_syntax)
+// that can be matched by a finite automaton:
+//   - alternation, grouping with (...) and (?:...);
+//   - quantifiers *, +, ?, {m}, {m,}, {m,n} and their non-greedy forms
+//     (greediness doesn't matter when we only check for a match);
+//   - the anchors ^, $, \A and \Z;
+//   - bracket expressions with ranges, character classes and escapes;
+//   - character-entry escapes and the class shorthands \d, \s, \w, \D, \S, \W;
+//   - the ***= and ***: directors.
+// Everything else (backreferences, lookahead constraints, word boundaries,
+// embedded options, collating elements and equivalence classes) is reported
+// as unsupported.
+//
+// The pattern is compiled by Tcl first, so we can rely on its syntax being
+// valid. Matching is done on Unicode code points, the character classes have
+// the same members as in Tcl because they are built by Tcl_UniCharIs*()
+// functions.
+
+#include "tjvRegexp.h"
+
+// The limit of NFA states. Counted repetitions of large expressions
+// can create too many states. Patterns that exceed this limit are reported
+// as unsupported.
+#define TJV_REGEXP_MAX_STATES 20000
+// The limit of nested groups
+#define TJV_REGEXP_MAX_DEPTH 100
+
+#define TJV_UNICODE_MAX 0x10FFFF
+// Tcl character classes are limited to the Basic Multilingual Plane
+#define TJV_UNICODE_BMP_MAX 0xFFFF
+
+typedef struct {
+    int *ranges;
+    int count;
+    int capacity;
+} tjv_RegexpClass;
+
+typedef struct {
+    tjv_Automaton *a;
+    const char *p;
+    Tcl_Size length;
+    Tcl_Size pos;
+    int depth;
+    const char *reason;
+} tjv_RegexpParser;
+
+static void tjv_RegexpClassAdd(tjv_RegexpClass *cls, int lo, int hi) {
+    if (cls->count == cls->capacity) {
+        cls->capacity = (cls->capacity == 0 ? 16 : cls->capacity * 2);
+        cls->ranges = ckrealloc(cls->ranges, sizeof(int) * 2 * cls->capacity);
+    }
+    cls->ranges[cls->count * 2] = lo;
+    cls->ranges[cls->count * 2 + 1] = hi;
+    cls->count++;
+}
+
+static void tjv_RegexpClassFree(tjv_RegexpClass *cls) {
+    if (cls->ranges != NULL) {
+        ckfree(cls->ranges);
+    }
+}
+
+static int tjv_RegexpCompareRange(const void *a, const void *b) {
+    int x = *(const int *)a;
+    int y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+// Sorts the ranges and merges those that overlap or adjoin.
+static void tjv_RegexpClassNormalize(tjv_RegexpClass *cls) {
+
+    if (cls->count < 2) {
+        return;
+    }
+
+    qsort(cls->ranges, (size_t)cls->count, sizeof(int) * 2, tjv_RegexpCompareRange);
+
+    int n = 0;
+    for (int i = 1; i < cls->count; i++) {
+        if (cls->ranges[i * 2] <= cls->ranges[n * 2 + 1] + 1) {
+            if (cls->ranges[i * 2 + 1] > cls->ranges[n * 2 + 1]) {
+                cls->ranges[n * 2 + 1] = cls->ranges[i * 2 + 1];
+            }
+        } else {
+            n++;
+            cls->ranges[n * 2] = cls->ranges[i * 2];
+            cls->ranges[n * 2 + 1] = cls->ranges[i * 2 + 1];
+        }
+    }
+    cls->count = n + 1;
+
+}
+
+// Replaces the class with its complement. The class must be normalized.
+static void tjv_RegexpClassNegate(tjv_RegexpClass *cls) {
+
+    tjv_RegexpClass result = { NULL, 0, 0 };
+    int next = 0;
+
+    for (int i = 0; i < cls->count; i++) {
+        if (cls->ranges[i * 2] > next) {
+            tjv_RegexpClassAdd(&result, next, cls->ranges[i * 2] - 1);
+        }
+        next = cls->ranges[i * 2 + 1] + 1;
+    }
+    if (next <= TJV_UNICODE_MAX) {
+        tjv_RegexpClassAdd(&result, next, TJV_UNICODE_MAX);
+    }
+
+    tjv_RegexpClassFree(cls);
+    *cls = result;
+
+}
+
+static int tjv_UniCharIsXdigit(int ch) {
+    return (ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'f') || (ch >= 'A' && ch <= 'F');
+}
+
+static int tjv_UniCharIsBlank(int ch) {
+    return ch == ' ' || ch == '\t';
+}
+
+// In Tcl regexps, printable characters also include spaces except
+// the control characters
+static int tjv_UniCharIsPrint(int ch) {
+    return Tcl_UniCharIsGraph(ch) || (ch >= 0x20 && Tcl_UniCharIsSpace(ch));
+}
+
+// Adds the members of the named class. Returns 0 for unknown names.
+static int tjv_RegexpClassAddNamed(tjv_RegexpClass *cls, const char *name, Tcl_Size length) {
+
+    static const struct {
+        const char *name;
+        int (*is_member)(int ch);
+    } classes[] = {
+        { "alnum",  Tcl_UniCharIsAlnum    },
+        { "alpha",  Tcl_UniCharIsAlpha    },
+        { "blank",  tjv_UniCharIsBlank    },
+        { "cntrl",  Tcl_UniCharIsControl  },
+        { "digit",  Tcl_UniCharIsDigit    },
+        { "graph",  Tcl_UniCharIsGraph    },
+        { "lower",  Tcl_UniCharIsLower    },
+        { "print",  tjv_UniCharIsPrint    },
+        { "punct",  Tcl_UniCharIsPunct    },
+        { "space",  Tcl_UniCharIsSpace    },
+        { "upper",  Tcl_UniCharIsUpper    },
+        { "xdigit", tjv_UniCharIsXdigit   },
+        // Not a real class name, used for \w
+        { "_word",  Tcl_UniCharIsWordChar },
+        { NULL, NULL }
+    };
+
+    for (int i = 0; classes[i].name != NULL; i++) {
+
+        if (strlen(classes[i].name) != (size_t)length || memcmp(classes[i].name, name, (size_t)length) != 0) {
+            continue;
+        }
+
+        int start = -1;
+        for (int ch = 0; ch <= TJV_UNICODE_BMP_MAX + 1; ch++) {
+            int is_member = (ch <= TJV_UNICODE_BMP_MAX && classes[i].is_member(ch));
+            if (is_member && start == -1) {
+                start = ch;
+            } else if (!is_member && start != -1) {
+                tjv_RegexpClassAdd(cls, start, ch - 1);
+                start = -1;
+            }
+        }
+
+        return 1;
+
+    }
+
+    return 0;
+
+}
+
+static inline int tjv_RegexpIsEnd(tjv_RegexpParser *rp) {
+    return rp->pos >= rp->length;
+}
+
+static inline char tjv_RegexpPeek(tjv_RegexpParser *rp, Tcl_Size offset) {
+    return (rp->pos + offset < rp->length ? rp->p[rp->pos + offset] : '\0');
+}
+
+static inline int tjv_RegexpIsDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static int tjv_RegexpHexValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+static int tjv_RegexpParseHex(tjv_RegexpParser *rp, int max_digits) {
+    int value = 0;
+    for (int i = 0; i < max_digits && tjv_RegexpHexValue(tjv_RegexpPeek(rp, 0)) != -1; i++) {
+        value = value * 16 + tjv_RegexpHexValue(tjv_RegexpPeek(rp, 0));
+        rp->pos++;
+    }
+    return value;
+}
+
+typedef enum {
+    TJV_REGEXP_ESCAPE_CHAR,
+    TJV_REGEXP_ESCAPE_CLASS,
+    TJV_REGEXP_ESCAPE_BEGIN,
+    TJV_REGEXP_ESCAPE_END,
+    TJV_REGEXP_ESCAPE_UNSUPPORTED
+} tjv_RegexpEscapeType;
+
+// Parses the escape after a backslash. For TJV_REGEXP_ESCAPE_CHAR, stores
+// the character in *ch_ptr. For TJV_REGEXP_ESCAPE_CLASS, adds the members
+// of the class to cls.
+static tjv_RegexpEscapeType tjv_RegexpParseEscape(tjv_RegexpParser *rp, int *ch_ptr, tjv_RegexpClass *cls) {
+
+    char c = tjv_RegexpPeek(rp, 0);
+
+    if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))) {
+        // The escaped character is taken literally
+        rp->pos += tjv_Utf8Decode(rp->p + rp->pos, rp->length - rp->pos, ch_ptr);
+        return TJV_REGEXP_ESCAPE_CHAR;
+    }
+
+    rp->pos++;
+
+    switch (c) {
+    case 'a': *ch_ptr = 0x07; break;
+    case 'b': *ch_ptr = 0x08; break;
+    case 'B': *ch_ptr = '\\'; break;
+    case 'e': *ch_ptr = 0x1B; break;
+    case 'f': *ch_ptr = 0x0C; break;
+    case 'n': *ch_ptr = 0x0A; break;
+    case 'r': *ch_ptr = 0x0D; break;
+    case 't': *ch_ptr = 0x09; break;
+    case 'v': *ch_ptr = 0x0B; break;
+    case 'c':
+        *ch_ptr = tjv_RegexpPeek(rp, 0) & 0x1F;
+        rp->pos++;
+        break;
+    case 'x':
+        *ch_ptr = tjv_RegexpParseHex(rp, 2);
+        break;
+    case 'u':
+        *ch_ptr = tjv_RegexpParseHex(rp, 4);
+        break;
+    case 'U':
+        *ch_ptr = tjv_RegexpParseHex(rp, 8);
+        if (*ch_ptr > TJV_UNICODE_MAX) {
+            rp->reason = "character code outside of Unicode range";
+            return TJV_REGEXP_ESCAPE_UNSUPPORTED;
+        }
+        break;
+    case 'd':
+    case 'D':
+    case 's':
+    case 'S':
+    case 'w':
+    case 'W': ; // empty statement
+        tjv_RegexpClass tmp = { NULL, 0, 0 };
+        switch (c) {
+        case 'd': case 'D': tjv_RegexpClassAddNamed(&tmp, "digit", 5); break;
+        case 's': case 'S': tjv_RegexpClassAddNamed(&tmp, "space", 5); break;
+        default:            tjv_RegexpClassAddNamed(&tmp, "_word", 5); break;
+        }
+        if (c == 'D' || c == 'S' || c == 'W') {
+            tjv_RegexpClassNormalize(&tmp);
+            tjv_RegexpClassNegate(&tmp);
+        }
+        for (int i = 0; i < tmp.count; i++) {
+            tjv_RegexpClassAdd(cls, tmp.ranges[i * 2], tmp.ranges[i * 2 + 1]);
+        }
+        tjv_RegexpClassFree(&tmp);
+        return TJV_REGEXP_ESCAPE_CLASS;
+    case 'A':
+        return TJV_REGEXP_ESCAPE_BEGIN;
+    case 'Z':
+        return TJV_REGEXP_ESCAPE_END;
+    case 'm':
+    case 'M':
+    case 'y':
+    case 'Y':
+        rp->reason = "word boundary constraint";
+        return TJV_REGEXP_ESCAPE_UNSUPPORTED;
+    case '0':
+        if (tjv_RegexpIsDigit(tjv_RegexpPeek(rp, 0))) {
+            rp->reason = "octal escape";
+            return TJV_REGEXP_ESCAPE_UNSUPPORTED;
+        }
+        *ch_ptr = 0;
+        break;
+    default:
+        if (c >= '1' && c <= '9') {
+            rp->reason = "backreference";
+        } else {
+            rp->reason = "unknown escape";
+        }
+        return TJV_REGEXP_ESCAPE_UNSUPPORTED;
+    }
+
+    return TJV_REGEXP_ESCAPE_CHAR;
+
+}
+
+// Parses a bracket expression. The current position is after the opening
+// bracket.
+static int tjv_RegexpParseBracket(tjv_RegexpParser *rp, tjv_NfaFragment *f) {
+
+    tjv_RegexpClass cls = { NULL, 0, 0 };
+    int is_negated = 0;
+
+    if (tjv_RegexpPeek(rp, 0) == '^') {
+        is_negated = 1;
+        rp->pos++;
+    }
+
+    int is_first = 1;
+    while (!tjv_RegexpIsEnd(rp)) {
+
+        char c = tjv_RegexpPeek(rp, 0);
+
+        if (c == ']' && !is_first) {
+            rp->pos++;
+            break;
+        }
+        is_first = 0;
+
+        int lo;
+
+        if (c == '[' && (tjv_RegexpPeek(rp, 1) == '.' || tjv_RegexpPeek(rp, 1) == '=')) {
+            rp->reason = "collating element or equivalence class";
+            goto error;
+        } else if (c == '[' && tjv_RegexpPeek(rp, 1) == ':') {
+            rp->pos += 2;
+            Tcl_Size start = rp->pos;
+            while (!tjv_RegexpIsEnd(rp) && !(tjv_RegexpPeek(rp, 0) == ':' && tjv_RegexpPeek(rp, 1) == ']')) {
+                rp->pos++;
+            }
+            if (!tjv_RegexpClassAddNamed(&cls, rp->p + start, rp->pos - start)) {
+                rp->reason = "unknown character class";
+                goto error;
+            }
+            rp->pos += 2;
+            continue;
+        } else if (c == '\\') {
+            rp->pos++;
+            tjv_RegexpEscapeType type = tjv_RegexpParseEscape(rp, &lo, &cls);
+            if (type == TJV_REGEXP_ESCAPE_CLASS) {
+                continue;
+            }
+            if (type != TJV_REGEXP_ESCAPE_CHAR) {
+                if (rp->reason == NULL) {
+                    rp->reason = "constraint escape in bracket expression";
+                }
+                goto error;
+            }
+        } else {
+            rp->pos += tjv_Utf8Decode(rp->p + rp->pos, rp->length - rp->pos, &lo);
+        }
+
+        int hi = lo;
+
+        // A range, unless '-' is the last character in the brackets
+        if (tjv_RegexpPeek(rp, 0) == '-' && tjv_RegexpPeek(rp, 1) != ']' && rp->pos + 1 < rp->length) {
+            rp->pos++;
+            if (tjv_RegexpPeek(rp, 0) == '[') {
+                rp->reason = "range with a collating element";
+                goto error;
+            } else if (tjv_RegexpPeek(rp, 0) == '\\') {
+                rp->pos++;
+                if (tjv_RegexpParseEscape(rp, &hi, &cls) != TJV_REGEXP_ESCAPE_CHAR) {
+                    if (rp->reason == NULL) {
+                        rp->reason = "invalid range in bracket expression";
+                    }
+                    goto error;
+                }
+            } else {
+                rp->pos += tjv_Utf8Decode(rp->p + rp->pos, rp->length - rp->pos, &hi);
+            }
+        }
+
+        tjv_RegexpClassAdd(&cls, lo, hi);
+
+    }
+
+    tjv_RegexpClassNormalize(&cls);
+    if (is_negated) {
+        tjv_RegexpClassNegate(&cls);
+    }
+
+    *f = tjv_NfaCharClass(rp->a, cls.ranges, cls.count);
+    tjv_RegexpClassFree(&cls);
+    return 1;
+
+error:
+
+    tjv_RegexpClassFree(&cls);
+    return 0;
+
+}
+
+static int tjv_RegexpParseAlt(tjv_RegexpParser *rp, tjv_NfaFragment *f);
+
+static int tjv_RegexpParseAtom(tjv_RegexpParser *rp, tjv_NfaFragment *f) {
+
+    char c = tjv_RegexpPeek(rp, 0);
+    int ch;
+
+    switch (c) {
+    case '(':
+        rp->pos++;
+        if (tjv_RegexpPeek(rp, 0) == '?') {
+            if (tjv_RegexpPeek(rp, 1) == '=' || tjv_RegexpPeek(rp, 1) == '!') {
+                rp->reason = "lookahead constraint";
+                return 0;
+            }
+            if (tjv_RegexpPeek(rp, 1) != ':') {
+                rp->reason = "embedded options";
+                return 0;
+            }
+            rp->pos += 2;
+        }
+        if (++rp->depth > TJV_REGEXP_MAX_DEPTH) {
+            rp->reason = "too many nested groups";
+            return 0;
+        }
+        if (!tjv_RegexpParseAlt(rp, f)) {
+            return 0;
+        }
+        rp->depth--;
+        // Skip the closing parenthesis
+        rp->pos++;
+        return 1;
+    case '.':
+        rp->pos++;
+        *f = tjv_NfaCharRange(rp->a, 0, TJV_UNICODE_MAX);
+        return 1;
+    case '^':
+        rp->pos++;
+        *f = tjv_NfaAssert(rp->a, TJV_NFA_BEGIN);
+        return 1;
+    case '$':
+        rp->pos++;
+        *f = tjv_NfaAssert(rp->a, TJV_NFA_END);
+        return 1;
+    case '[':
+        rp->pos++;
+        return tjv_RegexpParseBracket(rp, f);
+    case '\\': ; // empty statement
+        rp->pos++;
+        tjv_RegexpClass cls = { NULL, 0, 0 };
+        switch (tjv_RegexpParseEscape(rp, &ch, &cls)) {
+        case TJV_REGEXP_ESCAPE_CHAR:
+            *f = tjv_NfaCharRange(rp->a, ch, ch);
+            break;
+        case TJV_REGEXP_ESCAPE_CLASS:
+            tjv_RegexpClassNormalize(&cls);
+            *f = tjv_NfaCharClass(rp->a, cls.ranges, cls.count);
+            break;
+        case TJV_REGEXP_ESCAPE_BEGIN:
+            *f = tjv_NfaAssert(rp->a, TJV_NFA_BEGIN);
+            break;
+        case TJV_REGEXP_ESCAPE_END:
+            *f = tjv_NfaAssert(rp->a, TJV_NFA_END);
+            break;
+        case TJV_REGEXP_ESCAPE_UNSUPPORTED:
+            tjv_RegexpClassFree(&cls);
+            return 0;
+        }
+        tjv_RegexpClassFree(&cls);
+        return 1;
+    default:
+        rp->pos += tjv_Utf8Decode(rp->p + rp->pos, rp->length - rp->pos, &ch);
+        *f = tjv_NfaCharRange(rp->a, ch, ch);
+        return 1;
+    }
+
+}
+
+static int tjv_RegexpParseNumber(tjv_RegexpParser *rp) {
+    int value = 0;
+    while (tjv_RegexpIsDigit(tjv_RegexpPeek(rp, 0))) {
+        value = value * 10 + (tjv_RegexpPeek(rp, 0) - '0');
+        rp->pos++;
+    }
+    return value;
+}
+
+// Parses an atom followed by an optional quantifier. For counted repetitions,
+// the atom is parsed again for each copy.
+static int tjv_RegexpParsePiece(tjv_RegexpParser *rp, tjv_NfaFragment *f) {
+
+    Tcl_Size atom_start = rp->pos;
+
+    if (!tjv_RegexpParseAtom(rp, f)) {
+        return 0;
+    }
+
+    char c = tjv_RegexpPeek(rp, 0);
+
+    if (c == '*' || c == '+' || c == '?') {
+        rp->pos++;
+        switch (c) {
+        case '*': *f = tjv_NfaStar(rp->a, *f);  break;
+        case '+': *f = tjv_NfaPlus(rp->a, *f);  break;
+        case '?': *f = tjv_NfaQuest(rp->a, *f); break;
+        }
+    } else if (c == '{' && tjv_RegexpIsDigit(tjv_RegexpPeek(rp, 1))) {
+
+        Tcl_Size atom_end = rp->pos;
+
+        rp->pos++;
+        int min = tjv_RegexpParseNumber(rp);
+        int max = min;
+        if (tjv_RegexpPeek(rp, 0) == ',') {
+            rp->pos++;
+            max = (tjv_RegexpIsDigit(tjv_RegexpPeek(rp, 0)) ? tjv_RegexpParseNumber(rp) : -1);
+        }
+        // Skip the closing brace
+        rp->pos++;
+        Tcl_Size quantifier_end = rp->pos;
+
+        // The first copy is already parsed
+        tjv_NfaFragment result = (min == 0 ? tjv_NfaEmpty(rp->a) : *f);
+        tjv_NfaFragment copy = *f;
+        int copies = (max == -1 ? min + 1 : (max > 0 ? max : 1));
+
+        for (int i = 1; i <= copies; i++) {
+
+            if (i > 1) {
+                rp->pos = atom_start;
+                if (!tjv_RegexpParseAtom(rp, &copy)) {
+                    return 0;
+                }
+                assert(rp->pos == atom_end && "parsed the same atom with different length");
+                if (rp->a->nfa_count > TJV_REGEXP_MAX_STATES) {
+                    rp->reason = "pattern is too large";
+                    return 0;
+                }
+            }
+
+            if (i <= min) {
+                if (i > 1) {
+                    result = tjv_NfaConcat(rp->a, result, copy);
+                }
+            } else if (max == -1) {
+                // {m,} is m copies followed by a star of the last one
+                result = tjv_NfaConcat(rp->a, result, tjv_NfaStar(rp->a, copy));
+            } else {
+                result = tjv_NfaConcat(rp->a, result, tjv_NfaQuest(rp->a, copy));
+            }
+
+        }
+
+        // {0} matches only the empty string
+        if (max == 0) {
+            result = tjv_NfaEmpty(rp->a);
+        }
+
+        UNUSED(atom_end);
+        rp->pos = quantifier_end;
+        *f = result;
+
+    } else {
+        return 1;
+    }
+
+    // Non-greedy quantifiers match the same strings
+    if (tjv_RegexpPeek(rp, 0) == '?') {
+        rp->pos++;
+    }
+
+    return 1;
+
+}
+
+static int tjv_RegexpParseBranch(tjv_RegexpParser *rp, tjv_NfaFragment *f) {
+
+    *f = tjv_NfaEmpty(rp->a);
+
+    while (!tjv_RegexpIsEnd(rp) && tjv_RegexpPeek(rp, 0) != '|' && tjv_RegexpPeek(rp, 0) != ')') {
+        tjv_NfaFragment piece;
+        if (!tjv_RegexpParsePiece(rp, &piece)) {
+            return 0;
+        }
+        *f = tjv_NfaConcat(rp->a, *f, piece);
+        if (rp->a->nfa_count > TJV_REGEXP_MAX_STATES) {
+            rp->reason = "pattern is too large";
+            return 0;
+        }
+    }
+
+    return 1;
+
+}
+
+static int tjv_RegexpParseAlt(tjv_RegexpParser *rp, tjv_NfaFragment *f) {
+
+    if (!tjv_RegexpParseBranch(rp, f)) {
+        return 0;
+    }
+
+    while (tjv_RegexpPeek(rp, 0) == '|' && !tjv_RegexpIsEnd(rp)) {
+        rp->pos++;
+        tjv_NfaFragment branch;
+        if (!tjv_RegexpParseBranch(rp, &branch)) {
+            return 0;
+        }
+        *f = tjv_NfaAlt(rp->a, *f, branch);
+    }
+
+    return 1;
+
+}
+
+tjv_Automaton *tjv_RegexpCompile(Tcl_Obj *pattern, const char **reason_ptr) {
+
+    tjv_RegexpParser rp;
+    rp.p = Tcl_GetStringFromObj(pattern, &rp.length);
+    rp.pos = 0;
+    rp.depth = 0;
+    rp.reason = NULL;
+    rp.a = tjv_AutomatonAlloc(0);
+
+    DBG2(printf("enter: pattern: [%s]", rp.p));
+
+    tjv_NfaFragment f;
+
+    if (rp.length >= 4 && memcmp(rp.p, "***=", 4) == 0) {
+        // The rest of the pattern is a literal string
+        f = tjv_NfaString(rp.a, rp.p + 4, rp.length - 4);
+        goto done;
+    }
+
+    if (rp.length >= 4 && memcmp(rp.p, "***:", 4) == 0) {
+        rp.pos = 4;
+    }
+
+    if (!tjv_RegexpParseAlt(&rp, &f)) {
+        goto error;
+    }
+
+done:
+
+    tjv_AutomatonFinish(rp.a, f);
+    DBG2(printf("return: ok"));
+    return rp.a;
+
+error:
+
+    DBG2(printf("return: unsupported (%s)", rp.reason));
+    *reason_ptr = (rp.reason == NULL ? "unsupported construct" : rp.reason);
+    tjv_AutomatonFree(rp.a);
+    return NULL;
+
+}
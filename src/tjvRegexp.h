@@ -0,0 +1,27 @@
+/**
+ * Copyright Jerily LTD. All Rights Reserved.
+ * SPDX-FileCopyrightText: 2024 Neofytos Dimitriou (neo@jerily.cy)
+ * SPDX-License-Identifier: MIT.
+ */
+#ifndef TJV_REGEXP_H
+#define TJV_REGEXP_H
+
+#include "common.h"
+#include "tjvAutomaton.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Compiles a Tcl advanced regular expression into an automaton that searches
+// for a match in linear time. The pattern must be already validated by Tcl.
+// If the pattern uses constructs that are not supported (such as
+// backreferences or lookahead constraints), returns NULL and sets
+// *reason_ptr to their description.
+tjv_Automaton *tjv_RegexpCompile(Tcl_Obj *pattern, const char **reason_ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TJV_REGEXP_H
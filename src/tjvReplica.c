@@ -0,0 +1,290 @@
+/**
+ * Copyright Jerily LTD. All Rights Reserved.
+ * SPDX-FileCopyrightText: 2024 Neofytos Dimitriou (neo@jerily.cy)
+ * SPDX-License-Identifier: MIT.
+ */
+
+#include "tjvReplica.h"
+
+struct tjv_Replica {
+    // The arguments of tjv::compile as a list
+    char *spec;
+    Tcl_Size length;
+    // The schema and the thread that compiled it
+    tjv_ValidationElement *root;
+    Tcl_ThreadId owner;
+    // Protected by tjv_replica_mx. References are held by the schema, by
+    // the copies and by tjv_ReplicaRetain().
+    int refcount;
+    int is_released;
+};
+
+typedef struct tjv_ReplicaCopy tjv_ReplicaCopy;
+
+struct tjv_ReplicaCopy {
+    tjv_ReplicaCopy *next;
+    tjv_Replica *replica;
+    // NULL if the schema can't be compiled by the thread
+    tjv_ValidationElement *root;
+};
+
+typedef struct ThreadSpecificData {
+    int is_initialized;
+    // The value of tjv_replica_generation when the copies were checked
+    unsigned int generation;
+    tjv_ReplicaCopy *first;
+} ThreadSpecificData;
+
+static Tcl_ThreadDataKey dataKey;
+
+#define TCL_TSD_INIT(keyPtr) \
+    (ThreadSpecificData *)Tcl_GetThreadData((keyPtr), sizeof(ThreadSpecificData))
+
+static Tcl_Mutex tjv_replica_mx;
+// Incremented when a schema is freed, so threads know that some of their
+// copies are not needed anymore
+static unsigned int tjv_replica_generation = 0;
+
+static void tjv_ReplicaThreadExitProc(ClientData clientData);
+
+tjv_Replica *tjv_ReplicaNew(Tcl_Size objc, Tcl_Obj *const objv[], tjv_ValidationElement *root) {
+
+    Tcl_Obj *spec = Tcl_NewListObj(objc, objv);
+    Tcl_Size length;
+    const char *str = Tcl_GetStringFromObj(spec, &length);
+
+    tjv_Replica *replica = ckalloc(sizeof(tjv_Replica));
+    replica->spec = ckalloc(length + 1);
+    memcpy(replica->spec, str, length + 1);
+    replica->length = length;
+    replica->root = root;
+    replica->owner = Tcl_GetCurrentThread();
+    replica->refcount = 1;
+    replica->is_released = 0;
+
+    Tcl_BounceRefCount(spec);
+
+    DBG2(printf("replica: %p spec: [%s]", (void *)replica, replica->spec));
+
+    return replica;
+
+}
+
+void tjv_ReplicaRetain(tjv_Replica *replica) {
+    Tcl_MutexLock(&tjv_replica_mx);
+    replica->refcount++;
+    Tcl_MutexUnlock(&tjv_replica_mx);
+}
+
+void tjv_ReplicaFree(tjv_Replica *replica) {
+
+    Tcl_MutexLock(&tjv_replica_mx);
+    int refcount = --replica->refcount;
+    Tcl_MutexUnlock(&tjv_replica_mx);
+
+    if (refcount == 0) {
+        DBG2(printf("free replica: %p", (void *)replica));
+        ckfree(replica->spec);
+        ckfree(replica);
+    }
+
+}
+
+void tjv_ReplicaRelease(tjv_Replica *replica) {
+
+    DBG2(printf("release replica: %p", (void *)replica));
+
+    Tcl_MutexLock(&tjv_replica_mx);
+    replica->is_released = 1;
+    tjv_replica_generation++;
+    Tcl_MutexUnlock(&tjv_replica_mx);
+
+    tjv_ReplicaFree(replica);
+
+}
+
+// Compiles the arguments of the schema in the current thread. The interpreter
+// is only needed for error messages of the compiler, the copy doesn't use it.
+static tjv_ValidationElement *tjv_ReplicaCompile(tjv_Replica *replica) {
+
+    DBG2(printf("compile replica: %p", (void *)replica));
+
+    Tcl_Interp *interp = Tcl_CreateInterp();
+    Tcl_Obj *spec = Tcl_NewStringObj(replica->spec, replica->length);
+    Tcl_IncrRefCount(spec);
+
+    tjv_ValidationElement *root = NULL;
+
+    Tcl_Size objc;
+    Tcl_Obj **objv;
+    if (Tcl_ListObjGetElements(interp, spec, &objc, &objv) == TCL_OK) {
+        // The name of the variable for the handle is not used
+        Tcl_Obj *trace_variable_name = NULL;
+        root = tjv_ValidationCompile(interp, objc, objv, &trace_variable_name, NULL);
+    }
+
+    if (root == NULL) {
+        DBG2(printf("unable to compile: %s", Tcl_GetStringResult(interp)));
+    }
+
+    Tcl_DecrRefCount(spec);
+    Tcl_DeleteInterp(interp);
+
+    return root;
+
+}
+
+static void tjv_ReplicaCopyFree(tjv_ReplicaCopy *copy) {
+    if (copy->root != NULL) {
+        tjv_ValidationElementFree(copy->root);
+    }
+    tjv_ReplicaFree(copy->replica);
+    ckfree(copy);
+}
+
+// Frees the copies of the schemas that are already freed
+static void tjv_ReplicaSweep(ThreadSpecificData *tsdPtr) {
+
+    tjv_ReplicaCopy **copy_ptr = &tsdPtr->first;
+
+    while (*copy_ptr != NULL) {
+
+        tjv_ReplicaCopy *copy = *copy_ptr;
+
+        Tcl_MutexLock(&tjv_replica_mx);
+        int is_released = copy->replica->is_released;
+        Tcl_MutexUnlock(&tjv_replica_mx);
+
+        if (is_released) {
+            DBG2(printf("free the copy of replica: %p", (void *)copy->replica));
+            *copy_ptr = copy->next;
+            tjv_ReplicaCopyFree(copy);
+        } else {
+            copy_ptr = &copy->next;
+        }
+
+    }
+
+}
+
+tjv_ValidationElement *tjv_ReplicaGet(tjv_Replica *replica) {
+
+    Tcl_MutexLock(&tjv_replica_mx);
+    int is_released = replica->is_released;
+    unsigned int generation = tjv_replica_generation;
+    Tcl_MutexUnlock(&tjv_replica_mx);
+
+    if (is_released) {
+        DBG2(printf("return: NULL (the schema is freed)"));
+        return NULL;
+    }
+
+    if (replica->owner == Tcl_GetCurrentThread()) {
+        return replica->root;
+    }
+
+    ThreadSpecificData *tsdPtr = TCL_TSD_INIT(&dataKey);
+
+    if (!tsdPtr->is_initialized) {
+        // Exit handlers are registered per thread, so the copies are
+        // freed by the thread that compiled them
+        DBG2(printf("first use in the thread"));
+        Tcl_CreateThreadExitHandler(tjv_ReplicaThreadExitProc, NULL);
+        tsdPtr->is_initialized = 1;
+        tsdPtr->generation = generation;
+    } else if (tsdPtr->generation != generation) {
+        tjv_ReplicaSweep(tsdPtr);
+        tsdPtr->generation = generation;
+    }
+
+    for (tjv_ReplicaCopy *copy = tsdPtr->first; copy != NULL; copy = copy->next) {
+        if (copy->replica == replica) {
+            return copy->root;
+        }
+    }
+
+    // The copy holds a reference to the source, so another source can't
+    // get the same address while the copy exists
+    tjv_ReplicaCopy *copy = ckalloc(sizeof(tjv_ReplicaCopy));
+    copy->replica = replica;
+    tjv_ReplicaRetain(replica);
+    copy->root = tjv_ReplicaCompile(replica);
+    copy->next = tsdPtr->first;
+    tsdPtr->first = copy;
+
+    return copy->root;
+
+}
+
+static void tjv_ReplicaThreadExitProc(ClientData clientData) {
+
+    UNUSED(clientData);
+
+    ThreadSpecificData *tsdPtr = TCL_TSD_INIT(&dataKey);
+
+    DBG2(printf("enter..."));
+
+    while (tsdPtr->first != NULL) {
+        tjv_ReplicaCopy *copy = tsdPtr->first;
+        tsdPtr->first = copy->next;
+        tjv_ReplicaCopyFree(copy);
+    }
+
+    DBG2(printf("return: ok"));
+
+}
+
+void tjv_ReplicaTextSet(tjv_ReplicaText *text, Tcl_Obj *obj) {
+
+    if (obj == NULL) {
+        text->bytes = NULL;
+        text->length = 0;
+        return;
+    }
+
+    Tcl_Size length;
+    const char *str = Tcl_GetStringFromObj(obj, &length);
+    text->bytes = ckalloc(length + 1);
+    memcpy(text->bytes, str, length + 1);
+    text->length = length;
+
+    Tcl_BounceRefCount(obj);
+
+}
+
+Tcl_Obj *tjv_ReplicaTextGet(tjv_ReplicaText *text) {
+
+    if (text->bytes == NULL) {
+        return NULL;
+    }
+
+    Tcl_Obj *obj = Tcl_NewStringObj(text->bytes, text->length);
+    tjv_ReplicaTextFree(text);
+
+    return obj;
+
+}
+
+void tjv_ReplicaTextAppendList(tjv_ReplicaText *text, Tcl_Obj **list_ptr) {
+
+    Tcl_Obj *list = tjv_ReplicaTextGet(text);
+    if (list == NULL) {
+        return;
+    }
+
+    if (*list_ptr == NULL) {
+        *list_ptr = list;
+        return;
+    }
+
+    Tcl_ListObjAppendList(NULL, *list_ptr, list);
+    Tcl_BounceRefCount(list);
+
+}
+
+void tjv_ReplicaTextFree(tjv_ReplicaText *text) {
+    if (text->bytes != NULL) {
+        ckfree(text->bytes);
+        text->bytes = NULL;
+    }
+}
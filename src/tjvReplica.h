@@ -0,0 +1,60 @@
+/**
+ * Copyright Jerily LTD. All Rights Reserved.
+ * SPDX-FileCopyrightText: 2024 Neofytos Dimitriou (neo@jerily.cy)
+ * SPDX-License-Identifier: MIT.
+ */
+#ifndef TJV_REPLICA_H
+#define TJV_REPLICA_H
+
+#include "common.h"
+#include "tjvCompile.h"
+
+// A compiled schema has Tcl objects, regexps and automata that can only be
+// used by the thread that created them. Other threads compile the arguments
+// of the schema again and validate with their own copies of it. Results are
+// passed back as strings.
+
+// A string that is passed from one thread to another. It is empty if bytes
+// is NULL.
+typedef struct {
+    char *bytes;
+    Tcl_Size length;
+} tjv_ReplicaText;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Creates the source of copies for the schema that is compiled from the
+// specified arguments by the current thread. The schema owns the source.
+tjv_Replica *tjv_ReplicaNew(Tcl_Size objc, Tcl_Obj *const objv[], tjv_ValidationElement *root);
+// Called when the schema is freed. Copies of other threads are freed by
+// them the next time they get a copy of any schema, or when they exit.
+void tjv_ReplicaRelease(tjv_Replica *replica);
+// Keeps the source in memory until tjv_ReplicaFree() is called, even if
+// the schema is freed before
+void tjv_ReplicaRetain(tjv_Replica *replica);
+void tjv_ReplicaFree(tjv_Replica *replica);
+
+// Returns the schema for the current thread: the schema itself in the thread
+// that created it, or the copy of the current thread, which is compiled on
+// the first use. Returns NULL if the schema is already freed or if the copy
+// can't be compiled.
+tjv_ValidationElement *tjv_ReplicaGet(tjv_Replica *replica);
+
+// Copies the string representation of the object to the text, and releases
+// the object if it has no references. The text is empty if obj is NULL.
+void tjv_ReplicaTextSet(tjv_ReplicaText *text, Tcl_Obj *obj);
+// Returns a new object with the text and frees the text. Returns NULL if
+// the text is empty.
+Tcl_Obj *tjv_ReplicaTextGet(tjv_ReplicaText *text);
+// Appends the elements of the list in the text to the list that is created
+// if it is NULL, and frees the text
+void tjv_ReplicaTextAppendList(tjv_ReplicaText *text, Tcl_Obj **list_ptr);
+void tjv_ReplicaTextFree(tjv_ReplicaText *text);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TJV_REPLICA_H
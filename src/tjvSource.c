@@ -0,0 +1,349 @@
+/**
+ * Copyright Jerily LTD. All Rights Reserved.
+ * SPDX-FileCopyrightText: 2024 Neofytos Dimitriou (neo@jerily.cy)
+ * SPDX-License-Identifier: MIT.
+ */
+
+#include "tjvSource.h"
+#include "tjvValidateJson.h"
+#include "tjvMessage.h"
+#include "tjvJsonScan.h"
+
+#include <limits.h>
+#include <errno.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// The text is parsed directly from the bytes of the file or the channel.
+// They should be UTF-8, as the encoding of the channel is not used. Only
+// the values that are added to the outcome become Tcl objects, so the
+// result is the same as when the text is read to a string and validated.
+
+// Validates the text and sets the result in the same way as the validate
+// subcommand
+static int tjv_SourceValidate(Tcl_Interp *interp, tjv_ValidationElement *root, const char *json, Tcl_Size length, Tcl_Obj *outcome_var_name) {
+
+    DBG2(printf("enter: length: %" TCL_SIZE_MODIFIER "d", length));
+
+    Tcl_Obj *error_message = NULL;
+    Tcl_Obj *error_details = NULL;
+    Tcl_Obj *outcome = Tcl_NewDictObj();
+
+    tjv_JsonDocument doc;
+    int parse_result = tjv_JsonParse(&doc, json, length, 0);
+    tjv_ValidateJsonRootText(json, length, &doc, parse_result, root, &error_message, &error_details, &outcome);
+
+    if (error_message == NULL) {
+        if (outcome_var_name == NULL) {
+            Tcl_SetObjResult(interp, outcome);
+        } else {
+            Tcl_ObjSetVar2(interp, outcome_var_name, NULL, outcome, 0);
+            Tcl_SetObjResult(interp, Tcl_NewBooleanObj(1));
+        }
+        DBG2(printf("return: ok"));
+        return TCL_OK;
+    }
+
+    Tcl_BounceRefCount(outcome);
+
+    if (outcome_var_name == NULL) {
+        Tcl_SetObjResult(interp, tjv_MessageCombine(error_message));
+        Tcl_BounceRefCount(error_details);
+        DBG2(printf("return: TCL_ERROR"));
+        return TCL_ERROR;
+    }
+
+    Tcl_ObjSetVar2(interp, outcome_var_name, NULL, tjv_MessageCombineDetails(error_message, error_details), 0);
+    Tcl_SetObjResult(interp, Tcl_NewBooleanObj(0));
+    DBG2(printf("return: 0 (with error variable)"));
+    return TCL_OK;
+
+}
+
+static void tjv_SourceSetStats(Tcl_Interp *interp, Tcl_Obj *stats_var_name, Tcl_WideInt bytes, const Tcl_Time *start) {
+
+    Tcl_Time now;
+    Tcl_GetTime(&now);
+
+    Tcl_WideInt microseconds = ((Tcl_WideInt)now.sec - start->sec) * 1000000 + (now.usec - start->usec);
+
+    Tcl_Obj *stats = Tcl_NewDictObj();
+    Tcl_DictObjPut(NULL, stats, Tcl_NewStringObj("bytes", -1), Tcl_NewWideIntObj(bytes));
+    Tcl_DictObjPut(NULL, stats, Tcl_NewStringObj("microseconds", -1), Tcl_NewWideIntObj(microseconds));
+    // Bytes per microsecond are megabytes per second
+    Tcl_DictObjPut(NULL, stats, Tcl_NewStringObj("throughput", -1),
+        Tcl_NewDoubleObj(microseconds > 0 ? (double)bytes / (double)microseconds : 0.0));
+
+    DBG2(printf("stats: [%s]", Tcl_GetString(stats)));
+    Tcl_ObjSetVar2(interp, stats_var_name, NULL, stats, 0);
+
+}
+
+// Reads the channel to the end, and appends the bytes to the buffer
+static int tjv_SourceRead(Tcl_Interp *interp, Tcl_Channel chan, Tcl_DString *ds) {
+
+    for (;;) {
+
+        Tcl_Size length = Tcl_DStringLength(ds);
+        if (length > TCL_SIZE_MAX - TJV_SOURCE_BUFFER_SIZE || (Tcl_WideUInt)length > TJV_JSON_SCAN_MAX_LENGTH) {
+            SetResult("the text is too large to validate");
+            DBG2(printf("return: TCL_ERROR (too large)"));
+            return TCL_ERROR;
+        }
+
+        Tcl_DStringSetLength(ds, length + TJV_SOURCE_BUFFER_SIZE);
+        Tcl_Size count = Tcl_Read(chan, Tcl_DStringValue(ds) + length, TJV_SOURCE_BUFFER_SIZE);
+
+        if (count < 0) {
+            Tcl_DStringSetLength(ds, length);
+            Tcl_SetObjResult(interp, Tcl_ObjPrintf("error reading \"%s\": %s",
+                Tcl_GetChannelName(chan), Tcl_PosixError(interp)));
+            DBG2(printf("return: TCL_ERROR (read error)"));
+            return TCL_ERROR;
+        }
+
+        Tcl_DStringSetLength(ds, length + count);
+
+        if (Tcl_Eof(chan)) {
+            break;
+        }
+
+        // Without data, a channel in non-blocking mode would be read again
+        // and again
+        if (count == 0 && Tcl_InputBlocked(chan)) {
+            Tcl_SetObjResult(interp, Tcl_ObjPrintf("channel \"%s\" is in non-blocking mode and has no data",
+                Tcl_GetChannelName(chan)));
+            DBG2(printf("return: TCL_ERROR (blocked)"));
+            return TCL_ERROR;
+        }
+
+    }
+
+    DBG2(printf("return: ok (%" TCL_SIZE_MODIFIER "d bytes)", Tcl_DStringLength(ds)));
+    return TCL_OK;
+
+}
+
+static int tjv_SourceValidateRead(Tcl_Interp *interp, tjv_ValidationElement *root, Tcl_Channel chan, Tcl_Obj *outcome_var_name, Tcl_Obj *stats_var_name) {
+
+    Tcl_Time start;
+    Tcl_GetTime(&start);
+
+    Tcl_DString ds;
+    Tcl_DStringInit(&ds);
+
+    int rc = tjv_SourceRead(interp, chan, &ds);
+    if (rc == TCL_OK) {
+        rc = tjv_SourceValidate(interp, root, Tcl_DStringValue(&ds), Tcl_DStringLength(&ds), outcome_var_name);
+        if (stats_var_name != NULL) {
+            tjv_SourceSetStats(interp, stats_var_name, Tcl_DStringLength(&ds), &start);
+        }
+    }
+
+    Tcl_DStringFree(&ds);
+
+    return rc;
+
+}
+
+int tjv_SourceValidateChannel(Tcl_Interp *interp, tjv_ValidationElement *root, Tcl_Obj *channel_name, Tcl_Obj *outcome_var_name, Tcl_Obj *stats_var_name) {
+
+    DBG2(printf("enter: channel: %s", Tcl_GetString(channel_name)));
+
+    if (root->type != TJV_VALIDATION_JSON) {
+        SetResult("validation of channels requires a schema of the json type");
+        DBG2(printf("return: TCL_ERROR (not json)"));
+        return TCL_ERROR;
+    }
+
+    int mode;
+    Tcl_Channel chan = Tcl_GetChannel(interp, Tcl_GetString(channel_name), &mode);
+    if (chan == NULL) {
+        DBG2(printf("return: TCL_ERROR (no channel)"));
+        return TCL_ERROR;
+    }
+
+    if (!(mode & TCL_READABLE)) {
+        Tcl_SetObjResult(interp, Tcl_ObjPrintf("channel \"%s\" wasn't opened for reading",
+            Tcl_GetString(channel_name)));
+        DBG2(printf("return: TCL_ERROR (not readable)"));
+        return TCL_ERROR;
+    }
+
+    return tjv_SourceValidateRead(interp, root, chan, outcome_var_name, stats_var_name);
+
+}
+
+int tjv_SourceMapFile(Tcl_Interp *interp, Tcl_Obj *path, tjv_SourceMapping *mapping) {
+
+    DBG2(printf("enter: path: %s", Tcl_GetString(path)));
+
+    mapping->bytes = NULL;
+    mapping->length = 0;
+    mapping->map = NULL;
+
+#ifndef _WIN32
+
+    // Files of virtual filesystems have no native path, they are read
+    // as channels
+    const char *native_path = Tcl_FSGetNativePath(path);
+    if (native_path == NULL) {
+        DBG2(printf("return: ok (no native path)"));
+        return TCL_OK;
+    }
+
+    int fd = open(native_path, O_RDONLY);
+    if (fd == -1) {
+        Tcl_SetErrno(errno);
+        Tcl_SetObjResult(interp, Tcl_ObjPrintf("couldn't open \"%s\": %s",
+            Tcl_GetString(path), Tcl_PosixError(interp)));
+        DBG2(printf("return: TCL_ERROR (open failed)"));
+        return TCL_ERROR;
+    }
+
+    struct stat st;
+    int error = 0;
+    if (fstat(fd, &st) == -1) {
+        error = errno;
+    } else if (!S_ISREG(st.st_mode)) {
+        error = (S_ISDIR(st.st_mode) ? EISDIR : EINVAL);
+    }
+    if (error != 0) {
+        close(fd);
+        Tcl_SetErrno(error);
+        Tcl_SetObjResult(interp, Tcl_ObjPrintf("couldn't read \"%s\": %s",
+            Tcl_GetString(path), Tcl_PosixError(interp)));
+        DBG2(printf("return: TCL_ERROR (not a regular file)"));
+        return TCL_ERROR;
+    }
+
+    if ((Tcl_WideUInt)st.st_size > (Tcl_WideUInt)TCL_SIZE_MAX) {
+        close(fd);
+        Tcl_SetObjResult(interp, Tcl_ObjPrintf("file \"%s\" is too large to validate", Tcl_GetString(path)));
+        DBG2(printf("return: TCL_ERROR (too large)"));
+        return TCL_ERROR;
+    }
+
+    mapping->length = (Tcl_Size)st.st_size;
+    mapping->bytes = "";
+
+    // An empty file can't be mapped
+    if (mapping->length > 0) {
+        void *map = mmap(NULL, mapping->length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            Tcl_SetErrno(errno);
+            close(fd);
+            mapping->bytes = NULL;
+            mapping->length = 0;
+            Tcl_SetObjResult(interp, Tcl_ObjPrintf("couldn't map \"%s\": %s",
+                Tcl_GetString(path), Tcl_PosixError(interp)));
+            DBG2(printf("return: TCL_ERROR (mmap failed)"));
+            return TCL_ERROR;
+        }
+#ifdef MADV_SEQUENTIAL
+        madvise(map, mapping->length, MADV_SEQUENTIAL);
+#endif
+        mapping->map = map;
+        mapping->bytes = (const char *)map;
+    }
+
+    close(fd);
+
+    DBG2(printf("return: ok (%" TCL_SIZE_MODIFIER "d bytes)", mapping->length));
+
+#else
+
+    UNUSED(interp);
+    DBG2(printf("return: ok (not supported)"));
+
+#endif
+
+    return TCL_OK;
+
+}
+
+void tjv_SourceUnmapFile(tjv_SourceMapping *mapping) {
+#ifndef _WIN32
+    if (mapping->map != NULL) {
+        munmap(mapping->map, mapping->length);
+        mapping->map = NULL;
+    }
+#endif
+    mapping->bytes = NULL;
+    mapping->length = 0;
+}
+
+Tcl_Channel tjv_SourceOpenFile(Tcl_Interp *interp, Tcl_Obj *path) {
+
+    Tcl_Channel chan = Tcl_FSOpenFileChannel(interp, path, "r", 0);
+    if (chan == NULL) {
+        DBG2(printf("return: error (open failed)"));
+        return NULL;
+    }
+
+    if (Tcl_SetChannelOption(interp, chan, "-translation", "binary") != TCL_OK) {
+        Tcl_Close(NULL, chan);
+        DBG2(printf("return: error (configure failed)"));
+        return NULL;
+    }
+
+    return chan;
+
+}
+
+int tjv_SourceValidateFile(Tcl_Interp *interp, tjv_ValidationElement *root, Tcl_Obj *path, Tcl_Obj *outcome_var_name, Tcl_Obj *stats_var_name) {
+
+    DBG2(printf("enter: path: %s", Tcl_GetString(path)));
+
+    if (root->type != TJV_VALIDATION_JSON) {
+        SetResult("validation of files requires a schema of the json type");
+        DBG2(printf("return: TCL_ERROR (not json)"));
+        return TCL_ERROR;
+    }
+
+    Tcl_Time start;
+    Tcl_GetTime(&start);
+
+    tjv_SourceMapping mapping;
+    if (tjv_SourceMapFile(interp, path, &mapping) != TCL_OK) {
+        DBG2(printf("return: TCL_ERROR (map failed)"));
+        return TCL_ERROR;
+    }
+
+    int rc;
+
+    // Larger texts can't be parsed, see tjv_JsonScan()
+    if ((Tcl_WideUInt)mapping.length > TJV_JSON_SCAN_MAX_LENGTH) {
+        tjv_SourceUnmapFile(&mapping);
+        Tcl_SetObjResult(interp, Tcl_ObjPrintf("file \"%s\" is too large to validate", Tcl_GetString(path)));
+        DBG2(printf("return: TCL_ERROR (too large)"));
+        return TCL_ERROR;
+    }
+
+    if (mapping.bytes != NULL) {
+        rc = tjv_SourceValidate(interp, root, mapping.bytes, mapping.length, outcome_var_name);
+        if (stats_var_name != NULL) {
+            tjv_SourceSetStats(interp, stats_var_name, mapping.length, &start);
+        }
+        tjv_SourceUnmapFile(&mapping);
+        return rc;
+    }
+
+    Tcl_Channel chan = tjv_SourceOpenFile(interp, path);
+    if (chan == NULL) {
+        DBG2(printf("return: TCL_ERROR (open failed)"));
+        return TCL_ERROR;
+    }
+
+    rc = tjv_SourceValidateRead(interp, root, chan, outcome_var_name, stats_var_name);
+
+    Tcl_Close(NULL, chan);
+
+    return rc;
+
+}
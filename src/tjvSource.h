@@ -0,0 +1,46 @@
+/**
+ * Copyright Jerily LTD. All Rights Reserved.
+ * SPDX-FileCopyrightText: 2024 Neofytos Dimitriou (neo@jerily.cy)
+ * SPDX-License-Identifier: MIT.
+ */
+#ifndef TJV_SOURCE_H
+#define TJV_SOURCE_H
+
+#include "common.h"
+#include "tjvCompile.h"
+
+// The number of bytes that are read from a channel at once
+#define TJV_SOURCE_BUFFER_SIZE 65536
+
+// The contents of a file that is mapped to memory
+typedef struct {
+    const char *bytes;
+    Tcl_Size length;
+    void *map;
+} tjv_SourceMapping;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Validates the JSON text of the file or the channel without creating a Tcl
+// string for it, and sets the interpreter result in the same way as the
+// validate subcommand. The file is mapped to memory if possible. If
+// stats_var_name is not NULL, the variable is set to a dict with the size of
+// the text, the time and the throughput.
+int tjv_SourceValidateFile(Tcl_Interp *interp, tjv_ValidationElement *root, Tcl_Obj *path, Tcl_Obj *outcome_var_name, Tcl_Obj *stats_var_name);
+int tjv_SourceValidateChannel(Tcl_Interp *interp, tjv_ValidationElement *root, Tcl_Obj *channel_name, Tcl_Obj *outcome_var_name, Tcl_Obj *stats_var_name);
+
+// Maps the file to memory. If the file can't be mapped, e.g. it belongs to
+// a virtual filesystem, then the bytes are set to NULL, and the file should
+// be read by the channel returned from tjv_SourceOpenFile().
+int tjv_SourceMapFile(Tcl_Interp *interp, Tcl_Obj *path, tjv_SourceMapping *mapping);
+void tjv_SourceUnmapFile(tjv_SourceMapping *mapping);
+// Opens the file for reading of bytes
+Tcl_Channel tjv_SourceOpenFile(Tcl_Interp *interp, Tcl_Obj *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TJV_SOURCE_H
@@ -0,0 +1,228 @@
+/**
+ * Copyright Jerily LTD. All Rights Reserved.
+ * SPDX-FileCopyrightText: 2024 Neofytos Dimitriou (neo@jerily.cy)
+ * SPDX-License-Identifier: MIT.
+ */
+
+#include "tjvStep.h"
+#include "tjvValidateTcl.h"
+#include "tjvMessage.h"
+
+// The validation keeps its frames on a work stack of its own, so it can be
+// suspended after any number of values and resumed by the next step. The
+// script can run between steps, and it can change the internal
+// representation of the data, so the frames keep references to their
+// values and look them up again when they are resumed.
+
+typedef struct {
+    Tcl_Interp *interp;
+    Tcl_Command cmd_token;
+    Tcl_Obj *cmd_name;
+    ClientData owner;
+    Tcl_Obj *data;
+    tjv_WorkStack *ws;
+    // The frame that runs next, NULL when the validation is done
+    tjv_WorkFrame *frame;
+    Tcl_Obj *error_message;
+    Tcl_Obj *error_details;
+    Tcl_Obj *outcome;
+    // The error message and the error dict when the validation is done
+    Tcl_Obj *message;
+    Tcl_Obj *details;
+} tjv_StepJob;
+
+// Keeps the result of the finished validation for the result subcommand
+static void tjv_StepComplete(tjv_StepJob *job) {
+
+    DBG2(printf("enter: %s", (job->error_message == NULL ? "valid" : "invalid")));
+
+    if (job->error_message == NULL) {
+        Tcl_IncrRefCount(job->outcome);
+        return;
+    }
+
+    Tcl_BounceRefCount(job->outcome);
+    job->outcome = NULL;
+
+    Tcl_IncrRefCount(job->error_message);
+    job->message = tjv_MessageCombine(job->error_message);
+    Tcl_IncrRefCount(job->message);
+    job->details = tjv_MessageCombineDetails(job->error_message, job->error_details);
+    Tcl_IncrRefCount(job->details);
+    Tcl_DecrRefCount(job->error_message);
+
+}
+
+static int tjv_StepCmd(ClientData clientData, Tcl_Interp *interp, int objc, Tcl_Obj *const objv[]) {
+
+    DBG2(printf("enter: objc: %d", objc));
+
+    static const char *const commands[] = {
+        "destroy", "result", "step",
+        NULL
+    };
+
+    enum commands {
+        cmdDestroy, cmdResult, cmdStep
+    };
+
+    if (objc < 2) {
+wrongArgsNum:
+        Tcl_WrongNumArgs(interp, 1, objv, "step ?count?");
+        Tcl_AppendPrintfToObj(Tcl_GetObjResult(interp), " or \"%s result ?outcome_variable?\""
+            " or \"%s destroy\"", Tcl_GetString(objv[0]), Tcl_GetString(objv[0]));
+        DBG2(printf("return: TCL_ERROR (wrong # args)"));
+        return TCL_ERROR;
+    }
+
+    int command;
+    if (Tcl_GetIndexFromObj(interp, objv[1], commands, "subcommand", 0, &command) != TCL_OK) {
+        DBG2(printf("return: error (wrong subcommand: [%s])", Tcl_GetString(objv[1])));
+        return TCL_ERROR;
+    }
+
+    tjv_StepJob *job = (tjv_StepJob *)clientData;
+
+    switch ((enum commands) command) {
+
+    case cmdDestroy:
+        if (objc != 2) {
+            goto wrongArgsNum;
+        }
+        DBG2(printf("destroy subcommand"));
+        Tcl_SetObjResult(interp, job->cmd_name);
+        Tcl_DeleteCommandFromToken(job->interp, job->cmd_token);
+        break;
+
+    case cmdStep:
+        if (objc > 3) {
+            goto wrongArgsNum;
+        }
+        Tcl_Size count = TJV_STEP_DEFAULT_SIZE;
+        if (objc == 3) {
+            if (Tcl_GetSizeIntFromObj(interp, objv[2], &count) != TCL_OK) {
+                DBG2(printf("return: TCL_ERROR (wrong count)"));
+                return TCL_ERROR;
+            }
+            if (count < 1) {
+                SetResult("the count of values must be a positive integer");
+                DBG2(printf("return: TCL_ERROR (wrong count)"));
+                return TCL_ERROR;
+            }
+        }
+        if (job->frame != NULL) {
+            DBG2(printf("step subcommand: %" TCL_SIZE_MODIFIER "d values", count));
+            job->frame = tjv_WorkStackRun(job->frame, &count);
+            if (job->frame == NULL) {
+                tjv_StepComplete(job);
+            }
+        }
+        Tcl_SetObjResult(interp, Tcl_NewBooleanObj(job->frame == NULL));
+        break;
+
+    case cmdResult:
+        if (objc > 3) {
+            goto wrongArgsNum;
+        }
+        DBG2(printf("result subcommand"));
+        if (job->frame != NULL) {
+            SetResult("the validation is not complete");
+            DBG2(printf("return: TCL_ERROR (not complete)"));
+            return TCL_ERROR;
+        }
+        Tcl_Obj *outcome_var_name = (objc == 3 ? objv[2] : NULL);
+        if (job->outcome != NULL) {
+            if (outcome_var_name == NULL) {
+                Tcl_SetObjResult(interp, job->outcome);
+            } else {
+                if (Tcl_ObjSetVar2(interp, outcome_var_name, NULL, job->outcome, TCL_LEAVE_ERR_MSG) == NULL) {
+                    return TCL_ERROR;
+                }
+                Tcl_SetObjResult(interp, Tcl_NewBooleanObj(1));
+            }
+        } else if (outcome_var_name == NULL) {
+            Tcl_SetObjResult(interp, job->message);
+            DBG2(printf("return: TCL_ERROR"));
+            return TCL_ERROR;
+        } else {
+            if (Tcl_ObjSetVar2(interp, outcome_var_name, NULL, job->details, TCL_LEAVE_ERR_MSG) == NULL) {
+                return TCL_ERROR;
+            }
+            Tcl_SetObjResult(interp, Tcl_NewBooleanObj(0));
+        }
+        break;
+
+    }
+
+    DBG2(printf("return: ok"));
+    return TCL_OK;
+
+}
+
+static void tjv_StepDeleteProc(ClientData clientData) {
+
+    tjv_StepJob *job = (tjv_StepJob *)clientData;
+
+    DBG2(printf("delete command: %s", Tcl_GetString(job->cmd_name)));
+
+    if (job->frame != NULL) {
+        // The remaining frames release their values without validation
+        DBG2(printf("abort the validation"));
+        job->ws->is_aborted = 1;
+        tjv_WorkStackRun(job->frame, NULL);
+        if (job->error_message != NULL) {
+            Tcl_BounceRefCount(job->error_message);
+            Tcl_BounceRefCount(job->error_details);
+        }
+        Tcl_BounceRefCount(job->outcome);
+    } else if (job->outcome != NULL) {
+        Tcl_DecrRefCount(job->outcome);
+    } else {
+        Tcl_DecrRefCount(job->message);
+        Tcl_DecrRefCount(job->details);
+    }
+
+    tjv_WorkStackFree(job->ws);
+    Tcl_DecrRefCount(job->data);
+    Tcl_DecrRefCount(job->cmd_name);
+    Tcl_Release(job->owner);
+    ckfree(job);
+
+    DBG2(printf("return: ok"));
+
+}
+
+int tjv_StepCreate(Tcl_Interp *interp, ClientData owner, tjv_ValidationElement *root, Tcl_Obj *data) {
+
+    DBG2(printf("enter"));
+
+    tjv_StepJob *job = ckalloc(sizeof(tjv_StepJob));
+
+    job->interp = interp;
+    job->owner = owner;
+    Tcl_Preserve(owner);
+    job->data = data;
+    Tcl_IncrRefCount(data);
+    job->error_message = NULL;
+    job->error_details = NULL;
+    job->outcome = Tcl_NewDictObj();
+    job->message = NULL;
+    job->details = NULL;
+
+    job->ws = tjv_WorkStackNew();
+    job->frame = tjv_ValidateTclBegin(job->ws, data, NULL, root, &job->error_message, &job->error_details, &job->outcome);
+
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%p", (void *)job);
+    job->cmd_name = Tcl_ObjPrintf("::tjv::step%s", buf);
+    Tcl_IncrRefCount(job->cmd_name);
+
+    job->cmd_token = Tcl_CreateObjCommand(interp, Tcl_GetString(job->cmd_name), tjv_StepCmd,
+        (ClientData)job, tjv_StepDeleteProc);
+
+    DBG2(printf("return: ok (created command: %s)", Tcl_GetString(job->cmd_name)));
+
+    Tcl_SetObjResult(interp, job->cmd_name);
+    return TCL_OK;
+
+}
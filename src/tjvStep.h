@@ -0,0 +1,28 @@
+/**
+ * Copyright Jerily LTD. All Rights Reserved.
+ * SPDX-FileCopyrightText: 2024 Neofytos Dimitriou (neo@jerily.cy)
+ * SPDX-License-Identifier: MIT.
+ */
+#ifndef TJV_STEP_H
+#define TJV_STEP_H
+
+#include "common.h"
+#include "tjvCompile.h"
+
+// The default number of values that are validated by one step
+#define TJV_STEP_DEFAULT_SIZE 1000
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Creates the command of a validation that is done in steps, and sets
+// the interpreter result to its name. The owner of the schema is preserved
+// with Tcl_Preserve() while the command exists.
+int tjv_StepCreate(Tcl_Interp *interp, ClientData owner, tjv_ValidationElement *root, Tcl_Obj *data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TJV_STEP_H
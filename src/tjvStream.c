@@ -0,0 +1,982 @@
+/**
+ * Copyright Jerily LTD. All Rights Reserved.
+ * SPDX-FileCopyrightText: 2024 Neofytos Dimitriou (neo@jerily.cy)
+ * SPDX-License-Identifier: MIT.
+ */
+
+#include "tjvStream.h"
+#include "tjvValidateTcl.h"
+#include "tjvValidateJson.h"
+#include "tjvMessage.h"
+#include "tjvWorkStack.h"
+
+// The text is tokenized as it arrives, and only the token that is not
+// complete yet is kept between chunks. Scalar values are validated as soon
+// as their tokens are complete. Objects and arrays of the schema have frames
+// that check their members one by one, and the checks that need all members,
+// such as required keys, are done when the container is closed. Unions and
+// arrays with unique items need the whole value, so their text is collected
+// and validated when the value is complete. Containers that are not in the
+// schema are skipped, only their syntax is checked.
+
+typedef enum {
+    // A value is expected
+    TJV_STREAM_VALUE,
+    // The first element of an array or the end of the array
+    TJV_STREAM_VALUE_OR_CLOSE,
+    TJV_STREAM_KEY,
+    TJV_STREAM_KEY_OR_CLOSE,
+    TJV_STREAM_COLON,
+    // A comma or the end of the container
+    TJV_STREAM_NEXT,
+    // The root value is complete, only whitespace can follow
+    TJV_STREAM_END
+} tjv_StreamState;
+
+typedef enum {
+    TJV_STREAM_TOKEN_NONE,
+    TJV_STREAM_TOKEN_STRING,
+    TJV_STREAM_TOKEN_SCALAR
+} tjv_StreamTokenType;
+
+typedef struct tjv_StreamFrame tjv_StreamFrame;
+
+// An object or an array of the schema that is validated while its members
+// arrive
+struct tjv_StreamFrame {
+    tjv_StreamFrame *parent;
+    // The nesting level of the container in the text
+    Tcl_Size level;
+    tjv_ValidationElement *ve;
+    tjv_ValidationElementType type;
+    tjv_ValidationStack *stack;
+    tjv_ValidationStack *stack_parent;
+    tjv_ValidationStack stack_own;
+    Tcl_Obj **outcome_ptr;
+    // The number of members so far
+    Tcl_Size count;
+    // The element of the current member, NULL if it is not validated
+    tjv_ValidationElement *child_ve;
+    Tcl_Obj **child_outcome_ptr;
+    // The keys that are found, by their index in keys_objv
+    uint64_t *found_bits;
+    // The outcome of array elements
+    Tcl_Obj *result_outcome;
+    Tcl_Obj *item_outcome;
+};
+
+typedef struct {
+    Tcl_Interp *interp;
+    Tcl_Command cmd_token;
+    Tcl_Obj *cmd_name;
+    ClientData owner;
+    tjv_ValidationElement *root;
+    // The type of the root value, if the root value is validated
+    int is_root_validated;
+    tjv_ValidationElementType root_type;
+    // The stack frame of the json element
+    tjv_ValidationStack stack;
+    tjv_StreamState state;
+    // The opening characters of containers that are not closed yet
+    Tcl_DString levels;
+    tjv_WorkStack *ws;
+    // The innermost container that is validated
+    tjv_StreamFrame *frame;
+    // The token that is not complete yet
+    tjv_StreamTokenType token;
+    int is_escape;
+    Tcl_DString token_text;
+    Tcl_DString unescaped;
+    // The value that is collected to be validated as a whole
+    tjv_ValidationElement *capture_ve;
+    int is_capture_root;
+    Tcl_Size capture_depth;
+    int is_capture_string;
+    int is_capture_escape;
+    Tcl_DString capture_text;
+    // The whole text, only if it is added to the outcome
+    Tcl_Obj *text;
+    // The text is not valid JSON, nothing is processed after the error
+    int is_failed;
+    Tcl_Obj *error_message;
+    Tcl_Obj *error_details;
+    Tcl_Obj *outcome;
+} tjv_Stream;
+
+static inline int tjv_StreamIsDelimiter(char c) {
+    switch (c) {
+    case ' ':
+    case '\t':
+    case '\n':
+    case '\r':
+    case ',':
+    case ':':
+    case '[':
+    case ']':
+    case '{':
+    case '}':
+    case '"':
+        return 1;
+    }
+    return 0;
+}
+
+// Compares the key of a member with a key of the schema in the same way
+// as tjv_JsonGetObjectItem()
+static inline int tjv_StreamIsKeyMatched(const char *key, const char *schema_key) {
+
+    const unsigned char *a = (const unsigned char *)key;
+    const unsigned char *b = (const unsigned char *)schema_key;
+
+    for (;; a++, b++) {
+        unsigned char ca = (*a >= 'A' && *a <= 'Z' ? *a + ('a' - 'A') : *a);
+        unsigned char cb = (*b >= 'A' && *b <= 'Z' ? *b + ('a' - 'A') : *b);
+        if (ca != cb) {
+            return 0;
+        }
+        if (ca == '\0') {
+            return 1;
+        }
+    }
+
+}
+
+static inline int tjv_StreamIsRoot(tjv_Stream *s) {
+    return Tcl_DStringLength(&s->levels) == 0;
+}
+
+// Returns the frame of the container that the current value belongs to, or
+// NULL if the container is not validated
+static inline tjv_StreamFrame *tjv_StreamParent(tjv_Stream *s) {
+    tjv_StreamFrame *frame = s->frame;
+    if (frame != NULL && frame->level == Tcl_DStringLength(&s->levels) - 1) {
+        return frame;
+    }
+    return NULL;
+}
+
+static void tjv_StreamSyntaxError(tjv_Stream *s, const char *reason) {
+
+    UNUSED(reason);
+    DBG2(printf("syntax error: %s", reason));
+
+    s->is_failed = 1;
+
+    // The result is the same as when the whole text can't be parsed, the
+    // errors that are found before are dropped
+    if (s->error_message != NULL) {
+        Tcl_BounceRefCount(s->error_message);
+        Tcl_BounceRefCount(s->error_details);
+        s->error_message = NULL;
+        s->error_details = NULL;
+    }
+
+    s->stack.next = NULL;
+    s->stack.index = -1;
+    tjv_MessageGenerateType(&s->stack, tjv_GetValidationTypeString(s->root->type_ex),
+        &s->error_message, &s->error_details);
+
+}
+
+// Validates a complete value of the container frame, or the root value if
+// the frame is NULL
+static void tjv_StreamValidate(tjv_Stream *s, const tjv_JsonValue *json, tjv_StreamFrame *frame, tjv_ValidationElement *ve) {
+
+    // The cleaned values are needed only for the outcome of the root value,
+    // which is created from the whole text
+    if (frame == NULL) {
+        tjv_ValidateJsonRoot(json, &s->stack, ve, &s->error_message, &s->error_details, &s->outcome);
+        if (s->stack.cleaned != NULL) {
+            Tcl_BounceRefCount(s->stack.cleaned);
+            s->stack.cleaned = NULL;
+        }
+    } else {
+        tjv_ValidateJsonValue(json, frame->stack, ve, &s->error_message, &s->error_details, frame->child_outcome_ptr);
+        if (frame->stack->child_cleaned != NULL) {
+            Tcl_BounceRefCount(frame->stack->child_cleaned);
+            frame->stack->child_cleaned = NULL;
+        }
+    }
+
+}
+
+static void tjv_StreamPop(tjv_Stream *s, tjv_StreamFrame *frame) {
+
+    if (frame->found_bits != NULL) {
+        ckfree(frame->found_bits);
+    }
+    if (frame->item_outcome != NULL) {
+        Tcl_BounceRefCount(frame->item_outcome);
+    }
+    if (frame->result_outcome != NULL) {
+        Tcl_BounceRefCount(frame->result_outcome);
+    }
+    if (frame->stack_parent != NULL) {
+        frame->stack_parent->next = NULL;
+    }
+
+    s->frame = frame->parent;
+    tjv_WorkStackPop(s->ws, frame);
+
+}
+
+// Pushes the frame of the container that is just opened. The parent is NULL
+// for the root value.
+static void tjv_StreamPush(tjv_Stream *s, tjv_StreamFrame *parent, tjv_ValidationElement *ve, tjv_ValidationElementType type) {
+
+    tjv_StreamFrame *frame = tjv_WorkStackPush(s->ws, sizeof(tjv_StreamFrame));
+
+    frame->parent = s->frame;
+    frame->level = Tcl_DStringLength(&s->levels) - 1;
+    frame->ve = ve;
+    frame->type = type;
+    frame->count = 0;
+    frame->child_ve = NULL;
+    frame->child_outcome_ptr = NULL;
+    frame->found_bits = NULL;
+    frame->result_outcome = NULL;
+    frame->item_outcome = NULL;
+
+    if (parent == NULL) {
+        frame->stack = &s->stack;
+        frame->stack_parent = NULL;
+        frame->outcome_ptr = &s->outcome;
+    } else {
+        tjv_ValidationStack *stack = &frame->stack_own;
+        stack->head = parent->stack->head;
+        stack->next = NULL;
+        stack->key = (ve->flag == TJV_FLAG_SKIP_KEY ? INT2PTR(1) : ve->key);
+        stack->index = -1;
+        stack->cleaned = NULL;
+        stack->child_cleaned = NULL;
+        stack->depth = parent->stack->depth + 1;
+        parent->stack->next = stack;
+        frame->stack = stack;
+        frame->stack_parent = parent->stack;
+        frame->outcome_ptr = parent->child_outcome_ptr;
+    }
+
+    if (type == TJV_VALIDATION_OBJECT) {
+        if (ve->opts.obj_type.keys_objc > 0) {
+            size_t size = sizeof(uint64_t) * TJV_BITMAP_WORDS(ve->opts.obj_type.keys_objc);
+            frame->found_bits = ckalloc(size);
+            memset(frame->found_bits, 0, size);
+        }
+        frame->child_outcome_ptr = frame->outcome_ptr;
+    } else {
+        frame->child_ve = ve->opts.array_type.element;
+        if (frame->child_ve != NULL && frame->outcome_ptr != NULL && ve->outkey != NULL) {
+            frame->result_outcome = Tcl_NewListObj(0, NULL);
+            frame->item_outcome = Tcl_NewDictObj();
+            frame->child_outcome_ptr = &frame->item_outcome;
+        }
+    }
+
+    DBG2(printf("push frame at level %" TCL_SIZE_MODIFIER "d", frame->level));
+    s->frame = frame;
+
+}
+
+// Called before a value of any type, to count array elements
+static void tjv_StreamBeginValue(tjv_Stream *s) {
+
+    tjv_StreamFrame *frame = tjv_StreamParent(s);
+    if (frame == NULL || frame->type != TJV_VALIDATION_ARRAY) {
+        return;
+    }
+
+    tjv_ValidationElement *ve = frame->ve;
+
+    frame->count++;
+    if (ve->opts.array_type.is_max_items_defined && frame->count == ve->opts.array_type.max_items + 1) {
+        // The limit is reported for the array, not for the element
+        frame->stack->index = -1;
+        tjv_MessageGenerateLimit(frame->stack, "value has more items than the maximum %s",
+            ve->opts.array_type.max_items, &s->error_message, &s->error_details);
+    }
+
+    frame->stack->index = frame->count - 1;
+
+}
+
+// Called when a value is complete
+static void tjv_StreamEndValue(tjv_Stream *s) {
+
+    if (tjv_StreamIsRoot(s)) {
+        s->state = TJV_STREAM_END;
+        return;
+    }
+
+    s->state = TJV_STREAM_NEXT;
+
+    tjv_StreamFrame *frame = tjv_StreamParent(s);
+    if (frame == NULL || frame->item_outcome == NULL) {
+        return;
+    }
+
+    Tcl_Size dict_size;
+    Tcl_DictObjSize(NULL, frame->item_outcome, &dict_size);
+    if (dict_size > 0) {
+        Tcl_ListObjAppendElement(NULL, frame->result_outcome, frame->item_outcome);
+        frame->item_outcome = Tcl_NewDictObj();
+    }
+
+}
+
+static void tjv_StreamScalar(tjv_Stream *s, const tjv_JsonValue *json) {
+
+    if (tjv_StreamIsRoot(s)) {
+        tjv_StreamValidate(s, json, NULL, s->root);
+    } else {
+        tjv_StreamFrame *frame = tjv_StreamParent(s);
+        if (frame != NULL && frame->child_ve != NULL) {
+            tjv_StreamValidate(s, json, frame, frame->child_ve);
+        }
+    }
+
+    tjv_StreamEndValue(s);
+
+}
+
+static void tjv_StreamKey(tjv_Stream *s, const tjv_JsonValue *key) {
+
+    s->state = TJV_STREAM_COLON;
+
+    tjv_StreamFrame *frame = tjv_StreamParent(s);
+    if (frame == NULL) {
+        return;
+    }
+
+    tjv_ValidationElement *ve = frame->ve;
+
+    DBG2(printf("key: [%s]", key->str));
+
+    frame->count++;
+    if (ve->opts.obj_type.is_max_properties_defined && frame->count == ve->opts.obj_type.max_properties + 1) {
+        tjv_MessageGenerateLimit(frame->stack, "value has more properties than the maximum %s",
+            ve->opts.obj_type.max_properties, &s->error_message, &s->error_details);
+    }
+
+    // Only the first member with the key is validated, the same as when
+    // the members are looked up in a parsed document
+    frame->child_ve = NULL;
+    for (Tcl_Size i = 0; i < ve->opts.obj_type.keys_objc; i++) {
+        tjv_ValidationElement *element = ve->opts.obj_type.elements[i];
+        if (!tjv_StreamIsKeyMatched(key->str, Tcl_GetString(element->key))) {
+            continue;
+        }
+        uint64_t bit = (uint64_t)1 << (i % 64);
+        if (!(frame->found_bits[i / 64] & bit)) {
+            frame->found_bits[i / 64] |= bit;
+            frame->child_ve = element;
+        }
+        return;
+    }
+
+    if (ve->opts.obj_type.additional == TJV_ADDITIONAL_DENY) {
+        DBG2(printf("unknown key: [%s] (ERROR)", key->str));
+        tjv_MessageGenerateAdditional(frame->stack, key->str, &s->error_message, &s->error_details);
+    }
+
+}
+
+static void tjv_StreamOpen(tjv_Stream *s, char c) {
+
+    int is_root = tjv_StreamIsRoot(s);
+    tjv_StreamFrame *parent = NULL;
+    tjv_ValidationElement *ve;
+    tjv_ValidationElementType type;
+
+    if (is_root) {
+        ve = (s->is_root_validated ? s->root : NULL);
+        type = s->root_type;
+    } else {
+        parent = tjv_StreamParent(s);
+        ve = (parent == NULL ? NULL : parent->child_ve);
+        type = (ve == NULL ? TJV_VALIDATION_JSON : ve->type);
+    }
+
+    if (ve != NULL) {
+
+        if (type == TJV_VALIDATION_UNION || (type == TJV_VALIDATION_ARRAY && ve->opts.array_type.is_unique_items)) {
+            DBG2(printf("collect the value"));
+            s->capture_ve = ve;
+            s->is_capture_root = is_root;
+            s->capture_depth = 1;
+            s->is_capture_string = 0;
+            s->is_capture_escape = 0;
+            Tcl_DStringSetLength(&s->capture_text, 0);
+            Tcl_DStringAppend(&s->capture_text, &c, 1);
+            return;
+        }
+
+        if (type != (c == '{' ? TJV_VALIDATION_OBJECT : TJV_VALIDATION_ARRAY) ||
+            (parent != NULL && parent->stack->depth >= TJV_VALIDATION_MAX_DEPTH))
+        {
+            // The validator reports the wrong type or the depth of an empty
+            // container in the same way as for the complete one
+            DBG2(printf("skip the value"));
+            tjv_JsonValue empty;
+            memset(&empty, 0, sizeof(tjv_JsonValue));
+            empty.type = (c == '{' ? TJV_JSON_OBJECT : TJV_JSON_ARRAY);
+            tjv_StreamValidate(s, &empty, parent, ve);
+            ve = NULL;
+        }
+
+    }
+
+    Tcl_DStringAppend(&s->levels, &c, 1);
+    s->state = (c == '{' ? TJV_STREAM_KEY_OR_CLOSE : TJV_STREAM_VALUE_OR_CLOSE);
+
+    if (ve != NULL) {
+        tjv_StreamPush(s, parent, ve, type);
+    }
+
+}
+
+static void tjv_StreamClose(tjv_Stream *s) {
+
+    Tcl_Size level = Tcl_DStringLength(&s->levels) - 1;
+    tjv_StreamFrame *frame = s->frame;
+
+    if (frame != NULL && frame->level == level) {
+
+        tjv_ValidationElement *ve = frame->ve;
+        tjv_ValidationStack *stack = frame->stack;
+        Tcl_Obj **outcome_ptr = frame->outcome_ptr;
+        Tcl_Obj **error_message_ptr = &s->error_message;
+        Tcl_Obj **error_details_ptr = &s->error_details;
+
+        if (frame->type == TJV_VALIDATION_OBJECT) {
+            if (frame->count < ve->opts.obj_type.min_properties) {
+                tjv_MessageGenerateLimit(stack, "value has fewer properties than the minimum %s",
+                    ve->opts.obj_type.min_properties, error_message_ptr, error_details_ptr);
+            }
+            for (Tcl_Size i = 0; i < ve->opts.obj_type.keys_objc; i++) {
+                tjv_ValidationElement *element = ve->opts.obj_type.elements[i];
+                if (element->is_required && !(frame->found_bits[i / 64] & ((uint64_t)1 << (i % 64)))) {
+                    DBG2(printf("check key: [%s] - doesn't exist (ERROR)", Tcl_GetString(element->key)));
+                    tjv_MessageGenerateRequired(stack, element->key, error_message_ptr, error_details_ptr);
+                }
+            }
+        } else {
+            stack->index = -1;
+            if (frame->count < ve->opts.array_type.min_items) {
+                tjv_MessageGenerateLimit(stack, "value has fewer items than the minimum %s",
+                    ve->opts.array_type.min_items, error_message_ptr, error_details_ptr);
+            }
+            if (frame->item_outcome != NULL) {
+                Tcl_BounceRefCount(frame->item_outcome);
+                frame->item_outcome = NULL;
+                ADD_OUTCOME(frame->result_outcome);
+                frame->result_outcome = NULL;
+            }
+        }
+
+        tjv_StreamPop(s, frame);
+
+    }
+
+    Tcl_DStringSetLength(&s->levels, level);
+    tjv_StreamEndValue(s);
+
+}
+
+static void tjv_StreamStringEnd(tjv_Stream *s) {
+
+    s->token = TJV_STREAM_TOKEN_NONE;
+
+    Tcl_Size length = Tcl_DStringLength(&s->token_text);
+    Tcl_DStringSetLength(&s->unescaped, length + 1);
+
+    tjv_JsonValue value;
+    const char *error;
+    if (tjv_JsonParseScalar(&value, Tcl_DStringValue(&s->token_text), length,
+        Tcl_DStringValue(&s->unescaped), &error) != TCL_OK)
+    {
+        tjv_StreamSyntaxError(s, error);
+        return;
+    }
+
+    if (s->state == TJV_STREAM_KEY || s->state == TJV_STREAM_KEY_OR_CLOSE) {
+        tjv_StreamKey(s, &value);
+    } else {
+        tjv_StreamScalar(s, &value);
+    }
+
+}
+
+static void tjv_StreamScalarEnd(tjv_Stream *s) {
+
+    s->token = TJV_STREAM_TOKEN_NONE;
+
+    tjv_JsonValue value;
+    const char *error;
+    if (tjv_JsonParseScalar(&value, Tcl_DStringValue(&s->token_text), Tcl_DStringLength(&s->token_text),
+        NULL, &error) != TCL_OK)
+    {
+        tjv_StreamSyntaxError(s, error);
+        return;
+    }
+
+    tjv_StreamScalar(s, &value);
+
+}
+
+static void tjv_StreamCaptureEnd(tjv_Stream *s) {
+
+    DBG2(printf("the value is collected"));
+
+    tjv_JsonDocument doc;
+    if (tjv_JsonParse(&doc, Tcl_DStringValue(&s->capture_text), Tcl_DStringLength(&s->capture_text),
+        TJV_JSON_SCAN_MODIFIED_UTF8) != TCL_OK)
+    {
+        tjv_StreamSyntaxError(s, doc.error);
+    } else {
+        tjv_StreamValidate(s, doc.root, (s->is_capture_root ? NULL : tjv_StreamParent(s)), s->capture_ve);
+        tjv_StreamEndValue(s);
+    }
+
+    tjv_JsonFree(&doc);
+    // The text can be large, don't keep it until the next value
+    Tcl_DStringFree(&s->capture_text);
+
+}
+
+// Each of the following functions consumes the characters of the current
+// token and returns the position after them
+
+static const char *tjv_StreamFeedString(tjv_Stream *s, const char *p, const char *end) {
+
+    const char *start = p;
+
+    for (; p < end; p++) {
+        unsigned char c = (unsigned char)*p;
+        if (s->is_escape) {
+            s->is_escape = 0;
+        } else if (c == '\\') {
+            s->is_escape = 1;
+        } else if (c == '"') {
+            p++;
+            Tcl_DStringAppend(&s->token_text, start, p - start);
+            tjv_StreamStringEnd(s);
+            return p;
+        } else if (c < 0x20) {
+            tjv_StreamSyntaxError(s, "unescaped control character in string");
+            return end;
+        }
+    }
+
+    Tcl_DStringAppend(&s->token_text, start, p - start);
+    return p;
+
+}
+
+static const char *tjv_StreamFeedScalar(tjv_Stream *s, const char *p, const char *end) {
+
+    const char *start = p;
+
+    while (p < end && !tjv_StreamIsDelimiter(*p)) {
+        p++;
+    }
+
+    Tcl_DStringAppend(&s->token_text, start, p - start);
+
+    if (p < end) {
+        tjv_StreamScalarEnd(s);
+    }
+
+    return p;
+
+}
+
+static const char *tjv_StreamFeedCapture(tjv_Stream *s, const char *p, const char *end) {
+
+    const char *start = p;
+
+    while (p < end) {
+        char c = *p++;
+        if (s->is_capture_string) {
+            if (s->is_capture_escape) {
+                s->is_capture_escape = 0;
+            } else if (c == '\\') {
+                s->is_capture_escape = 1;
+            } else if (c == '"') {
+                s->is_capture_string = 0;
+            }
+            continue;
+        }
+        switch (c) {
+        case '"':
+            s->is_capture_string = 1;
+            break;
+        case '{':
+        case '[':
+            s->capture_depth++;
+            break;
+        case '}':
+        case ']':
+            if (--s->capture_depth == 0) {
+                Tcl_DStringAppend(&s->capture_text, start, p - start);
+                tjv_StreamCaptureEnd(s);
+                return p;
+            }
+            break;
+        }
+    }
+
+    Tcl_DStringAppend(&s->capture_text, start, p - start);
+    return p;
+
+}
+
+static void tjv_StreamFeed(tjv_Stream *s, const char *p, Tcl_Size length) {
+
+    const char *end = p + length;
+
+    while (p < end && !s->is_failed) {
+
+        if (s->capture_depth > 0) {
+            p = tjv_StreamFeedCapture(s, p, end);
+            continue;
+        }
+
+        if (s->token == TJV_STREAM_TOKEN_STRING) {
+            p = tjv_StreamFeedString(s, p, end);
+            continue;
+        }
+
+        if (s->token == TJV_STREAM_TOKEN_SCALAR) {
+            p = tjv_StreamFeedScalar(s, p, end);
+            continue;
+        }
+
+        char c = *p;
+        int is_value_expected = (s->state == TJV_STREAM_VALUE || s->state == TJV_STREAM_VALUE_OR_CLOSE);
+        Tcl_Size level = Tcl_DStringLength(&s->levels);
+        char container = (level == 0 ? '\0' : Tcl_DStringValue(&s->levels)[level - 1]);
+
+        switch (c) {
+        case ' ':
+        case '\t':
+        case '\n':
+        case '\r':
+            break;
+        case '"':
+            if (is_value_expected) {
+                tjv_StreamBeginValue(s);
+            } else if (s->state != TJV_STREAM_KEY && s->state != TJV_STREAM_KEY_OR_CLOSE) {
+                tjv_StreamSyntaxError(s, "unexpected string");
+                return;
+            }
+            s->token = TJV_STREAM_TOKEN_STRING;
+            s->is_escape = 0;
+            Tcl_DStringSetLength(&s->token_text, 0);
+            Tcl_DStringAppend(&s->token_text, "\"", 1);
+            break;
+        case '{':
+        case '[':
+            if (!is_value_expected) {
+                tjv_StreamSyntaxError(s, "unexpected container");
+                return;
+            }
+            tjv_StreamBeginValue(s);
+            tjv_StreamOpen(s, c);
+            break;
+        case '}':
+        case ']':
+            if (container != (c == '}' ? '{' : '[') || !(s->state == TJV_STREAM_NEXT ||
+                s->state == (c == '}' ? TJV_STREAM_KEY_OR_CLOSE : TJV_STREAM_VALUE_OR_CLOSE)))
+            {
+                tjv_StreamSyntaxError(s, "unexpected end of container");
+                return;
+            }
+            tjv_StreamClose(s);
+            break;
+        case ',':
+            if (s->state != TJV_STREAM_NEXT) {
+                tjv_StreamSyntaxError(s, "unexpected comma");
+                return;
+            }
+            s->state = (container == '{' ? TJV_STREAM_KEY : TJV_STREAM_VALUE);
+            break;
+        case ':':
+            if (s->state != TJV_STREAM_COLON) {
+                tjv_StreamSyntaxError(s, "unexpected colon");
+                return;
+            }
+            s->state = TJV_STREAM_VALUE;
+            break;
+        default:
+            if (!is_value_expected) {
+                tjv_StreamSyntaxError(s, "unexpected value");
+                return;
+            }
+            tjv_StreamBeginValue(s);
+            s->token = TJV_STREAM_TOKEN_SCALAR;
+            Tcl_DStringSetLength(&s->token_text, 0);
+            // The character is consumed as a part of the token
+            continue;
+        }
+
+        p++;
+
+    }
+
+}
+
+// Completes the validation after the last chunk
+static void tjv_StreamFinish(tjv_Stream *s) {
+
+    if (s->is_failed) {
+        return;
+    }
+
+    if (s->token == TJV_STREAM_TOKEN_SCALAR) {
+        tjv_StreamScalarEnd(s);
+        if (s->is_failed) {
+            return;
+        }
+    }
+
+    if (s->state != TJV_STREAM_END || s->token != TJV_STREAM_TOKEN_NONE || s->capture_depth > 0) {
+        tjv_StreamSyntaxError(s, "unexpected end of text");
+        return;
+    }
+
+    // The outcome of the root value is the cleaned text, which is created
+    // by validation of the whole document
+    if (s->text != NULL && s->error_message == NULL) {
+        DBG2(printf("validate the whole text for the outcome"));
+        Tcl_DecrRefCount(s->outcome);
+        s->outcome = Tcl_NewDictObj();
+        Tcl_IncrRefCount(s->outcome);
+        tjv_ValidateTcl(s->text, NULL, s->root, &s->error_message, &s->error_details, &s->outcome);
+    }
+
+}
+
+static int tjv_StreamCmd(ClientData clientData, Tcl_Interp *interp, int objc, Tcl_Obj *const objv[]) {
+
+    DBG2(printf("enter: objc: %d", objc));
+
+    static const char *const commands[] = {
+        "destroy", "feed", "finish",
+        NULL
+    };
+
+    enum commands {
+        cmdDestroy, cmdFeed, cmdFinish
+    };
+
+    if (objc < 2) {
+wrongArgsNum:
+        Tcl_WrongNumArgs(interp, 1, objv, "feed chunk");
+        Tcl_AppendPrintfToObj(Tcl_GetObjResult(interp), " or \"%s finish ?outcome_variable?\""
+            " or \"%s destroy\"", Tcl_GetString(objv[0]), Tcl_GetString(objv[0]));
+        DBG2(printf("return: TCL_ERROR (wrong # args)"));
+        return TCL_ERROR;
+    }
+
+    int command;
+    if (Tcl_GetIndexFromObj(interp, objv[1], commands, "subcommand", 0, &command) != TCL_OK) {
+        DBG2(printf("return: error (wrong subcommand: [%s])", Tcl_GetString(objv[1])));
+        return TCL_ERROR;
+    }
+
+    tjv_Stream *s = (tjv_Stream *)clientData;
+
+    switch ((enum commands) command) {
+
+    case cmdDestroy:
+        if (objc != 2) {
+            goto wrongArgsNum;
+        }
+        DBG2(printf("destroy subcommand"));
+        Tcl_SetObjResult(interp, s->cmd_name);
+        Tcl_DeleteCommandFromToken(s->interp, s->cmd_token);
+        break;
+
+    case cmdFeed:
+        if (objc != 3) {
+            goto wrongArgsNum;
+        }
+        Tcl_Size length;
+        const char *chunk = Tcl_GetStringFromObj(objv[2], &length);
+        DBG2(printf("feed subcommand: %" TCL_SIZE_MODIFIER "d bytes", length));
+        if (!s->is_failed) {
+            if (s->text != NULL) {
+                Tcl_AppendToObj(s->text, chunk, length);
+            }
+            tjv_StreamFeed(s, chunk, length);
+        }
+        Tcl_SetObjResult(interp, Tcl_NewBooleanObj(s->error_message == NULL));
+        break;
+
+    case cmdFinish:
+        if (objc > 3) {
+            goto wrongArgsNum;
+        }
+        DBG2(printf("finish subcommand"));
+        tjv_StreamFinish(s);
+        int rc = TCL_OK;
+        Tcl_Obj *outcome_var_name = (objc == 3 ? objv[2] : NULL);
+        if (s->error_message == NULL) {
+            if (outcome_var_name == NULL) {
+                Tcl_SetObjResult(interp, s->outcome);
+            } else if (Tcl_ObjSetVar2(interp, outcome_var_name, NULL, s->outcome, TCL_LEAVE_ERR_MSG) == NULL) {
+                rc = TCL_ERROR;
+            } else {
+                Tcl_SetObjResult(interp, Tcl_NewBooleanObj(1));
+            }
+        } else {
+            // The messages are released by the functions that combine them
+            Tcl_Obj *error_message = s->error_message;
+            Tcl_Obj *error_details = s->error_details;
+            s->error_message = NULL;
+            s->error_details = NULL;
+            if (outcome_var_name == NULL) {
+                Tcl_BounceRefCount(error_details);
+                Tcl_SetObjResult(interp, tjv_MessageCombine(error_message));
+                rc = TCL_ERROR;
+            } else if (Tcl_ObjSetVar2(interp, outcome_var_name, NULL,
+                tjv_MessageCombineDetails(error_message, error_details), TCL_LEAVE_ERR_MSG) == NULL)
+            {
+                rc = TCL_ERROR;
+            } else {
+                Tcl_SetObjResult(interp, Tcl_NewBooleanObj(0));
+            }
+        }
+        // The session is over, whether the text is valid or not
+        Tcl_DeleteCommandFromToken(s->interp, s->cmd_token);
+        DBG2(printf("return: %s", (rc == TCL_OK ? "ok" : "TCL_ERROR")));
+        return rc;
+
+    }
+
+    DBG2(printf("return: ok"));
+    return TCL_OK;
+
+}
+
+static void tjv_StreamDeleteProc(ClientData clientData) {
+
+    tjv_Stream *s = (tjv_Stream *)clientData;
+
+    DBG2(printf("delete command: %s", Tcl_GetString(s->cmd_name)));
+
+    while (s->frame != NULL) {
+        tjv_StreamPop(s, s->frame);
+    }
+
+    if (s->error_message != NULL) {
+        Tcl_BounceRefCount(s->error_message);
+        Tcl_BounceRefCount(s->error_details);
+    }
+    Tcl_DecrRefCount(s->outcome);
+    if (s->text != NULL) {
+        Tcl_DecrRefCount(s->text);
+    }
+
+    Tcl_DStringFree(&s->levels);
+    Tcl_DStringFree(&s->token_text);
+    Tcl_DStringFree(&s->unescaped);
+    Tcl_DStringFree(&s->capture_text);
+
+    tjv_WorkStackFree(s->ws);
+    Tcl_DecrRefCount(s->cmd_name);
+    Tcl_Release(s->owner);
+    ckfree(s);
+
+    DBG2(printf("return: ok"));
+
+}
+
+int tjv_StreamCreate(Tcl_Interp *interp, ClientData owner, tjv_ValidationElement *root) {
+
+    DBG2(printf("enter"));
+
+    if (root->type != TJV_VALIDATION_JSON) {
+        SetResult("streaming validation requires a schema of the json type");
+        DBG2(printf("return: TCL_ERROR (not json)"));
+        return TCL_ERROR;
+    }
+
+    tjv_Stream *s = ckalloc(sizeof(tjv_Stream));
+
+    s->interp = interp;
+    s->owner = owner;
+    Tcl_Preserve(owner);
+    s->root = root;
+
+    switch (root->flag) {
+    case TJV_FLAG_JSON_TYPE_OBJECT:
+        s->is_root_validated = 1;
+        s->root_type = TJV_VALIDATION_OBJECT;
+        break;
+    case TJV_FLAG_JSON_TYPE_ARRAY:
+        s->is_root_validated = 1;
+        s->root_type = TJV_VALIDATION_ARRAY;
+        break;
+    case TJV_FLAG_JSON_TYPE_UNION:
+        s->is_root_validated = 1;
+        s->root_type = TJV_VALIDATION_UNION;
+        break;
+    case TJV_FLAG_NONE:
+    case TJV_FLAG_SKIP_KEY:
+        s->is_root_validated = 0;
+        s->root_type = TJV_VALIDATION_JSON;
+        break;
+    }
+
+    // The same stack frame as tjv_ValidateTcl() creates for the root value
+    s->stack.head = &s->stack;
+    s->stack.next = NULL;
+    s->stack.key = root->key;
+    s->stack.index = -1;
+    s->stack.cleaned = NULL;
+    s->stack.child_cleaned = NULL;
+    s->stack.depth = 0;
+
+    s->state = TJV_STREAM_VALUE;
+    Tcl_DStringInit(&s->levels);
+    s->ws = tjv_WorkStackNew();
+    s->frame = NULL;
+    s->token = TJV_STREAM_TOKEN_NONE;
+    s->is_escape = 0;
+    Tcl_DStringInit(&s->token_text);
+    Tcl_DStringInit(&s->unescaped);
+    s->capture_ve = NULL;
+    s->is_capture_root = 0;
+    s->capture_depth = 0;
+    s->is_capture_string = 0;
+    s->is_capture_escape = 0;
+    Tcl_DStringInit(&s->capture_text);
+
+    if (root->outkey != NULL) {
+        s->text = Tcl_NewObj();
+        Tcl_IncrRefCount(s->text);
+    } else {
+        s->text = NULL;
+    }
+
+    s->is_failed = 0;
+    s->error_message = NULL;
+    s->error_details = NULL;
+    s->outcome = Tcl_NewDictObj();
+    Tcl_IncrRefCount(s->outcome);
+
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%p", (void *)s);
+    s->cmd_name = Tcl_ObjPrintf("::tjv::stream%s", buf);
+    Tcl_IncrRefCount(s->cmd_name);
+
+    s->cmd_token = Tcl_CreateObjCommand(interp, Tcl_GetString(s->cmd_name), tjv_StreamCmd,
+        (ClientData)s, tjv_StreamDeleteProc);
+
+    DBG2(printf("return: ok (created command: %s)", Tcl_GetString(s->cmd_name)));
+
+    Tcl_SetObjResult(interp, s->cmd_name);
+    return TCL_OK;
+
+}
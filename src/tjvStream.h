@@ -0,0 +1,26 @@
+/**
+ * Copyright Jerily LTD. All Rights Reserved.
+ * SPDX-FileCopyrightText: 2024 Neofytos Dimitriou (neo@jerily.cy)
+ * SPDX-License-Identifier: MIT.
+ */
+#ifndef TJV_STREAM_H
+#define TJV_STREAM_H
+
+#include "common.h"
+#include "tjvCompile.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Creates the command of a validation session that receives JSON text in
+// chunks, and sets the interpreter result to its name. The schema should be
+// of the json type. The owner of the schema is preserved with Tcl_Preserve()
+// while the command exists.
+int tjv_StreamCreate(Tcl_Interp *interp, ClientData owner, tjv_ValidationElement *root);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TJV_STREAM_H
@@ -0,0 +1,214 @@
+/**
+ * Copyright Jerily LTD. All Rights Reserved.
+ * SPDX-FileCopyrightText: 2024 Neofytos Dimitriou (neo@jerily.cy)
+ * SPDX-License-Identifier: MIT.
+ */
+
+#include "tjvStringSet.h"
+
+// Size of the on-stack buffer for folding of the lookup strings. Longer
+// strings are folded in a heap buffer.
+#define TJV_STRING_SET_FOLD_BUFFER 256
+
+static const unsigned char tjv_StringSetAsciiFold[256] = {
+      0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,  15,
+     16,  17,  18,  19,  20,  21,  22,  23,  24,  25,  26,  27,  28,  29,  30,  31,
+     32,  33,  34,  35,  36,  37,  38,  39,  40,  41,  42,  43,  44,  45,  46,  47,
+     48,  49,  50,  51,  52,  53,  54,  55,  56,  57,  58,  59,  60,  61,  62,  63,
+     64, 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o',
+    'p', 'q', 'r', 's', 't', 'u', 'v', 'w', 'x', 'y', 'z',  91,  92,  93,  94,  95,
+     96,  97,  98,  99, 100, 101, 102, 103, 104, 105, 106, 107, 108, 109, 110, 111,
+    112, 113, 114, 115, 116, 117, 118, 119, 120, 121, 122, 123, 124, 125, 126, 127,
+    128, 129, 130, 131, 132, 133, 134, 135, 136, 137, 138, 139, 140, 141, 142, 143,
+    144, 145, 146, 147, 148, 149, 150, 151, 152, 153, 154, 155, 156, 157, 158, 159,
+    160, 161, 162, 163, 164, 165, 166, 167, 168, 169, 170, 171, 172, 173, 174, 175,
+    176, 177, 178, 179, 180, 181, 182, 183, 184, 185, 186, 187, 188, 189, 190, 191,
+    192, 193, 194, 195, 196, 197, 198, 199, 200, 201, 202, 203, 204, 205, 206, 207,
+    208, 209, 210, 211, 212, 213, 214, 215, 216, 217, 218, 219, 220, 221, 222, 223,
+    224, 225, 226, 227, 228, 229, 230, 231, 232, 233, 234, 235, 236, 237, 238, 239,
+    240, 241, 242, 243, 244, 245, 246, 247, 248, 249, 250, 251, 252, 253, 254, 255
+};
+
+static inline uint64_t tjv_StringSetHash(const char *str, Tcl_Size length) {
+
+    const uint64_t k = 0x9E3779B97F4A7C15ULL;
+    uint64_t h = (uint64_t)length * k;
+    uint64_t chunk;
+
+    for (; length >= 8; str += 8, length -= 8) {
+        memcpy(&chunk, str, 8);
+        h = (h ^ chunk) * k;
+        h ^= h >> 29;
+    }
+
+    if (length > 0) {
+        chunk = 0;
+        memcpy(&chunk, str, (size_t)length);
+        h = (h ^ chunk) * k;
+    }
+
+    // Final avalanche from MurmurHash3
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB93FE53F4D63ULL;
+    h ^= h >> 33;
+
+    return h;
+
+}
+
+// Folds the string to lower case. The destination buffer must have room for
+// length + 1 bytes, the folded string is never longer than the source string.
+// Returns the length of the folded string.
+static Tcl_Size tjv_StringSetFold(const char *src, Tcl_Size length, char *dst, int flags) {
+
+    Tcl_Size i;
+    for (i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)src[i];
+        if (c >= 0x80 && !(flags & TJV_STRING_SET_NOCASE_ASCII)) {
+            break;
+        }
+        dst[i] = (char)tjv_StringSetAsciiFold[c];
+    }
+
+    if (i == length) {
+        dst[i] = '\0';
+        return i;
+    }
+
+    // Slow path for non-ASCII characters. A character is lowered only if
+    // its lower case form has the same encoded length, the same as
+    // Tcl_UtfToLower() does.
+    Tcl_Size dst_length = i;
+    while (i < length) {
+        Tcl_UniChar ch = 0;
+        int src_bytes = Tcl_UtfToUniChar(src + i, &ch);
+        Tcl_UniChar lower_ch = Tcl_UniCharToLower(ch);
+        char buf[TCL_UTF_MAX];
+        if (lower_ch != ch && Tcl_UniCharToUtf(lower_ch, buf) <= src_bytes) {
+            dst_length += Tcl_UniCharToUtf(lower_ch, dst + dst_length);
+        } else {
+            memcpy(dst + dst_length, src + i, (size_t)src_bytes);
+            dst_length += src_bytes;
+        }
+        i += src_bytes;
+    }
+
+    dst[dst_length] = '\0';
+    return dst_length;
+
+}
+
+static const tjv_StringSetEntry *tjv_StringSetLookup(const tjv_StringSet *set, const char *str, Tcl_Size length) {
+
+    uint64_t hash = tjv_StringSetHash(str, length);
+
+    for (uint64_t i = hash & set->mask;; i = (i + 1) & set->mask) {
+        const tjv_StringSetEntry *entry = &set->entries[i];
+        if (entry->str == NULL) {
+            return NULL;
+        }
+        if (entry->hash == hash && entry->length == length && memcmp(entry->str, str, (size_t)length) == 0) {
+            return entry;
+        }
+    }
+
+}
+
+Tcl_Size tjv_StringSetFind(const tjv_StringSet *set, const char *str, Tcl_Size length) {
+
+    const tjv_StringSetEntry *entry;
+
+    if (!(set->flags & (TJV_STRING_SET_NOCASE | TJV_STRING_SET_NOCASE_ASCII))) {
+        entry = tjv_StringSetLookup(set, str, length);
+        return (entry == NULL ? -1 : entry->index);
+    }
+
+    char static_buffer[TJV_STRING_SET_FOLD_BUFFER];
+    char *buffer = (length < TJV_STRING_SET_FOLD_BUFFER ? static_buffer : ckalloc(length + 1));
+
+    Tcl_Size folded_length = tjv_StringSetFold(str, length, buffer, set->flags);
+    entry = tjv_StringSetLookup(set, buffer, folded_length);
+
+    if (buffer != static_buffer) {
+        ckfree(buffer);
+    }
+
+    return (entry == NULL ? -1 : entry->index);
+
+}
+
+int tjv_StringSetContains(const tjv_StringSet *set, const char *str, Tcl_Size length) {
+    return tjv_StringSetFind(set, str, length) != -1;
+}
+
+tjv_StringSet *tjv_StringSetCreate(Tcl_Size objc, Tcl_Obj *const objv[], int flags) {
+
+    DBG2(printf("enter: objc: %" TCL_SIZE_MODIFIER "d flags: %d", objc, flags));
+
+    // The table size is a power of 2 that is at least twice the number
+    // of strings.
+    uint64_t size = 2;
+    while (size < (uint64_t)objc * 2) {
+        size <<= 1;
+    }
+
+    Tcl_Size strings_size = 0;
+    for (Tcl_Size i = 0; i < objc; i++) {
+        Tcl_Size length;
+        Tcl_GetStringFromObj(objv[i], &length);
+        strings_size += length + 1;
+    }
+
+    tjv_StringSet *set = ckalloc(sizeof(tjv_StringSet));
+    set->entries = ckalloc(sizeof(tjv_StringSetEntry) * size);
+    memset(set->entries, 0, sizeof(tjv_StringSetEntry) * size);
+    set->mask = size - 1;
+    set->count = 0;
+    set->flags = flags;
+    set->strings = ckalloc(strings_size > 0 ? strings_size : 1);
+
+    char *str = set->strings;
+    for (Tcl_Size i = 0; i < objc; i++) {
+
+        Tcl_Size length;
+        const char *src = Tcl_GetStringFromObj(objv[i], &length);
+
+        if (flags & (TJV_STRING_SET_NOCASE | TJV_STRING_SET_NOCASE_ASCII)) {
+            length = tjv_StringSetFold(src, length, str, flags);
+        } else {
+            memcpy(str, src, (size_t)length + 1);
+        }
+
+        if (tjv_StringSetLookup(set, str, length) != NULL) {
+            DBG2(printf("skip duplicate: [%s]", str));
+            continue;
+        }
+
+        uint64_t hash = tjv_StringSetHash(str, length);
+        uint64_t pos = hash & set->mask;
+        while (set->entries[pos].str != NULL) {
+            pos = (pos + 1) & set->mask;
+        }
+
+        set->entries[pos].str = str;
+        set->entries[pos].length = length;
+        set->entries[pos].hash = hash;
+        set->entries[pos].index = i;
+        set->count++;
+
+        str += length + 1;
+
+    }
+
+    DBG2(printf("return: ok (%" TCL_SIZE_MODIFIER "d unique strings, table size: %llu)", set->count, (unsigned long long)size));
+    return set;
+
+}
+
+void tjv_StringSetFree(tjv_StringSet *set) {
+    ckfree(set->strings);
+    ckfree(set->entries);
+    ckfree(set);
+}
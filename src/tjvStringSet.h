@@ -0,0 +1,55 @@
+/**
+ * Copyright Jerily LTD. All Rights Reserved.
+ * SPDX-FileCopyrightText: 2024 Neofytos Dimitriou (neo@jerily.cy)
+ * SPDX-License-Identifier: MIT.
+ */
+#ifndef TJV_STRINGSET_H
+#define TJV_STRINGSET_H
+
+#include "common.h"
+
+// Compare strings case-insensitively. Strings are folded to lower case
+// by the same rules as [string tolower].
+#define TJV_STRING_SET_NOCASE 1
+// Compare strings case-insensitively, only ASCII letters are folded
+#define TJV_STRING_SET_NOCASE_ASCII 2
+
+typedef struct {
+    const char *str;
+    Tcl_Size length;
+    uint64_t hash;
+    // Index of the string in the list the set was created from
+    Tcl_Size index;
+} tjv_StringSetEntry;
+
+// An immutable set of strings built once from a list of allowed values.
+// It is an open-addressing hash table with at most 50% load. Entries store
+// the hash and the length of the string, so that for most lookups the bytes
+// are compared at most once.
+typedef struct {
+    tjv_StringSetEntry *entries;
+    uint64_t mask;
+    Tcl_Size count;
+    int flags;
+    // Storage for (folded) copies of the strings
+    char *strings;
+} tjv_StringSet;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+tjv_StringSet *tjv_StringSetCreate(Tcl_Size objc, Tcl_Obj *const objv[], int flags);
+void tjv_StringSetFree(tjv_StringSet *set);
+
+int tjv_StringSetContains(const tjv_StringSet *set, const char *str, Tcl_Size length);
+// Returns the index of the string in the list the set was created from,
+// or -1 if the string is not in the set. For duplicates, the index of
+// the first one is returned.
+Tcl_Size tjv_StringSetFind(const tjv_StringSet *set, const char *str, Tcl_Size length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TJV_STRINGSET_H
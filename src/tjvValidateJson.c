@@ -5,46 +5,388 @@
  */
 
 #include "tjvValidateJson.h"
+#include "tjvValidateTcl.h"
 #include "tjvMessage.h"
-#include <cjson/cJSON.h>
+#include "tjvJsonNumber.h"
+#include "tjvWorkStack.h"
+#include "tjvReplica.h"
+#include "tjvPool.h"
+
+// The minimum number of elements of the root array of a compiled schema
+// that are validated in parallel by worker threads
+#define TJV_JSON_PARALLEL_MIN_ITEMS 1024
+// The number of elements that a thread validates at once
+#define TJV_JSON_PARALLEL_BLOCK_SIZE 256
+// The maximum number of stack frames from the head to the root array. There
+// are only one or two of them for the root value.
+#define TJV_JSON_PARALLEL_MAX_FRAMES 8
+
+// The cleaned value of an object member
+typedef struct {
+    const tjv_JsonValue *member;
+    Tcl_Obj *cleaned;
+} tjv_JsonCleanedMember;
+
+typedef enum {
+    TJV_UNION_TAGGED,
+    TJV_UNION_SINGLE,
+    TJV_UNION_TRIAL
+} tjv_UnionMode;
+
+typedef struct tjv_JsonFrame tjv_JsonFrame;
+
+// A frame of the work stack, the same as tjv_TclFrame
+struct tjv_JsonFrame {
+
+    tjv_WorkFrame base;
+
+    const tjv_JsonValue *json;
+    tjv_ValidationElement *ve;
+    // The type to validate. For the root value of the json type, it is
+    // defined by the options of the element.
+    tjv_ValidationElementType type;
+
+    Tcl_Obj **error_message_ptr;
+    Tcl_Obj **error_details_ptr;
+    Tcl_Obj **outcome_ptr;
+
+    // The stack frame for error paths. It is stack_own, or the frame of
+    // the union for its variants, or the frame of the json element for
+    // the root value.
+    tjv_ValidationStack *stack;
+    tjv_ValidationStack *stack_parent;
+    tjv_ValidationStack stack_own;
+
+    int is_variant;
+
+    union {
+        struct {
+            // The number of object members that are found in the schema
+            Tcl_Size found;
+            // Members with cleaned values
+            tjv_JsonCleanedMember *cleaned_members;
+            Tcl_Size cleaned_count;
+            Tcl_Size i;
+            // The validated member. It is NULL if the default value of
+            // a missing member is validated for the JSON output.
+            const tjv_JsonValue *val;
+        } obj;
+        struct {
+            Tcl_Obj *result_outcome;
+            Tcl_Obj *item_outcome;
+            // JSON text of the array with cleaned elements. It is started when
+            // the first cleaned element is found, and then all elements are added.
+            Tcl_Obj *cleaned;
+            // The validated element
+            const tjv_JsonValue *val;
+        } arr;
+        struct {
+            tjv_UnionMode mode;
+            Tcl_Size i;
+            Tcl_Size matched;
+            Tcl_Obj *matched_outcome;
+            Tcl_Obj *matched_cleaned;
+            Tcl_Obj *variant_message;
+            Tcl_Obj *variant_details;
+            Tcl_Obj *variant_outcome;
+            // The length of the JSON output before the variant, the same
+            // as in tjv_TclFrame
+            Tcl_Size output_length;
+        } uni;
+    } u;
+
+};
+
+static tjv_WorkFrame *tjv_ValidateJsonStep(tjv_WorkFrame *base);
+
+static tjv_WorkFrame *tjv_ValidateJsonPush(tjv_WorkStack *ws, tjv_WorkFrame *parent, tjv_ValidationStack *stack_parent, const tjv_JsonValue *json, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr) {
+
+    tjv_JsonFrame *frame = tjv_WorkStackPush(ws, sizeof(tjv_JsonFrame));
+
+    frame->base.step = tjv_ValidateJsonStep;
+    frame->base.ws = ws;
+    frame->base.parent = parent;
+    frame->base.is_resumed = 0;
+    frame->json = json;
+    frame->ve = ve;
+    frame->type = ve->type;
+    frame->error_message_ptr = error_message_ptr;
+    frame->error_details_ptr = error_details_ptr;
+    frame->outcome_ptr = outcome_ptr;
+    frame->is_variant = 0;
+
+    // JSON values always have a parent, at least the frame of the json element
+    tjv_ValidationStack *stack = &frame->stack_own;
+    stack->head = stack_parent->head;
+    stack->next = NULL;
+    stack->key = (ve->flag == TJV_FLAG_SKIP_KEY ? INT2PTR(1) : ve->key);
+    stack->index = -1;
+    stack->cleaned = NULL;
+    stack->child_cleaned = NULL;
+    stack->depth = stack_parent->depth + 1;
+    stack_parent->next = stack;
+
+    frame->stack = stack;
+    frame->stack_parent = stack_parent;
+
+    return &frame->base;
 
-// Forward declaration
-static void tjv_ValidateJson(const cJSON *json, tjv_ValidationStack *stack, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr);
+}
+
+// Pushes a frame that uses the stack frame of the union for its variants, or
+// the frame of the json element for the root value. Variants are the same as
+// in tjv_ValidateTclPushVariant().
+static tjv_WorkFrame *tjv_ValidateJsonPushShared(tjv_WorkStack *ws, tjv_WorkFrame *parent, int is_variant, tjv_ValidationStack *stack, const tjv_JsonValue *json, tjv_ValidationElement *ve, tjv_ValidationElementType type, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr) {
+
+    tjv_JsonFrame *frame = tjv_WorkStackPush(ws, sizeof(tjv_JsonFrame));
+
+    frame->base.step = tjv_ValidateJsonStep;
+    frame->base.ws = ws;
+    frame->base.parent = parent;
+    frame->base.is_resumed = 0;
+    frame->json = json;
+    frame->ve = ve;
+    frame->type = type;
+    frame->error_message_ptr = error_message_ptr;
+    frame->error_details_ptr = error_details_ptr;
+    frame->outcome_ptr = outcome_ptr;
+    frame->is_variant = is_variant;
+
+    frame->stack = stack;
+    frame->stack_parent = NULL;
+    if (is_variant) {
+        stack->depth++;
+    }
+
+    return &frame->base;
+
+}
+
+// Pops the frame and returns its parent that should be resumed
+static tjv_WorkFrame *tjv_ValidateJsonPop(tjv_JsonFrame *frame) {
+
+    if (frame->is_variant) {
+        frame->stack->depth--;
+    } else if (frame->stack_parent != NULL) {
+        // The parent takes the cleaned value
+        if (frame->stack_own.cleaned != NULL) {
+            frame->stack_parent->child_cleaned = frame->stack_own.cleaned;
+        }
+        frame->stack_parent->next = NULL;
+    }
+
+    tjv_WorkFrame *parent = frame->base.parent;
+    tjv_WorkStackPop(frame->base.ws, frame);
+
+    if (parent != NULL) {
+        parent->is_resumed = 1;
+    }
+
+    return parent;
+
+}
+
+// Reports the first element that is equal to one of the previous elements
+static void tjv_ValidateJsonArrayUnique(const tjv_JsonValue *json, tjv_ValidationStack *stack, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr) {
+
+    Tcl_HashTable seen;
+    Tcl_InitObjHashTable(&seen);
+
+    const tjv_JsonValue *val;
+    Tcl_Size index = 0;
+    tjv_JsonArrayForEach(val, json) {
+
+        Tcl_Obj *canonical = tjv_JsonCanonical(val);
+
+        int is_new;
+        Tcl_HashEntry *entry = Tcl_CreateHashEntry(&seen, (char *)canonical, &is_new);
+        // The hash table holds a reference to the key if it was added
+        Tcl_BounceRefCount(canonical);
+
+        if (is_new) {
+            Tcl_SetHashValue(entry, INT2PTR(index));
+            index++;
+            continue;
+        }
+
+        DBG2(printf("duplicate element #%" TCL_SIZE_MODIFIER "d", index));
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%" TCL_LL_MODIFIER "d and #%" TCL_LL_MODIFIER "d",
+            (Tcl_WideInt)PTR2INT(Tcl_GetHashValue(entry)), (Tcl_WideInt)index);
+        tjv_MessageGenerateValue(stack,
+            Tcl_ObjPrintf("value has duplicate items #%s", buf),
+            error_message_ptr, error_details_ptr);
+        break;
+
+    }
+
+    Tcl_DeleteHashTable(&seen);
+
+}
+
+static inline int tjv_ValidateJsonObjectIsKnown(const tjv_JsonValue *member, tjv_ValidationElement *ve) {
+    return ve->opts.obj_type.json_key_index != NULL &&
+        tjv_StringSetFind(ve->opts.obj_type.json_key_index, member->key, member->key_length) != -1;
+}
+
+// Creates JSON text of the object where the members have cleaned values
+// and unknown members are stripped if needed
+static Tcl_Obj *tjv_ValidateJsonObjectClean(const tjv_JsonValue *json, tjv_ValidationElement *ve, const tjv_JsonCleanedMember *cleaned_members, Tcl_Size cleaned_count) {
+
+    Tcl_Obj *rc = Tcl_NewStringObj("{", 1);
+    int is_first = 1;
+
+    const tjv_JsonValue *member;
+    tjv_JsonArrayForEach(member, json) {
+
+        if (ve->opts.obj_type.additional == TJV_ADDITIONAL_STRIP && !tjv_ValidateJsonObjectIsKnown(member, ve)) {
+            DBG2(printf("unknown key: [%s] (strip)", member->key));
+            continue;
+        }
+
+        if (!is_first) {
+            Tcl_AppendToObj(rc, ",", 1);
+        }
+        is_first = 0;
+
+        tjv_JsonAppendString(rc, member->key, member->key_length);
+        Tcl_AppendToObj(rc, ":", 1);
+
+        Tcl_Obj *member_cleaned = NULL;
+        for (Tcl_Size i = 0; i < cleaned_count; i++) {
+            if (cleaned_members[i].member == member) {
+                member_cleaned = cleaned_members[i].cleaned;
+                break;
+            }
+        }
+
+        if (member_cleaned != NULL) {
+            Tcl_AppendObjToObj(rc, member_cleaned);
+        } else {
+            tjv_JsonAppendValue(rc, member);
+        }
+
+    }
+
+    Tcl_AppendToObj(rc, "}", 1);
+    return rc;
+
+}
+
+static tjv_WorkFrame *tjv_ValidateJsonObject(tjv_JsonFrame *frame) {
 
-static void tjv_ValidateJsonObject(const cJSON *json, tjv_ValidationStack *stack, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr) {
+    const tjv_JsonValue *json = frame->json;
+    tjv_ValidationStack *stack = frame->stack;
+    tjv_ValidationElement *ve = frame->ve;
+    Tcl_Obj **error_message_ptr = frame->error_message_ptr;
+    Tcl_Obj **error_details_ptr = frame->error_details_ptr;
+    Tcl_Obj **outcome_ptr = frame->outcome_ptr;
+    Tcl_Obj *output = frame->base.ws->output;
 
-    UNUSED(outcome_ptr);
+    if (frame->base.is_resumed) {
+        goto child;
+    }
 
     DBG2(printf("enter"));
 
-    if (ve->is_nullable && cJSON_IsNull(json)) {
+    if (ve->is_nullable && tjv_JsonIsNull(json)) {
+        if (output != NULL) {
+            Tcl_AppendToObj(output, "null", 4);
+        }
         DBG2(printf("return: ok (null can be accepted)"));
-        return;
+        return NULL;
     }
 
     // Check if data is valid object
-    if (!cJSON_IsObject(json)) {
+    if (!tjv_JsonIsObject(json)) {
         tjv_MessageGenerateType(stack, tjv_GetValidationTypeString(ve->type_ex), error_message_ptr, error_details_ptr);
         DBG2(printf("return: error"));
-        return;
+        return NULL;
     }
 
+    if (json->count < ve->opts.obj_type.min_properties) {
+        tjv_MessageGenerateLimit(stack, "value has fewer properties than the minimum %s",
+            ve->opts.obj_type.min_properties, error_message_ptr, error_details_ptr);
+    } else if (ve->opts.obj_type.is_max_properties_defined && json->count > ve->opts.obj_type.max_properties) {
+        tjv_MessageGenerateLimit(stack, "value has more properties than the maximum %s",
+            ve->opts.obj_type.max_properties, error_message_ptr, error_details_ptr);
+    }
+
+    frame->u.obj.found = 0;
+    frame->u.obj.cleaned_members = NULL;
+    frame->u.obj.cleaned_count = 0;
+    frame->u.obj.i = 0;
+
     // Do we have keys to validate?
     if (ve->opts.obj_type.keys_list == NULL) {
-        goto done;
+        if (output != NULL) {
+            tjv_JsonAppendValue(output, json);
+        }
+        goto additional;
+    }
+
+    if (output != NULL) {
+        Tcl_AppendToObj(output, "{", 1);
+        // The variant of a tagged union starts with its tag, the same
+        // as in tjv_ValidateTclObject()
+        if (frame->is_variant) {
+            Tcl_Obj *discriminator = ((tjv_JsonFrame *)frame->base.parent)->ve->opts.union_type.discriminator;
+            if (discriminator != NULL) {
+                Tcl_Size length;
+                const char *str = Tcl_GetStringFromObj(discriminator, &length);
+                if (tjv_StringSetFind(ve->opts.obj_type.key_index, str, length) == -1) {
+                    tjv_JsonAppendKey(output, discriminator);
+                    str = Tcl_GetStringFromObj(ve->key, &length);
+                    tjv_JsonAppendString(output, str, length);
+                }
+            }
+        }
+    }
+
+    goto next;
+
+child:
+
+    if (frame->u.obj.val == NULL) {
+        // The default value doesn't become a part of the cleaned object
+        if (stack->child_cleaned != NULL) {
+            Tcl_BounceRefCount(stack->child_cleaned);
+            stack->child_cleaned = NULL;
+        }
+    } else if (stack->child_cleaned != NULL) {
+        DBG2(printf("key [%s] has cleaned value", frame->u.obj.val->key));
+        if (frame->u.obj.cleaned_members == NULL) {
+            frame->u.obj.cleaned_members = ckalloc(sizeof(tjv_JsonCleanedMember) * ve->opts.obj_type.keys_objc);
+        }
+        frame->u.obj.cleaned_members[frame->u.obj.cleaned_count].member = frame->u.obj.val;
+        frame->u.obj.cleaned_members[frame->u.obj.cleaned_count].cleaned = stack->child_cleaned;
+        frame->u.obj.cleaned_count++;
+        stack->child_cleaned = NULL;
     }
 
+    frame->u.obj.i++;
+
+next:
+
     // Go throught all keys
-    for (Tcl_Size i = 0; i < ve->opts.obj_type.keys_objc; i++) {
+    for (; frame->u.obj.i < ve->opts.obj_type.keys_objc; frame->u.obj.i++) {
 
-        tjv_ValidationElement *element = ve->opts.obj_type.elements[i];
+        tjv_ValidationElement *element = ve->opts.obj_type.elements[frame->u.obj.i];
 
-        cJSON *val = cJSON_GetObjectItem(json, Tcl_GetString(element->key));
+        const tjv_JsonValue *val = tjv_JsonGetObjectItem(json, Tcl_GetString(element->key));
         if (val == NULL) {
             // There is no such key. Report an error if it is required.
             if (element->is_required) {
                 DBG2(printf("check key: [%s] - doesn't exist (ERROR)", Tcl_GetString(element->key)));
                 tjv_MessageGenerateRequired(stack, element->key, error_message_ptr, error_details_ptr);
+            } else if (output != NULL && element->default_value != NULL) {
+                // The default value is a Tcl value, the same as in
+                // tjv_ValidateTclObject()
+                DBG2(printf("check key: [%s] - doesn't exist (default)", Tcl_GetString(element->key)));
+                frame->u.obj.val = NULL;
+                tjv_JsonAppendKey(output, element->key);
+                return tjv_ValidateTclPushChild(&frame->base, stack, element->default_value, element,
+                    error_message_ptr, error_details_ptr);
             } else {
                 DBG2(printf("check key: [%s] - doesn't exist (OK)", Tcl_GetString(element->key)));
             }
@@ -54,201 +396,728 @@ static void tjv_ValidateJsonObject(const cJSON *json, tjv_ValidationStack *stack
         DBG2(printf("check key: [%s]", Tcl_GetString(element->key)));
 
         // We found a key, let's validate its value.
-        tjv_ValidateJson(val, stack, element, error_message_ptr, error_details_ptr, outcome_ptr);
+        frame->u.obj.found++;
+        frame->u.obj.val = val;
+        if (output != NULL) {
+            tjv_JsonAppendKey(output, element->key);
+        }
+        return tjv_ValidateJsonPush(frame->base.ws, &frame->base, stack, val, element,
+            error_message_ptr, error_details_ptr, outcome_ptr);
 
     }
 
-done:
+additional: ; // empty statement
+
+    int is_stripped = 0;
+
+    // If all keys are unique, each found member corresponds to one schema key.
+    // So, there may be unknown members only if not all members are found.
+    if (ve->opts.obj_type.additional != TJV_ADDITIONAL_ALLOW && (frame->u.obj.found < json->count ||
+        (ve->opts.obj_type.json_key_index != NULL &&
+        ve->opts.obj_type.json_key_index->count != ve->opts.obj_type.keys_objc)))
+    {
+        if (ve->opts.obj_type.additional == TJV_ADDITIONAL_STRIP) {
+            is_stripped = 1;
+        } else {
+            const tjv_JsonValue *member;
+            tjv_JsonArrayForEach(member, json) {
+                if (!tjv_ValidateJsonObjectIsKnown(member, ve)) {
+                    DBG2(printf("unknown key: [%s] (ERROR)", member->key));
+                    tjv_MessageGenerateAdditional(stack, member->key, error_message_ptr, error_details_ptr);
+                }
+            }
+        }
+    }
+
+    if (output != NULL && ve->opts.obj_type.keys_list != NULL) {
+        Tcl_AppendToObj(output, "}", 1);
+    }
+
+    tjv_JsonCleanedMember *cleaned_members = frame->u.obj.cleaned_members;
+    Tcl_Size cleaned_count = frame->u.obj.cleaned_count;
+
+    if (is_stripped || cleaned_count > 0) {
+        stack->cleaned = tjv_ValidateJsonObjectClean(json, ve, cleaned_members, cleaned_count);
+        DBG2(printf("cleaned value: [%s]", Tcl_GetString(stack->cleaned)));
+    }
+
+    if (cleaned_members != NULL) {
+        for (Tcl_Size i = 0; i < cleaned_count; i++) {
+            Tcl_BounceRefCount(cleaned_members[i].cleaned);
+        }
+        ckfree(cleaned_members);
+    }
+
+    DBG2(printf("return: ok"));
+    return NULL;
+
+}
+
+// A stack frame from the head to the root array without Tcl objects, so
+// that other threads can build the same frame for error paths
+typedef struct {
+    // NULL, INT2PTR(1) or the string of the key
+    const char *key;
+    Tcl_Size key_length;
+    Tcl_Size index;
+    Tcl_Size depth;
+} tjv_JsonParallelFrame;
+
+// Consecutive elements of the array and the results of their validation
+typedef struct {
+    const tjv_JsonValue *first;
+    Tcl_Size first_index;
+    Tcl_Size count;
+    // The block is not validated if the worker can't compile the schema
+    int is_done;
+    tjv_ReplicaText error_message;
+    tjv_ReplicaText error_details;
+    // The list of non-empty outcomes of the elements
+    tjv_ReplicaText outcome;
+    // JSON text of the elements without brackets, it is empty if there are
+    // no cleaned elements in the block
+    tjv_ReplicaText cleaned;
+    // JSON output of the elements without brackets
+    tjv_ReplicaText output;
+} tjv_JsonParallelBlock;
+
+typedef struct {
+    tjv_Replica *replica;
+    tjv_JsonParallelFrame frames[TJV_JSON_PARALLEL_MAX_FRAMES];
+    int frame_count;
+    int is_outcome;
+    int is_output;
+    tjv_JsonParallelBlock *blocks;
+} tjv_JsonParallelJob;
+
+// Validates the elements of the block by the root element of the schema of
+// the current thread, in the same way as tjv_ValidateJsonArray() does
+static void tjv_ValidateJsonArrayBlock(tjv_JsonParallelJob *job, tjv_JsonParallelBlock *block, tjv_ValidationElement *root) {
+
+    DBG2(printf("validate elements from #%" TCL_SIZE_MODIFIER "d, count: %" TCL_SIZE_MODIFIER "d",
+        block->first_index, block->count));
+
+    tjv_ValidationStack stack[TJV_JSON_PARALLEL_MAX_FRAMES];
+    for (int i = 0; i < job->frame_count; i++) {
+        tjv_JsonParallelFrame *f = &job->frames[i];
+        stack[i].head = &stack[0];
+        stack[i].next = (i + 1 < job->frame_count ? &stack[i + 1] : NULL);
+        if (f->key == NULL || f->key == INT2PTR(1)) {
+            stack[i].key = (Tcl_Obj *)f->key;
+        } else {
+            stack[i].key = Tcl_NewStringObj(f->key, f->key_length);
+            Tcl_IncrRefCount(stack[i].key);
+        }
+        stack[i].index = f->index;
+        stack[i].cleaned = NULL;
+        stack[i].child_cleaned = NULL;
+        stack[i].depth = f->depth;
+    }
+    tjv_ValidationStack *parent = &stack[job->frame_count - 1];
+
+    // The stack of the thread can be used by a validation that is already
+    // running, so its output is restored
+    tjv_WorkStack *ws = tjv_WorkStackGet();
+    Tcl_Obj *ws_output = ws->output;
+    ws->output = (job->is_output ? Tcl_NewObj() : NULL);
+
+    Tcl_Obj *error_message = NULL;
+    Tcl_Obj *error_details = NULL;
+    Tcl_Obj *result_outcome = NULL;
+    Tcl_Obj *item_outcome = NULL;
+    if (job->is_outcome) {
+        result_outcome = Tcl_NewListObj(0, NULL);
+        item_outcome = Tcl_NewDictObj();
+    }
+    Tcl_Obj *cleaned = NULL;
+
+    const tjv_JsonValue *val = block->first;
+    for (Tcl_Size i = 0; i < block->count; i++, val = val->next) {
+
+        parent->index = block->first_index + i;
+        if (ws->output != NULL) {
+            tjv_JsonAppendSeparator(ws->output);
+        }
+
+        tjv_ValidateJsonValue(val, parent, root->opts.array_type.element, &error_message, &error_details,
+            (item_outcome == NULL ? NULL : &item_outcome));
+
+        if (parent->child_cleaned != NULL && cleaned == NULL) {
+            cleaned = Tcl_NewObj();
+            for (const tjv_JsonValue *prev = block->first; prev != val; prev = prev->next) {
+                if (prev != block->first) {
+                    Tcl_AppendToObj(cleaned, ",", 1);
+                }
+                tjv_JsonAppendValue(cleaned, prev);
+            }
+        }
+
+        if (cleaned != NULL) {
+            if (val != block->first) {
+                Tcl_AppendToObj(cleaned, ",", 1);
+            }
+            if (parent->child_cleaned != NULL) {
+                Tcl_AppendObjToObj(cleaned, parent->child_cleaned);
+                Tcl_BounceRefCount(parent->child_cleaned);
+                parent->child_cleaned = NULL;
+            } else {
+                tjv_JsonAppendValue(cleaned, val);
+            }
+        }
+
+        if (item_outcome != NULL) {
+            Tcl_Size dict_size;
+            Tcl_DictObjSize(NULL, item_outcome, &dict_size);
+            if (dict_size > 0) {
+                Tcl_ListObjAppendElement(NULL, result_outcome, item_outcome);
+                item_outcome = Tcl_NewDictObj();
+            }
+        }
+
+    }
+
+    if (item_outcome != NULL) {
+        Tcl_BounceRefCount(item_outcome);
+    }
+
+    block->is_done = 1;
+    tjv_ReplicaTextSet(&block->error_message, error_message);
+    tjv_ReplicaTextSet(&block->error_details, error_details);
+    tjv_ReplicaTextSet(&block->outcome, result_outcome);
+    tjv_ReplicaTextSet(&block->cleaned, cleaned);
+    tjv_ReplicaTextSet(&block->output, ws->output);
+
+    ws->output = ws_output;
+
+    for (int i = 0; i < job->frame_count; i++) {
+        if (stack[i].key != NULL && stack[i].key != INT2PTR(1)) {
+            Tcl_DecrRefCount(stack[i].key);
+        }
+    }
+
+}
+
+static void tjv_ValidateJsonArrayBlockProc(void *clientData, Tcl_Size index) {
+
+    tjv_JsonParallelJob *job = (tjv_JsonParallelJob *)clientData;
+    tjv_JsonParallelBlock *block = &job->blocks[index];
+
+    tjv_ValidationElement *root = tjv_ReplicaGet(job->replica);
+    if (root == NULL) {
+        DBG2(printf("block #%" TCL_SIZE_MODIFIER "d is left to the current thread", index));
+        block->is_done = 0;
+        return;
+    }
+
+    tjv_ValidateJsonArrayBlock(job, block, root);
+
+}
+
+// Validates the elements of a large root array of a compiled schema in
+// parallel by worker threads, each with its own copy of the schema. The
+// results of blocks of elements are merged in the order of elements, so
+// they are the same as in tjv_ValidateJsonArray(). Returns 0 if the array
+// should be validated by the current thread.
+static int tjv_ValidateJsonArrayParallel(tjv_JsonFrame *frame) {
+
+    const tjv_JsonValue *json = frame->json;
+    tjv_ValidationStack *stack = frame->stack;
+    tjv_ValidationElement *ve = frame->ve;
+    tjv_WorkStack *ws = frame->base.ws;
+    Tcl_Obj **outcome_ptr = frame->outcome_ptr;
+
+    // Steps of a validation are run by the thread of the interpreter only
+    if (ve->replica == NULL || frame->is_variant || ws->is_resumable ||
+        json->count < TJV_JSON_PARALLEL_MIN_ITEMS || tjv_PoolThreads() == 0)
+    {
+        return 0;
+    }
+
+    tjv_JsonParallelJob job;
+    job.replica = ve->replica;
+    job.frame_count = 0;
+    for (tjv_ValidationStack *s = stack->head; ; s = s->next) {
+        if (s == NULL || job.frame_count == TJV_JSON_PARALLEL_MAX_FRAMES) {
+            DBG2(printf("unexpected stack frames"));
+            return 0;
+        }
+        tjv_JsonParallelFrame *f = &job.frames[job.frame_count++];
+        if (s->key == NULL || s->key == INT2PTR(1)) {
+            f->key = (const char *)s->key;
+            f->key_length = 0;
+        } else {
+            f->key = Tcl_GetStringFromObj(s->key, &f->key_length);
+        }
+        f->index = s->index;
+        f->depth = s->depth;
+        if (s == stack) {
+            break;
+        }
+    }
+    job.is_outcome = (outcome_ptr != NULL && ve->outkey != NULL);
+    job.is_output = (ws->output != NULL);
+
+    Tcl_Size block_count = (json->count + TJV_JSON_PARALLEL_BLOCK_SIZE - 1) / TJV_JSON_PARALLEL_BLOCK_SIZE;
+    job.blocks = ckalloc(sizeof(tjv_JsonParallelBlock) * block_count);
+
+    const tjv_JsonValue *val = json->child;
+    for (Tcl_Size i = 0; i < block_count; i++) {
+        tjv_JsonParallelBlock *block = &job.blocks[i];
+        block->first = val;
+        block->first_index = i * TJV_JSON_PARALLEL_BLOCK_SIZE;
+        block->count = json->count - block->first_index;
+        if (block->count > TJV_JSON_PARALLEL_BLOCK_SIZE) {
+            block->count = TJV_JSON_PARALLEL_BLOCK_SIZE;
+        }
+        for (Tcl_Size j = 0; j < block->count; j++) {
+            val = val->next;
+        }
+    }
+
+    DBG2(printf("validate %" TCL_SIZE_MODIFIER "d elements in %" TCL_SIZE_MODIFIER "d blocks",
+        json->count, block_count));
+
+    tjv_PoolRun(tjv_ValidateJsonArrayBlockProc, &job, block_count);
+
+    Tcl_Obj *output = ws->output;
+    if (output != NULL) {
+        Tcl_AppendToObj(output, "[", 1);
+    }
+
+    Tcl_Obj *result_outcome = (job.is_outcome ? Tcl_NewListObj(0, NULL) : NULL);
+    Tcl_Obj *cleaned = NULL;
+
+    for (Tcl_Size i = 0; i < block_count; i++) {
+
+        tjv_JsonParallelBlock *block = &job.blocks[i];
+        if (!block->is_done) {
+            tjv_ValidateJsonArrayBlock(&job, block, ve);
+        }
+
+        tjv_ReplicaTextAppendList(&block->error_message, frame->error_message_ptr);
+        tjv_ReplicaTextAppendList(&block->error_details, frame->error_details_ptr);
+
+        if (result_outcome != NULL) {
+            tjv_ReplicaTextAppendList(&block->outcome, &result_outcome);
+        } else {
+            tjv_ReplicaTextFree(&block->outcome);
+        }
+
+        // An element without output is not valid, so the output is not
+        // used then, but the separators are still the same
+        Tcl_Obj *block_output = tjv_ReplicaTextGet(&block->output);
+        if (block_output != NULL) {
+            if (Tcl_GetCharLength(block_output) > 0) {
+                tjv_JsonAppendSeparator(output);
+                Tcl_AppendObjToObj(output, block_output);
+            }
+            Tcl_BounceRefCount(block_output);
+        }
+
+        if (block->cleaned.bytes != NULL && cleaned == NULL) {
+            DBG2(printf("array element has cleaned value"));
+            cleaned = Tcl_NewStringObj("[", 1);
+            for (const tjv_JsonValue *prev = json->child; prev != block->first; prev = prev->next) {
+                if (prev != json->child) {
+                    Tcl_AppendToObj(cleaned, ",", 1);
+                }
+                tjv_JsonAppendValue(cleaned, prev);
+            }
+        }
+
+        if (cleaned != NULL) {
+            if (i > 0) {
+                Tcl_AppendToObj(cleaned, ",", 1);
+            }
+            Tcl_Obj *block_cleaned = tjv_ReplicaTextGet(&block->cleaned);
+            if (block_cleaned != NULL) {
+                Tcl_AppendObjToObj(cleaned, block_cleaned);
+                Tcl_BounceRefCount(block_cleaned);
+            } else {
+                val = block->first;
+                for (Tcl_Size j = 0; j < block->count; j++, val = val->next) {
+                    if (j > 0) {
+                        Tcl_AppendToObj(cleaned, ",", 1);
+                    }
+                    tjv_JsonAppendValue(cleaned, val);
+                }
+            }
+        }
+
+    }
+
+    ckfree(job.blocks);
+
+    stack->index = json->count;
+
+    if (result_outcome != NULL) {
+        ADD_OUTCOME(result_outcome);
+    }
+
+    if (output != NULL) {
+        Tcl_AppendToObj(output, "]", 1);
+    }
+
+    if (cleaned != NULL) {
+        Tcl_AppendToObj(cleaned, "]", 1);
+        stack->cleaned = cleaned;
+    }
 
     DBG2(printf("return: ok"));
+    return 1;
 
 }
 
-static void tjv_ValidateJsonArray(const cJSON *json, tjv_ValidationStack *stack, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr) {
+static tjv_WorkFrame *tjv_ValidateJsonArray(tjv_JsonFrame *frame) {
 
-    UNUSED(outcome_ptr);
+    const tjv_JsonValue *json = frame->json;
+    tjv_ValidationStack *stack = frame->stack;
+    tjv_ValidationElement *ve = frame->ve;
+    Tcl_Obj **error_message_ptr = frame->error_message_ptr;
+    Tcl_Obj **error_details_ptr = frame->error_details_ptr;
+    Tcl_Obj **outcome_ptr = frame->outcome_ptr;
+    Tcl_Obj *output = frame->base.ws->output;
+
+    if (frame->base.is_resumed) {
+        goto child;
+    }
 
     DBG2(printf("enter"));
 
-    if (ve->is_nullable && cJSON_IsNull(json)) {
+    if (ve->is_nullable && tjv_JsonIsNull(json)) {
+        if (output != NULL) {
+            Tcl_AppendToObj(output, "null", 4);
+        }
         DBG2(printf("return: ok (null can be accepted)"));
-        return;
+        return NULL;
     }
 
-    if (!cJSON_IsArray(json)) {
+    if (!tjv_JsonIsArray(json)) {
         tjv_MessageGenerateType(stack, tjv_GetValidationTypeString(ve->type_ex), error_message_ptr, error_details_ptr);
         DBG2(printf("return: error"));
-        return;
+        return NULL;
+    }
+
+    if (json->count < ve->opts.array_type.min_items) {
+        tjv_MessageGenerateLimit(stack, "value has fewer items than the minimum %s",
+            ve->opts.array_type.min_items, error_message_ptr, error_details_ptr);
+    } else if (ve->opts.array_type.is_max_items_defined && json->count > ve->opts.array_type.max_items) {
+        tjv_MessageGenerateLimit(stack, "value has more items than the maximum %s",
+            ve->opts.array_type.max_items, error_message_ptr, error_details_ptr);
+    }
+
+    if (ve->opts.array_type.is_unique_items && json->count > 1) {
+        tjv_ValidateJsonArrayUnique(json, stack, error_message_ptr, error_details_ptr);
     }
 
     // Do we need to validate list elements?
     if (ve->opts.array_type.element == NULL) {
-        goto done;
+        if (output != NULL) {
+            tjv_JsonAppendValue(output, json);
+        }
+        DBG2(printf("return: ok"));
+        return NULL;
+    }
+
+    if (tjv_ValidateJsonArrayParallel(frame)) {
+        return NULL;
+    }
+
+    if (output != NULL) {
+        Tcl_AppendToObj(output, "[", 1);
     }
 
-    Tcl_Obj *result_outcome, *item_outcome, **item_outcome_ptr;
     if (outcome_ptr == NULL || ve->outkey == NULL) {
-        item_outcome = NULL;
-        item_outcome_ptr = NULL;
+        frame->u.arr.result_outcome = NULL;
+        frame->u.arr.item_outcome = NULL;
     } else {
-        result_outcome = Tcl_NewListObj(0, NULL);
-        item_outcome = Tcl_NewDictObj();
-        item_outcome_ptr = &item_outcome;
+        frame->u.arr.result_outcome = Tcl_NewListObj(0, NULL);
+        frame->u.arr.item_outcome = Tcl_NewDictObj();
     }
     DBG2(printf("array should return result: %s", (outcome_ptr == NULL ? "no" : "yes")));
 
+    frame->u.arr.cleaned = NULL;
+
     // Go throught all keys
-    const cJSON *val;
+    frame->u.arr.val = json->child;
     stack->index = 0;
-    cJSON_ArrayForEach(val, json) {
+    goto next;
 
-        DBG2(printf("check array element #%" TCL_SIZE_MODIFIER "d", stack->index));
+child: ; // empty statement
 
-        tjv_ValidateJson(val, stack, ve->opts.array_type.element, error_message_ptr, error_details_ptr, item_outcome_ptr);
+    const tjv_JsonValue *val = frame->u.arr.val;
+    Tcl_Obj *cleaned = frame->u.arr.cleaned;
 
-        if (item_outcome != NULL) {
+    if (stack->child_cleaned != NULL && cleaned == NULL) {
+        DBG2(printf("array element has cleaned value"));
+        cleaned = Tcl_NewStringObj("[", 1);
+        const tjv_JsonValue *prev;
+        for (prev = json->child; prev != val; prev = prev->next) {
+            if (prev != json->child) {
+                Tcl_AppendToObj(cleaned, ",", 1);
+            }
+            tjv_JsonAppendValue(cleaned, prev);
+        }
+        frame->u.arr.cleaned = cleaned;
+    }
 
-            Tcl_Size dict_size;
-            Tcl_DictObjSize(NULL, item_outcome, &dict_size);
+    if (cleaned != NULL) {
+        if (val != json->child) {
+            Tcl_AppendToObj(cleaned, ",", 1);
+        }
+        if (stack->child_cleaned != NULL) {
+            Tcl_AppendObjToObj(cleaned, stack->child_cleaned);
+            Tcl_BounceRefCount(stack->child_cleaned);
+            stack->child_cleaned = NULL;
+        } else {
+            tjv_JsonAppendValue(cleaned, val);
+        }
+    }
 
-            if (dict_size > 0) {
-                DBG2(printf("got result with %d key(s)", dict_size));
-                Tcl_ListObjAppendElement(NULL, result_outcome, item_outcome);
-                item_outcome = Tcl_NewDictObj();
-            } else {
-                DBG2(printf("got empty result"));
-            }
+    if (frame->u.arr.item_outcome != NULL) {
+
+        Tcl_Size dict_size;
+        Tcl_DictObjSize(NULL, frame->u.arr.item_outcome, &dict_size);
 
+        if (dict_size > 0) {
+            DBG2(printf("got result with %d key(s)", dict_size));
+            Tcl_ListObjAppendElement(NULL, frame->u.arr.result_outcome, frame->u.arr.item_outcome);
+            frame->u.arr.item_outcome = Tcl_NewDictObj();
+        } else {
+            DBG2(printf("got empty result"));
         }
 
-        stack->index++;
+    }
+
+    frame->u.arr.val = val->next;
+    stack->index++;
+
+next:
+
+    if (frame->u.arr.val != NULL) {
+        DBG2(printf("check array element #%" TCL_SIZE_MODIFIER "d", stack->index));
+        if (output != NULL) {
+            tjv_JsonAppendSeparator(output);
+        }
+        return tjv_ValidateJsonPush(frame->base.ws, &frame->base, stack, frame->u.arr.val, ve->opts.array_type.element,
+            error_message_ptr, error_details_ptr,
+            (frame->u.arr.item_outcome == NULL ? NULL : &frame->u.arr.item_outcome));
+    }
 
+    if (frame->u.arr.item_outcome != NULL) {
+        Tcl_BounceRefCount(frame->u.arr.item_outcome);
+        ADD_OUTCOME(frame->u.arr.result_outcome);
     }
 
-    if (item_outcome != NULL) {
-        Tcl_BounceRefCount(item_outcome);
-        ADD_OUTCOME(result_outcome);
+    if (output != NULL) {
+        Tcl_AppendToObj(output, "]", 1);
     }
 
-done:
+    if (frame->u.arr.cleaned != NULL) {
+        Tcl_AppendToObj(frame->u.arr.cleaned, "]", 1);
+        stack->cleaned = frame->u.arr.cleaned;
+    }
 
     DBG2(printf("return: ok"));
+    return NULL;
 
 }
 
-static inline void tjv_ValidateJsonInteger(const cJSON *json, tjv_ValidationStack *stack, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr) {
+static inline void tjv_ValidateJsonInteger(const tjv_JsonValue *json, Tcl_Obj *output, tjv_ValidationStack *stack, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr) {
 
     DBG2(printf("enter"));
 
-    if (ve->is_nullable && cJSON_IsNull(json)) {
+    if (ve->is_nullable && tjv_JsonIsNull(json)) {
+        if (output != NULL) {
+            Tcl_AppendToObj(output, "null", 4);
+        }
         DBG2(printf("return: ok (null can be accepted)"));
         return;
     }
 
-    if (!cJSON_IsNumber(json)) {
+    if (!tjv_JsonIsNumber(json)) {
 wrongFormat:
         tjv_MessageGenerateType(stack, tjv_GetValidationTypeString(ve->type_ex), error_message_ptr, error_details_ptr);
         DBG2(printf("return: error"));
         return;
     }
 
-    // Make sure that the value is an integer
-    double val = cJSON_GetNumberValue(json);
-    if (val != (double)json->valueint) {
+    // Make sure that the value is an integer. The value is taken directly from
+    // the number text without conversion to double. Integers outside the 64-bit
+    // range are always outside the -minimum/-maximum range, so only their sign
+    // matters for the check. Bignum is created only if it is needed for
+    // the outcome or the JSON output.
+    Tcl_WideInt val;
+    mp_int big;
+    int is_big_needed = ((ve->outkey != NULL && outcome_ptr != NULL) || output != NULL);
+    tjv_JsonIntegerType int_type = tjv_JsonGetIntegerValue(json, &val, (is_big_needed ? &big : NULL));
+
+    if (int_type == TJV_JSON_INTEGER_NONE) {
         goto wrongFormat;
     }
 
+    if (int_type == TJV_JSON_INTEGER_TOO_LONG) {
+        tjv_MessageGenerateValue(stack,
+            Tcl_ObjPrintf("integer value has more than %d digits", TJV_JSON_INTEGER_MAX_DIGITS),
+            error_message_ptr, error_details_ptr);
+        DBG2(printf("return: error"));
+        return;
+    }
+
     char buf[64];
 
-    if (ve->opts.int_type.is_min_value_defined && json->valueint < ve->opts.int_type.min_value) {
+    if (ve->opts.int_type.is_min_value_defined && (int_type == TJV_JSON_INTEGER_BIG ?
+        val < 0 : val < ve->opts.int_type.min_value))
+    {
         snprintf(buf, sizeof(buf), "%" TCL_LL_MODIFIER "d", ve->opts.int_type.min_value);
         tjv_MessageGenerateValue(stack,
             Tcl_ObjPrintf("value is less than the minimum %s", buf),
             error_message_ptr, error_details_ptr);
-    } else if (ve->opts.int_type.is_max_value_defined && json->valueint > ve->opts.int_type.max_value) {
+    } else if (ve->opts.int_type.is_max_value_defined && (int_type == TJV_JSON_INTEGER_BIG ?
+        val > 0 : val > ve->opts.int_type.max_value))
+    {
         snprintf(buf, sizeof(buf), "%" TCL_LL_MODIFIER "d", ve->opts.int_type.max_value);
         tjv_MessageGenerateValue(stack,
             Tcl_ObjPrintf("value is greater than the maximum %s", buf),
             error_message_ptr, error_details_ptr);
+    } else if (int_type == TJV_JSON_INTEGER_BIG) {
+        if (is_big_needed) {
+            // Tcl_NewBignumObj() takes ownership of the bignum
+            Tcl_Obj *big_obj = Tcl_NewBignumObj(&big);
+            is_big_needed = 0;
+            ADD_OUTCOME(big_obj);
+            if (output != NULL) {
+                Tcl_AppendObjToObj(output, big_obj);
+            }
+            Tcl_BounceRefCount(big_obj);
+        }
     } else {
-        ADD_OUTCOME(Tcl_NewWideIntObj(json->valueint));
+        ADD_OUTCOME(Tcl_NewWideIntObj(val));
+        if (output != NULL) {
+            tjv_JsonAppendWideInt(output, val);
+        }
+    }
+
+    if (int_type == TJV_JSON_INTEGER_BIG && is_big_needed) {
+        mp_clear(&big);
     }
 
     DBG2(printf("return: ok"));
 
 }
 
-static inline void tjv_ValidateJsonDouble(const cJSON *json, tjv_ValidationStack *stack, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr) {
+static inline void tjv_ValidateJsonDouble(const tjv_JsonValue *json, Tcl_Obj *output, tjv_ValidationStack *stack, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr) {
 
     DBG2(printf("enter"));
 
-    if (ve->is_nullable && cJSON_IsNull(json)) {
+    if (ve->is_nullable && tjv_JsonIsNull(json)) {
+        if (output != NULL) {
+            Tcl_AppendToObj(output, "null", 4);
+        }
         DBG2(printf("return: ok (null can be accepted)"));
         return;
     }
 
-    if (!cJSON_IsNumber(json)) {
+    if (!tjv_JsonIsNumber(json)) {
         tjv_MessageGenerateType(stack, tjv_GetValidationTypeString(ve->type_ex), error_message_ptr, error_details_ptr);
         DBG2(printf("return: error"));
         return;
     }
 
-    double val = cJSON_GetNumberValue(json);
+    // The number is converted to double only if it is required for the outcome
+    // or when the -minimum/-maximum check can't be decided by its digits.
+    double val;
+    int is_converted;
+    int range = tjv_JsonCheckNumberRange(json,
+        (ve->opts.double_type.is_min_value_defined ? &ve->opts.double_type.min_value : NULL),
+        (ve->opts.double_type.is_max_value_defined ? &ve->opts.double_type.max_value : NULL),
+        &val, &is_converted);
 
-    if (ve->opts.double_type.is_min_value_defined && val < ve->opts.double_type.min_value) {
+    if (range < 0) {
         tjv_MessageGenerateValue(stack,
             Tcl_ObjPrintf("value is less than the minimum %f", ve->opts.double_type.min_value),
             error_message_ptr, error_details_ptr);
-    } else if (ve->opts.double_type.is_max_value_defined && val > ve->opts.double_type.max_value) {
+    } else if (range > 0) {
         tjv_MessageGenerateValue(stack,
             Tcl_ObjPrintf("value is greater than the maximum %f", ve->opts.double_type.max_value),
             error_message_ptr, error_details_ptr);
     } else {
+        if (!is_converted && (output != NULL || (ve->outkey != NULL && outcome_ptr != NULL))) {
+            val = tjv_JsonGetNumberValue(json);
+        }
         ADD_OUTCOME(Tcl_NewDoubleObj(val));
+        if (output != NULL) {
+            tjv_JsonAppendDouble(output, val);
+        }
     }
 
     DBG2(printf("return: ok"));
 
 }
 
-static inline void tjv_ValidateJsonBoolean(const cJSON *json, tjv_ValidationStack *stack, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr) {
+static inline void tjv_ValidateJsonBoolean(const tjv_JsonValue *json, Tcl_Obj *output, tjv_ValidationStack *stack, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr) {
 
     DBG2(printf("enter"));
 
-    if (ve->is_nullable && cJSON_IsNull(json)) {
+    if (ve->is_nullable && tjv_JsonIsNull(json)) {
+        if (output != NULL) {
+            Tcl_AppendToObj(output, "null", 4);
+        }
         DBG2(printf("return: ok (null can be accepted)"));
         return;
     }
 
-    if (!cJSON_IsBool(json)) {
+    if (!tjv_JsonIsBool(json)) {
         tjv_MessageGenerateType(stack, tjv_GetValidationTypeString(ve->type_ex), error_message_ptr, error_details_ptr);
         DBG2(printf("return: error"));
         return;
     }
 
-    ADD_OUTCOME(Tcl_NewBooleanObj(cJSON_IsTrue(json) ? 1 : 0));
+    ADD_OUTCOME(Tcl_NewBooleanObj(tjv_JsonIsTrue(json) ? 1 : 0));
+    if (output != NULL) {
+        Tcl_AppendToObj(output, (tjv_JsonIsTrue(json) ? "true" : "false"), -1);
+    }
 
     DBG2(printf("return: ok"));
 
 }
 
-static inline void tjv_ValidateJsonString(const cJSON *json, tjv_ValidationStack *stack, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr) {
+static inline void tjv_ValidateJsonString(const tjv_JsonValue *json, Tcl_Obj *output, tjv_ValidationStack *stack, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr) {
 
     DBG2(printf("enter"));
 
-    if (ve->is_nullable && cJSON_IsNull(json)) {
+    if (ve->is_nullable && tjv_JsonIsNull(json)) {
+        if (output != NULL) {
+            Tcl_AppendToObj(output, "null", 4);
+        }
         DBG2(printf("return: ok (null can be accepted)"));
         return;
     }
 
-    if (!cJSON_IsString(json)) {
+    if (!tjv_JsonIsString(json)) {
         tjv_MessageGenerateType(stack, tjv_GetValidationTypeString(ve->type_ex), error_message_ptr, error_details_ptr);
         DBG2(printf("return: error"));
         return;
     }
 
-    const char *val = cJSON_GetStringValue(json);
-    DBG2(printf("string to validate: [%s]", val));
+    const char *val = json->str;
+    DBG2(printf("string to validate: [%.*s]", (int)json->length, val));
+
+    if (ve->opts.str_type.min_length > 0 || ve->opts.str_type.is_max_length_defined) {
+
+        Tcl_Size length = tjv_Utf8Length(val, json->length);
+
+        if (length < ve->opts.str_type.min_length) {
+            tjv_MessageGenerateLimit(stack, "value is shorter than the minimum length %s",
+                ve->opts.str_type.min_length, error_message_ptr, error_details_ptr);
+            goto error;
+        } else if (ve->opts.str_type.is_max_length_defined && length > ve->opts.str_type.max_length) {
+            tjv_MessageGenerateLimit(stack, "value is longer than the maximum length %s",
+                ve->opts.str_type.max_length, error_message_ptr, error_details_ptr);
+            goto error;
+        }
+
+    }
 
     // If pattern is NULL, we don't need to validate anything
     if (ve->opts.str_type.pattern == NULL) {
@@ -257,13 +1126,17 @@ static inline void tjv_ValidateJsonString(const cJSON *json, tjv_ValidationStack
 
     switch (ve->opts.str_type.match) {
     case TJV_STRING_MATCHING_GLOB:
+    case TJV_STRING_MATCHING_GLOBLIST:
 
-        if (Tcl_StringMatch(val, Tcl_GetString(ve->opts.str_type.pattern)) == 1) {
+        if (tjv_GlobMatch(ve->opts.str_type.glob, val, json->length)) {
             goto done;
         }
 
         tjv_MessageGenerateValue(stack,
-            Tcl_ObjPrintf("value does not match the specified glob pattern '%s'", Tcl_GetString(ve->opts.str_type.pattern)),
+            Tcl_ObjPrintf((ve->opts.str_type.match == TJV_STRING_MATCHING_GLOB ?
+                "value does not match the specified glob pattern '%s'" :
+                "value does not match any of the specified glob patterns '%s'"),
+                Tcl_GetString(ve->opts.str_type.pattern)),
             error_message_ptr, error_details_ptr);
         goto error;
 
@@ -279,11 +1152,17 @@ static inline void tjv_ValidateJsonString(const cJSON *json, tjv_ValidationStack
         // converts the source string from char* to Tcl_DString before matching.
         //
         // So we convert our string into a temporary object to be able to use
-        // the modern Tcl_Reg_RExpExecObj() function.
+        // the modern Tcl_Reg_RExpExecObj() function. The dfa engine works
+        // with the string directly.
 
-        Tcl_Obj *obj = Tcl_NewStringObj(val, -1);
-        int re_result = Tcl_RegExpExecObj(NULL, ve->opts.str_type.regexp, obj, 0, 0, 0);
-        Tcl_BounceRefCount(obj);
+        int re_result;
+        if (ve->opts.str_type.automaton != NULL) {
+            re_result = tjv_AutomatonMatch(ve->opts.str_type.automaton, val, json->length);
+        } else {
+            Tcl_Obj *obj = Tcl_NewStringObj(val, json->length);
+            re_result = Tcl_RegExpExecObj(NULL, ve->opts.str_type.regexp, obj, 0, 0, 0);
+            Tcl_BounceRefCount(obj);
+        }
 
         if (re_result == 1) {
             goto done;
@@ -300,12 +1179,11 @@ static inline void tjv_ValidateJsonString(const cJSON *json, tjv_ValidationStack
 
         break;
 
-    case TJV_STRING_MATCHING_LIST: ; // empty statement
+    case TJV_STRING_MATCHING_LIST:
+    case TJV_STRING_MATCHING_ILIST:
 
-        for (Tcl_Size i = 0; i < ve->opts.str_type.pattern_objc; i++) {
-            if (strcmp(val, Tcl_GetString(ve->opts.str_type.pattern_objv[i])) == 0) {
-                goto done;
-            }
+        if (tjv_StringSetContains(ve->opts.str_type.set, val, json->length)) {
+            goto done;
         }
 
         tjv_MessageGenerateValue(stack,
@@ -319,7 +1197,10 @@ static inline void tjv_ValidateJsonString(const cJSON *json, tjv_ValidationStack
 
 done:
 
-    ADD_OUTCOME(Tcl_NewStringObj(val, -1));
+    ADD_OUTCOME(Tcl_NewStringObj(val, json->length));
+    if (output != NULL) {
+        tjv_JsonAppendString(output, val, json->length);
+    }
     DBG2(printf("return: ok"));
     return;
 
@@ -330,53 +1211,365 @@ error:
 
 }
 
-static void tjv_ValidateJson(const cJSON *json, tjv_ValidationStack *stack_parent, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr) {
+// Checks only the type of the value to skip the variants that can't match
+// without validating them
+static int tjv_ValidateJsonIsType(const tjv_JsonValue *json, tjv_ValidationElement *ve) {
+
+    if (tjv_JsonIsNull(json)) {
+        return ve->is_nullable || ve->type == TJV_VALIDATION_JSON;
+    }
+
+    switch (ve->type) {
+    case TJV_VALIDATION_STRING:
+        return tjv_JsonIsString(json);
+    case TJV_VALIDATION_INTEGER:
+    case TJV_VALIDATION_DOUBLE:
+        return tjv_JsonIsNumber(json);
+    case TJV_VALIDATION_BOOLEAN:
+        return tjv_JsonIsBool(json);
+    case TJV_VALIDATION_OBJECT:
+        return tjv_JsonIsObject(json);
+    case TJV_VALIDATION_ARRAY:
+        return tjv_JsonIsArray(json);
+    case TJV_VALIDATION_UNION:
+        return ve->opts.union_type.discriminator == NULL || tjv_JsonIsObject(json);
+    case TJV_VALIDATION_JSON:
+        break;
+    }
+
+    return 1;
 
-    UNUSED(outcome_ptr);
+}
+
+static tjv_WorkFrame *tjv_ValidateJsonUnion(tjv_JsonFrame *frame) {
+
+    const tjv_JsonValue *json = frame->json;
+    tjv_ValidationStack *stack = frame->stack;
+    tjv_ValidationElement *ve = frame->ve;
+    Tcl_Obj **error_message_ptr = frame->error_message_ptr;
+    Tcl_Obj **error_details_ptr = frame->error_details_ptr;
+    Tcl_Obj **outcome_ptr = frame->outcome_ptr;
+    Tcl_Obj *output = frame->base.ws->output;
+
+    tjv_ValidationElement **elements = ve->opts.union_type.elements;
+
+    if (frame->base.is_resumed) {
+        switch (frame->u.uni.mode) {
+        case TJV_UNION_TAGGED:
+        case TJV_UNION_SINGLE:
+            DBG2(printf("return: ok"));
+            return NULL;
+        case TJV_UNION_TRIAL:
+            goto trial;
+        }
+    }
 
     DBG2(printf("enter"));
 
-    tjv_ValidationStack stack = { NULL, NULL, (ve->flag == TJV_FLAG_SKIP_KEY ? INT2PTR(1) : ve->key), -1 };
-    if (stack_parent == NULL) {
-        stack.head = &stack;
-    } else {
-        stack.head = stack_parent->head;
-        stack_parent->next = &stack;
+    if (ve->is_nullable && tjv_JsonIsNull(json)) {
+        if (output != NULL) {
+            Tcl_AppendToObj(output, "null", 4);
+        }
+        DBG2(printf("return: ok (null can be accepted)"));
+        return NULL;
     }
 
-    switch (ve->type) {
+    if (ve->opts.union_type.discriminator != NULL) {
+
+        // Validate the value by the variant that is selected by the tag
+
+        if (!tjv_JsonIsObject(json)) {
+            tjv_MessageGenerateType(stack, "object", error_message_ptr, error_details_ptr);
+            DBG2(printf("return: error (not an object)"));
+            return NULL;
+        }
+
+        const tjv_JsonValue *tag = tjv_JsonGetObjectItem(json, Tcl_GetString(ve->opts.union_type.discriminator));
+        if (tag == NULL) {
+            DBG2(printf("return: error (no tag)"));
+            tjv_MessageGenerateRequired(stack, ve->opts.union_type.discriminator, error_message_ptr, error_details_ptr);
+            return NULL;
+        }
+
+        if (!tjv_JsonIsString(tag)) {
+            DBG2(printf("return: error (tag is not a string)"));
+            tjv_MessageGenerateMember(TJV_MSG_KEYWORD_TYPE, stack, ve->opts.union_type.discriminator,
+                Tcl_NewStringObj("should be string", -1), error_message_ptr, error_details_ptr);
+            return NULL;
+        }
+
+        Tcl_Size index = tjv_StringSetFind(ve->opts.union_type.tag_index, tag->str, tag->length);
+        if (index == -1) {
+            DBG2(printf("return: error (unknown tag [%.*s])", (int)tag->length, tag->str));
+            tjv_MessageGenerateMember(TJV_MSG_KEYWORD_VALUE, stack, ve->opts.union_type.discriminator,
+                Tcl_ObjPrintf("value is not one of the specified variants '%s'", Tcl_GetString(ve->opts.union_type.tags_list)),
+                error_message_ptr, error_details_ptr);
+            return NULL;
+        }
+
+        DBG2(printf("validate variant [%.*s]", (int)tag->length, tag->str));
+        frame->u.uni.mode = TJV_UNION_TAGGED;
+        return tjv_ValidateJsonPushShared(frame->base.ws, &frame->base, 1, stack, json, elements[index], elements[index]->type,
+            error_message_ptr, error_details_ptr, outcome_ptr);
+
+    }
+
+    // Find the variants that can match by the type of the value, the same
+    // as in tjv_ValidateTclUnion()
+
+    Tcl_Size candidate = -1;
+    Tcl_Size candidate_count = 0;
+    for (Tcl_Size i = 0; i < ve->opts.union_type.count; i++) {
+        if (tjv_ValidateJsonIsType(json, elements[i])) {
+            candidate = (candidate_count == 0 ? i : candidate);
+            candidate_count++;
+        }
+    }
+
+    DBG2(printf("candidates: %" TCL_SIZE_MODIFIER "d", candidate_count));
+
+    if (candidate_count == 0) {
+        Tcl_Obj *types = tjv_GetUnionTypeString(ve);
+        tjv_MessageGenerateType(stack, Tcl_GetString(types), error_message_ptr, error_details_ptr);
+        Tcl_BounceRefCount(types);
+        DBG2(printf("return: error (no candidates)"));
+        return NULL;
+    }
+
+    if (candidate_count == 1) {
+        DBG2(printf("validate the only candidate"));
+        frame->u.uni.mode = TJV_UNION_SINGLE;
+        return tjv_ValidateJsonPushShared(frame->base.ws, &frame->base, 1, stack, json, elements[candidate], elements[candidate]->type,
+            error_message_ptr, error_details_ptr, outcome_ptr);
+    }
+
+    // Each variant is validated with its own copy of the outcome. The copy
+    // and the cleaned value of the matched variant are kept, and they are
+    // discarded for other variants.
+
+    frame->u.uni.mode = TJV_UNION_TRIAL;
+    frame->u.uni.i = candidate;
+    frame->u.uni.matched = -1;
+    frame->u.uni.matched_outcome = NULL;
+    frame->u.uni.matched_cleaned = NULL;
+    goto next;
+
+trial:
+
+    // An array variant leaves its last index in the stack frame
+    stack->index = -1;
+
+    if (frame->u.uni.variant_message != NULL) {
+        DBG2(printf("variant #%" TCL_SIZE_MODIFIER "d doesn't match", frame->u.uni.i));
+        Tcl_BounceRefCount(frame->u.uni.variant_message);
+        Tcl_BounceRefCount(frame->u.uni.variant_details);
+        if (frame->u.uni.variant_outcome != NULL) {
+            Tcl_BounceRefCount(frame->u.uni.variant_outcome);
+        }
+        if (stack->cleaned != NULL) {
+            Tcl_BounceRefCount(stack->cleaned);
+            stack->cleaned = NULL;
+        }
+        if (output != NULL) {
+            Tcl_SetObjLength(output, frame->u.uni.output_length);
+        }
+        frame->u.uni.i++;
+        goto next;
+    }
+
+    DBG2(printf("variant #%" TCL_SIZE_MODIFIER "d matches", frame->u.uni.i));
+
+    if (frame->u.uni.matched != -1) {
+        if (stack->cleaned != NULL) {
+            Tcl_BounceRefCount(stack->cleaned);
+            stack->cleaned = NULL;
+        }
+        if (output != NULL) {
+            Tcl_SetObjLength(output, frame->u.uni.output_length);
+        }
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%" TCL_LL_MODIFIER "d and #%" TCL_LL_MODIFIER "d",
+            (Tcl_WideInt)frame->u.uni.matched, (Tcl_WideInt)frame->u.uni.i);
+        tjv_MessageGenerateValue(stack,
+            Tcl_ObjPrintf("value matches more than one variant: #%s", buf),
+            error_message_ptr, error_details_ptr);
+        DBG2(printf("error (more than one variant)"));
+        goto matched;
+    }
+
+    frame->u.uni.matched = frame->u.uni.i;
+    frame->u.uni.matched_outcome = frame->u.uni.variant_outcome;
+    frame->u.uni.matched_cleaned = stack->cleaned;
+    stack->cleaned = NULL;
+
+    if (!ve->opts.union_type.is_one_of) {
+        goto matched;
+    }
+
+    frame->u.uni.i++;
+
+next:
+
+    for (; frame->u.uni.i < ve->opts.union_type.count; frame->u.uni.i++) {
+
+        tjv_ValidationElement *variant = elements[frame->u.uni.i];
+
+        if (!tjv_ValidateJsonIsType(json, variant)) {
+            continue;
+        }
+
+        frame->u.uni.variant_message = NULL;
+        frame->u.uni.variant_details = NULL;
+        frame->u.uni.variant_outcome = NULL;
+        if (outcome_ptr != NULL && frame->u.uni.matched == -1) {
+            frame->u.uni.variant_outcome = Tcl_DuplicateObj(*outcome_ptr);
+        }
+        if (output != NULL) {
+            Tcl_GetStringFromObj(output, &frame->u.uni.output_length);
+        }
+
+        return tjv_ValidateJsonPushShared(frame->base.ws, &frame->base, 1, stack, json, variant, variant->type,
+            &frame->u.uni.variant_message, &frame->u.uni.variant_details,
+            (frame->u.uni.variant_outcome == NULL ? NULL : &frame->u.uni.variant_outcome));
+
+    }
+
+matched:
+
+    if (frame->u.uni.matched == -1) {
+        tjv_MessageGenerateValue(stack,
+            Tcl_NewStringObj("value does not match any of the variants", -1),
+            error_message_ptr, error_details_ptr);
+        DBG2(printf("return: error (no variants)"));
+        return NULL;
+    }
+
+    stack->cleaned = frame->u.uni.matched_cleaned;
+
+    if (frame->u.uni.matched_outcome != NULL) {
+        Tcl_Obj *outcome = *outcome_ptr;
+        *outcome_ptr = frame->u.uni.matched_outcome;
+        Tcl_BounceRefCount(outcome);
+    }
+
+    DBG2(printf("return: ok"));
+    return NULL;
+
+}
+
+// Runs the frame until it pushes a child frame or is done. Returns the frame
+// that should run next.
+static tjv_WorkFrame *tjv_ValidateJsonStep(tjv_WorkFrame *base) {
+
+    tjv_JsonFrame *frame = (tjv_JsonFrame *)base;
+    tjv_WorkFrame *child = NULL;
+
+    if (!base->is_resumed) {
+        if (base->ws->is_aborted) {
+            DBG2(printf("aborted"));
+            goto pop;
+        }
+        if (frame->stack->depth > TJV_VALIDATION_MAX_DEPTH) {
+            DBG2(printf("too deep"));
+            tjv_MessageGenerateLimit(frame->stack, "value is nested deeper than the maximum depth %s",
+                TJV_VALIDATION_MAX_DEPTH, frame->error_message_ptr, frame->error_details_ptr);
+            goto pop;
+        }
+    }
+
+    switch (frame->type) {
     case TJV_VALIDATION_STRING:
-        tjv_ValidateJsonString(json, &stack, ve, error_message_ptr, error_details_ptr, outcome_ptr);
+        tjv_ValidateJsonString(frame->json, base->ws->output, frame->stack, frame->ve, frame->error_message_ptr, frame->error_details_ptr, frame->outcome_ptr);
         break;
     case TJV_VALIDATION_INTEGER:
-        tjv_ValidateJsonInteger(json, &stack, ve, error_message_ptr, error_details_ptr, outcome_ptr);
+        tjv_ValidateJsonInteger(frame->json, base->ws->output, frame->stack, frame->ve, frame->error_message_ptr, frame->error_details_ptr, frame->outcome_ptr);
         break;
     case TJV_VALIDATION_JSON:
-        // tjv_ValidateJsonJson(json, &stack, ve, error_message_ptr, error_details_ptr);
+        // tjv_ValidateJsonJson(json, stack, ve, error_message_ptr, error_details_ptr);
+        if (base->ws->output != NULL) {
+            tjv_JsonAppendValue(base->ws->output, frame->json);
+        }
         break;
     case TJV_VALIDATION_OBJECT:
-        tjv_ValidateJsonObject(json, &stack, ve, error_message_ptr, error_details_ptr, outcome_ptr);
+        child = tjv_ValidateJsonObject(frame);
         break;
     case TJV_VALIDATION_ARRAY:
-        tjv_ValidateJsonArray(json, &stack, ve, error_message_ptr, error_details_ptr, outcome_ptr);
+        child = tjv_ValidateJsonArray(frame);
         break;
     case TJV_VALIDATION_BOOLEAN:
-        tjv_ValidateJsonBoolean(json, &stack, ve, error_message_ptr, error_details_ptr, outcome_ptr);
+        tjv_ValidateJsonBoolean(frame->json, base->ws->output, frame->stack, frame->ve, frame->error_message_ptr, frame->error_details_ptr, frame->outcome_ptr);
         break;
     case TJV_VALIDATION_DOUBLE:
-        tjv_ValidateJsonDouble(json, &stack, ve, error_message_ptr, error_details_ptr, outcome_ptr);
+        tjv_ValidateJsonDouble(frame->json, base->ws->output, frame->stack, frame->ve, frame->error_message_ptr, frame->error_details_ptr, frame->outcome_ptr);
+        break;
+    case TJV_VALIDATION_UNION:
+        child = tjv_ValidateJsonUnion(frame);
         break;
     }
 
-    if (stack_parent != NULL) {
-        stack_parent->next = NULL;
+    if (child != NULL) {
+        return child;
+    }
+
+pop:
+
+    return tjv_ValidateJsonPop(frame);
+
+}
+
+// Pushes the frame for the root value of the json element. The root value
+// is validated in the stack frame of the element. Returns NULL if the value
+// doesn't need validation.
+static tjv_WorkFrame *tjv_ValidateJsonPushRoot(tjv_WorkStack *ws, tjv_WorkFrame *parent, const tjv_JsonValue *root, tjv_ValidationStack *stack, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr) {
+
+    switch (ve->flag) {
+    case TJV_FLAG_JSON_TYPE_ARRAY:
+        DBG2(printf("validate json array"));
+        return tjv_ValidateJsonPushShared(ws, parent, 0, stack, root, ve, TJV_VALIDATION_ARRAY,
+            error_message_ptr, error_details_ptr, outcome_ptr);
+    case TJV_FLAG_JSON_TYPE_OBJECT:
+        DBG2(printf("validate json object"));
+        return tjv_ValidateJsonPushShared(ws, parent, 0, stack, root, ve, TJV_VALIDATION_OBJECT,
+            error_message_ptr, error_details_ptr, outcome_ptr);
+    case TJV_FLAG_JSON_TYPE_UNION:
+        DBG2(printf("validate json union"));
+        return tjv_ValidateJsonPushShared(ws, parent, 0, stack, root, ve, TJV_VALIDATION_UNION,
+            error_message_ptr, error_details_ptr, outcome_ptr);
+    case TJV_FLAG_NONE:
+    case TJV_FLAG_SKIP_KEY:
+        break;
+    }
+
+    DBG2(printf("no need to validate json"));
+    if (ws->output != NULL) {
+        tjv_JsonAppendValue(ws->output, root);
+    }
+    return NULL;
+
+}
+
+// Reports the data that is not a valid JSON
+static void tjv_ValidateTclJsonParseError(tjv_JsonDocument *doc, tjv_ValidationStack *stack, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr) {
+    UNUSED(doc);
+    DBG2(printf("json parse error: %s at %" TCL_SIZE_MODIFIER "d", doc->error, doc->error_offset));
+    tjv_MessageGenerateType(stack, tjv_GetValidationTypeString(ve->type_ex), error_message_ptr, error_details_ptr);
+}
+
+void tjv_ValidateTclJsonEnd(Tcl_Obj *data, tjv_JsonDocument *doc, tjv_ValidationStack *stack, tjv_ValidationElement *ve, Tcl_Obj **outcome_ptr) {
+
+    tjv_JsonFree(doc);
+
+    if (stack->cleaned != NULL) {
+        ADD_OUTCOME(stack->cleaned);
+    } else {
+        ADD_OUTCOME(data);
     }
 
     DBG2(printf("return: ok"));
 
 }
 
-void tjv_ValidateTclJson(Tcl_Obj *data, tjv_ValidationStack *stack, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr) {
+tjv_WorkFrame *tjv_ValidateTclJsonBegin(tjv_WorkFrame *parent, Tcl_Obj *data, tjv_JsonDocument *doc, tjv_ValidationStack *stack, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr) {
 
     DBG2(printf("enter"));
 
@@ -384,33 +1577,142 @@ void tjv_ValidateTclJson(Tcl_Obj *data, tjv_ValidationStack *stack, tjv_Validati
     const char *json_string = Tcl_GetStringFromObj(data, &length);
     DBG2(printf("parse json: [%s]", json_string));
 
-    const cJSON *json = cJSON_ParseWithLength(json_string, length);
-    if (json == NULL) {
-        DBG2(printf("json parse error near: %s", cJSON_GetErrorPtr()));
-        tjv_MessageGenerateType(stack, tjv_GetValidationTypeString(ve->type_ex), error_message_ptr, error_details_ptr);
+    if (tjv_JsonParse(doc, json_string, length, TJV_JSON_SCAN_MODIFIED_UTF8) != TCL_OK) {
+        tjv_ValidateTclJsonParseError(doc, stack, ve, error_message_ptr, error_details_ptr);
         DBG2(printf("return: error"));
+        return NULL;
+    }
+
+    tjv_WorkFrame *frame = tjv_ValidateJsonPushRoot(parent->ws, parent, doc->root, stack, ve,
+        error_message_ptr, error_details_ptr, outcome_ptr);
+    if (frame == NULL) {
+        tjv_ValidateTclJsonEnd(data, doc, stack, ve, outcome_ptr);
+    }
+
+    return frame;
+
+}
+
+void tjv_ValidateTclJsonParsed(Tcl_Obj *data, tjv_JsonDocument *doc, int parse_result, tjv_ValidationStack *stack_parent, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr) {
+
+    DBG2(printf("enter"));
+
+    // The stack frame of the value, the same as tjv_ValidateTcl() uses
+    tjv_ValidationStack stack;
+    stack.head = stack_parent->head;
+    stack.next = NULL;
+    stack.key = (ve->flag == TJV_FLAG_SKIP_KEY ? INT2PTR(1) : ve->key);
+    stack.index = -1;
+    stack.cleaned = NULL;
+    stack.child_cleaned = NULL;
+    stack.depth = stack_parent->depth + 1;
+    stack_parent->next = &stack;
+
+    if (parse_result != TCL_OK) {
+        tjv_ValidateTclJsonParseError(doc, &stack, ve, error_message_ptr, error_details_ptr);
+    } else {
+        tjv_WorkFrame *frame = tjv_ValidateJsonPushRoot(tjv_WorkStackGet(), NULL, doc->root, &stack, ve,
+            error_message_ptr, error_details_ptr, outcome_ptr);
+        tjv_WorkStackRun(frame, NULL);
+        tjv_ValidateTclJsonEnd(data, doc, &stack, ve, outcome_ptr);
+    }
+
+    stack_parent->next = NULL;
+    stack_parent->child_cleaned = stack.cleaned;
+
+}
+
+void tjv_ValidateJsonDocument(tjv_JsonDocument *doc, int parse_result, const char *format, tjv_ValidationStack *stack_parent, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr) {
+
+    DBG2(printf("enter: format: %s", format));
+
+    if (parse_result != TCL_OK) {
+        DBG2(printf("%s decode error: %s at %" TCL_SIZE_MODIFIER "d", format, doc->error, doc->error_offset));
+        // The stack frame of the value, the same as tjv_ValidateTclJsonParsed() uses
+        tjv_ValidationStack stack;
+        stack.head = stack_parent->head;
+        stack.next = NULL;
+        stack.key = (ve->flag == TJV_FLAG_SKIP_KEY ? INT2PTR(1) : ve->key);
+        stack.index = -1;
+        stack.cleaned = NULL;
+        stack.child_cleaned = NULL;
+        stack.depth = stack_parent->depth + 1;
+        stack_parent->next = &stack;
+        tjv_MessageGenerateType(&stack, format, error_message_ptr, error_details_ptr);
+        stack_parent->next = NULL;
+        tjv_JsonFree(doc);
         return;
     }
 
-    switch (ve->flag) {
-    case TJV_FLAG_JSON_TYPE_ARRAY:
-        DBG2(printf("validate json array"));
-        tjv_ValidateJsonArray(json, stack, ve, error_message_ptr, error_details_ptr, outcome_ptr);
-        break;
-    case TJV_FLAG_JSON_TYPE_OBJECT:
-        DBG2(printf("validate json object"));
-        tjv_ValidateJsonObject(json, stack, ve, error_message_ptr, error_details_ptr, outcome_ptr);
-        break;
-    case TJV_FLAG_NONE:
-    case TJV_FLAG_SKIP_KEY:
-        DBG2(printf("no need to validate json"));
-        break;
+    if (ve->type != TJV_VALIDATION_JSON) {
+        tjv_ValidateJsonValue(doc->root, stack_parent, ve, error_message_ptr, error_details_ptr, outcome_ptr);
+        tjv_JsonFree(doc);
+        return;
     }
 
-    cJSON_Delete((cJSON *)json);
+    // The element of the json type adds the JSON text of the value to
+    // the outcome. There is no source text, so it is generated.
+    Tcl_Obj *data = NULL;
+    if (ve->outkey != NULL && outcome_ptr != NULL) {
+        data = Tcl_NewObj();
+        tjv_JsonAppendValue(data, doc->root);
+    }
 
-    ADD_OUTCOME(data);
+    tjv_ValidateTclJsonParsed(data, doc, TCL_OK, stack_parent, ve, error_message_ptr, error_details_ptr, outcome_ptr);
 
-    DBG2(printf("return: ok"));
+    if (data != NULL) {
+        Tcl_BounceRefCount(data);
+    }
+
+}
+
+void tjv_ValidateJsonRootDocument(Tcl_Obj *data, tjv_JsonDocument *doc, int parse_result, const char *format, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr) {
+
+    // The stack frame that doesn't add anything to the paths, so they
+    // are the same as in a single validation
+    tjv_ValidationStack stack;
+    stack.head = &stack;
+    stack.next = NULL;
+    stack.key = NULL;
+    stack.index = -1;
+    stack.depth = -1;
+    stack.cleaned = NULL;
+    stack.child_cleaned = NULL;
+
+    if (format == NULL) {
+        tjv_ValidateTclJsonParsed(data, doc, parse_result, &stack, ve, error_message_ptr, error_details_ptr, outcome_ptr);
+    } else {
+        tjv_ValidateJsonDocument(doc, parse_result, format, &stack, ve, error_message_ptr, error_details_ptr, outcome_ptr);
+    }
+
+    if (stack.child_cleaned != NULL) {
+        Tcl_BounceRefCount(stack.child_cleaned);
+    }
+
+}
+
+void tjv_ValidateJsonRootText(const char *json, Tcl_Size length, tjv_JsonDocument *doc, int parse_result, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr) {
+
+    // The text is a part of the outcome only if the root element has
+    // an outkey
+    Tcl_Obj *data = (ve->outkey == NULL ? NULL : Tcl_NewStringObj(json, length));
+
+    tjv_ValidateJsonRootDocument(data, doc, parse_result, NULL, ve, error_message_ptr, error_details_ptr, outcome_ptr);
+
+    if (data != NULL) {
+        Tcl_BounceRefCount(data);
+    }
+
+}
+
+void tjv_ValidateJsonValue(const tjv_JsonValue *json, tjv_ValidationStack *stack_parent, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr) {
+    tjv_WorkFrame *frame = tjv_ValidateJsonPush(tjv_WorkStackGet(), NULL, stack_parent, json, ve,
+        error_message_ptr, error_details_ptr, outcome_ptr);
+    tjv_WorkStackRun(frame, NULL);
+}
 
+void tjv_ValidateJsonRoot(const tjv_JsonValue *json, tjv_ValidationStack *stack, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr) {
+    tjv_WorkFrame *frame = tjv_ValidateJsonPushRoot(tjv_WorkStackGet(), NULL, json, stack, ve,
+        error_message_ptr, error_details_ptr, outcome_ptr);
+    tjv_WorkStackRun(frame, NULL);
 }
@@ -8,12 +8,42 @@
 
 #include "common.h"
 #include "tjvCompile.h"
+#include "tjvJson.h"
+#include "tjvWorkStack.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-void tjv_ValidateTclJson(Tcl_Obj *data, tjv_ValidationStack *stack_parent, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr);
+// Parses the data of the json type to the document and pushes the frame for
+// its root value. The parent frame is resumed when the value is validated,
+// and then it should call tjv_ValidateTclJsonEnd(). Returns NULL if there is
+// nothing to validate, the document is already freed then.
+tjv_WorkFrame *tjv_ValidateTclJsonBegin(tjv_WorkFrame *parent, Tcl_Obj *data, tjv_JsonDocument *doc, tjv_ValidationStack *stack, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr);
+// Frees the document and adds the value to the outcome
+void tjv_ValidateTclJsonEnd(Tcl_Obj *data, tjv_JsonDocument *doc, tjv_ValidationStack *stack, tjv_ValidationElement *ve, Tcl_Obj **outcome_ptr);
+// Validates a JSON value that is a member or an element of a container with
+// the stack frame stack_parent, e.g. a value of a JSON stream. The cleaned
+// value is left in stack_parent->child_cleaned.
+void tjv_ValidateJsonValue(const tjv_JsonValue *json, tjv_ValidationStack *stack_parent, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr);
+// Validates the root value of the json element in its stack frame. The value
+// is not added to the outcome, and the cleaned value is left in stack->cleaned.
+void tjv_ValidateJsonRoot(const tjv_JsonValue *json, tjv_ValidationStack *stack, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr);
+// Validates the data of the json type that is already parsed to the document
+// with the specified result of tjv_JsonParse(). The document is freed.
+void tjv_ValidateTclJsonParsed(Tcl_Obj *data, tjv_JsonDocument *doc, int parse_result, tjv_ValidationStack *stack_parent, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr);
+// Validates the value that is decoded from another format, e.g. MessagePack,
+// to the document with the specified result of the decoder. A decode error is
+// reported as a value that is not of the format. The document is freed.
+void tjv_ValidateJsonDocument(tjv_JsonDocument *doc, int parse_result, const char *format, tjv_ValidationStack *stack_parent, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr);
+// Validates the document as the root value, so the paths are the same as in
+// a single validation. The document is parsed from the JSON text data if
+// format is NULL (see tjv_ValidateTclJsonParsed()), or decoded from format
+// otherwise (see tjv_ValidateJsonDocument()). The document is freed.
+void tjv_ValidateJsonRootDocument(Tcl_Obj *data, tjv_JsonDocument *doc, int parse_result, const char *format, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr);
+// The same as tjv_ValidateJsonRootDocument() for the document parsed from
+// the JSON text that is not a Tcl object yet
+void tjv_ValidateJsonRootText(const char *json, Tcl_Size length, tjv_JsonDocument *doc, int parse_result, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr);
 
 #ifdef __cplusplus
 }
@@ -7,28 +7,762 @@
 #include "tjvValidateTcl.h"
 #include "tjvValidateJson.h"
 #include "tjvMessage.h"
+#include "tjvJsonScan.h"
+#include "tjvWorkStack.h"
+#include "tjvForm.h"
+#include "tjvJsonNumber.h"
+#include <math.h>
+
+// Dicts with at most 1/TJV_DICT_ITERATE_RATIO of the schema keys are
+// validated in one pass over the dict. Schemas with fewer than
+// TJV_DICT_ITERATE_MIN_KEYS keys are always validated by lookups.
+#define TJV_DICT_ITERATE_RATIO 2
+#define TJV_DICT_ITERATE_MIN_KEYS 8
+
+typedef struct {
+    Tcl_Size index;
+    Tcl_Obj *value;
+} tjv_DictValue;
+
+typedef enum {
+    TJV_UNION_TAGGED,
+    TJV_UNION_SINGLE,
+    TJV_UNION_TRIAL
+} tjv_UnionMode;
+
+typedef struct tjv_TclFrame tjv_TclFrame;
+
+// A frame of the work stack
+struct tjv_TclFrame {
+
+    tjv_WorkFrame base;
+
+    Tcl_Obj *data;
+    tjv_ValidationElement *ve;
+
+    Tcl_Obj **error_message_ptr;
+    Tcl_Obj **error_details_ptr;
+    Tcl_Obj **outcome_ptr;
+
+    // The stack frame for error paths. It is stack_own, or the frame of
+    // the union for its variants.
+    tjv_ValidationStack *stack;
+    tjv_ValidationStack *stack_parent;
+    tjv_ValidationStack stack_own;
+
+    int is_variant;
+
+    union {
+        struct {
+            Tcl_Size size;
+            // The number of dict keys that are found in the schema
+            Tcl_Size found;
+            // The copy of the dict with cleaned values or stripped keys
+            Tcl_Obj *cleaned;
+            // The key of the validated child
+            Tcl_Obj *key;
+            Tcl_Size i;
+            // The values that are found in one pass over the dict, and
+            // the index of the next schema key to check if it is required
+            int is_iterate;
+            tjv_DictValue *values;
+            Tcl_Size count;
+            Tcl_Size next;
+            // The dict that is validated instead of the data: the dict parsed
+            // from form data or the scratch copy of the data in the preserve
+            // mode. It is held by the frame until the object is validated.
+            Tcl_Obj *dict;
+            // The child is the default value of a missing key, it is only
+            // validated for the JSON output
+            int is_default;
+        } obj;
+        struct {
+            Tcl_Size objc;
+            Tcl_Obj **objv;
+            // The scratch copy of the data that is validated instead of it
+            // in the preserve mode
+            Tcl_Obj *list;
+            Tcl_Obj *result_outcome;
+            Tcl_Obj *item_outcome;
+            // The copy of the list with cleaned elements
+            Tcl_Obj *cleaned;
+        } arr;
+        struct {
+            tjv_UnionMode mode;
+            Tcl_Size i;
+            Tcl_Size matched;
+            Tcl_Obj *matched_outcome;
+            Tcl_Obj *matched_cleaned;
+            Tcl_Obj *variant_message;
+            Tcl_Obj *variant_details;
+            Tcl_Obj *variant_outcome;
+            // The length of the JSON output before the variant, the output
+            // of the variant is discarded if it doesn't match
+            Tcl_Size output_length;
+        } uni;
+        struct {
+            // The parsed value of the json type, while its frames run
+            tjv_JsonDocument doc;
+        } json;
+    } u;
+
+};
+
+static tjv_WorkFrame *tjv_ValidateTclStep(tjv_WorkFrame *base);
+
+// Tcl object types of numbers and booleans. Values of these types are read
+// without conversion. They are NULL if Tcl doesn't have such types.
+static const Tcl_ObjType *tjv_int_type = NULL;
+static const Tcl_ObjType *tjv_wide_int_type = NULL;
+static const Tcl_ObjType *tjv_double_type = NULL;
+static const Tcl_ObjType *tjv_boolean_type = NULL;
+static const Tcl_ObjType *tjv_boolean_string_type = NULL;
+static const Tcl_ObjType *tjv_dict_type = NULL;
+static const Tcl_ObjType *tjv_list_type = NULL;
+
+static int tjv_validatetcl_initialized = 0;
+static Tcl_Mutex tjv_validatetcl_initialize_mx;
+
+void tjv_ValidateTclInit(void) {
+
+    Tcl_MutexLock(&tjv_validatetcl_initialize_mx);
+
+    if (!tjv_validatetcl_initialized) {
+        DBG2(printf("enter..."));
+        tjv_int_type = Tcl_GetObjType("int");
+        tjv_wide_int_type = Tcl_GetObjType("wideInt");
+        tjv_double_type = Tcl_GetObjType("double");
+        tjv_boolean_type = Tcl_GetObjType("boolean");
+        tjv_boolean_string_type = Tcl_GetObjType("booleanString");
+        tjv_dict_type = Tcl_GetObjType("dict");
+        tjv_list_type = Tcl_GetObjType("list");
+        tjv_validatetcl_initialized = 1;
+        DBG2(printf("return: ok"));
+    }
+
+    Tcl_MutexUnlock(&tjv_validatetcl_initialize_mx);
+
+}
+
+#define TJV_IS_OBJ_TYPE(obj, type) ((type) != NULL && (obj)->typePtr == (type))
+#define TJV_IS_OBJ_INT(obj) (TJV_IS_OBJ_TYPE((obj), tjv_int_type) || TJV_IS_OBJ_TYPE((obj), tjv_wide_int_type))
+
+// Parses an integer in the plain decimal form, the most common one in data.
+// Returns 0 for any other form, such as hexadecimal numbers or numbers with
+// leading zeros or spaces, and for numbers that may not fit, so they should
+// be parsed by Tcl.
+static int tjv_ValidateTclParseWideInt(const char *str, Tcl_Size length, Tcl_WideInt *val) {
+
+    const char *end = str + length;
+
+    int is_negative = 0;
+    if (str < end && (*str == '-' || *str == '+')) {
+        is_negative = (*str == '-');
+        str++;
+    }
+
+    // 18 digits always fit in 64 bits
+    Tcl_Size digits = end - str;
+    if (digits == 0 || digits > 18 || (*str == '0' && digits > 1)) {
+        return 0;
+    }
+
+    Tcl_WideInt result = 0;
+    for (; str < end; str++) {
+        if (*str < '0' || *str > '9') {
+            return 0;
+        }
+        result = result * 10 + (*str - '0');
+    }
+
+    *val = (is_negative ? -result : result);
+    return 1;
+
+}
+
+// Numbers in the JSON form are parsed in the same way as in JSON text, and
+// Tcl parses them to the same values
+static int tjv_ValidateTclParseDouble(const char *str, Tcl_Size length, double *val) {
+
+    if (length == 0 || !(*str == '-' || (*str >= '0' && *str <= '9'))) {
+        return 0;
+    }
+
+    tjv_JsonValue number;
+    const char *error;
+    if (tjv_JsonParseScalar(&number, str, length, NULL, &error) != TCL_OK) {
+        return 0;
+    }
+
+    *val = tjv_JsonGetNumberValue(&number);
+    return isfinite(*val);
+
+}
+
+// The following functions get the value in the same way as Tcl_GetWideIntFromObj(),
+// Tcl_GetDoubleFromObj() and Tcl_GetBooleanFromObj(). If is_preserve is set,
+// they don't change the internal representation of the data. If the data is
+// not of a suitable type already, its string representation is parsed. Values
+// in the forms that are not parsed here are parsed by Tcl in a scratch copy.
+
+static int tjv_ValidateTclGetWideInt(Tcl_Obj *data, int is_preserve, Tcl_WideInt *val) {
+    if (!is_preserve || TJV_IS_OBJ_INT(data)) {
+        return Tcl_GetWideIntFromObj(NULL, data, val);
+    }
+    Tcl_Size length;
+    const char *str = Tcl_GetStringFromObj(data, &length);
+    if (tjv_ValidateTclParseWideInt(str, length, val)) {
+        return TCL_OK;
+    }
+    Tcl_Obj *scratch = Tcl_NewStringObj(str, length);
+    int rc = Tcl_GetWideIntFromObj(NULL, scratch, val);
+    Tcl_BounceRefCount(scratch);
+    return rc;
+}
+
+static int tjv_ValidateTclGetDouble(Tcl_Obj *data, int is_preserve, double *val) {
+    if (!is_preserve || TJV_IS_OBJ_TYPE(data, tjv_double_type) || TJV_IS_OBJ_INT(data)) {
+        return Tcl_GetDoubleFromObj(NULL, data, val);
+    }
+    Tcl_Size length;
+    const char *str = Tcl_GetStringFromObj(data, &length);
+    if (tjv_ValidateTclParseDouble(str, length, val)) {
+        return TCL_OK;
+    }
+    Tcl_Obj *scratch = Tcl_NewStringObj(str, length);
+    int rc = Tcl_GetDoubleFromObj(NULL, scratch, val);
+    Tcl_BounceRefCount(scratch);
+    return rc;
+}
+
+static int tjv_ValidateTclGetBoolean(Tcl_Obj *data, int is_preserve, int *val) {
+    if (!is_preserve || TJV_IS_OBJ_TYPE(data, tjv_boolean_type) || TJV_IS_OBJ_TYPE(data, tjv_boolean_string_type) ||
+        TJV_IS_OBJ_INT(data))
+    {
+        return Tcl_GetBooleanFromObj(NULL, data, val);
+    }
+    Tcl_Size length;
+    const char *str = Tcl_GetStringFromObj(data, &length);
+    Tcl_Obj *scratch = Tcl_NewStringObj(str, length);
+    int rc = Tcl_GetBooleanFromObj(NULL, scratch, val);
+    Tcl_BounceRefCount(scratch);
+    return rc;
+}
+
+// In the preserve mode, a value that has the internal representation of
+// another type is converted to a dict or a list in a scratch copy. Returns
+// the copy, or NULL if the value can be converted as is: it is already of
+// this type or has only the string representation, so nothing is lost.
+static Tcl_Obj *tjv_ValidateTclScratch(Tcl_Obj *data, const Tcl_ObjType *type) {
+    if (data->typePtr == NULL || TJV_IS_OBJ_TYPE(data, type)) {
+        return NULL;
+    }
+    DBG2(printf("scratch copy of %s value", data->typePtr->name));
+    Tcl_Obj *scratch = Tcl_DuplicateObj(data);
+    Tcl_IncrRefCount(scratch);
+    return scratch;
+}
+
+// Returns a new object with the canonical form of a list element to check
+// if elements are unique. Numbers and booleans are compared by their values
+// if the elements are declared as such. All other values, including dicts,
+// are compared by their string representations.
+static Tcl_Obj *tjv_ValidateTclArrayCanonical(Tcl_Obj *data, tjv_ValidationElement *element, int is_preserve) {
+
+    if (element != NULL) {
+        switch (element->type) {
+        case TJV_VALIDATION_INTEGER: ; // empty statement
+            Tcl_WideInt wide_val;
+            if (tjv_ValidateTclGetWideInt(data, is_preserve, &wide_val) == TCL_OK) {
+                return Tcl_NewWideIntObj(wide_val);
+            }
+            break;
+        case TJV_VALIDATION_DOUBLE: ; // empty statement
+            double double_val;
+            if (tjv_ValidateTclGetDouble(data, is_preserve, &double_val) == TCL_OK) {
+                // Make sure that 0.0 and -0.0 are the same
+                if (double_val == 0) {
+                    double_val = 0;
+                }
+                char buf[32];
+                snprintf(buf, sizeof(buf), "%.17g", double_val);
+                return Tcl_NewStringObj(buf, -1);
+            }
+            break;
+        case TJV_VALIDATION_BOOLEAN: ; // empty statement
+            int bool_val;
+            if (tjv_ValidateTclGetBoolean(data, is_preserve, &bool_val) == TCL_OK) {
+                return Tcl_NewIntObj(bool_val);
+            }
+            break;
+        case TJV_VALIDATION_STRING:
+        case TJV_VALIDATION_JSON:
+        case TJV_VALIDATION_OBJECT:
+        case TJV_VALIDATION_ARRAY:
+        case TJV_VALIDATION_UNION:
+            break;
+        }
+    }
+
+    Tcl_Size length;
+    const char *str = Tcl_GetStringFromObj(data, &length);
+    return Tcl_NewStringObj(str, length);
+
+}
+
+// Reports the first element that is equal to one of the previous elements
+static void tjv_ValidateTclArrayUnique(Tcl_Size objc, Tcl_Obj **objv, int is_preserve, tjv_ValidationStack *stack, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr) {
+
+    Tcl_HashTable seen;
+    Tcl_InitObjHashTable(&seen);
+
+    for (Tcl_Size i = 0; i < objc; i++) {
+
+        Tcl_Obj *canonical = tjv_ValidateTclArrayCanonical(objv[i], ve->opts.array_type.element, is_preserve);
+
+        int is_new;
+        Tcl_HashEntry *entry = Tcl_CreateHashEntry(&seen, (char *)canonical, &is_new);
+        // The hash table holds a reference to the key if it was added
+        Tcl_BounceRefCount(canonical);
+
+        if (is_new) {
+            Tcl_SetHashValue(entry, INT2PTR(i));
+            continue;
+        }
+
+        DBG2(printf("duplicate element #%" TCL_SIZE_MODIFIER "d", i));
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%" TCL_LL_MODIFIER "d and #%" TCL_LL_MODIFIER "d",
+            (Tcl_WideInt)PTR2INT(Tcl_GetHashValue(entry)), (Tcl_WideInt)i);
+        tjv_MessageGenerateValue(stack,
+            Tcl_ObjPrintf("value has duplicate items #%s", buf),
+            error_message_ptr, error_details_ptr);
+        break;
+
+    }
+
+    Tcl_DeleteHashTable(&seen);
+
+}
+
+// Puts the cleaned value of the last validated child to the cleaned copy
+// of the dict. The copy is created when it is needed for the first time.
+static inline void tjv_ValidateTclObjectChildCleaned(Tcl_Obj *data, Tcl_Obj *key, tjv_ValidationStack *stack, Tcl_Obj **cleaned_ptr) {
+
+    if (stack->child_cleaned == NULL) {
+        return;
+    }
+
+    DBG2(printf("key [%s] has cleaned value", Tcl_GetString(key)));
+
+    if (*cleaned_ptr == NULL) {
+        *cleaned_ptr = Tcl_DuplicateObj(data);
+    }
+    Tcl_DictObjPut(NULL, *cleaned_ptr, key, stack->child_cleaned);
+    stack->child_cleaned = NULL;
+
+}
+
+// Reports or strips the dict keys that are not in the schema
+static void tjv_ValidateTclObjectAdditional(Tcl_Obj *data, tjv_ValidationStack *stack, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **cleaned_ptr) {
+
+    Tcl_DictSearch search;
+    Tcl_Obj *key, *value;
+    int is_done;
+
+    Tcl_DictObjFirst(NULL, data, &search, &key, &value, &is_done);
+    for (; !is_done; Tcl_DictObjNext(&search, &key, &value, &is_done)) {
+
+        Tcl_Size length;
+        const char *str = Tcl_GetStringFromObj(key, &length);
+        if (ve->opts.obj_type.key_index != NULL &&
+            tjv_StringSetFind(ve->opts.obj_type.key_index, str, length) != -1)
+        {
+            continue;
+        }
+
+        if (ve->opts.obj_type.additional == TJV_ADDITIONAL_DENY) {
+            DBG2(printf("unknown key: [%s] (ERROR)", str));
+            tjv_MessageGenerateAdditional(stack, str, error_message_ptr, error_details_ptr);
+        } else {
+            DBG2(printf("unknown key: [%s] (strip)", str));
+            if (*cleaned_ptr == NULL) {
+                *cleaned_ptr = Tcl_DuplicateObj(data);
+            }
+            Tcl_DictObjRemove(NULL, *cleaned_ptr, key);
+        }
+
+    }
+    Tcl_DictObjDone(&search);
+
+}
+
+// Reports missing required keys with indexes from..to-1
+static void tjv_ValidateTclObjectRequired(tjv_ValidationElement *ve, Tcl_Size from, Tcl_Size to, tjv_ValidationStack *stack, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr) {
+
+    const uint64_t *bits = ve->opts.obj_type.required_bits;
+
+    Tcl_Size i = from;
+    while (i < to) {
+        uint64_t word = bits[i / 64] >> (i % 64);
+        if (word == 0) {
+            i = (i / 64 + 1) * 64;
+            continue;
+        }
+        i += TJV_CTZ64(word);
+        if (i >= to) {
+            break;
+        }
+        tjv_ValidationElement *element = ve->opts.obj_type.elements[i];
+        DBG2(printf("check key: [%s] - doesn't exist (ERROR)", Tcl_GetString(element->key)));
+        tjv_MessageGenerateRequired(stack, element->key, error_message_ptr, error_details_ptr);
+        i++;
+    }
+
+}
+
+// Appends the dict without schema keys to the JSON output. Its values are
+// appended as strings, since their types are not known.
+static void tjv_ValidateTclOutputDict(Tcl_Obj *output, Tcl_Obj *data) {
 
-static inline void tjv_ValidateTclObject(Tcl_Obj *data, tjv_ValidationStack *stack, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr) {
+    Tcl_DictSearch search;
+    Tcl_Obj *key, *value;
+    int is_done;
+
+    Tcl_AppendToObj(output, "{", 1);
+
+    Tcl_DictObjFirst(NULL, data, &search, &key, &value, &is_done);
+    for (; !is_done; Tcl_DictObjNext(&search, &key, &value, &is_done)) {
+        tjv_JsonAppendKey(output, key);
+        Tcl_Size length;
+        const char *str = Tcl_GetStringFromObj(value, &length);
+        tjv_JsonAppendString(output, str, length);
+    }
+    Tcl_DictObjDone(&search);
+
+    Tcl_AppendToObj(output, "}", 1);
+
+}
+
+// Appends the list without the schema of its elements to the JSON output
+// as an array of strings
+static void tjv_ValidateTclOutputList(Tcl_Obj *output, Tcl_Size objc, Tcl_Obj **objv) {
+
+    Tcl_AppendToObj(output, "[", 1);
+
+    for (Tcl_Size i = 0; i < objc; i++) {
+        if (i > 0) {
+            Tcl_AppendToObj(output, ",", 1);
+        }
+        Tcl_Size length;
+        const char *str = Tcl_GetStringFromObj(objv[i], &length);
+        tjv_JsonAppendString(output, str, length);
+    }
+
+    Tcl_AppendToObj(output, "]", 1);
+
+}
+
+static tjv_WorkFrame *tjv_ValidateTclPush(tjv_WorkStack *ws, tjv_WorkFrame *parent, tjv_ValidationStack *stack_parent, Tcl_Obj *data, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr) {
+
+    tjv_TclFrame *frame = tjv_WorkStackPush(ws, sizeof(tjv_TclFrame));
+
+    frame->base.step = tjv_ValidateTclStep;
+    frame->base.ws = ws;
+    frame->base.parent = parent;
+    frame->base.is_resumed = 0;
+    frame->data = data;
+    if (ws->is_resumable) {
+        // The parent value can change its internal representation while
+        // the validation is suspended, and it would release the child value
+        Tcl_IncrRefCount(data);
+    }
+    frame->ve = ve;
+    frame->error_message_ptr = error_message_ptr;
+    frame->error_details_ptr = error_details_ptr;
+    frame->outcome_ptr = outcome_ptr;
+    frame->is_variant = 0;
+
+    tjv_ValidationStack *stack = &frame->stack_own;
+    stack->next = NULL;
+    stack->key = (ve->flag == TJV_FLAG_SKIP_KEY ? INT2PTR(1) : ve->key);
+    stack->index = -1;
+    stack->cleaned = NULL;
+    stack->child_cleaned = NULL;
+    if (stack_parent == NULL) {
+        stack->head = stack;
+        stack->depth = 0;
+    } else {
+        stack->head = stack_parent->head;
+        stack->depth = stack_parent->depth + 1;
+        stack_parent->next = stack;
+    }
+
+    frame->stack = stack;
+    frame->stack_parent = stack_parent;
+
+    return &frame->base;
+
+}
+
+// Pushes a frame to validate the value by a variant of the union. The variant
+// uses the stack frame of the union, so the union and its variants share
+// the same path in error messages. Variants can be unions themselves, and
+// the depth of the stack frame is increased to limit them in the same way
+// as nested values.
+static tjv_WorkFrame *tjv_ValidateTclPushVariant(tjv_TclFrame *parent, tjv_ValidationElement *variant, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr) {
+
+    tjv_WorkStack *ws = parent->base.ws;
+    tjv_TclFrame *frame = tjv_WorkStackPush(ws, sizeof(tjv_TclFrame));
+
+    frame->base.step = tjv_ValidateTclStep;
+    frame->base.ws = ws;
+    frame->base.parent = &parent->base;
+    frame->base.is_resumed = 0;
+    frame->data = parent->data;
+    if (ws->is_resumable) {
+        Tcl_IncrRefCount(frame->data);
+    }
+    frame->ve = variant;
+    frame->error_message_ptr = error_message_ptr;
+    frame->error_details_ptr = error_details_ptr;
+    frame->outcome_ptr = outcome_ptr;
+    frame->is_variant = 1;
+
+    frame->stack = parent->stack;
+    frame->stack_parent = NULL;
+    frame->stack->depth++;
+
+    return &frame->base;
+
+}
+
+// Pops the frame and returns its parent that should be resumed
+static tjv_WorkFrame *tjv_ValidateTclPop(tjv_TclFrame *frame) {
+
+    if (frame->is_variant) {
+        frame->stack->depth--;
+    } else {
+        // The parent takes the cleaned value. If there is no parent,
+        // the value is only referenced by the outcome, if at all.
+        tjv_ValidationStack *stack_parent = frame->stack_parent;
+        if (frame->stack_own.cleaned != NULL) {
+            if (stack_parent != NULL) {
+                stack_parent->child_cleaned = frame->stack_own.cleaned;
+            } else {
+                Tcl_BounceRefCount(frame->stack_own.cleaned);
+            }
+        }
+        if (stack_parent != NULL) {
+            stack_parent->next = NULL;
+        }
+    }
+
+    tjv_WorkStack *ws = frame->base.ws;
+    if (ws->is_resumable) {
+        Tcl_DecrRefCount(frame->data);
+    }
+
+    tjv_WorkFrame *parent = frame->base.parent;
+    tjv_WorkStackPop(ws, frame);
+
+    if (parent != NULL) {
+        parent->is_resumed = 1;
+    }
+
+    return parent;
+
+}
+
+// Finds the dict keys that are in the schema. The found values are sorted
+// by the index of their elements, so the values are validated and the errors
+// are reported in the same order as when the schema keys are looked up in
+// the dict. There are no found values between the neighbouring ones in
+// the sorted order, so all required keys between them are missing.
+static Tcl_Size tjv_ValidateTclObjectCollect(Tcl_Obj *data, tjv_ValidationElement *ve, tjv_DictValue *values) {
+
+    Tcl_Size count = 0;
+
+    Tcl_DictSearch search;
+    Tcl_Obj *key, *value;
+    int is_done;
+
+    Tcl_DictObjFirst(NULL, data, &search, &key, &value, &is_done);
+    for (; !is_done; Tcl_DictObjNext(&search, &key, &value, &is_done)) {
+
+        Tcl_Size length;
+        const char *str = Tcl_GetStringFromObj(key, &length);
+        Tcl_Size index = tjv_StringSetFind(ve->opts.obj_type.key_index, str, length);
+        if (index == -1) {
+            continue;
+        }
+
+        // Insertion sort, the number of values is small
+        Tcl_Size i = count++;
+        while (i > 0 && values[i - 1].index > index) {
+            values[i] = values[i - 1];
+            i--;
+        }
+        values[i].index = index;
+        values[i].value = value;
+
+    }
+    Tcl_DictObjDone(&search);
+
+    DBG2(printf("found %" TCL_SIZE_MODIFIER "d keys from the schema", count));
+
+    return count;
+
+}
+
+static tjv_WorkFrame *tjv_ValidateTclObject(tjv_TclFrame *frame) {
+
+    Tcl_Obj *data = frame->data;
+    tjv_ValidationStack *stack = frame->stack;
+    tjv_ValidationElement *ve = frame->ve;
+    Tcl_Obj **error_message_ptr = frame->error_message_ptr;
+    Tcl_Obj **error_details_ptr = frame->error_details_ptr;
+    Tcl_Obj **outcome_ptr = frame->outcome_ptr;
+    Tcl_Obj *output = frame->base.ws->output;
+
+    if (frame->base.is_resumed) {
+        if (frame->u.obj.dict != NULL) {
+            data = frame->u.obj.dict;
+        }
+        if (frame->u.obj.is_default) {
+            // The default value doesn't become a part of the cleaned dict
+            if (stack->child_cleaned != NULL) {
+                Tcl_BounceRefCount(stack->child_cleaned);
+                stack->child_cleaned = NULL;
+            }
+            frame->u.obj.is_default = 0;
+        } else {
+            tjv_ValidateTclObjectChildCleaned(data, frame->u.obj.key, stack, &frame->u.obj.cleaned);
+        }
+        if (frame->u.obj.is_iterate) {
+            frame->u.obj.next = frame->u.obj.values[frame->u.obj.i].index + 1;
+        }
+        frame->u.obj.i++;
+        goto next;
+    }
 
     DBG2(printf("enter"));
 
+    // The form data is validated as the dict parsed from it
+    frame->u.obj.dict = NULL;
+    if (ve->type_ex == TJV_VALIDATION_EX_FORM) {
+        frame->u.obj.dict = tjv_FormParse(data, ve);
+        if (frame->u.obj.dict == NULL) {
+            tjv_MessageGenerateType(stack, "form", error_message_ptr, error_details_ptr);
+            DBG2(printf("return: error"));
+            return NULL;
+        }
+        Tcl_IncrRefCount(frame->u.obj.dict);
+        data = frame->u.obj.dict;
+    } else if (frame->base.ws->is_preserve) {
+        frame->u.obj.dict = tjv_ValidateTclScratch(data, tjv_dict_type);
+        if (frame->u.obj.dict != NULL) {
+            data = frame->u.obj.dict;
+        }
+    }
+
     // Check if data is valid dict
     Tcl_Size size;
     if (Tcl_DictObjSize(NULL, data, &size) != TCL_OK) {
         tjv_MessageGenerateType(stack, "object (Tcl dict)", error_message_ptr, error_details_ptr);
+        if (frame->u.obj.dict != NULL) {
+            Tcl_DecrRefCount(frame->u.obj.dict);
+        }
         DBG2(printf("return: error"));
-        return;
+        return NULL;
+    }
+
+    if (size < ve->opts.obj_type.min_properties) {
+        tjv_MessageGenerateLimit(stack, "value has fewer properties than the minimum %s",
+            ve->opts.obj_type.min_properties, error_message_ptr, error_details_ptr);
+    } else if (ve->opts.obj_type.is_max_properties_defined && size > ve->opts.obj_type.max_properties) {
+        tjv_MessageGenerateLimit(stack, "value has more properties than the maximum %s",
+            ve->opts.obj_type.max_properties, error_message_ptr, error_details_ptr);
     }
 
+    frame->u.obj.size = size;
+    frame->u.obj.found = 0;
+    frame->u.obj.cleaned = NULL;
+    frame->u.obj.i = 0;
+    frame->u.obj.is_iterate = 0;
+    frame->u.obj.is_default = 0;
+
     // Do we have keys to validate?
     if (ve->opts.obj_type.keys_list == NULL) {
-        goto done;
+        if (output != NULL) {
+            tjv_ValidateTclOutputDict(output, data);
+        }
+        goto additional;
+    }
+
+    if (output != NULL) {
+        Tcl_AppendToObj(output, "{", 1);
+        // The variant of a tagged union starts with its tag, unless
+        // the tag is one of its keys
+        if (frame->is_variant) {
+            Tcl_Obj *discriminator = ((tjv_TclFrame *)frame->base.parent)->ve->opts.union_type.discriminator;
+            if (discriminator != NULL) {
+                Tcl_Size length;
+                const char *str = Tcl_GetStringFromObj(discriminator, &length);
+                if (tjv_StringSetFind(ve->opts.obj_type.key_index, str, length) == -1) {
+                    tjv_JsonAppendKey(output, discriminator);
+                    str = Tcl_GetStringFromObj(ve->key, &length);
+                    tjv_JsonAppendString(output, str, length);
+                }
+            }
+        }
+    }
+
+    // For a small dict, most lookups of schema keys would miss. It is faster
+    // to go through the dict once. The found values are not referenced, so
+    // this is not used if the validation can be suspended. Missing keys are
+    // not visited, so this is not used if they have default values for
+    // the JSON output.
+    if (!frame->base.ws->is_resumable && ve->opts.obj_type.required_bits != NULL &&
+        (output == NULL || !ve->opts.obj_type.is_default_defined) &&
+        ve->opts.obj_type.keys_objc >= TJV_DICT_ITERATE_MIN_KEYS &&
+        size * TJV_DICT_ITERATE_RATIO <= ve->opts.obj_type.keys_objc)
+    {
+        DBG2(printf("validate in one pass (dict size: %" TCL_SIZE_MODIFIER "d)", size));
+        frame->u.obj.is_iterate = 1;
+        // The values are released with the frame
+        frame->u.obj.values = (size == 0 ? NULL : tjv_WorkStackPush(frame->base.ws, sizeof(tjv_DictValue) * size));
+        frame->u.obj.count = (size == 0 ? 0 : tjv_ValidateTclObjectCollect(data, ve, frame->u.obj.values));
+        frame->u.obj.found = frame->u.obj.count;
+        frame->u.obj.next = 0;
+    }
+
+next:
+
+    if (frame->u.obj.is_iterate) {
+
+        if (frame->u.obj.i < frame->u.obj.count) {
+            tjv_DictValue *value = &frame->u.obj.values[frame->u.obj.i];
+            tjv_ValidateTclObjectRequired(ve, frame->u.obj.next, value->index, stack, error_message_ptr, error_details_ptr);
+            tjv_ValidationElement *element = ve->opts.obj_type.elements[value->index];
+            DBG2(printf("check key: [%s]", Tcl_GetString(element->key)));
+            frame->u.obj.key = element->key;
+            if (output != NULL) {
+                tjv_JsonAppendKey(output, element->key);
+            }
+            return tjv_ValidateTclPush(frame->base.ws, &frame->base, stack, value->value, element,
+                error_message_ptr, error_details_ptr, outcome_ptr);
+        }
+
+        tjv_ValidateTclObjectRequired(ve, frame->u.obj.next, ve->opts.obj_type.keys_objc, stack, error_message_ptr, error_details_ptr);
+        goto additional;
+
     }
 
     // Go throught all keys
-    for (Tcl_Size i = 0; i < ve->opts.obj_type.keys_objc; i++) {
+    for (; frame->u.obj.i < ve->opts.obj_type.keys_objc; frame->u.obj.i++) {
 
-        tjv_ValidationElement *element = ve->opts.obj_type.elements[i];
+        tjv_ValidationElement *element = ve->opts.obj_type.elements[frame->u.obj.i];
 
         // Try to get a key
         Tcl_Obj *val = NULL;
@@ -38,6 +772,15 @@ static inline void tjv_ValidateTclObject(Tcl_Obj *data, tjv_ValidationStack *sta
             if (element->is_required) {
                 DBG2(printf("check key: [%s] - doesn't exist (ERROR)", Tcl_GetString(element->key)));
                 tjv_MessageGenerateRequired(stack, element->key, error_message_ptr, error_details_ptr);
+            } else if (output != NULL && element->default_value != NULL) {
+                // The default value is validated as the value of the key,
+                // but it only goes to the JSON output
+                DBG2(printf("check key: [%s] - doesn't exist (default)", Tcl_GetString(element->key)));
+                frame->u.obj.is_default = 1;
+                frame->u.obj.key = element->key;
+                tjv_JsonAppendKey(output, element->key);
+                return tjv_ValidateTclPush(frame->base.ws, &frame->base, stack, element->default_value, element,
+                    error_message_ptr, error_details_ptr, NULL);
             } else {
                 DBG2(printf("check key: [%s] - doesn't exist (OK)", Tcl_GetString(element->key)));
             }
@@ -47,88 +790,199 @@ static inline void tjv_ValidateTclObject(Tcl_Obj *data, tjv_ValidationStack *sta
         DBG2(printf("check key: [%s]", Tcl_GetString(element->key)));
 
         // We found a key, let's validate its value.
-        tjv_ValidateTcl(val, stack, element, error_message_ptr, error_details_ptr, outcome_ptr);
+        frame->u.obj.found++;
+        frame->u.obj.key = element->key;
+        if (output != NULL) {
+            tjv_JsonAppendKey(output, element->key);
+        }
+        return tjv_ValidateTclPush(frame->base.ws, &frame->base, stack, val, element,
+            error_message_ptr, error_details_ptr, outcome_ptr);
 
     }
 
-done:
+additional:
 
-    ADD_OUTCOME(data);
+    // If all keys are unique, each found dict key corresponds to one schema key.
+    // So, there are unknown keys only if not all dict keys are found.
+    if (ve->opts.obj_type.additional != TJV_ADDITIONAL_ALLOW && (frame->u.obj.found < frame->u.obj.size ||
+        (ve->opts.obj_type.key_index != NULL && ve->opts.obj_type.required_bits == NULL)))
+    {
+        tjv_ValidateTclObjectAdditional(data, stack, ve, error_message_ptr, error_details_ptr, &frame->u.obj.cleaned);
+    }
+
+    if (output != NULL && ve->opts.obj_type.keys_list != NULL) {
+        Tcl_AppendToObj(output, "}", 1);
+    }
+
+    if (frame->u.obj.cleaned != NULL) {
+        ADD_OUTCOME(frame->u.obj.cleaned);
+        // The parent keeps the form data, not the dict parsed from it
+        if (ve->type_ex == TJV_VALIDATION_EX_FORM) {
+            Tcl_BounceRefCount(frame->u.obj.cleaned);
+        } else {
+            stack->cleaned = frame->u.obj.cleaned;
+        }
+    } else {
+        // The outcome is the data itself, not its scratch copy
+        ADD_OUTCOME(ve->type_ex == TJV_VALIDATION_EX_FORM ? data : frame->data);
+    }
+
+    if (frame->u.obj.dict != NULL) {
+        Tcl_DecrRefCount(frame->u.obj.dict);
+    }
 
     DBG2(printf("return: ok"));
+    return NULL;
 
 }
 
-static inline void tjv_ValidateTclArray(Tcl_Obj *data, tjv_ValidationStack *stack, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr) {
+static tjv_WorkFrame *tjv_ValidateTclArray(tjv_TclFrame *frame) {
+
+    tjv_ValidationStack *stack = frame->stack;
+    tjv_ValidationElement *ve = frame->ve;
+    Tcl_Obj **error_message_ptr = frame->error_message_ptr;
+    Tcl_Obj **error_details_ptr = frame->error_details_ptr;
+    Tcl_Obj **outcome_ptr = frame->outcome_ptr;
+    Tcl_Obj *output = frame->base.ws->output;
+
+    if (frame->base.is_resumed) {
+        if (frame->base.ws->is_resumable && frame->u.arr.list == NULL) {
+            // The list could get a new internal representation while
+            // the validation was suspended
+            Tcl_ListObjGetElements(NULL, frame->data, &frame->u.arr.objc, &frame->u.arr.objv);
+        }
+        goto child;
+    }
 
     DBG2(printf("enter"));
 
+    // The scratch copy is held by the frame until the array is validated
+    Tcl_Obj *list = frame->data;
+    frame->u.arr.list = NULL;
+    if (frame->base.ws->is_preserve) {
+        frame->u.arr.list = tjv_ValidateTclScratch(list, tjv_list_type);
+        if (frame->u.arr.list != NULL) {
+            list = frame->u.arr.list;
+        }
+    }
+
     // Check if data is valid list
     Tcl_Size items_objc;
     Tcl_Obj **items_objv;
-    if (Tcl_ListObjGetElements(NULL, data, &items_objc, &items_objv) != TCL_OK) {
+    if (Tcl_ListObjGetElements(NULL, list, &items_objc, &items_objv) != TCL_OK) {
         tjv_MessageGenerateType(stack, "array (Tcl list)", error_message_ptr, error_details_ptr);
-        DBG2(printf("return: error"));
-        return;
+        goto done;
+    }
+
+    if (items_objc < ve->opts.array_type.min_items) {
+        tjv_MessageGenerateLimit(stack, "value has fewer items than the minimum %s",
+            ve->opts.array_type.min_items, error_message_ptr, error_details_ptr);
+    } else if (ve->opts.array_type.is_max_items_defined && items_objc > ve->opts.array_type.max_items) {
+        tjv_MessageGenerateLimit(stack, "value has more items than the maximum %s",
+            ve->opts.array_type.max_items, error_message_ptr, error_details_ptr);
+    }
+
+    if (ve->opts.array_type.is_unique_items && items_objc > 1) {
+        tjv_ValidateTclArrayUnique(items_objc, items_objv, frame->base.ws->is_preserve, stack, ve, error_message_ptr, error_details_ptr);
     }
 
     // Do we need to validate list elements?
     if (ve->opts.array_type.element == NULL) {
+        if (output != NULL) {
+            tjv_ValidateTclOutputList(output, items_objc, items_objv);
+        }
         goto done;
     }
 
-    Tcl_Obj *result_outcome, *item_outcome, **item_outcome_ptr;
+    if (output != NULL) {
+        Tcl_AppendToObj(output, "[", 1);
+    }
+
+    frame->u.arr.objc = items_objc;
+    frame->u.arr.objv = items_objv;
+
     if (outcome_ptr == NULL || ve->outkey == NULL) {
-        item_outcome = NULL;
-        item_outcome_ptr = NULL;
+        frame->u.arr.result_outcome = NULL;
+        frame->u.arr.item_outcome = NULL;
     } else {
-        result_outcome = Tcl_NewListObj(0, NULL);
-        item_outcome = Tcl_NewDictObj();
-        item_outcome_ptr = &item_outcome;
+        frame->u.arr.result_outcome = Tcl_NewListObj(0, NULL);
+        frame->u.arr.item_outcome = Tcl_NewDictObj();
     }
     DBG2(printf("array should return result: %s", (outcome_ptr == NULL ? "no" : "yes")));
 
-    // Go throught all keys
-    for (stack->index = 0; stack->index < items_objc; stack->index++) {
+    frame->u.arr.cleaned = NULL;
 
-        DBG2(printf("check array element #%" TCL_SIZE_MODIFIER "d", stack->index));
+    stack->index = 0;
+    goto next;
 
-        tjv_ValidateTcl(items_objv[stack->index], stack, ve->opts.array_type.element, error_message_ptr, error_details_ptr, item_outcome_ptr);
+child:
 
-        if (item_outcome != NULL) {
+    if (stack->child_cleaned != NULL) {
+        DBG2(printf("array element has cleaned value"));
+        if (frame->u.arr.cleaned == NULL) {
+            frame->u.arr.cleaned = Tcl_DuplicateObj(frame->u.arr.list == NULL ? frame->data : frame->u.arr.list);
+        }
+        Tcl_ListObjReplace(NULL, frame->u.arr.cleaned, stack->index, 1, 1, &stack->child_cleaned);
+        stack->child_cleaned = NULL;
+    }
 
-            Tcl_Size dict_size;
-            Tcl_DictObjSize(NULL, item_outcome, &dict_size);
+    if (frame->u.arr.item_outcome != NULL) {
 
-            if (dict_size > 0) {
-                DBG2(printf("got result with %d key(s)", dict_size));
-                Tcl_ListObjAppendElement(NULL, result_outcome, item_outcome);
-                item_outcome = Tcl_NewDictObj();
-            } else {
-                DBG2(printf("got empty result"));
-            }
+        Tcl_Size dict_size;
+        Tcl_DictObjSize(NULL, frame->u.arr.item_outcome, &dict_size);
 
+        if (dict_size > 0) {
+            DBG2(printf("got result with %d key(s)", dict_size));
+            Tcl_ListObjAppendElement(NULL, frame->u.arr.result_outcome, frame->u.arr.item_outcome);
+            frame->u.arr.item_outcome = Tcl_NewDictObj();
+        } else {
+            DBG2(printf("got empty result"));
         }
 
     }
 
-    if (item_outcome != NULL) {
-        Tcl_BounceRefCount(item_outcome);
-        ADD_OUTCOME(result_outcome);
+    stack->index++;
+
+next:
+
+    if (stack->index < frame->u.arr.objc) {
+        DBG2(printf("check array element #%" TCL_SIZE_MODIFIER "d", stack->index));
+        if (output != NULL) {
+            tjv_JsonAppendSeparator(output);
+        }
+        return tjv_ValidateTclPush(frame->base.ws, &frame->base, stack, frame->u.arr.objv[stack->index], ve->opts.array_type.element,
+            error_message_ptr, error_details_ptr,
+            (frame->u.arr.item_outcome == NULL ? NULL : &frame->u.arr.item_outcome));
+    }
+
+    if (frame->u.arr.item_outcome != NULL) {
+        Tcl_BounceRefCount(frame->u.arr.item_outcome);
+        ADD_OUTCOME(frame->u.arr.result_outcome);
     }
 
+    if (output != NULL) {
+        Tcl_AppendToObj(output, "]", 1);
+    }
+
+    stack->cleaned = frame->u.arr.cleaned;
+
 done:
 
-    DBG2(printf("return: ok"));
+    if (frame->u.arr.list != NULL) {
+        Tcl_DecrRefCount(frame->u.arr.list);
+    }
+
+    DBG2(printf("return"));
+    return NULL;
 
 }
 
-static inline void tjv_ValidateTclInteger(Tcl_Obj *data, tjv_ValidationStack *stack, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr) {
+static inline void tjv_ValidateTclInteger(Tcl_Obj *data, tjv_WorkStack *ws, tjv_ValidationStack *stack, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr) {
 
     DBG2(printf("enter; value: [%s]", Tcl_GetString(data)));
 
     Tcl_WideInt val;
-    if (Tcl_GetWideIntFromObj(NULL, data, &val) != TCL_OK) {
+    if (tjv_ValidateTclGetWideInt(data, ve->is_coerce || ws->is_preserve, &val) != TCL_OK) {
         tjv_MessageGenerateType(stack, tjv_GetValidationTypeString(ve->type_ex), error_message_ptr, error_details_ptr);
         DBG2(printf("return: error"));
         return;
@@ -147,19 +1001,22 @@ static inline void tjv_ValidateTclInteger(Tcl_Obj *data, tjv_ValidationStack *st
             Tcl_ObjPrintf("value is greater than the maximum %s", buf),
             error_message_ptr, error_details_ptr);
     } else {
-        ADD_OUTCOME(data);
+        ADD_OUTCOME(ve->is_coerce ? Tcl_NewWideIntObj(val) : data);
+        if (ws->output != NULL) {
+            tjv_JsonAppendWideInt(ws->output, val);
+        }
     }
 
     DBG2(printf("return: ok"));
 
 }
 
-static inline void tjv_ValidateTclDouble(Tcl_Obj *data, tjv_ValidationStack *stack, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr) {
+static inline void tjv_ValidateTclDouble(Tcl_Obj *data, tjv_WorkStack *ws, tjv_ValidationStack *stack, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr) {
 
     DBG2(printf("enter"));
 
     double val;
-    if (Tcl_GetDoubleFromObj(NULL, data, &val) != TCL_OK) {
+    if (tjv_ValidateTclGetDouble(data, ve->is_coerce || ws->is_preserve, &val) != TCL_OK) {
         tjv_MessageGenerateType(stack, tjv_GetValidationTypeString(ve->type_ex), error_message_ptr, error_details_ptr);
         DBG2(printf("return: error"));
         return;
@@ -174,34 +1031,60 @@ static inline void tjv_ValidateTclDouble(Tcl_Obj *data, tjv_ValidationStack *sta
             Tcl_ObjPrintf("value is greater than the maximum %f", ve->opts.double_type.max_value),
             error_message_ptr, error_details_ptr);
     } else {
-        ADD_OUTCOME(data);
+        ADD_OUTCOME(ve->is_coerce ? Tcl_NewDoubleObj(val) : data);
+        if (ws->output != NULL) {
+            tjv_JsonAppendDouble(ws->output, val);
+        }
     }
 
     DBG2(printf("return: ok"));
 
 }
 
-static inline void tjv_ValidateTclBoolean(Tcl_Obj *data, tjv_ValidationStack *stack, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr) {
+static inline void tjv_ValidateTclBoolean(Tcl_Obj *data, tjv_WorkStack *ws, tjv_ValidationStack *stack, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr) {
 
     DBG2(printf("enter"));
 
     int val;
-    if (Tcl_GetBooleanFromObj(NULL, data, &val) != TCL_OK) {
+    if (tjv_ValidateTclGetBoolean(data, ve->is_coerce || ws->is_preserve, &val) != TCL_OK) {
         tjv_MessageGenerateType(stack, tjv_GetValidationTypeString(ve->type_ex), error_message_ptr, error_details_ptr);
         DBG2(printf("return: error"));
         return;
     }
 
     ADD_OUTCOME(Tcl_NewBooleanObj(val));
+    if (ws->output != NULL) {
+        Tcl_AppendToObj(ws->output, (val ? "true" : "false"), -1);
+    }
 
     DBG2(printf("return: ok"));
 
 }
 
-static inline void tjv_ValidateTclString(Tcl_Obj *data, tjv_ValidationStack *stack, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr) {
+static inline void tjv_ValidateTclString(Tcl_Obj *data, tjv_WorkStack *ws, tjv_ValidationStack *stack, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr) {
 
     DBG2(printf("enter"));
 
+    if (ve->opts.str_type.min_length > 0 || ve->opts.str_type.is_max_length_defined) {
+
+        // Tcl_GetCharLength() would convert the value to a unicode string.
+        // Count the characters in the string representation instead.
+        Tcl_Size length;
+        const char *str = Tcl_GetStringFromObj(data, &length);
+        length = tjv_Utf8Length(str, length);
+
+        if (length < ve->opts.str_type.min_length) {
+            tjv_MessageGenerateLimit(stack, "value is shorter than the minimum length %s",
+                ve->opts.str_type.min_length, error_message_ptr, error_details_ptr);
+            goto error;
+        } else if (ve->opts.str_type.is_max_length_defined && length > ve->opts.str_type.max_length) {
+            tjv_MessageGenerateLimit(stack, "value is longer than the maximum length %s",
+                ve->opts.str_type.max_length, error_message_ptr, error_details_ptr);
+            goto error;
+        }
+
+    }
+
     // If pattern is NULL, we don't need to validate anything
     if (ve->opts.str_type.pattern == NULL) {
         goto done;
@@ -209,15 +1092,21 @@ static inline void tjv_ValidateTclString(Tcl_Obj *data, tjv_ValidationStack *sta
 
     switch (ve->opts.str_type.match) {
     case TJV_STRING_MATCHING_GLOB:
+    case TJV_STRING_MATCHING_GLOBLIST: ; // empty statement
 
         DBG2(printf("glob pattern: %s", Tcl_GetString(ve->opts.str_type.pattern)));
 
-        if (Tcl_StringMatch(Tcl_GetString(data), Tcl_GetString(ve->opts.str_type.pattern)) == 1) {
+        Tcl_Size glob_length;
+        const char *glob_str = Tcl_GetStringFromObj(data, &glob_length);
+        if (tjv_GlobMatch(ve->opts.str_type.glob, glob_str, glob_length)) {
             goto done;
         }
 
         tjv_MessageGenerateValue(stack,
-            Tcl_ObjPrintf("value does not match the specified glob pattern '%s'", Tcl_GetString(ve->opts.str_type.pattern)),
+            Tcl_ObjPrintf((ve->opts.str_type.match == TJV_STRING_MATCHING_GLOB ?
+                "value does not match the specified glob pattern '%s'" :
+                "value does not match any of the specified glob patterns '%s'"),
+                Tcl_GetString(ve->opts.str_type.pattern)),
             error_message_ptr, error_details_ptr);
         goto error;
 
@@ -227,7 +1116,13 @@ static inline void tjv_ValidateTclString(Tcl_Obj *data, tjv_ValidationStack *sta
 
         DBG2(printf("regexp pattern: %s", Tcl_GetString(ve->opts.str_type.pattern)));
 
-        if (Tcl_RegExpExecObj(NULL, ve->opts.str_type.regexp, data, 0, 0, 0) == 1) {
+        if (ve->opts.str_type.automaton != NULL) {
+            Tcl_Size length;
+            const char *str = Tcl_GetStringFromObj(data, &length);
+            if (tjv_AutomatonMatch(ve->opts.str_type.automaton, str, length)) {
+                goto done;
+            }
+        } else if (Tcl_RegExpExecObj(NULL, ve->opts.str_type.regexp, data, 0, 0, 0) == 1) {
             goto done;
         }
 
@@ -242,15 +1137,15 @@ static inline void tjv_ValidateTclString(Tcl_Obj *data, tjv_ValidationStack *sta
 
         break;
 
-    case TJV_STRING_MATCHING_LIST: ; // empty statement
+    case TJV_STRING_MATCHING_LIST:
+    case TJV_STRING_MATCHING_ILIST: ; // empty statement
 
         DBG2(printf("valid list: %s", Tcl_GetString(ve->opts.str_type.pattern)));
 
-        const char *str = Tcl_GetString(data);
-        for (Tcl_Size i = 0; i < ve->opts.str_type.pattern_objc; i++) {
-            if (strcmp(str, Tcl_GetString(ve->opts.str_type.pattern_objv[i])) == 0) {
-                goto done;
-            }
+        Tcl_Size length;
+        const char *str = Tcl_GetStringFromObj(data, &length);
+        if (tjv_StringSetContains(ve->opts.str_type.set, str, length)) {
+            goto done;
         }
 
         tjv_MessageGenerateValue(stack,
@@ -265,6 +1160,11 @@ static inline void tjv_ValidateTclString(Tcl_Obj *data, tjv_ValidationStack *sta
 done:
 
     ADD_OUTCOME(data);
+    if (ws->output != NULL) {
+        Tcl_Size length;
+        const char *str = Tcl_GetStringFromObj(data, &length);
+        tjv_JsonAppendString(ws->output, str, length);
+    }
     DBG2(printf("return: ok"));
     return;
 
@@ -276,46 +1176,384 @@ error:
 }
 
 
-void tjv_ValidateTcl(Tcl_Obj *data, tjv_ValidationStack *stack_parent, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr) {
+// Checks if the value is a valid dict or list. In the preserve mode, a dict
+// is always a valid list, and a list is a valid dict if it has an even
+// number of elements. Values of other types are checked on a scratch copy.
+static int tjv_ValidateTclIsContainer(Tcl_Obj *data, const Tcl_ObjType *type, int is_preserve) {
 
-    DBG2(printf("enter"));
+    Tcl_Size size;
 
-    tjv_ValidationStack stack = { NULL, NULL, (ve->flag == TJV_FLAG_SKIP_KEY ? INT2PTR(1) : ve->key), -1 };
-    if (stack_parent == NULL) {
-        stack.head = &stack;
-    } else {
-        stack.head = stack_parent->head;
-        stack_parent->next = &stack;
+    if (is_preserve && type == tjv_dict_type && TJV_IS_OBJ_TYPE(data, tjv_list_type)) {
+        Tcl_ListObjLength(NULL, data, &size);
+        return (size % 2) == 0;
+    }
+
+    if (is_preserve && type == tjv_list_type && TJV_IS_OBJ_TYPE(data, tjv_dict_type)) {
+        return 1;
+    }
+
+    Tcl_Obj *scratch = (is_preserve ? tjv_ValidateTclScratch(data, type) : NULL);
+    if (scratch != NULL) {
+        data = scratch;
     }
 
+    int rc = (type == tjv_list_type ? Tcl_ListObjLength(NULL, data, &size) : Tcl_DictObjSize(NULL, data, &size));
+
+    if (scratch != NULL) {
+        Tcl_DecrRefCount(scratch);
+    }
+
+    return rc == TCL_OK;
+
+}
+
+// Checks only the type of the value to skip the variants that can't match
+// without validating them
+static int tjv_ValidateTclIsType(Tcl_Obj *data, tjv_ValidationElement *ve, int is_preserve) {
+
     switch (ve->type) {
+    case TJV_VALIDATION_INTEGER: ; // empty statement
+        Tcl_WideInt wide_val;
+        return tjv_ValidateTclGetWideInt(data, ve->is_coerce || is_preserve, &wide_val) == TCL_OK;
+    case TJV_VALIDATION_DOUBLE: ; // empty statement
+        double double_val;
+        return tjv_ValidateTclGetDouble(data, ve->is_coerce || is_preserve, &double_val) == TCL_OK;
+    case TJV_VALIDATION_BOOLEAN: ; // empty statement
+        int bool_val;
+        return tjv_ValidateTclGetBoolean(data, ve->is_coerce || is_preserve, &bool_val) == TCL_OK;
+    case TJV_VALIDATION_OBJECT:
+        // Any string can be form data
+        if (ve->type_ex == TJV_VALIDATION_EX_FORM) {
+            break;
+        }
+        return tjv_ValidateTclIsContainer(data, tjv_dict_type, is_preserve);
+    case TJV_VALIDATION_ARRAY:
+        return tjv_ValidateTclIsContainer(data, tjv_list_type, is_preserve);
+    case TJV_VALIDATION_UNION:
+        if (ve->opts.union_type.discriminator != NULL) {
+            return tjv_ValidateTclIsContainer(data, tjv_dict_type, is_preserve);
+        }
+        break;
     case TJV_VALIDATION_STRING:
-        tjv_ValidateTclString(data, &stack, ve, error_message_ptr, error_details_ptr, outcome_ptr);
+    case TJV_VALIDATION_JSON:
+        break;
+    }
+
+    return 1;
+
+}
+
+static tjv_WorkFrame *tjv_ValidateTclUnion(tjv_TclFrame *frame) {
+
+    Tcl_Obj *data = frame->data;
+    tjv_ValidationStack *stack = frame->stack;
+    tjv_ValidationElement *ve = frame->ve;
+    Tcl_Obj **error_message_ptr = frame->error_message_ptr;
+    Tcl_Obj **error_details_ptr = frame->error_details_ptr;
+    Tcl_Obj **outcome_ptr = frame->outcome_ptr;
+    Tcl_Obj *output = frame->base.ws->output;
+
+    tjv_ValidationElement **elements = ve->opts.union_type.elements;
+
+    if (frame->base.is_resumed) {
+        switch (frame->u.uni.mode) {
+        case TJV_UNION_TAGGED:
+        case TJV_UNION_SINGLE:
+            goto done;
+        case TJV_UNION_TRIAL:
+            goto trial;
+        }
+    }
+
+    DBG2(printf("enter"));
+
+    if (ve->opts.union_type.discriminator != NULL) {
+
+        // Validate the value by the variant that is selected by the tag
+
+        // In the preserve mode, the tag is looked up in a scratch copy
+        Tcl_Obj *scratch = (frame->base.ws->is_preserve ? tjv_ValidateTclScratch(data, tjv_dict_type) : NULL);
+
+        Tcl_Obj *tag = NULL;
+        if (Tcl_DictObjGet(NULL, (scratch == NULL ? data : scratch), ve->opts.union_type.discriminator, &tag) != TCL_OK) {
+            tjv_MessageGenerateType(stack, "object (Tcl dict)", error_message_ptr, error_details_ptr);
+            DBG2(printf("return: error (not a dict)"));
+            goto tagged_error;
+        }
+
+        if (tag == NULL) {
+            DBG2(printf("return: error (no tag)"));
+            tjv_MessageGenerateRequired(stack, ve->opts.union_type.discriminator, error_message_ptr, error_details_ptr);
+            goto tagged_error;
+        }
+
+        Tcl_Size length;
+        const char *str = Tcl_GetStringFromObj(tag, &length);
+        Tcl_Size index = tjv_StringSetFind(ve->opts.union_type.tag_index, str, length);
+        if (index == -1) {
+            DBG2(printf("return: error (unknown tag [%s])", str));
+            tjv_MessageGenerateMember(TJV_MSG_KEYWORD_VALUE, stack, ve->opts.union_type.discriminator,
+                Tcl_ObjPrintf("value is not one of the specified variants '%s'", Tcl_GetString(ve->opts.union_type.tags_list)),
+                error_message_ptr, error_details_ptr);
+            goto tagged_error;
+        }
+
+        DBG2(printf("validate variant [%s]", str));
+        if (scratch != NULL) {
+            Tcl_DecrRefCount(scratch);
+        }
+        frame->u.uni.mode = TJV_UNION_TAGGED;
+        return tjv_ValidateTclPushVariant(frame, elements[index], error_message_ptr, error_details_ptr, outcome_ptr);
+
+tagged_error:
+
+        if (scratch != NULL) {
+            Tcl_DecrRefCount(scratch);
+        }
+        return NULL;
+
+    }
+
+    // Find the variants that can match by the type of the value. If there
+    // is only one of them, it is validated directly and reports its own
+    // errors. Otherwise, the variants are tried one by one.
+
+    Tcl_Size candidate = -1;
+    Tcl_Size candidate_count = 0;
+    for (Tcl_Size i = 0; i < ve->opts.union_type.count; i++) {
+        if (tjv_ValidateTclIsType(data, elements[i], frame->base.ws->is_preserve)) {
+            candidate = (candidate_count == 0 ? i : candidate);
+            candidate_count++;
+        }
+    }
+
+    DBG2(printf("candidates: %" TCL_SIZE_MODIFIER "d", candidate_count));
+
+    if (candidate_count == 0) {
+        Tcl_Obj *types = tjv_GetUnionTypeString(ve);
+        tjv_MessageGenerateType(stack, Tcl_GetString(types), error_message_ptr, error_details_ptr);
+        Tcl_BounceRefCount(types);
+        DBG2(printf("return: error (no candidates)"));
+        return NULL;
+    }
+
+    if (candidate_count == 1) {
+        DBG2(printf("validate the only candidate"));
+        frame->u.uni.mode = TJV_UNION_SINGLE;
+        return tjv_ValidateTclPushVariant(frame, elements[candidate], error_message_ptr, error_details_ptr, outcome_ptr);
+    }
+
+    // Each variant is validated with its own copy of the outcome. The copy
+    // and the cleaned value of the matched variant are kept, and they are
+    // discarded for other variants.
+
+    frame->u.uni.mode = TJV_UNION_TRIAL;
+    frame->u.uni.i = candidate;
+    frame->u.uni.matched = -1;
+    frame->u.uni.matched_outcome = NULL;
+    frame->u.uni.matched_cleaned = NULL;
+    goto next;
+
+trial:
+
+    // An array variant leaves its last index in the stack frame
+    stack->index = -1;
+
+    if (frame->u.uni.variant_message != NULL) {
+        DBG2(printf("variant #%" TCL_SIZE_MODIFIER "d doesn't match", frame->u.uni.i));
+        Tcl_BounceRefCount(frame->u.uni.variant_message);
+        Tcl_BounceRefCount(frame->u.uni.variant_details);
+        if (frame->u.uni.variant_outcome != NULL) {
+            Tcl_BounceRefCount(frame->u.uni.variant_outcome);
+        }
+        if (stack->cleaned != NULL) {
+            Tcl_BounceRefCount(stack->cleaned);
+            stack->cleaned = NULL;
+        }
+        if (output != NULL) {
+            Tcl_SetObjLength(output, frame->u.uni.output_length);
+        }
+        frame->u.uni.i++;
+        goto next;
+    }
+
+    DBG2(printf("variant #%" TCL_SIZE_MODIFIER "d matches", frame->u.uni.i));
+
+    if (frame->u.uni.matched != -1) {
+        if (stack->cleaned != NULL) {
+            Tcl_BounceRefCount(stack->cleaned);
+            stack->cleaned = NULL;
+        }
+        if (output != NULL) {
+            Tcl_SetObjLength(output, frame->u.uni.output_length);
+        }
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%" TCL_LL_MODIFIER "d and #%" TCL_LL_MODIFIER "d",
+            (Tcl_WideInt)frame->u.uni.matched, (Tcl_WideInt)frame->u.uni.i);
+        tjv_MessageGenerateValue(stack,
+            Tcl_ObjPrintf("value matches more than one variant: #%s", buf),
+            error_message_ptr, error_details_ptr);
+        DBG2(printf("error (more than one variant)"));
+        goto matched;
+    }
+
+    frame->u.uni.matched = frame->u.uni.i;
+    frame->u.uni.matched_outcome = frame->u.uni.variant_outcome;
+    frame->u.uni.matched_cleaned = stack->cleaned;
+    stack->cleaned = NULL;
+
+    if (!ve->opts.union_type.is_one_of) {
+        goto matched;
+    }
+
+    frame->u.uni.i++;
+
+next:
+
+    for (; frame->u.uni.i < ve->opts.union_type.count; frame->u.uni.i++) {
+
+        if (!tjv_ValidateTclIsType(data, elements[frame->u.uni.i], frame->base.ws->is_preserve)) {
+            continue;
+        }
+
+        frame->u.uni.variant_message = NULL;
+        frame->u.uni.variant_details = NULL;
+        frame->u.uni.variant_outcome = NULL;
+        if (outcome_ptr != NULL && frame->u.uni.matched == -1) {
+            frame->u.uni.variant_outcome = Tcl_DuplicateObj(*outcome_ptr);
+        }
+        if (output != NULL) {
+            Tcl_GetStringFromObj(output, &frame->u.uni.output_length);
+        }
+
+        return tjv_ValidateTclPushVariant(frame, elements[frame->u.uni.i],
+            &frame->u.uni.variant_message, &frame->u.uni.variant_details,
+            (frame->u.uni.variant_outcome == NULL ? NULL : &frame->u.uni.variant_outcome));
+
+    }
+
+matched:
+
+    if (frame->u.uni.matched == -1) {
+        tjv_MessageGenerateValue(stack,
+            Tcl_NewStringObj("value does not match any of the variants", -1),
+            error_message_ptr, error_details_ptr);
+        DBG2(printf("return: error (no variants)"));
+        return NULL;
+    }
+
+    stack->cleaned = frame->u.uni.matched_cleaned;
+
+    if (frame->u.uni.matched_outcome != NULL) {
+        Tcl_Obj *outcome = *outcome_ptr;
+        *outcome_ptr = frame->u.uni.matched_outcome;
+        Tcl_BounceRefCount(outcome);
+    }
+
+done:
+
+    ADD_OUTCOME(stack->cleaned != NULL ? stack->cleaned : data);
+
+    DBG2(printf("return: ok"));
+    return NULL;
+
+}
+
+// Validates the value of the json type. Its parsed document is validated
+// by the frames of JSON values, and the frame is resumed when they are done.
+static tjv_WorkFrame *tjv_ValidateTclJsonFrame(tjv_TclFrame *frame) {
+
+    if (frame->base.is_resumed) {
+        tjv_ValidateTclJsonEnd(frame->data, &frame->u.json.doc, frame->stack, frame->ve, frame->outcome_ptr);
+        return NULL;
+    }
+
+    return tjv_ValidateTclJsonBegin(&frame->base, frame->data, &frame->u.json.doc, frame->stack, frame->ve,
+        frame->error_message_ptr, frame->error_details_ptr, frame->outcome_ptr);
+
+}
+
+static tjv_WorkFrame *tjv_ValidateTclStep(tjv_WorkFrame *base) {
+
+    tjv_TclFrame *frame = (tjv_TclFrame *)base;
+    tjv_WorkFrame *child = NULL;
+
+    if (!base->is_resumed) {
+        if (base->ws->is_aborted) {
+            DBG2(printf("aborted"));
+            goto pop;
+        }
+        if (frame->stack->depth > TJV_VALIDATION_MAX_DEPTH) {
+            DBG2(printf("too deep"));
+            tjv_MessageGenerateLimit(frame->stack, "value is nested deeper than the maximum depth %s",
+                TJV_VALIDATION_MAX_DEPTH, frame->error_message_ptr, frame->error_details_ptr);
+            goto pop;
+        }
+    }
+
+    switch (frame->ve->type) {
+    case TJV_VALIDATION_STRING:
+        tjv_ValidateTclString(frame->data, base->ws, frame->stack, frame->ve, frame->error_message_ptr, frame->error_details_ptr, frame->outcome_ptr);
         break;
     case TJV_VALIDATION_INTEGER:
-        tjv_ValidateTclInteger(data, &stack, ve, error_message_ptr, error_details_ptr, outcome_ptr);
+        tjv_ValidateTclInteger(frame->data, base->ws, frame->stack, frame->ve, frame->error_message_ptr, frame->error_details_ptr, frame->outcome_ptr);
         break;
     case TJV_VALIDATION_JSON:
-        tjv_ValidateTclJson(data, &stack, ve, error_message_ptr, error_details_ptr, outcome_ptr);
+        child = tjv_ValidateTclJsonFrame(frame);
         break;
     case TJV_VALIDATION_OBJECT:
-        tjv_ValidateTclObject(data, &stack, ve, error_message_ptr, error_details_ptr, outcome_ptr);
+        child = tjv_ValidateTclObject(frame);
         break;
     case TJV_VALIDATION_ARRAY:
-        tjv_ValidateTclArray(data, &stack, ve, error_message_ptr, error_details_ptr, outcome_ptr);
+        child = tjv_ValidateTclArray(frame);
         break;
     case TJV_VALIDATION_BOOLEAN:
-        tjv_ValidateTclBoolean(data, &stack, ve, error_message_ptr, error_details_ptr, outcome_ptr);
+        tjv_ValidateTclBoolean(frame->data, base->ws, frame->stack, frame->ve, frame->error_message_ptr, frame->error_details_ptr, frame->outcome_ptr);
         break;
     case TJV_VALIDATION_DOUBLE:
-        tjv_ValidateTclDouble(data, &stack, ve, error_message_ptr, error_details_ptr, outcome_ptr);
+        tjv_ValidateTclDouble(frame->data, base->ws, frame->stack, frame->ve, frame->error_message_ptr, frame->error_details_ptr, frame->outcome_ptr);
+        break;
+    case TJV_VALIDATION_UNION:
+        child = tjv_ValidateTclUnion(frame);
         break;
     }
 
-    if (stack_parent != NULL) {
-        stack_parent->next = NULL;
+    if (child != NULL) {
+        return child;
     }
 
+pop:
+
+    return tjv_ValidateTclPop(frame);
+
+}
+
+tjv_WorkFrame *tjv_ValidateTclBegin(tjv_WorkStack *ws, Tcl_Obj *data, tjv_ValidationStack *stack_parent, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr) {
+    ws->is_preserve = ve->is_preserve;
+    return tjv_ValidateTclPush(ws, NULL, stack_parent, data, ve, error_message_ptr, error_details_ptr, outcome_ptr);
+}
+
+tjv_WorkFrame *tjv_ValidateTclPushChild(tjv_WorkFrame *parent, tjv_ValidationStack *stack_parent, Tcl_Obj *data, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr) {
+    return tjv_ValidateTclPush(parent->ws, parent, stack_parent, data, ve, error_message_ptr, error_details_ptr, NULL);
+}
+
+// Nested values are validated on the work stack instead of the C stack,
+// so deep data doesn't depend on the stack size of the thread
+void tjv_ValidateTcl(Tcl_Obj *data, tjv_ValidationStack *stack_parent, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr) {
+
+    DBG2(printf("enter"));
+
+    // The stack of the thread can be used by a validation that is
+    // already running, so its mode is restored
+    tjv_WorkStack *ws = tjv_WorkStackGet();
+    int is_preserve = ws->is_preserve;
+    ws->is_preserve = ve->is_preserve;
+
+    tjv_WorkFrame *frame = tjv_ValidateTclPush(ws, NULL, stack_parent, data, ve, error_message_ptr, error_details_ptr, outcome_ptr);
+    tjv_WorkStackRun(frame, NULL);
+
+    ws->is_preserve = is_preserve;
+
     DBG2(printf("return: %s", (*error_message_ptr == NULL ? "ok" : "error")));
 
-}
\ No newline at end of file
+}
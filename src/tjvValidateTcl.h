@@ -8,12 +8,22 @@
 
 #include "common.h"
 #include "tjvCompile.h"
+#include "tjvWorkStack.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+void tjv_ValidateTclInit(void);
 void tjv_ValidateTcl(Tcl_Obj *data, tjv_ValidationStack *stack_parent, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr);
+// Pushes the root frame to the work stack without validating anything. The
+// validation is done by tjv_WorkStackRun(), and it can be done in steps if
+// the work stack is resumable.
+tjv_WorkFrame *tjv_ValidateTclBegin(tjv_WorkStack *ws, Tcl_Obj *data, tjv_ValidationStack *stack_parent, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr, Tcl_Obj **outcome_ptr);
+// Pushes a frame to validate the Tcl value as a child of the frame of
+// another validator, e.g. the default value of a missing JSON object member.
+// There is no outcome for the value.
+tjv_WorkFrame *tjv_ValidateTclPushChild(tjv_WorkFrame *parent, tjv_ValidationStack *stack_parent, Tcl_Obj *data, tjv_ValidationElement *ve, Tcl_Obj **error_message_ptr, Tcl_Obj **error_details_ptr);
 
 #ifdef __cplusplus
 }
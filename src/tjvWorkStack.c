@@ -0,0 +1,197 @@
+/**
+ * Copyright Jerily LTD. All Rights Reserved.
+ * SPDX-FileCopyrightText: 2024 Neofytos Dimitriou (neo@jerily.cy)
+ * SPDX-License-Identifier: MIT.
+ */
+
+#include "tjvWorkStack.h"
+
+// The size of a memory block. Larger frames get a block of their own size.
+#define TJV_WORK_STACK_BLOCK_SIZE 32768
+// Alignment of the frames
+#define TJV_WORK_STACK_ALIGN 16
+
+struct tjv_WorkStackBlock {
+    tjv_WorkStackBlock *prev;
+    tjv_WorkStackBlock *next;
+    size_t size;
+    size_t used;
+    // The frames follow the header
+};
+
+#define TJV_WORK_STACK_HEADER_SIZE \
+    ((sizeof(tjv_WorkStackBlock) + TJV_WORK_STACK_ALIGN - 1) & ~(size_t)(TJV_WORK_STACK_ALIGN - 1))
+
+#define tjv_WorkStackBlockData(b) ((char *)(b) + TJV_WORK_STACK_HEADER_SIZE)
+
+typedef struct ThreadSpecificData {
+    int is_initialized;
+    tjv_WorkStack ws;
+} ThreadSpecificData;
+
+static Tcl_ThreadDataKey dataKey;
+
+#define TCL_TSD_INIT(keyPtr) \
+    (ThreadSpecificData *)Tcl_GetThreadData((keyPtr), sizeof(ThreadSpecificData))
+
+static void tjv_WorkStackThreadExitProc(ClientData clientData);
+
+static tjv_WorkStackBlock *tjv_WorkStackBlockAlloc(tjv_WorkStackBlock *prev, size_t size) {
+
+    if (size < TJV_WORK_STACK_BLOCK_SIZE) {
+        size = TJV_WORK_STACK_BLOCK_SIZE;
+    }
+
+    DBG2(printf("new block of %zu bytes", size));
+
+    tjv_WorkStackBlock *block = ckalloc(TJV_WORK_STACK_HEADER_SIZE + size);
+    block->prev = prev;
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+
+    return block;
+
+}
+
+// Frees the blocks after the specified one
+static void tjv_WorkStackFreeAfter(tjv_WorkStackBlock *block) {
+    tjv_WorkStackBlock *next = block->next;
+    block->next = NULL;
+    while (next != NULL) {
+        tjv_WorkStackBlock *tmp = next->next;
+        ckfree(next);
+        next = tmp;
+    }
+}
+
+tjv_WorkStack *tjv_WorkStackGet(void) {
+
+    ThreadSpecificData *tsdPtr = TCL_TSD_INIT(&dataKey);
+
+    if (!tsdPtr->is_initialized) {
+        // Exit handlers are registered per thread, so the blocks are
+        // freed by the thread that uses them
+        DBG2(printf("first use in the thread"));
+        Tcl_CreateThreadExitHandler(tjv_WorkStackThreadExitProc, NULL);
+        tsdPtr->is_initialized = 1;
+    }
+
+    return &tsdPtr->ws;
+
+}
+
+tjv_WorkStack *tjv_WorkStackNew(void) {
+    tjv_WorkStack *ws = ckalloc(sizeof(tjv_WorkStack));
+    ws->first = NULL;
+    ws->current = NULL;
+    ws->is_resumable = 1;
+    ws->is_aborted = 0;
+    ws->is_preserve = 0;
+    ws->output = NULL;
+    return ws;
+}
+
+// Frees all blocks of the stack
+static void tjv_WorkStackRelease(tjv_WorkStack *ws) {
+    if (ws->first != NULL) {
+        tjv_WorkStackFreeAfter(ws->first);
+        ckfree(ws->first);
+        ws->first = NULL;
+        ws->current = NULL;
+    }
+}
+
+void tjv_WorkStackFree(tjv_WorkStack *ws) {
+    tjv_WorkStackRelease(ws);
+    ckfree(ws);
+}
+
+void *tjv_WorkStackPush(tjv_WorkStack *ws, size_t size) {
+
+    size = (size + TJV_WORK_STACK_ALIGN - 1) & ~(size_t)(TJV_WORK_STACK_ALIGN - 1);
+
+    tjv_WorkStackBlock *block = ws->current;
+    if (block == NULL) {
+        block = tjv_WorkStackBlockAlloc(NULL, size);
+        ws->first = block;
+    } else if (block->size - block->used < size) {
+        // The next block is not in use. It is replaced if it is too small.
+        if (block->next != NULL && block->next->size < size) {
+            tjv_WorkStackFreeAfter(block);
+        }
+        if (block->next == NULL) {
+            block->next = tjv_WorkStackBlockAlloc(block, size);
+        }
+        block = block->next;
+    }
+    ws->current = block;
+
+    void *frame = tjv_WorkStackBlockData(block) + block->used;
+    block->used += size;
+
+    return frame;
+
+}
+
+void tjv_WorkStackPop(tjv_WorkStack *ws, void *frame) {
+
+    tjv_WorkStackBlock *block = ws->current;
+    char *ptr = (char *)frame;
+
+    // Release the blocks that were used after the one with the frame
+    while (ptr < tjv_WorkStackBlockData(block) || ptr >= tjv_WorkStackBlockData(block) + block->size) {
+        block->used = 0;
+        block = block->prev;
+    }
+
+    block->used = ptr - tjv_WorkStackBlockData(block);
+
+    // The frame was the first one in the block. Keep the block as a spare
+    // one, and go to the previous block.
+    if (block->used == 0 && block->prev != NULL) {
+        block = block->prev;
+    }
+    ws->current = block;
+
+    // The stack is empty. Free the blocks that were needed only for deep
+    // data, but keep the first one and the one after it.
+    if (block == ws->first && block->used == 0 && block->next != NULL) {
+        tjv_WorkStackFreeAfter(block->next);
+    }
+
+}
+
+static void tjv_WorkStackThreadExitProc(ClientData clientData) {
+
+    UNUSED(clientData);
+
+    ThreadSpecificData *tsdPtr = TCL_TSD_INIT(&dataKey);
+
+    DBG2(printf("enter..."));
+
+    tjv_WorkStackRelease(&tsdPtr->ws);
+
+    DBG2(printf("return: ok"));
+
+}
+
+tjv_WorkFrame *tjv_WorkStackRun(tjv_WorkFrame *frame, Tcl_Size *steps_ptr) {
+
+    if (steps_ptr == NULL) {
+        while (frame != NULL) {
+            frame = frame->step(frame);
+        }
+        return NULL;
+    }
+
+    Tcl_Size steps = *steps_ptr;
+    while (frame != NULL && steps > 0) {
+        frame = frame->step(frame);
+        steps--;
+    }
+    *steps_ptr = steps;
+
+    return frame;
+
+}
@@ -0,0 +1,76 @@
+/**
+ * Copyright Jerily LTD. All Rights Reserved.
+ * SPDX-FileCopyrightText: 2024 Neofytos Dimitriou (neo@jerily.cy)
+ * SPDX-License-Identifier: MIT.
+ */
+#ifndef TJV_WORKSTACK_H
+#define TJV_WORKSTACK_H
+
+#include "common.h"
+
+typedef struct tjv_WorkStackBlock tjv_WorkStackBlock;
+typedef struct tjv_WorkFrame tjv_WorkFrame;
+
+// A list of memory blocks for frames. Frames never move, so pointers to them
+// and into them stay valid until they are popped.
+typedef struct {
+    // The first block is kept while the stack exists
+    tjv_WorkStackBlock *first;
+    tjv_WorkStackBlock *current;
+    // The validation can be suspended between steps and resumed later,
+    // after the script has run. Frames keep references to their values.
+    int is_resumable;
+    // The validation is abandoned. Frames that are not started yet are
+    // popped without validation.
+    int is_aborted;
+    // Tcl values are validated without changing their internal
+    // representations, as the root element specifies
+    int is_preserve;
+    // If it is not NULL, the validated values are appended to it as
+    // canonical JSON text (see -output json)
+    Tcl_Obj *output;
+} tjv_WorkStack;
+
+// Runs the frame until it pushes a child frame or is done. Returns the frame
+// that should run next, the child or the parent.
+typedef tjv_WorkFrame *(tjv_WorkFrameStepProc)(tjv_WorkFrame *frame);
+
+// The header of the frames of Tcl values and JSON values. Values are
+// validated without recursion: objects, arrays and unions push a frame for
+// the child value and return, and they are resumed when the child frame
+// is popped.
+struct tjv_WorkFrame {
+    tjv_WorkFrameStepProc *step;
+    tjv_WorkStack *ws;
+    tjv_WorkFrame *parent;
+    // Set when a child frame is popped
+    int is_resumed;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Returns the work stack of the current thread. Its blocks are kept between
+// validations and freed when the thread exits.
+tjv_WorkStack *tjv_WorkStackGet(void);
+// Creates a resumable work stack that is owned by the caller
+tjv_WorkStack *tjv_WorkStackNew(void);
+void tjv_WorkStackFree(tjv_WorkStack *ws);
+
+// Allocates a frame on the work stack
+void *tjv_WorkStackPush(tjv_WorkStack *ws, size_t size);
+// Releases the frame and all frames that are pushed after it
+void tjv_WorkStackPop(tjv_WorkStack *ws, void *frame);
+
+// Runs frames until all of them are popped and returns NULL. If steps_ptr
+// is not NULL, stops after the specified number of steps, decreases it by
+// the number of steps that are done and returns the frame that should run
+// next.
+tjv_WorkFrame *tjv_WorkStackRun(tjv_WorkFrame *frame, Tcl_Size *steps_ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TJV_WORKSTACK_H